@@ -7,6 +7,19 @@
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <open62541/client.h>
+#include <open62541/client_config_default.h>
+#include <open62541/client_highlevel.h>
+
+#include "sim_golden.h"
+#include "sim_hash.h"
+#include "sim_loop.h"
+#include "sim_metrics.h"
+#include "sim_security.h"
 
 #define PI 3.14159265
 #define DEFAULT_CYCLE_TIME_MS 100
@@ -32,16 +45,20 @@ typedef struct {
         double positioner_error_percent;
         double last_control_signal;
         double last_update_time;
+        double elapsed_seconds;     // Simulated time, clocks the dead time
     } error;
 } FlowControlValve;
 
 // Globals
 FlowControlValve flow_control_valve;
+SimHashLog hash_log;
 volatile bool running = true;
 UA_Server *server;
+SimLoop loop = {.epoll_fd = -1, .timer_fd = -1, .wake_fd = -1};
 
 void stopHandler(int sign) {
     running = false;
+    SimLoop_Wake(&loop);
 }
 
 void FlowControlValve_Init(FlowControlValve *valve) {
@@ -62,12 +79,15 @@ void FlowControlValve_Init(FlowControlValve *valve) {
     valve->error.positioner_error_percent = 0.0;
     valve->error.last_control_signal = valve->config.control_signal;
     valve->error.last_update_time = 0.0;
+    valve->error.elapsed_seconds = 0.0;
 }
 
 void FlowControlValve_Update(FlowControlValve *valve, uint32_t cycle_time_ms) {
     if (!valve) return;
 
-    double now = (double)clock() / CLOCKS_PER_SEC;
+    // Simulated, not process time, so a run is reproducible
+    valve->error.elapsed_seconds += cycle_time_ms / 1000.0;
+    double now = valve->error.elapsed_seconds;
     double control_signal = fmin(fmax(valve->config.control_signal, 0.0), 100.0);
 
     if (now - valve->error.last_update_time < valve->error.dead_time_seconds)
@@ -104,6 +124,158 @@ void FlowControlValve_Update(FlowControlValve *valve, uint32_t cycle_time_ms) {
     valve->state.flow = Cv_eff * sqrt(delta_p);
 }
 
+// ==================== LOOP ANALYTICS ====================
+// Streaming stiction and oscillation indicators for a fleet of valves. The
+// state is kept as structure-of-arrays so the per-cycle update is a flat,
+// branch-free loop the compiler can vectorize. Every indicator is an
+// exponentially weighted average over roughly ANALYTICS_WINDOW cycles, so no
+// sample history is stored.
+#define ANALYTICS_WINDOW 128
+#define ANALYTICS_MOVE_EPS 1e-3      // % change that counts as movement
+#define ANALYTICS_CROSSING_BAND 0.5  // % deviation from the mean to count a zero crossing
+#define ANALYTICS_MIN_CROSSINGS 4.0  // Crossings per window before oscillation is reported
+#define ANALYTICS_MAX_PERIOD_CV 0.5  // Crossing interval spread still considered regular
+#define ANALYTICS_INTERVAL_ALPHA 0.25 // Weight of the newest crossing interval
+
+typedef struct {
+    size_t count;
+
+    // Inputs gathered from the valves each cycle
+    double *control_signal;
+    double *opening;
+
+    // Per-valve streaming state
+    double *prev_control_signal;
+    double *prev_opening;
+    double *move_rate;          // EWMA of "controller moved"
+    double *stuck_rate;         // EWMA of "controller moved, valve did not"
+    double *mean_signal;        // EWMA of the control signal
+    double *sign;               // Side of the mean the signal is on (+1/-1)
+    double *since_crossing;     // Cycles since the last zero crossing
+    double *crossing_rate;      // EWMA of zero crossings per cycle
+    double *interval_mean;      // EWMA of cycles between crossings
+    double *interval_var;
+    double *direction;          // Last non-zero travel direction (+1/-1/0)
+
+    // Outputs
+    double *stiction_index;     // 0..1, share of controller moves the valve ignored
+    double *oscillating;        // 1.0 when regular zero crossings are seen
+    double *period_s;           // Estimated oscillation period
+    double *travel;             // Accumulated travel (%)
+    double *reversals;          // Travel direction changes
+} LoopAnalytics;
+
+LoopAnalytics loop_analytics;
+
+static double FlowControlValve_ClampedSignal(const FlowControlValve *valve) {
+    return fmin(fmax(valve->config.control_signal, 0.0), 100.0);
+}
+
+bool LoopAnalytics_Init(LoopAnalytics *a, const FlowControlValve *valves, size_t count) {
+    double **fields[] = {
+        &a->control_signal, &a->opening, &a->prev_control_signal, &a->prev_opening,
+        &a->move_rate, &a->stuck_rate, &a->mean_signal, &a->sign, &a->since_crossing,
+        &a->crossing_rate, &a->interval_mean, &a->interval_var, &a->direction,
+        &a->stiction_index, &a->oscillating, &a->period_s, &a->travel, &a->reversals,
+    };
+    size_t field_count = sizeof(fields) / sizeof(fields[0]);
+
+    // One allocation, one array per field
+    double *block = calloc(field_count * count, sizeof(double));
+    if (!block)
+        return false;
+    a->count = count;
+    for (size_t f = 0; f < field_count; f++)
+        *fields[f] = block + f * count;
+
+    for (size_t i = 0; i < count; i++) {
+        a->prev_control_signal[i] = FlowControlValve_ClampedSignal(&valves[i]);
+        a->prev_opening[i] = valves[i].state.valve_opening;
+        a->mean_signal[i] = a->prev_control_signal[i];
+        a->sign[i] = 1.0;
+    }
+    return true;
+}
+
+void LoopAnalytics_Free(LoopAnalytics *a) {
+    free(a->control_signal); // Start of the block
+    memset(a, 0, sizeof(*a));
+}
+
+// Register the per-valve arrays with the state hash log, one segment per
+// field in the block order of LoopAnalytics_Init
+void LoopAnalytics_SetHashSegments(const LoopAnalytics *a, SimHashLog *log) {
+    static const char *names[] = {
+        "ControlSignal", "Opening", "PrevControlSignal", "PrevOpening",
+        "MoveRate", "StuckRate", "MeanSignal", "Sign", "SinceCrossing",
+        "CrossingRate", "IntervalMean", "IntervalVar", "Direction",
+        "StictionIndex", "Oscillating", "Period", "Travel", "Reversals",
+    };
+    char name[SIM_HASH_NAME_LENGTH];
+    for (size_t f = 0; f < sizeof(names) / sizeof(names[0]); f++) {
+        snprintf(name, sizeof(name), "LoopAnalytics.%s", names[f]);
+        SimHashLog_SetSegment(log, name, a->control_signal + f * a->count, sizeof(double), a->count, 0);
+    }
+}
+
+void LoopAnalytics_Update(LoopAnalytics *a, const FlowControlValve *valves, uint32_t cycle_time_ms) {
+    const size_t n = a->count;
+    const double alpha = 2.0 / (ANALYTICS_WINDOW + 1.0);
+    const double dt = cycle_time_ms / 1000.0;
+
+    // Gather the strided inputs once so the main loop reads contiguous arrays
+    for (size_t i = 0; i < n; i++) {
+        a->control_signal[i] = FlowControlValve_ClampedSignal(&valves[i]);
+        a->opening[i] = valves[i].state.valve_opening;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        double cs = a->control_signal[i];
+        double op = a->opening[i];
+        double d_cs = cs - a->prev_control_signal[i];
+        double d_op = op - a->prev_opening[i];
+
+        // Stiction: controller moves that did not move the valve
+        double cs_moved = fabs(d_cs) > ANALYTICS_MOVE_EPS ? 1.0 : 0.0;
+        double op_moved = fabs(d_op) > ANALYTICS_MOVE_EPS ? 1.0 : 0.0;
+        a->move_rate[i] += alpha * (cs_moved - a->move_rate[i]);
+        a->stuck_rate[i] += alpha * (cs_moved * (1.0 - op_moved) - a->stuck_rate[i]);
+        a->stiction_index[i] = a->stuck_rate[i] / fmax(a->move_rate[i], 1e-9);
+
+        // Zero crossings of the control signal around its running mean, with
+        // a dead band so noise does not count
+        a->mean_signal[i] += alpha * (cs - a->mean_signal[i]);
+        double dev = cs - a->mean_signal[i];
+        double side = dev > ANALYTICS_CROSSING_BAND ? 1.0 : (dev < -ANALYTICS_CROSSING_BAND ? -1.0 : a->sign[i]);
+        double crossed = side != a->sign[i] ? 1.0 : 0.0;
+        a->sign[i] = side;
+        a->since_crossing[i] += 1.0;
+
+        // Crossing interval statistics, updated only on a crossing
+        double w = ANALYTICS_INTERVAL_ALPHA * crossed;
+        double d_int = a->since_crossing[i] - a->interval_mean[i];
+        a->interval_mean[i] += w * d_int;
+        a->interval_var[i] = (1.0 - w) * (a->interval_var[i] + w * d_int * d_int);
+        a->since_crossing[i] *= 1.0 - crossed;
+        a->crossing_rate[i] += alpha * (crossed - a->crossing_rate[i]);
+
+        double cv = sqrt(a->interval_var[i]) / fmax(a->interval_mean[i], 1e-9);
+        double regular = cv < ANALYTICS_MAX_PERIOD_CV ? 1.0 : 0.0;
+        double enough = a->crossing_rate[i] * ANALYTICS_WINDOW >= ANALYTICS_MIN_CROSSINGS ? 1.0 : 0.0;
+        a->oscillating[i] = regular * enough;
+        a->period_s[i] = a->oscillating[i] * 2.0 * a->interval_mean[i] * dt;
+
+        // Travel and reversals of the valve itself
+        double dir = d_op > ANALYTICS_MOVE_EPS ? 1.0 : (d_op < -ANALYTICS_MOVE_EPS ? -1.0 : a->direction[i]);
+        a->reversals[i] += dir * a->direction[i] < 0.0 ? 1.0 : 0.0;
+        a->direction[i] = dir;
+        a->travel[i] += fabs(d_op);
+
+        a->prev_control_signal[i] = cs;
+        a->prev_opening[i] = op;
+    }
+}
+
 static void assignIfMatch(UA_QualifiedName *browseName, const char *name,
                          const UA_DataValue *data, const UA_DataType *type,
                          void *target) {
@@ -247,25 +419,429 @@ static void addFlowControlValveObject(UA_Server *server) {
         flowAttr, NULL, NULL);
 }
 
-int main(void) {
+// Read-only Status variable for one loop analytics output
+static void addAnalyticsVariable(UA_Server *server, const char *nodeIdStr, const char *displayName,
+                                 void *value, const UA_DataType *type) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", displayName);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    attr.userAccessLevel = UA_ACCESSLEVELMASK_READ;
+    attr.minimumSamplingInterval = DEFAULT_CYCLE_TIME_MS;
+    attr.dataType = type->typeId;
+    UA_Variant_setScalar(&attr.value, value, type);
+
+    UA_Server_addVariableNode(server, UA_NODEID_STRING(1, nodeIdStr),
+        UA_NODEID_STRING(1, "Status"),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+        UA_QUALIFIEDNAME(1, nodeIdStr),
+        UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+        attr, NULL, NULL);
+}
+
+static void addLoopAnalyticsVariables(UA_Server *server) {
+    UA_Boolean oscillating = false;
+    UA_UInt32 reversals = 0;
+    addAnalyticsVariable(server, "StictionIndex", "Stiction Index (0-1)",
+                         &loop_analytics.stiction_index[0], &UA_TYPES[UA_TYPES_DOUBLE]);
+    addAnalyticsVariable(server, "Oscillating", "Oscillating",
+                         &oscillating, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addAnalyticsVariable(server, "OscillationPeriod", "Oscillation Period (s)",
+                         &loop_analytics.period_s[0], &UA_TYPES[UA_TYPES_DOUBLE]);
+    addAnalyticsVariable(server, "Travel", "Accumulated Travel (%)",
+                         &loop_analytics.travel[0], &UA_TYPES[UA_TYPES_DOUBLE]);
+    addAnalyticsVariable(server, "Reversals", "Travel Reversals",
+                         &reversals, &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+static void writeLoopAnalytics(UA_Server *server, size_t i) {
+    UA_Variant value;
+    UA_Boolean oscillating = loop_analytics.oscillating[i] > 0.5;
+    UA_UInt32 reversals = (UA_UInt32)loop_analytics.reversals[i];
+
+    UA_Variant_setScalar(&value, &loop_analytics.stiction_index[i], &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "StictionIndex"), value);
+    UA_Variant_setScalar(&value, &oscillating, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "Oscillating"), value);
+    UA_Variant_setScalar(&value, &loop_analytics.period_s[i], &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "OscillationPeriod"), value);
+    UA_Variant_setScalar(&value, &loop_analytics.travel[i], &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "Travel"), value);
+    UA_Variant_setScalar(&value, &reversals, &UA_TYPES[UA_TYPES_UINT32]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "Reversals"), value);
+}
+
+// ==================== SECURE CHANNEL BENCHMARK ====================
+// --bench-security: one loopback client per security mode (None,
+// Basic256Sha256 Sign, Basic256Sha256 Sign&Encrypt) sends back-to-back Read
+// requests to a server running on its own thread. Each mode is measured
+// with one node per request and with SECBENCH_BATCH nodes per request,
+// since batching spreads the per-message signing and encryption cost over
+// more values. The policy sets up the AES key schedule and HMAC again for
+// every message, so fewer, larger messages are the only lever.
+#define SECBENCH_BATCH 100
+#define SECBENCH_MAX_SAMPLES 200000
+#define SECBENCH_MODES 3
+
+typedef struct {
+    UA_Server *server;
+    atomic_bool stop;
+} SecBenchServer;
+
+// Objects/SecBench/Tag_<i>, SECBENCH_BATCH read-only doubles
+static void addSecBenchTags(UA_Server *server, UA_NodeId *nodes, double *values) {
+    UA_NodeId benchNodeId = UA_NODEID_STRING(1, "SecBench");
+    UA_ObjectAttributes objAttr = UA_ObjectAttributes_default;
+    objAttr.displayName = UA_LOCALIZEDTEXT("en-US", "SecBench");
+    UA_Server_addObjectNode(server, benchNodeId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES), UA_QUALIFIEDNAME(1, "SecBench"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE), objAttr, NULL, NULL);
+
+    for (uint32_t t = 0; t < SECBENCH_BATCH; t++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Tag_%u", t);
+        nodes[t] = UA_NODEID_STRING_ALLOC(1, name);
+
+        UA_VariableAttributes attr = UA_VariableAttributes_default;
+        attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+        UA_Variant_setScalar(&attr.value, &values[t], &UA_TYPES[UA_TYPES_DOUBLE]);
+        UA_Server_addVariableNode(server, nodes[t], benchNodeId,
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT), UA_QUALIFIEDNAME(1, name),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), attr, NULL, NULL);
+    }
+}
+
+static int compareUInt64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentileUs(const uint64_t *sorted, size_t count, double p) {
+    if (count == 0)
+        return 0.0;
+    size_t index = (size_t)(p * (count - 1) + 0.5);
+    return sorted[index] / 1e3;
+}
+
+static void *SecBench_ServerThread(void *arg) {
+    SecBenchServer *bench_server = arg;
+    while (!atomic_load(&bench_server->stop))
+        UA_Server_run_iterate(bench_server->server, true);
+    return NULL;
+}
+
+static const char *securityModeName(UA_MessageSecurityMode mode) {
+    switch (mode) {
+        case UA_MESSAGESECURITYMODE_SIGN: return "Sign";
+        case UA_MESSAGESECURITYMODE_SIGNANDENCRYPT: return "SignAndEncrypt";
+        default: return "None";
+    }
+}
+
+static UA_Client *SecBench_Connect(uint16_t port, UA_MessageSecurityMode mode, const char *cert_dir) {
+    UA_Client *client = UA_Client_new();
+    UA_ClientConfig *config = UA_Client_getConfig(client);
+    if (mode == UA_MESSAGESECURITYMODE_NONE) {
+        UA_ClientConfig_setDefault(config);
+    } else {
+#ifdef UA_ENABLE_ENCRYPTION
+        UA_ByteString cert = UA_BYTESTRING_NULL, key = UA_BYTESTRING_NULL;
+        if (!SimSecurity_LoadOrCreate(cert_dir, "client", SIM_SECURITY_CLIENT_URI, &cert, &key)) {
+            UA_Client_delete(client);
+            return NULL;
+        }
+        UA_ClientConfig_setDefaultEncryption(config, cert, key, NULL, 0, NULL, 0);
+        UA_ByteString_clear(&cert);
+        UA_ByteString_clear(&key);
+        config->securityMode = mode;
+        config->securityPolicyUri = UA_STRING_ALLOC(SIM_SECURITY_POLICY_URI);
+        UA_String_clear(&config->clientDescription.applicationUri);
+        config->clientDescription.applicationUri = UA_STRING_ALLOC(SIM_SECURITY_CLIENT_URI);
+#else
+        UA_Client_delete(client);
+        return NULL;
+#endif
+    }
+
+    char url[64];
+    snprintf(url, sizeof(url), "opc.tcp://localhost:%u", port);
+    if (UA_Client_connect(client, url) != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Bench: cannot connect to %s with %s\n", url, securityModeName(mode));
+        UA_Client_delete(client);
+        return NULL;
+    }
+    return client;
+}
+
+// Back-to-back reads of `batch` nodes for `seconds`; prints a result row
+// and returns the values per second
+static double SecBench_Run(UA_Client *client, UA_MessageSecurityMode mode, const UA_NodeId *nodes,
+                           uint32_t batch, uint32_t seconds, double baseline, uint64_t *samples) {
+    UA_ReadValueId items[SECBENCH_BATCH];
+    for (uint32_t i = 0; i < batch; i++) {
+        UA_ReadValueId_init(&items[i]);
+        items[i].nodeId = nodes[i];
+        items[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_SOURCE;
+    request.nodesToRead = items;
+    request.nodesToReadSize = batch;
+
+    uint64_t requests = 0, errors = 0;
+    size_t sample_count = 0;
+    uint64_t start = SimMetrics_Now(), end = start + seconds * 1000000000ULL, now = start;
+    while (now < end && running) {
+        UA_ReadResponse response = UA_Client_Service_read(client, request);
+        uint64_t done = SimMetrics_Now();
+        if (response.responseHeader.serviceResult != UA_STATUSCODE_GOOD || response.resultsSize != batch)
+            errors++;
+        UA_ReadResponse_clear(&response);
+        if (sample_count < SECBENCH_MAX_SAMPLES)
+            samples[sample_count++] = done - now;
+        requests++;
+        now = done;
+    }
+
+    double wall_s = (now - start) / 1e9;
+    double values_per_s = wall_s > 0.0 ? requests * batch / wall_s : 0.0;
+    qsort(samples, sample_count, sizeof(uint64_t), compareUInt64);
+    printf("%-15s %6u %10.0f %11.0f %9.1f %9.1f %8.2f %7llu\n",
+           securityModeName(mode), batch, wall_s > 0.0 ? requests / wall_s : 0.0, values_per_s,
+           percentileUs(samples, sample_count, 0.50), percentileUs(samples, sample_count, 0.99),
+           baseline > 0.0 ? values_per_s / baseline : 1.0, (unsigned long long)errors);
+    fflush(stdout);
+    return values_per_s;
+}
+
+static int SecBench_Main(int argc, char **argv) {
+    uint32_t seconds = 5;
+    uint16_t port = 4852;
+    const char *dir_env = getenv("SIM_CERT_DIR");
+    const char *cert_dir = dir_env && *dir_env ? dir_env : ".";
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = (uint16_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s --bench-security [--seconds s] [--port p]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!seconds) {
+        fprintf(stderr, "Invalid --seconds\n");
+        return EXIT_FAILURE;
+    }
+
+    static UA_NodeId nodes[SECBENCH_BATCH];
+    static double values[SECBENCH_BATCH];
+    uint64_t *samples = calloc(SECBENCH_MAX_SAMPLES, sizeof(uint64_t));
+    if (!samples)
+        return EXIT_FAILURE;
+
+    SecBenchServer bench_server = {.server = UA_Server_new()};
+    atomic_store(&bench_server.stop, false);
+    // Loopback only: no trust list, the bench client's certificate is accepted
+    bool ok = SimSecurity_Configure(UA_Server_getConfig(bench_server.server), port,
+                                    SIM_SECURITY_ALLOW, cert_dir, NULL) == UA_STATUSCODE_GOOD;
+    if (!ok) {
+        // Start over with a clean configuration
+        fprintf(stderr, "Bench: encrypted endpoints unavailable, measuring None only\n");
+        UA_Server_delete(bench_server.server);
+        bench_server.server = UA_Server_new();
+        UA_ServerConfig_setMinimal(UA_Server_getConfig(bench_server.server), port, NULL);
+    }
+    size_t mode_count = ok ? SECBENCH_MODES : 1;
+    addSecBenchTags(bench_server.server, nodes, values);
+
+    pthread_t server_thread;
+    bool started = UA_Server_run_startup(bench_server.server) == UA_STATUSCODE_GOOD &&
+                   pthread_create(&server_thread, NULL, SecBench_ServerThread, &bench_server) == 0;
+
+    static const UA_MessageSecurityMode modes[SECBENCH_MODES] = {
+        UA_MESSAGESECURITYMODE_NONE, UA_MESSAGESECURITYMODE_SIGN, UA_MESSAGESECURITYMODE_SIGNANDENCRYPT
+    };
+    static const uint32_t batches[] = {1, SECBENCH_BATCH};
+    double baseline[2] = {0.0, 0.0};
+    printf("Read round trips over loopback, %u s per run, rel = values/s relative to None\n", seconds);
+    printf("%-15s %6s %10s %11s %9s %9s %8s %7s\n",
+           "mode", "batch", "req_per_s", "values_per_s", "p50_us", "p99_us", "rel", "errors");
+    bool connected = true;
+    for (size_t m = 0; started && m < mode_count && running; m++) {
+        UA_Client *client = SecBench_Connect(port, modes[m], cert_dir);
+        if (!client) {
+            connected = false;
+            break;
+        }
+        for (size_t b = 0; b < 2 && running; b++) {
+            double rate = SecBench_Run(client, modes[m], nodes, batches[b], seconds, baseline[b], samples);
+            if (m == 0)
+                baseline[b] = rate;
+        }
+        UA_Client_disconnect(client);
+        UA_Client_delete(client);
+    }
+
+    if (started) {
+        atomic_store(&bench_server.stop, true);
+        pthread_join(server_thread, NULL);
+    }
+    UA_Server_run_shutdown(bench_server.server);
+    UA_Server_delete(bench_server.server);
+    for (uint32_t t = 0; t < SECBENCH_BATCH; t++)
+        UA_NodeId_clear(&nodes[t]);
+    free(samples);
+    return started && connected ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// ==================== GOLDEN SCENARIOS ====================
+// Canonical runs for --golden record|check <trace> (sim_golden.h): one
+// valve with its loop analytics, driven by a control-signal profile. The
+// opening and flow follow from the latest control signal; the analytics
+// are running averages and sums over the whole run.
+#define GOLDEN_OPENING_TOL (100.0 * SIM_GOLDEN_ALGEBRAIC)   // %
+#define GOLDEN_FLOW_TOL (20.0 * SIM_GOLDEN_ALGEBRAIC)       // Flow at full opening
+#define GOLDEN_STICTION_TOL SIM_GOLDEN_INTEGRATED           // Index in [0, 1]
+#define GOLDEN_PERIOD_TOL (10.0 * SIM_GOLDEN_INTEGRATED)    // s
+#define GOLDEN_TRAVEL_TOL (1e3 * SIM_GOLDEN_INTEGRATED)     // %, a run's total travel
+
+typedef double (*GoldenProfile)(uint32_t step);
+
+// Slow triangle 0 -> 100 -> 0 %, 0.25 % per step
+static double goldenTriangle(uint32_t step) {
+    uint32_t s = step % 800;
+    return s < 400 ? s * 0.25 : (800 - s) * 0.25;
+}
+
+// 20 % sine around 50 %, 60-step period
+static double goldenSine(uint32_t step) {
+    return 50.0 + 20.0 * sin(2.0 * PI * step / 60.0);
+}
+
+// Staircase of 10 % steps every 30 steps, including out-of-range requests
+static double goldenStairs(uint32_t step) {
+    return -10.0 + 10.0 * ((step / 30) % 13);
+}
+
+static void FlowControlValve_GoldenRun(SimGolden *golden, const char *scenario, FlowControlValve *valve,
+                                       GoldenProfile profile, uint32_t steps, uint32_t every) {
+    LoopAnalytics analytics;
+    if (!LoopAnalytics_Init(&analytics, valve, 1))
+        return;
+    SimGolden_Begin(golden, scenario);
+    for (uint32_t step = 0; step < steps; step++) {
+        valve->config.control_signal = profile(step);
+        FlowControlValve_Update(valve, DEFAULT_CYCLE_TIME_MS);
+        LoopAnalytics_Update(&analytics, valve, DEFAULT_CYCLE_TIME_MS);
+        if (step % every != 0)
+            continue;
+        SimGolden_Signal(golden, step, "ValveOpening", valve->state.valve_opening, GOLDEN_OPENING_TOL, 0.0);
+        SimGolden_Signal(golden, step, "Flow", valve->state.flow, GOLDEN_FLOW_TOL, 0.0);
+        SimGolden_Signal(golden, step, "StictionIndex", analytics.stiction_index[0], GOLDEN_STICTION_TOL, 0.0);
+        SimGolden_Signal(golden, step, "Oscillating", analytics.oscillating[0], 0.0, 0.0);
+        SimGolden_Signal(golden, step, "OscillationPeriod", analytics.period_s[0], GOLDEN_PERIOD_TOL, 0.0);
+        SimGolden_Signal(golden, step, "Travel", analytics.travel[0], GOLDEN_TRAVEL_TOL, 0.0);
+        SimGolden_Signal(golden, step, "Reversals", analytics.reversals[0], 0.0, 0.0);
+    }
+    SimGolden_End(golden);
+    LoopAnalytics_Free(&analytics);
+}
+
+static void FlowControlValve_GoldenScenarios(SimGolden *golden) {
+    static const double stiction[] = {0.0, 0.5, 2.0, 5.0};
+    static const double hysteresis[] = {0.0, 1.0, 5.0};
+    FlowControlValve valve;
+    char name[SIM_GOLDEN_NAME_LENGTH];
+
+    // Stiction sweep over a slow triangle: the stem sticks until the
+    // request has moved by the threshold
+    for (size_t i = 0; i < sizeof(stiction) / sizeof(stiction[0]); i++) {
+        FlowControlValve_Init(&valve);
+        valve.error.stiction_threshold = stiction[i];
+        snprintf(name, sizeof(name), "fcv_stiction_%g", stiction[i]);
+        FlowControlValve_GoldenRun(golden, name, &valve, goldenTriangle, 1600, 4);
+    }
+
+    // Hysteresis sweep over an oscillating request
+    for (size_t i = 0; i < sizeof(hysteresis) / sizeof(hysteresis[0]); i++) {
+        FlowControlValve_Init(&valve);
+        valve.error.hysteresis_percent = hysteresis[i];
+        snprintf(name, sizeof(name), "fcv_hysteresis_%g", hysteresis[i]);
+        FlowControlValve_GoldenRun(golden, name, &valve, goldenSine, 600, 2);
+    }
+
+    // Linear and equal-percentage characteristics with a positioner error
+    for (int characteristic = 0; characteristic <= 1; characteristic++) {
+        FlowControlValve_Init(&valve);
+        valve.config.valve_characteristic = characteristic;
+        valve.error.positioner_error_percent = 5.0;
+        snprintf(name, sizeof(name), "fcv_characteristic_%d", characteristic);
+        FlowControlValve_GoldenRun(golden, name, &valve, goldenStairs, 390, 1);
+    }
+
+    // Dead time: the valve follows the staircase at most every 0.5 s
+    FlowControlValve_Init(&valve);
+    valve.error.dead_time_seconds = 0.5;
+    FlowControlValve_GoldenRun(golden, "fcv_dead_time", &valve, goldenStairs, 390, 1);
+}
+
+int main(int argc, char **argv) {
     signal(SIGINT, stopHandler);
     signal(SIGTERM, stopHandler);
 
+    if (argc > 1 && strcmp(argv[1], "--bench-security") == 0)
+        return SecBench_Main(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--golden") == 0)
+        return SimGolden_Main(argc - 1, argv + 1, FlowControlValve_GoldenScenarios);
+
     FlowControlValve_Init(&flow_control_valve);
+    if (!LoopAnalytics_Init(&loop_analytics, &flow_control_valve, 1))
+        return EXIT_FAILURE;
+
+    // Optional per-cycle state hashes (SIM_HASH_LOG)
+    if (!SimHashLog_OpenFromEnv(&hash_log, NULL, 1))
+        return EXIT_FAILURE;
+    SimHashLog_SetSegment(&hash_log, "FlowControlValve.config", &flow_control_valve.config,
+                          sizeof(flow_control_valve.config), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "FlowControlValve.state", &flow_control_valve.state,
+                          sizeof(flow_control_valve.state), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "FlowControlValve.error", &flow_control_valve.error,
+                          sizeof(flow_control_valve.error), 1, 0);
+    LoopAnalytics_SetHashSegments(&loop_analytics, &hash_log);
+    uint64_t cycle_count = 0;
     server = UA_Server_new();
-    UA_ServerConfig_setDefault(UA_Server_getConfig(server));
+    if (SimSecurity_ConfigureFromEnv(UA_Server_getConfig(server), 4840) != UA_STATUSCODE_GOOD) {
+        UA_Server_delete(server);
+        return EXIT_FAILURE;
+    }
 
     addFlowControlValveObject(server);
+    addLoopAnalyticsVariables(server);
     printf("OPC UA Flow Control Valve Server running at opc.tcp://localhost:4840\n");
 
+    SimMetrics_StartFromEnv(server);
+    int metrics_model = SimMetrics_RegisterModel("FlowControlValve");
+
     if (UA_Server_run_startup(server) != UA_STATUSCODE_GOOD) {
         UA_Server_delete(server);
         return EXIT_FAILURE;
     }
 
+    if (!SimLoop_Open(&loop, server, DEFAULT_CYCLE_TIME_MS))
+        running = false;
+
     while (running) {
-        UA_Server_run_iterate(server, true);
+        if (SimLoop_WaitTick(&loop) == 0)
+            continue;
+        uint64_t cycle_start = SimMetrics_Now();
         FlowControlValve_Update(&flow_control_valve, DEFAULT_CYCLE_TIME_MS);
+        LoopAnalytics_Update(&loop_analytics, &flow_control_valve, DEFAULT_CYCLE_TIME_MS);
+        SimMetrics_RecordModelStep(metrics_model, SimMetrics_Now() - cycle_start);
+        SimHashLog_Record(&hash_log, ++cycle_count);
 
         UA_Variant value;
         UA_Variant_init(&value);
@@ -274,15 +850,17 @@ int main(void) {
 
         UA_Variant_setScalar(&value, &flow_control_valve.state.flow, &UA_TYPES[UA_TYPES_DOUBLE]);
         UA_Server_writeValue(server, UA_NODEID_STRING(1, "Flow"), value);
+        writeLoopAnalytics(server, 0);
 
-#ifdef _WIN32
-        Sleep(DEFAULT_CYCLE_TIME_MS);
-#else
-        usleep(DEFAULT_CYCLE_TIME_MS * 1000);
-#endif
+        SimMetrics_RecordServer(server);
+        SimMetrics_RecordCycle(SimMetrics_Now() - cycle_start, DEFAULT_CYCLE_TIME_MS);
     }
 
+    SimLoop_Close(&loop);
     UA_Server_run_shutdown(server);
+    SimMetrics_Stop();
     UA_Server_delete(server);
+    LoopAnalytics_Free(&loop_analytics);
+    SimHashLog_Close(&hash_log);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Checks every server build against its golden trace (--golden check).
+#
+#   source/golden/check.sh [bindir]
+#
+# bindir holds the four server binaries (default: the current directory).
+# Exits non-zero if any trace fails or a binary is missing. After an
+# intended behavior change, re-record the affected trace with
+# `<binary> --golden record source/golden/<trace>` and commit it with the
+# change.
+
+golden_dir=$(cd "$(dirname "$0")" && pwd)
+bin_dir=${1:-.}
+status=0
+
+for entry in seperator:separator valve_control_opcua:valve Control_valve_flow:flow_valve \
+             transmitter_opcua:transmitter; do
+    binary=$bin_dir/${entry%%:*}
+    trace=$golden_dir/${entry##*:}.golden
+    if [ ! -x "$binary" ]; then
+        echo "MISSING: $binary"
+        status=1
+        continue
+    fi
+    echo "== $binary"
+    "$binary" --golden check "$trace" || status=1
+done
+
+exit $status
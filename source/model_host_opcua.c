@@ -0,0 +1,1792 @@
+#include <open62541/server.h>
+#include <open62541/server_config_default.h>
+#include <open62541/plugin/log_stdout.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sim_config.h"
+#include "sim_executor.h"
+#include "sim_hash.h"
+#include "sim_loop.h"
+#include "sim_metrics.h"
+#include "sim_security.h"
+#include "sim_shard.h"
+#include "sim_model_plugin.h"
+
+#define DEFAULT_CYCLE_TIME_MS 100
+#define MAX_MODELS 16
+#define MAX_NODE_ID_LENGTH 128
+#define MAX_PATH_LENGTH 512
+#define MAX_PROFILE_TOP_K 64
+#define DEFAULT_PARTITION_SIZE 256
+#define DEFAULT_VERIFY_CYCLES 100
+#define MAX_VERIFY_RUNS 8
+#define OPCUA_PORT 4840
+#define BENCH_SHARD_PORT 4900
+#define DEFAULT_BENCH_CYCLES 200
+#define MAX_BENCH_RUNS 8
+
+// ==================== MODEL HOST ====================
+// Generic OPC UA server for equipment models loaded as plugins.
+// Usage: model_host_opcua [--config <file>] [--profile <every N cycles>]
+//                         [--top <K>] [--threads <T>] [--partition <N>]
+//                         [--seed <S>] [--verify-threads <T,..>]
+//                         [--verify-cycles <C>] [--shard <k>/<N> --peers <host:port,..>]
+//                         [--bench-distributed <N,..>] [--bench-cycles <C>]
+//                         [<plugin.so>[:instances] ...]
+//
+// Every instance is exposed as Objects/<Model>/<Model>_<i> with a
+// Parameters folder (writable) and a State folder (read-only), generated
+// from the descriptor field tables.
+//
+// The optional config file is watched and re-applied between two cycles:
+//   plugin = ./pump_model.so:10     # load, resize or (when removed) unload
+//   Pump_3.SpeedSetpoint = 80       # set a parameter of one instance
+// Instances that the change does not touch keep their state and nodes.
+//
+// With --profile N every Nth cycle steps instances one at a time and times
+// each call. The per-model totals and the top-K most expensive instances
+// are published under Objects/Diagnostics and printed on SIGUSR1 and at exit.
+//
+// Instances are stepped in fixed partitions of --partition instances on
+// --threads threads (sim_executor.h), so results are bit-identical for any
+// thread count. ABI 2 models get one random stream per partition and cycle,
+// derived from --seed. Every double state field is also summed over all
+// instances into Objects/<Model>/Totals; partial sums are formed per
+// partition and added in partition order. --verify-threads runs
+// --verify-cycles cycles (steps and boundary streams) with each thread count
+// and compares the state hash after every cycle with the 1-thread run, then
+// exits. It needs an unsharded host.
+//
+// Boundary streams connect a state field of one instance to a parameter of
+// another; the value at the end of a cycle is the input of the next one:
+//   link = Pump_0.Speed -> Pump_1.SpeedSetpoint
+//   link = Pump_0..998.Speed -> Pump_1..999.SpeedSetpoint   # 999 streams
+// Links are re-read with the config file.
+//
+// Distributed mode: --shard k/N runs shard k of N processes. Each process
+// loads the same plugins and config file but holds only its own share of
+// every model: whole partitions, split evenly in instance order. Instance
+// numbers, node ids and random streams stay global, so a plant simulated
+// by N processes gives the same state as by one. Streams between shards
+// are exchanged each cycle over UDP (sim_shard.h) with the addresses in
+// --peers (entry k is this process); shard k serves OPC UA on port 4840 + k.
+// Totals are those of the local share. Plugins, instance counts and links
+// are fixed while distributed (a reload that changes them is refused until
+// all shards restart); parameters still reload.
+//
+// SIM_HASH_LOG=<path> records a hash of every model's instances after each
+// cycle (sim_hash.h), in blocks of one partition unless SIM_HASH_BLOCK is
+// set; shard k writes <path>.k. sim_hash_diff finds the first cycle and
+// instance block where two runs differ.
+// --bench-distributed 1,2,4 forks that many shards on the loopback
+// interface for each entry, runs --bench-cycles unpaced cycles without
+// OPC UA and prints cycle rate, speedup and a plant state hash that must
+// be the same for every process count. A speedup needs one core per shard:
+// on a single core, 2 and 4 shards measured 0.95x to 1.03x of one process.
+
+// Binds one OPC UA variable to one field of one instance
+typedef struct {
+    const SimFieldDescriptor *field;
+    void *value;        // Address of the field inside the instance
+    UA_NodeId nodeId;
+} FieldBinding;
+
+typedef struct {
+    const SimModelDescriptor *desc;
+    char path[MAX_PATH_LENGTH];
+    void *library;
+    void *instances;    // count * desc->instance_size bytes, contiguous
+    size_t count;
+    size_t first;       // Plant-wide number of instance 0 (distributed mode)
+    size_t global_count;
+
+    // count * param_count and count * state_count, instance-major
+    FieldBinding *param_bindings;
+    FieldBinding *state_bindings;
+
+    int metrics_slot;
+
+    // Sampled step time per instance, summed over profiled cycles
+    uint64_t *profile_ns;
+    uint64_t profile_samples;
+
+    // Optional ABI 2 entry point and the name part of its random keys
+    void (*step_random)(void *instances, size_t count, uint32_t cycle_time_ms, SimRandom *random);
+    uint64_t name_hash;
+
+    // Cross-instance totals of the double state fields
+    size_t *total_fields;       // Indices into desc->state
+    size_t total_count;
+    double *partials;           // partition-major, total_count per partition
+    size_t partial_capacity;    // Partitions the partials array can hold
+    double *totals;
+    UA_NodeId *total_nodes;
+} LoadedModel;
+
+// One model step handed to the executor
+typedef struct {
+    LoadedModel *model;
+    uint32_t cycle_time_ms;
+    uint64_t cycle;
+} StepJob;
+
+typedef struct {
+    const LoadedModel *model;
+    size_t index;
+    double mean_ns;
+} ProfileEntry;
+
+// A boundary stream with both ends in this process
+typedef struct {
+    const FieldBinding *source;     // State field
+    FieldBinding *target;           // Parameter field
+} StreamCopy;
+
+// Stream ends towards one other shard, in link order
+typedef struct {
+    const FieldBinding **sources;   // Packed into SimShardPeer.out
+    size_t source_count;
+    size_t source_capacity;
+    FieldBinding **targets;         // Unpacked from SimShardPeer.in
+    size_t target_count;
+    size_t target_capacity;
+} ShardStreams;
+
+// Result of one shard in --bench-distributed, sent to the parent
+typedef struct {
+    uint64_t elapsed_ns;
+    uint64_t wait_ns;
+    uint64_t retransmits;
+    uint64_t plant_hash;
+    uint64_t instances;
+    uint64_t streams;
+    bool ok;
+} ShardBenchResult;
+
+// Globals
+LoadedModel models[MAX_MODELS];
+size_t model_count = 0;
+uint32_t profile_every = 0;    // 0 = profiling off
+uint32_t profile_top_k = 10;
+uint64_t cycle_count = 0;
+size_t partition_size = DEFAULT_PARTITION_SIZE;
+uint64_t random_seed = 0;
+SimExecutor executor;
+uint32_t shard_index = 0;
+uint32_t shard_count = 1;      // 1 = not distributed
+SimShard shard = {.fd = -1};
+StreamCopy *local_streams = NULL;
+size_t local_stream_count = 0;
+size_t local_stream_capacity = 0;
+ShardStreams shard_streams[SIM_SHARD_MAX];
+volatile bool running = true;
+volatile sig_atomic_t report_requested = 0;
+UA_Server *server;
+SimLoop loop = {.epoll_fd = -1, .timer_fd = -1, .wake_fd = -1};
+SimHashLog hash_log;
+
+void stopHandler(int sign) {
+    running = false;
+    SimLoop_Wake(&loop);
+}
+
+void reportHandler(int sign) {
+    report_requested = 1;
+}
+
+static const UA_DataType *fieldDataType(SimFieldType type) {
+    switch (type) {
+        case SIM_FIELD_DOUBLE: return &UA_TYPES[UA_TYPES_DOUBLE];
+        case SIM_FIELD_INT32: return &UA_TYPES[UA_TYPES_INT32];
+        case SIM_FIELD_UINT32: return &UA_TYPES[UA_TYPES_UINT32];
+        case SIM_FIELD_BOOLEAN: return &UA_TYPES[UA_TYPES_BOOLEAN];
+        default: return NULL;
+    }
+}
+
+static void *instanceAt(const LoadedModel *model, size_t index) {
+    return (char *)model->instances + index * model->desc->instance_size;
+}
+
+// Instances [first, first + count) of a model with `total` instances held by
+// this shard: whole partitions, split evenly over the shards
+static void shardRange(size_t total, size_t *first, size_t *count) {
+    size_t blocks = SimPartition_Count(total, partition_size);
+    size_t begin = blocks * shard_index / shard_count * partition_size;
+    size_t end = blocks * (shard_index + 1) / shard_count * partition_size;
+    *first = begin < total ? begin : total;
+    *count = (end < total ? end : total) - *first;
+}
+
+// Shard holding instance `index` of a model with `total` instances
+static uint32_t shardOwner(size_t total, size_t index) {
+    size_t blocks = SimPartition_Count(total, partition_size);
+    size_t block = index / partition_size;
+    return (uint32_t)(((block + 1) * shard_count - 1) / blocks);
+}
+
+static bool fieldTableValid(const SimFieldDescriptor *fields, size_t count, size_t instance_size) {
+    for (size_t i = 0; i < count; i++) {
+        if (!fields[i].name || !fieldDataType(fields[i].type) ||
+            fields[i].offset + fieldDataType(fields[i].type)->memSize > instance_size)
+            return false;
+    }
+    return true;
+}
+
+// Split "path[:instances]"
+static bool parseModelSpec(const char *spec, char *path, size_t path_size, size_t *count) {
+    snprintf(path, path_size, "%s", spec);
+    *count = 1;
+    char *sep = strrchr(path, ':');
+    if (sep) {
+        *sep = '\0';
+        *count = strtoul(sep + 1, NULL, 10);
+    }
+    if (*count == 0) {
+        fprintf(stderr, "%s: instance count must be positive\n", spec);
+        return false;
+    }
+    return true;
+}
+
+static LoadedModel *findModelByPath(const char *path) {
+    for (size_t m = 0; m < model_count; m++) {
+        if (strcmp(models[m].path, path) == 0)
+            return &models[m];
+    }
+    return NULL;
+}
+
+static LoadedModel *findModelByName(const char *name, size_t name_length) {
+    for (size_t m = 0; m < model_count; m++) {
+        if (strlen(models[m].desc->name) == name_length &&
+            strncmp(models[m].desc->name, name, name_length) == 0)
+            return &models[m];
+    }
+    return NULL;
+}
+
+// --- OPC UA Callbacks ---
+static void onParameterWritten(UA_Server *server,
+                               const UA_NodeId *sessionId, void *sessionContext,
+                               const UA_NodeId *nodeId, void *nodeContext,
+                               const UA_NumericRange *range,
+                               const UA_DataValue *data) {
+    FieldBinding *binding = (FieldBinding *)nodeContext;
+    if (!binding || !data || !data->hasValue || !UA_Variant_isScalar(&data->value))
+        return;
+
+    const UA_DataType *type = fieldDataType(binding->field->type);
+    if (data->value.type == type)
+        memcpy(binding->value, data->value.data, type->memSize);
+}
+
+static void addFolder(UA_Server *server, UA_NodeId parentNode, const char *nodeIdStr,
+                      const char *browseName) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)browseName);
+
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char *)nodeIdStr), parentNode,
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, (char *)browseName),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            attr, NULL, NULL);
+}
+
+static void addFieldVariable(UA_Server *server, UA_NodeId parentNode,
+                             FieldBinding *binding, bool writable) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)binding->field->display_name);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    if (writable)
+        attr.accessLevel |= UA_ACCESSLEVELMASK_WRITE;
+    attr.minimumSamplingInterval = DEFAULT_CYCLE_TIME_MS;
+    attr.dataType = fieldDataType(binding->field->type)->typeId;
+    UA_Variant_setScalar(&attr.value, binding->value, fieldDataType(binding->field->type));
+
+    UA_Server_addVariableNode(server, binding->nodeId, parentNode,
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                              UA_QUALIFIEDNAME(1, (char *)binding->field->name),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                              attr, writable ? binding : NULL, NULL);
+
+    if (writable) {
+        UA_ValueCallback callback = {.onRead = NULL, .onWrite = onParameterWritten};
+        UA_Server_setVariableNode_valueCallback(server, binding->nodeId, callback);
+    }
+}
+
+static void addModelTypeFolder(UA_Server *server, const LoadedModel *model) {
+    UA_ObjectAttributes typeAttr = UA_ObjectAttributes_default;
+    typeAttr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)model->desc->name);
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char *)model->desc->name),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, (char *)model->desc->name),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            typeAttr, NULL, NULL);
+}
+
+// Add nodes for instances [first, model->count)
+static void addInstanceObjects(UA_Server *server, LoadedModel *model, size_t first) {
+    const SimModelDescriptor *desc = model->desc;
+    char nodeIdStr[MAX_NODE_ID_LENGTH];
+    char folderIdStr[MAX_NODE_ID_LENGTH + sizeof(".Parameters")];   // nodeIdStr and the longest suffix
+
+    for (size_t i = first; i < model->count; i++) {
+        snprintf(nodeIdStr, sizeof(nodeIdStr), "%s_%zu", desc->name, model->first + i);
+        UA_NodeId instanceId = UA_NODEID_STRING(1, nodeIdStr);
+
+        UA_ObjectAttributes objAttr = UA_ObjectAttributes_default;
+        objAttr.displayName = UA_LOCALIZEDTEXT("en-US", nodeIdStr);
+        UA_Server_addObjectNode(server, instanceId, UA_NODEID_STRING(1, (char *)desc->name),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                UA_QUALIFIEDNAME(1, nodeIdStr),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                objAttr, NULL, NULL);
+
+        snprintf(folderIdStr, sizeof(folderIdStr), "%s.Parameters", nodeIdStr);
+        addFolder(server, instanceId, folderIdStr, "Parameters");
+        for (size_t f = 0; f < desc->param_count; f++)
+            addFieldVariable(server, UA_NODEID_STRING(1, folderIdStr),
+                             &model->param_bindings[i * desc->param_count + f], true);
+
+        snprintf(folderIdStr, sizeof(folderIdStr), "%s.State", nodeIdStr);
+        addFolder(server, instanceId, folderIdStr, "State");
+        for (size_t f = 0; f < desc->state_count; f++)
+            addFieldVariable(server, UA_NODEID_STRING(1, folderIdStr),
+                             &model->state_bindings[i * desc->state_count + f], false);
+    }
+}
+
+// FNV-1a, used for random keys and for the determinism check
+#define HASH_SEED 0xCBF29CE484222325ULL
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool initTotals(LoadedModel *model) {
+    const SimModelDescriptor *desc = model->desc;
+    model->total_fields = calloc(desc->state_count + 1, sizeof(size_t));
+    model->totals = calloc(desc->state_count + 1, sizeof(double));
+    model->total_nodes = calloc(desc->state_count + 1, sizeof(UA_NodeId));
+    if (!model->total_fields || !model->totals || !model->total_nodes)
+        return false;
+
+    char nodeIdStr[MAX_NODE_ID_LENGTH];
+    for (size_t f = 0; f < desc->state_count; f++) {
+        if (desc->state[f].type != SIM_FIELD_DOUBLE)
+            continue;
+        snprintf(nodeIdStr, sizeof(nodeIdStr), "%s.Totals.%s", desc->name, desc->state[f].name);
+        model->total_nodes[model->total_count] = UA_NODEID_STRING_ALLOC(1, nodeIdStr);
+        model->total_fields[model->total_count++] = f;
+    }
+    return true;
+}
+
+static void freeTotals(LoadedModel *model) {
+    for (size_t t = 0; model->total_nodes && t < model->total_count; t++)
+        UA_NodeId_clear(&model->total_nodes[t]);
+    free(model->total_fields);
+    free(model->totals);
+    free(model->total_nodes);
+    free(model->partials);
+    model->total_fields = NULL;
+    model->totals = NULL;
+    model->total_nodes = NULL;
+    model->partials = NULL;
+    model->total_count = 0;
+    model->partial_capacity = 0;
+}
+
+static void addTotalsObjects(UA_Server *server, const LoadedModel *model) {
+    const SimModelDescriptor *desc = model->desc;
+    char folderIdStr[MAX_NODE_ID_LENGTH];
+    char displayName[MAX_NODE_ID_LENGTH];
+    snprintf(folderIdStr, sizeof(folderIdStr), "%s.Totals", desc->name);
+    addFolder(server, UA_NODEID_STRING(1, (char *)desc->name), folderIdStr, "Totals");
+
+    for (size_t t = 0; t < model->total_count; t++) {
+        const SimFieldDescriptor *field = &desc->state[model->total_fields[t]];
+        snprintf(displayName, sizeof(displayName), "Total %s", field->display_name);
+        UA_VariableAttributes attr = UA_VariableAttributes_default;
+        attr.displayName = UA_LOCALIZEDTEXT("en-US", displayName);
+        attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+        attr.minimumSamplingInterval = DEFAULT_CYCLE_TIME_MS;
+        attr.dataType = UA_TYPES[UA_TYPES_DOUBLE].typeId;
+        UA_Variant_setScalar(&attr.value, &model->totals[t], &UA_TYPES[UA_TYPES_DOUBLE]);
+        UA_Server_addVariableNode(server, model->total_nodes[t], UA_NODEID_STRING(1, folderIdStr),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                  UA_QUALIFIEDNAME(1, (char *)field->name),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, NULL);
+    }
+}
+
+// Delete nodes of instances [first, last); children go with the object
+static void deleteInstanceObjects(UA_Server *server, const LoadedModel *model,
+                                  size_t first, size_t last) {
+    char nodeIdStr[MAX_NODE_ID_LENGTH];
+    for (size_t i = first; i < last; i++) {
+        snprintf(nodeIdStr, sizeof(nodeIdStr), "%s_%zu", model->desc->name, model->first + i);
+        UA_Server_deleteNode(server, UA_NODEID_STRING(1, nodeIdStr), true);
+    }
+}
+
+// Point a binding table at the (possibly moved) instance array. Node ids of
+// the first `keep` instances are carried over from the old table.
+static FieldBinding *rebindFields(const LoadedModel *model, FieldBinding *old, size_t keep,
+                                  const SimFieldDescriptor *fields, size_t field_count) {
+    FieldBinding *bindings = calloc(model->count * field_count + 1, sizeof(FieldBinding));
+    if (!bindings)
+        return NULL;
+
+    char nodeIdStr[MAX_NODE_ID_LENGTH];
+    for (size_t i = 0; i < model->count; i++) {
+        for (size_t f = 0; f < field_count; f++) {
+            FieldBinding *binding = &bindings[i * field_count + f];
+            binding->field = &fields[f];
+            binding->value = (char *)instanceAt(model, i) + fields[f].offset;
+            if (i < keep) {
+                binding->nodeId = old[i * field_count + f].nodeId;
+            } else {
+                snprintf(nodeIdStr, sizeof(nodeIdStr), "%s_%zu.%s",
+                         model->desc->name, model->first + i, fields[f].name);
+                binding->nodeId = UA_NODEID_STRING_ALLOC(1, nodeIdStr);
+            }
+        }
+    }
+    return bindings;
+}
+
+// Grow or shrink a model in place. Surviving instances keep their state,
+// their nodes and therefore any monitored items on them.
+static bool Host_ResizeModel(UA_Server *server, LoadedModel *model, size_t new_count) {
+    const SimModelDescriptor *desc = model->desc;
+    size_t old_count = model->count;
+    size_t keep = old_count < new_count ? old_count : new_count;
+
+    if (server && new_count < old_count)
+        deleteInstanceObjects(server, model, new_count, old_count);
+    for (size_t i = keep; i < old_count; i++) {
+        for (size_t f = 0; f < desc->param_count; f++)
+            UA_NodeId_clear(&model->param_bindings[i * desc->param_count + f].nodeId);
+        for (size_t f = 0; f < desc->state_count; f++)
+            UA_NodeId_clear(&model->state_bindings[i * desc->state_count + f].nodeId);
+    }
+
+    // A shard may hold no instance of a small model
+    void *instances = realloc(model->instances, new_count * desc->instance_size + 1);
+    if (!instances)
+        return false;
+    model->instances = instances;
+    model->count = new_count;
+    for (size_t i = old_count; i < new_count; i++) {
+        memset(instanceAt(model, i), 0, desc->instance_size);
+        desc->init(instanceAt(model, i), (uint32_t)(model->first + i));
+    }
+
+    uint64_t *profile_ns = realloc(model->profile_ns, (new_count + 1) * sizeof(uint64_t));
+    if (!profile_ns)
+        return false;
+    model->profile_ns = profile_ns;
+    memset(profile_ns, 0, new_count * sizeof(uint64_t));    // Profile restarts
+    model->profile_samples = 0;
+
+    FieldBinding *params = rebindFields(model, model->param_bindings, keep,
+                                        desc->params, desc->param_count);
+    FieldBinding *state = rebindFields(model, model->state_bindings, keep,
+                                       desc->state, desc->state_count);
+    if (!params || !state) {
+        free(params);
+        free(state);
+        return false;
+    }
+    free(model->param_bindings);
+    free(model->state_bindings);
+    model->param_bindings = params;
+    model->state_bindings = state;
+
+    if (server) {
+        // Write callbacks of surviving nodes must see the new binding table
+        for (size_t i = 0; i < keep * desc->param_count; i++)
+            UA_Server_setNodeContext(server, params[i].nodeId, &params[i]);
+        addInstanceObjects(server, model, keep);
+    }
+    return true;
+}
+
+// Load a plugin with `count` instances. Adds its nodes when server is set.
+static LoadedModel *Host_LoadModel(UA_Server *server, const char *path, size_t count) {
+    if (model_count >= MAX_MODELS) {
+        fprintf(stderr, "Too many models (max %d)\n", MAX_MODELS);
+        return NULL;
+    }
+
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "Failed to load %s: %s\n", path, dlerror());
+        return NULL;
+    }
+
+    SimModelEntryFn entry = (SimModelEntryFn)dlsym(library, SIM_MODEL_ENTRY_SYMBOL);
+    const SimModelDescriptor *desc = entry ? entry() : NULL;
+    if (!desc) {
+        fprintf(stderr, "%s: missing %s()\n", path, SIM_MODEL_ENTRY_SYMBOL);
+        dlclose(library);
+        return NULL;
+    }
+    if (desc->abi_version < SIM_MODEL_ABI_MIN_VERSION || desc->abi_version > SIM_MODEL_ABI_VERSION) {
+        fprintf(stderr, "%s: ABI version %u, host supports %u to %u\n",
+                path, desc->abi_version, SIM_MODEL_ABI_MIN_VERSION, SIM_MODEL_ABI_VERSION);
+        dlclose(library);
+        return NULL;
+    }
+    if (!desc->name || !desc->init || !desc->step_batch || desc->instance_size == 0 ||
+        !fieldTableValid(desc->params, desc->param_count, desc->instance_size) ||
+        !fieldTableValid(desc->state, desc->state_count, desc->instance_size)) {
+        fprintf(stderr, "%s: invalid model descriptor\n", path);
+        dlclose(library);
+        return NULL;
+    }
+    if (findModelByName(desc->name, strlen(desc->name))) {
+        fprintf(stderr, "%s: model %s is already loaded\n", path, desc->name);
+        dlclose(library);
+        return NULL;
+    }
+
+    LoadedModel *model = &models[model_count];
+    memset(model, 0, sizeof(LoadedModel));
+    model->desc = desc;
+    model->library = library;
+    snprintf(model->path, sizeof(model->path), "%s", path);
+    model->metrics_slot = SimMetrics_RegisterModel(desc->name);
+    // Fields past step_batch only exist from ABI 2 on
+    model->step_random = desc->abi_version >= 2 ? desc->step_batch_random : NULL;
+    model->name_hash = hashBytes(HASH_SEED, desc->name, strlen(desc->name));
+
+    if (!initTotals(model)) {
+        freeTotals(model);
+        dlclose(library);
+        return NULL;
+    }
+    if (server) {
+        addModelTypeFolder(server, model);
+        addTotalsObjects(server, model);
+    }
+    size_t local_count;
+    model->global_count = count;
+    shardRange(count, &model->first, &local_count);
+    if (!Host_ResizeModel(server, model, local_count)) {
+        if (server)
+            UA_Server_deleteNode(server, UA_NODEID_STRING(1, (char *)desc->name), true);
+        free(model->instances);
+        free(model->profile_ns);
+        freeTotals(model);
+        dlclose(library);
+        return NULL;
+    }
+    model_count++;
+
+    if (shard_count > 1)
+        printf("Loaded model %s (%zu of %zu instances, from %s_%zu) from %s\n",
+               desc->name, local_count, count, desc->name, model->first, path);
+    else
+        printf("Loaded model %s (%zu instances) from %s\n", desc->name, count, path);
+    return model;
+}
+
+static void Host_UnloadModel(UA_Server *server, LoadedModel *model) {
+    if (server) {
+        deleteInstanceObjects(server, model, 0, model->count);
+        UA_Server_deleteNode(server, UA_NODEID_STRING(1, (char *)model->desc->name), true);
+    }
+    for (size_t i = 0; i < model->count * model->desc->param_count; i++)
+        UA_NodeId_clear(&model->param_bindings[i].nodeId);
+    for (size_t i = 0; i < model->count * model->desc->state_count; i++)
+        UA_NodeId_clear(&model->state_bindings[i].nodeId);
+    free(model->param_bindings);
+    free(model->state_bindings);
+    free(model->instances);
+    free(model->profile_ns);
+    freeTotals(model);
+    dlclose(model->library);
+
+    // Binding tables live on the heap, so moving the slot is safe
+    size_t index = (size_t)(model - models);
+    memmove(&models[index], &models[index + 1], (model_count - index - 1) * sizeof(LoadedModel));
+    model_count--;
+}
+
+static void Host_UnloadAll(UA_Server *server) {
+    while (model_count > 0)
+        Host_UnloadModel(server, &models[model_count - 1]);
+}
+
+// Parse text into the field type and store it
+static bool setFieldFromText(FieldBinding *binding, const char *text) {
+    char *end;
+    switch (binding->field->type) {
+        case SIM_FIELD_DOUBLE:
+            *(double *)binding->value = strtod(text, &end);
+            return end != text;
+        case SIM_FIELD_INT32:
+            *(int32_t *)binding->value = (int32_t)strtol(text, &end, 10);
+            return end != text;
+        case SIM_FIELD_UINT32:
+            *(uint32_t *)binding->value = (uint32_t)strtoul(text, &end, 10);
+            return end != text;
+        case SIM_FIELD_BOOLEAN:
+            *(bool *)binding->value = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+            return true;
+    }
+    return false;
+}
+
+// Instances [first, last] of one model and a field name
+typedef struct {
+    LoadedModel *model;
+    size_t first;
+    size_t last;
+    const char *field;
+} InstanceRef;
+
+// "<Model>_<a>[..<b>].<Field>", a and b plant-wide; text is modified
+static bool parseInstanceRef(char *text, InstanceRef *ref) {
+    char *dot = strrchr(text, '.');
+    if (!dot)
+        return false;
+    *dot = '\0';
+    ref->field = dot + 1;
+
+    char *range = strstr(text, "..");
+    char *digits_end = range ? range : dot;
+    char *underscore = digits_end;
+    while (underscore > text && *underscore != '_')
+        underscore--;
+    if (underscore == text)
+        return false;
+
+    ref->model = findModelByName(text, (size_t)(underscore - text));
+    if (!ref->model)
+        return false;
+    char *end;
+    ref->first = strtoul(underscore + 1, &end, 10);
+    if (end != digits_end || end == underscore + 1)
+        return false;
+    ref->last = ref->first;
+    if (range) {
+        ref->last = strtoul(range + 2, &end, 10);
+        if (end != dot || end == range + 2 || ref->last < ref->first)
+            return false;
+    }
+    return ref->last < ref->model->global_count;
+}
+
+static int findField(const SimFieldDescriptor *fields, size_t count, const char *name) {
+    for (size_t f = 0; f < count; f++) {
+        if (strcmp(fields[f].name, name) == 0)
+            return (int)f;
+    }
+    return -1;
+}
+
+static bool holdsInstance(const LoadedModel *model, size_t index) {
+    return index >= model->first && index < model->first + model->count;
+}
+
+// "<Model>_<index>.<Param>" -> binding, or NULL. *remote is set when the
+// instance exists but another shard holds it.
+static FieldBinding *findParameterBinding(const char *key, bool *remote) {
+    char text[CONFIG_MAX_KEY];
+    InstanceRef ref;
+    snprintf(text, sizeof(text), "%s", key);
+    *remote = false;
+    if (!parseInstanceRef(text, &ref) || ref.first != ref.last)
+        return NULL;
+
+    const SimModelDescriptor *desc = ref.model->desc;
+    int f = findField(desc->params, desc->param_count, ref.field);
+    if (f < 0)
+        return NULL;
+    if (!holdsInstance(ref.model, ref.first)) {
+        *remote = true;
+        return NULL;
+    }
+    return &ref.model->param_bindings[(ref.first - ref.model->first) * desc->param_count + (size_t)f];
+}
+
+static bool configListsPlugin(const ConfigFile *cfg, const char *model_path) {
+    char path[MAX_PATH_LENGTH];
+    size_t count;
+    for (size_t e = 0; e < cfg->count; e++) {
+        if (strcmp(cfg->entries[e].key, "plugin") == 0 &&
+            parseModelSpec(cfg->entries[e].value, path, sizeof(path), &count) &&
+            strcmp(path, model_path) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Bring the running plant in line with cfg; previous is the configuration
+// currently applied (NULL at startup).
+static void Host_ApplyConfig(UA_Server *server, const ConfigFile *cfg, const ConfigFile *previous) {
+    char path[MAX_PATH_LENGTH];
+    size_t count;
+
+    // 1. Unload plugins dropped from the file (command-line ones stay)
+    for (size_t m = model_count; m-- > 0;) {
+        if (previous && configListsPlugin(previous, models[m].path) &&
+            !configListsPlugin(cfg, models[m].path)) {
+            if (shard_count > 1) {
+                fprintf(stderr, "Config: %s stays loaded while distributed\n", models[m].desc->name);
+                continue;
+            }
+            printf("Config: unloading %s\n", models[m].desc->name);
+            Host_UnloadModel(server, &models[m]);
+        }
+    }
+
+    // 2. Load new plugins, resize existing ones
+    for (size_t e = 0; e < cfg->count; e++) {
+        if (strcmp(cfg->entries[e].key, "plugin") != 0 ||
+            !parseModelSpec(cfg->entries[e].value, path, sizeof(path), &count))
+            continue;
+        LoadedModel *model = findModelByPath(path);
+        if (!model && previous && shard_count > 1) {
+            // The other shards would not load it, and the stream layout is fixed
+            fprintf(stderr, "Config: %s cannot be loaded while distributed, restart all shards\n", path);
+        } else if (!model) {
+            Host_LoadModel(server, path, count);
+        } else if (model->global_count != count && shard_count > 1) {
+            fprintf(stderr, "Config: %s cannot be resized while distributed\n", model->desc->name);
+        } else if (model->global_count != count) {
+            printf("Config: %s %zu -> %zu instances\n", model->desc->name, model->count, count);
+            if (Host_ResizeModel(server, model, count))
+                model->global_count = count;
+            else
+                fprintf(stderr, "Config: resizing %s failed\n", model->desc->name);
+        }
+    }
+
+    // 3. Changed parameter assignments
+    for (size_t e = 0; e < cfg->count; e++) {
+        const ConfigEntry *entry = &cfg->entries[e];
+        if (strcmp(entry->key, "plugin") == 0 || strcmp(entry->key, "link") == 0 ||
+            !ConfigFile_Changed(cfg, previous, entry->key) || ConfigFile_Get(cfg, entry->key) != entry->value)
+            continue;
+
+        bool remote;
+        FieldBinding *binding = findParameterBinding(entry->key, &remote);
+        if (remote)
+            continue;       // Another shard applies it
+        if (!binding || !setFieldFromText(binding, entry->value)) {
+            fprintf(stderr, "Config: cannot apply %s = %s\n", entry->key, entry->value);
+            continue;
+        }
+        printf("Config: %s = %s\n", entry->key, entry->value);
+        if (server) {
+            UA_Variant value;
+            UA_Variant_setScalar(&value, binding->value, fieldDataType(binding->field->type));
+            UA_Server_writeValue(server, binding->nodeId, value);
+        }
+    }
+}
+
+// --- Boundary streams ---
+
+static double fieldToDouble(const FieldBinding *binding) {
+    switch (binding->field->type) {
+        case SIM_FIELD_DOUBLE: return *(const double *)binding->value;
+        case SIM_FIELD_INT32: return *(const int32_t *)binding->value;
+        case SIM_FIELD_UINT32: return *(const uint32_t *)binding->value;
+        case SIM_FIELD_BOOLEAN: return *(const bool *)binding->value ? 1.0 : 0.0;
+    }
+    return 0.0;
+}
+
+static void fieldFromDouble(FieldBinding *binding, double value) {
+    switch (binding->field->type) {
+        case SIM_FIELD_DOUBLE: *(double *)binding->value = value; break;
+        case SIM_FIELD_INT32: *(int32_t *)binding->value = (int32_t)value; break;
+        case SIM_FIELD_UINT32: *(uint32_t *)binding->value = (uint32_t)value; break;
+        case SIM_FIELD_BOOLEAN: *(bool *)binding->value = value != 0.0; break;
+    }
+}
+
+// Make room for one more item in a growing array
+static bool reserveItem(void **items, size_t *capacity, size_t count, size_t item_size) {
+    if (count < *capacity)
+        return true;
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = realloc(*items, new_capacity * item_size);
+    if (!grown)
+        return false;
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static void Host_FreeStreams(void) {
+    free(local_streams);
+    local_streams = NULL;
+    local_stream_count = 0;
+    local_stream_capacity = 0;
+    for (uint32_t p = 0; p < SIM_SHARD_MAX; p++) {
+        free(shard_streams[p].sources);
+        free(shard_streams[p].targets);
+        memset(&shard_streams[p], 0, sizeof(ShardStreams));
+    }
+}
+
+// Hash of everything the two ends of a stream between shards must agree on
+static uint32_t streamLayout(const ConfigFile *cfg) {
+    uint64_t hash = hashBytes(HASH_SEED, &partition_size, sizeof(partition_size));
+    hash = hashBytes(hash, &shard_count, sizeof(shard_count));
+    for (size_t m = 0; m < model_count; m++) {
+        hash = hashBytes(hash, &models[m].name_hash, sizeof(uint64_t));
+        hash = hashBytes(hash, &models[m].global_count, sizeof(size_t));
+    }
+    for (size_t e = 0; cfg && e < cfg->count; e++) {
+        if (strcmp(cfg->entries[e].key, "link") == 0)
+            hash = hashBytes(hash, cfg->entries[e].value, strlen(cfg->entries[e].value) + 1);
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// True if both files list the same links in the same order
+static bool sameLinks(const ConfigFile *cfg, const ConfigFile *other) {
+    size_t i = 0, j = 0;
+    for (;;) {
+        while (cfg && i < cfg->count && strcmp(cfg->entries[i].key, "link") != 0)
+            i++;
+        while (other && j < other->count && strcmp(other->entries[j].key, "link") != 0)
+            j++;
+        bool cfg_done = !cfg || i >= cfg->count;
+        bool other_done = !other || j >= other->count;
+        if (cfg_done || other_done)
+            return cfg_done && other_done;
+        if (strcmp(cfg->entries[i++].value, other->entries[j++].value) != 0)
+            return false;
+    }
+}
+
+// "<Model>_<a>[..<b>].<State> -> <Model>_<c>[..<d>].<Param>": one stream per
+// instance pair. Keeps the ends held by this shard; streams crossing to
+// another shard are appended in link order, which every shard shares.
+static bool Host_AddLink(const char *value) {
+    char text[CONFIG_MAX_VALUE];
+    snprintf(text, sizeof(text), "%s", value);
+    char *arrow = strstr(text, "->");
+    if (!arrow)
+        return false;
+    *arrow = '\0';
+
+    InstanceRef from, to;
+    if (!parseInstanceRef(Config_Trim(text), &from) || !parseInstanceRef(Config_Trim(arrow + 2), &to) ||
+        from.last - from.first != to.last - to.first)
+        return false;
+    const SimModelDescriptor *from_desc = from.model->desc;
+    const SimModelDescriptor *to_desc = to.model->desc;
+    int state_field = findField(from_desc->state, from_desc->state_count, from.field);
+    int param_field = findField(to_desc->params, to_desc->param_count, to.field);
+    if (state_field < 0 || param_field < 0)
+        return false;
+
+    for (size_t k = 0; k <= from.last - from.first; k++) {
+        size_t src = from.first + k;
+        size_t dst = to.first + k;
+        uint32_t src_shard = shardOwner(from.model->global_count, src);
+        uint32_t dst_shard = shardOwner(to.model->global_count, dst);
+        const FieldBinding *source = src_shard != shard_index ? NULL :
+            &from.model->state_bindings[(src - from.model->first) * from_desc->state_count + (size_t)state_field];
+        FieldBinding *target = dst_shard != shard_index ? NULL :
+            &to.model->param_bindings[(dst - to.model->first) * to_desc->param_count + (size_t)param_field];
+
+        if (source && target) {
+            if (!reserveItem((void **)&local_streams, &local_stream_capacity, local_stream_count, sizeof(StreamCopy)))
+                return false;
+            local_streams[local_stream_count++] = (StreamCopy){source, target};
+        } else if (source) {
+            ShardStreams *streams = &shard_streams[dst_shard];
+            if (!reserveItem((void **)&streams->sources, &streams->source_capacity, streams->source_count,
+                             sizeof(FieldBinding *)))
+                return false;
+            streams->sources[streams->source_count++] = source;
+        } else if (target) {
+            ShardStreams *streams = &shard_streams[src_shard];
+            if (!reserveItem((void **)&streams->targets, &streams->target_capacity, streams->target_count,
+                             sizeof(FieldBinding *)))
+                return false;
+            streams->targets[streams->target_count++] = target;
+        }
+    }
+    return true;
+}
+
+// Rebuild the stream tables from the link entries of cfg (may be NULL).
+// Binding tables move on resize, so this follows every config change.
+static bool Host_BuildStreams(const ConfigFile *cfg) {
+    Host_FreeStreams();
+    for (size_t e = 0; cfg && e < cfg->count; e++) {
+        if (strcmp(cfg->entries[e].key, "link") == 0 && !Host_AddLink(cfg->entries[e].value))
+            fprintf(stderr, "Config: cannot link %s\n", cfg->entries[e].value);
+    }
+    if (shard_count == 1)
+        return true;
+
+    shard.layout = streamLayout(cfg);
+    size_t crossing = 0;
+    for (uint32_t p = 0; p < shard_count; p++) {
+        if (!SimShard_SetStreams(&shard, p, shard_streams[p].source_count, shard_streams[p].target_count))
+            return false;
+        crossing += shard_streams[p].source_count + shard_streams[p].target_count;
+    }
+    printf("Shard %u/%u: %zu local streams, %zu to or from other shards\n",
+           shard_index, shard_count, local_stream_count, crossing);
+    return true;
+}
+
+// Carry this cycle's stream sources into the parameters of the next cycle.
+// Returns false if stopped while waiting for other shards.
+static bool Host_ExchangeStreams(UA_Server *server) {
+    for (size_t i = 0; i < local_stream_count; i++)
+        fieldFromDouble(local_streams[i].target, fieldToDouble(local_streams[i].source));
+    if (shard_count == 1)
+        return true;
+
+    for (uint32_t p = 0; p < shard_count; p++) {
+        const ShardStreams *streams = &shard_streams[p];
+        for (size_t i = 0; i < streams->source_count; i++)
+            shard.peers[p].out[i] = fieldToDouble(streams->sources[i]);
+    }
+    if (!SimShard_Exchange(&shard, cycle_count, server, &running))
+        return false;
+    for (uint32_t p = 0; p < shard_count; p++) {
+        const ShardStreams *streams = &shard_streams[p];
+        for (size_t i = 0; i < streams->target_count; i++)
+            fieldFromDouble(streams->targets[i], shard.peers[p].in[i]);
+    }
+    return true;
+}
+
+// Random stream of one partition in one cycle; independent of the thread
+// and, through the plant-wide partition number, of the shard
+static uint64_t Host_RandomKey(const LoadedModel *model, size_t partition, uint64_t cycle) {
+    uint64_t global_partition = model->first / partition_size + partition;
+    uint64_t key = SimRandom_Mix(random_seed ^ model->name_hash);
+    key = SimRandom_Mix(key ^ (global_partition << 32));
+    return SimRandom_Mix(key ^ cycle);
+}
+
+static void Host_StepRange(LoadedModel *model, size_t begin, size_t end, uint32_t cycle_time_ms,
+                           SimRandom *random) {
+    if (model->step_random)
+        model->step_random(instanceAt(model, begin), end - begin, cycle_time_ms, random);
+    else
+        model->desc->step_batch(instanceAt(model, begin), end - begin, cycle_time_ms);
+}
+
+// Sum the total fields over one partition, in instance order
+static void Host_PartialTotals(LoadedModel *model, size_t partition, size_t begin, size_t end) {
+    double *partial = &model->partials[partition * model->total_count];
+    for (size_t t = 0; t < model->total_count; t++) {
+        size_t offset = model->desc->state[model->total_fields[t]].offset;
+        double sum = 0.0;
+        for (size_t i = begin; i < end; i++)
+            sum += *(const double *)((const char *)instanceAt(model, i) + offset);
+        partial[t] = sum;
+    }
+}
+
+// Executor job: step one partition and form its partial totals
+static void Host_StepPartition(void *context, size_t partition) {
+    StepJob *job = context;
+    LoadedModel *model = job->model;
+    size_t begin, end;
+    SimPartition_Range(model->count, partition_size, partition, &begin, &end);
+    SimRandom random = {Host_RandomKey(model, partition, job->cycle), 0};
+    Host_StepRange(model, begin, end, job->cycle_time_ms, &random);
+    Host_PartialTotals(model, partition, begin, end);
+}
+
+// Profiled variant: one instance at a time, same partitions and streams
+static void Host_StepPartitionProfiled(StepJob *job, size_t partition) {
+    LoadedModel *model = job->model;
+    size_t begin, end;
+    SimPartition_Range(model->count, partition_size, partition, &begin, &end);
+    SimRandom random = {Host_RandomKey(model, partition, job->cycle), 0};
+    uint64_t t0 = SimMetrics_Now();
+    for (size_t i = begin; i < end; i++) {
+        Host_StepRange(model, i, i + 1, job->cycle_time_ms, &random);
+        uint64_t t1 = SimMetrics_Now();
+        model->profile_ns[i] += t1 - t0;
+        t0 = t1;
+    }
+    Host_PartialTotals(model, partition, begin, end);
+}
+
+static bool Host_ReservePartials(LoadedModel *model, size_t partitions) {
+    if (partitions <= model->partial_capacity)
+        return true;
+    double *partials = realloc(model->partials, (partitions * model->total_count + 1) * sizeof(double));
+    if (!partials)
+        return false;
+    model->partials = partials;
+    model->partial_capacity = partitions;
+    return true;
+}
+
+// Fixed-order reduction: partition 0 first, whatever thread ran it
+static void Host_ReduceTotals(LoadedModel *model, size_t partitions) {
+    for (size_t t = 0; t < model->total_count; t++) {
+        double sum = 0.0;
+        for (size_t p = 0; p < partitions; p++)
+            sum += model->partials[p * model->total_count + t];
+        model->totals[t] = sum;
+    }
+}
+
+// Returns true if this was a profiled cycle
+static bool Host_Step(uint32_t cycle_time_ms) {
+    bool profile = profile_every && cycle_count % profile_every == 0;
+    StepJob job = {.cycle_time_ms = cycle_time_ms, .cycle = cycle_count};
+    cycle_count++;
+
+    for (size_t m = 0; m < model_count; m++) {
+        LoadedModel *model = &models[m];
+        size_t partitions = SimPartition_Count(model->count, partition_size);
+        if (!Host_ReservePartials(model, partitions))
+            continue;
+
+        job.model = model;
+        uint64_t step_start = SimMetrics_Now();
+        if (profile) {
+            for (size_t p = 0; p < partitions; p++)
+                Host_StepPartitionProfiled(&job, p);
+            model->profile_samples++;
+        } else {
+            SimExecutor_Run(&executor, Host_StepPartition, &job, partitions);
+        }
+        Host_ReduceTotals(model, partitions);
+        SimMetrics_RecordModelStep(model->metrics_slot, SimMetrics_Now() - step_start);
+    }
+    return profile;
+}
+
+// Hash of every instance and total of every model
+static uint64_t Host_StateHash(void) {
+    uint64_t hash = HASH_SEED;
+    for (size_t m = 0; m < model_count; m++) {
+        const LoadedModel *model = &models[m];
+        hash = hashBytes(hash, model->instances, model->count * model->desc->instance_size);
+        hash = hashBytes(hash, model->totals, model->total_count * sizeof(double));
+    }
+    return hash;
+}
+
+// Hash of all instance state that does not depend on how the plant is split
+// over shards: one hash per instance, keyed by its plant-wide number, summed
+static uint64_t Host_PlantHash(void) {
+    uint64_t sum = 0;
+    for (size_t m = 0; m < model_count; m++) {
+        const LoadedModel *model = &models[m];
+        for (size_t i = 0; i < model->count; i++) {
+            uint64_t hash = hashBytes(model->name_hash, instanceAt(model, i), model->desc->instance_size);
+            sum += SimRandom_Mix(hash ^ (model->first + i));
+        }
+    }
+    return sum;
+}
+
+// Register every model's local instances with the state hash log, keyed
+// by plant-wide instance number. Again after every reload: instance arrays
+// move when a model is resized.
+static void Host_SetHashSegments(void) {
+    SimHashLog_ClearSegments(&hash_log);
+    for (size_t m = 0; m < model_count; m++)
+        SimHashLog_SetSegment(&hash_log, models[m].desc->name, models[m].instances,
+                              models[m].desc->instance_size, models[m].count, models[m].first);
+}
+
+// Run `cycles` cycles from the current state once per thread count and
+// compare the state hash after every cycle with a 1-thread run. The state
+// and the executor are restored afterwards.
+static bool Host_VerifyDeterminism(const uint32_t *thread_counts, size_t run_count, uint32_t cycles) {
+    void *snapshots[MAX_MODELS] = {0};
+    uint64_t *reference = calloc(cycles, sizeof(uint64_t));
+    uint64_t start_cycle = cycle_count;
+    uint32_t saved_profile_every = profile_every;
+    size_t saved_threads = executor.thread_count;
+    bool ok = reference != NULL;
+
+    for (size_t m = 0; ok && m < model_count; m++) {
+        size_t size = models[m].count * models[m].desc->instance_size;
+        snapshots[m] = malloc(size + 1);
+        ok = snapshots[m] != NULL;
+        if (ok)
+            memcpy(snapshots[m], models[m].instances, size);
+    }
+
+    profile_every = 0;
+    printf("Determinism check: %u cycles, partitions of %zu instances, seed %llu\n",
+           cycles, partition_size, (unsigned long long)random_seed);
+    for (size_t r = 0; ok && r <= run_count; r++) {
+        // Run 0 is the 1-thread reference
+        uint32_t threads = r == 0 ? 1 : thread_counts[r - 1];
+        for (size_t m = 0; m < model_count; m++)
+            memcpy(models[m].instances, snapshots[m], models[m].count * models[m].desc->instance_size);
+        cycle_count = start_cycle;
+        SimExecutor_Stop(&executor);
+        if (!SimExecutor_Start(&executor, threads)) {
+            ok = false;
+            break;
+        }
+
+        uint32_t mismatch = 0;
+        bool matched = true;
+        for (uint32_t c = 0; c < cycles && running; c++) {
+            // Streams carry state between instances exactly as in the main loop
+            Host_Step(DEFAULT_CYCLE_TIME_MS);
+            if (!Host_ExchangeStreams(NULL)) {
+                ok = false;
+                break;
+            }
+            uint64_t hash = Host_StateHash();
+            if (r == 0) {
+                reference[c] = hash;
+            } else if (matched && hash != reference[c]) {
+                matched = false;
+                mismatch = c;
+            }
+        }
+        if (!ok)
+            break;
+        if (r == 0)
+            printf("  1 thread : final hash %016llx\n", (unsigned long long)reference[cycles - 1]);
+        else if (matched)
+            printf("%3u threads: identical for %u cycles\n", threads, cycles);
+        else
+            printf("%3u threads: first mismatch at cycle %u\n", threads, mismatch);
+        ok = ok && matched;
+    }
+
+    for (size_t m = 0; m < model_count; m++) {
+        if (snapshots[m])
+            memcpy(models[m].instances, snapshots[m], models[m].count * models[m].desc->instance_size);
+        free(snapshots[m]);
+    }
+    free(reference);
+    cycle_count = start_cycle;
+    profile_every = saved_profile_every;
+    SimExecutor_Stop(&executor);
+    return SimExecutor_Start(&executor, saved_threads) && ok;
+}
+
+// Mean sampled step time of the k most expensive instances, descending
+static size_t Host_ProfileTopK(ProfileEntry *top, size_t k) {
+    size_t used = 0;
+    for (size_t m = 0; m < model_count; m++) {
+        const LoadedModel *model = &models[m];
+        if (model->profile_samples == 0)
+            continue;
+        for (size_t i = 0; i < model->count; i++) {
+            double mean_ns = (double)model->profile_ns[i] / model->profile_samples;
+            if (used == k && mean_ns <= top[k - 1].mean_ns)
+                continue;
+            size_t pos = used < k ? used++ : k - 1;
+            while (pos > 0 && top[pos - 1].mean_ns < mean_ns) {
+                top[pos] = top[pos - 1];
+                pos--;
+            }
+            top[pos] = (ProfileEntry){model, i, mean_ns};
+        }
+    }
+    return used;
+}
+
+static double Host_ModelMeanNs(const LoadedModel *model) {
+    if (model->profile_samples == 0)
+        return 0.0;
+    uint64_t total = 0;
+    for (size_t i = 0; i < model->count; i++)
+        total += model->profile_ns[i];
+    return (double)total / model->profile_samples;
+}
+
+static void Host_PrintProfile(void) {
+    ProfileEntry top[MAX_PROFILE_TOP_K];
+    size_t used = Host_ProfileTopK(top, profile_top_k);
+
+    printf("=== Step time profile (every %u cycles) ===\n", profile_every);
+    for (size_t m = 0; m < model_count; m++) {
+        double total_ns = Host_ModelMeanNs(&models[m]);
+        printf("%-16s %8zu instances %12.1f us/cycle %10.1f ns/instance\n",
+               models[m].desc->name, models[m].count, total_ns / 1000.0,
+               models[m].count ? total_ns / models[m].count : 0.0);
+    }
+    for (size_t i = 0; i < used; i++)
+        printf("%3zu. %s_%zu %10.1f ns\n", i + 1, top[i].model->desc->name,
+               top[i].model->first + top[i].index, top[i].mean_ns);
+}
+
+static void addDiagnosticsVariable(UA_Server *server, const char *name, const UA_DataType *type,
+                                   bool writable, void *value) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)name);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    if (writable)
+        attr.accessLevel |= UA_ACCESSLEVELMASK_WRITE;
+    attr.dataType = type->typeId;
+    if (value) {
+        attr.valueRank = UA_VALUERANK_SCALAR;
+        UA_Variant_setScalar(&attr.value, value, type);
+    } else {
+        attr.valueRank = UA_VALUERANK_ONE_DIMENSION;
+    }
+    UA_Server_addVariableNode(server, UA_NODEID_STRING(1, (char *)name),
+                              UA_NODEID_STRING(1, "Diagnostics"),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                              UA_QUALIFIEDNAME(1, (char *)name),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                              attr, NULL, NULL);
+}
+
+static void onProfileEveryWritten(UA_Server *server,
+                                  const UA_NodeId *sessionId, void *sessionContext,
+                                  const UA_NodeId *nodeId, void *nodeContext,
+                                  const UA_NumericRange *range,
+                                  const UA_DataValue *data) {
+    if (data && data->hasValue && UA_Variant_hasScalarType(&data->value, &UA_TYPES[UA_TYPES_UINT32]))
+        profile_every = *(UA_UInt32 *)data->value.data;
+}
+
+static void addDiagnosticsObject(UA_Server *server) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", "Diagnostics");
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Diagnostics"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, "Diagnostics"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            attr, NULL, NULL);
+
+    addDiagnosticsVariable(server, "ProfileEveryN", &UA_TYPES[UA_TYPES_UINT32], true, &profile_every);
+    UA_ValueCallback callback = {.onRead = NULL, .onWrite = onProfileEveryWritten};
+    UA_Server_setVariableNode_valueCallback(server, UA_NODEID_STRING(1, "ProfileEveryN"), callback);
+
+    addDiagnosticsVariable(server, "ModelNames", &UA_TYPES[UA_TYPES_STRING], false, NULL);
+    addDiagnosticsVariable(server, "ModelStepTimeUs", &UA_TYPES[UA_TYPES_DOUBLE], false, NULL);
+    addDiagnosticsVariable(server, "TopInstances", &UA_TYPES[UA_TYPES_STRING], false, NULL);
+    addDiagnosticsVariable(server, "TopInstanceStepTimeNs", &UA_TYPES[UA_TYPES_DOUBLE], false, NULL);
+}
+
+static void writeStringArray(UA_Server *server, const char *nodeIdStr, UA_String *strings, size_t count) {
+    UA_Variant value;
+    UA_Variant_setArray(&value, strings, count, &UA_TYPES[UA_TYPES_STRING]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, (char *)nodeIdStr), value);
+    for (size_t i = 0; i < count; i++)
+        UA_String_clear(&strings[i]);
+}
+
+static void Host_PublishProfile(UA_Server *server) {
+    ProfileEntry top[MAX_PROFILE_TOP_K];
+    UA_String names[MAX_PROFILE_TOP_K > MAX_MODELS ? MAX_PROFILE_TOP_K : MAX_MODELS];
+    double times[MAX_PROFILE_TOP_K > MAX_MODELS ? MAX_PROFILE_TOP_K : MAX_MODELS];
+    char name[MAX_NODE_ID_LENGTH];
+    UA_Variant value;
+
+    for (size_t m = 0; m < model_count; m++) {
+        names[m] = UA_STRING_ALLOC(models[m].desc->name);
+        times[m] = Host_ModelMeanNs(&models[m]) / 1000.0;
+    }
+    UA_Variant_setArray(&value, times, model_count, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "ModelStepTimeUs"), value);
+    writeStringArray(server, "ModelNames", names, model_count);
+
+    size_t used = Host_ProfileTopK(top, profile_top_k);
+    for (size_t i = 0; i < used; i++) {
+        snprintf(name, sizeof(name), "%s_%zu", top[i].model->desc->name, top[i].model->first + top[i].index);
+        names[i] = UA_STRING_ALLOC(name);
+        times[i] = top[i].mean_ns;
+    }
+    UA_Variant_setArray(&value, times, used, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, "TopInstanceStepTimeNs"), value);
+    writeStringArray(server, "TopInstances", names, used);
+}
+
+static void Host_PublishState(UA_Server *server) {
+    UA_Variant value;
+    for (size_t m = 0; m < model_count; m++) {
+        const LoadedModel *model = &models[m];
+        size_t binding_count = model->count * model->desc->state_count;
+        for (size_t i = 0; i < binding_count; i++) {
+            FieldBinding *binding = &model->state_bindings[i];
+            UA_Variant_setScalar(&value, binding->value, fieldDataType(binding->field->type));
+            UA_Server_writeValue(server, binding->nodeId, value);
+        }
+        for (size_t t = 0; t < model->total_count; t++) {
+            UA_Variant_setScalar(&value, &model->totals[t], &UA_TYPES[UA_TYPES_DOUBLE]);
+            UA_Server_writeValue(server, model->total_nodes[t], value);
+        }
+    }
+}
+
+// Comma-separated list of positive integers
+static size_t parseCountList(const char *text, uint32_t *out, size_t max) {
+    size_t count = 0;
+    char *end;
+    while (*text && count < max) {
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || value == 0)
+            break;
+        out[count++] = (uint32_t)value;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+typedef struct {
+    const char *config_path;
+    uint32_t thread_count;
+    uint32_t verify_threads[MAX_VERIFY_RUNS];
+    size_t verify_run_count;
+    uint32_t verify_cycles;
+    const char *peers;
+    uint32_t bench_processes[MAX_BENCH_RUNS];
+    size_t bench_run_count;
+    uint32_t bench_cycles;
+    const char *model_specs[MAX_MODELS];
+    size_t model_spec_count;
+} HostOptions;
+
+static bool parseHostOptions(int argc, char **argv, HostOptions *options) {
+    memset(options, 0, sizeof(*options));
+    options->thread_count = 1;
+    options->verify_cycles = DEFAULT_VERIFY_CYCLES;
+    options->bench_cycles = DEFAULT_BENCH_CYCLES;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            options->config_path = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_every = (uint32_t)strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            profile_top_k = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (profile_top_k < 1 || profile_top_k > MAX_PROFILE_TOP_K)
+                profile_top_k = 10;
+            continue;
+        }
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options->thread_count = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (options->thread_count < 1)
+                options->thread_count = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--partition") == 0 && i + 1 < argc) {
+            partition_size = strtoul(argv[++i], NULL, 10);
+            if (partition_size < 1)
+                partition_size = DEFAULT_PARTITION_SIZE;
+            continue;
+        }
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            random_seed = strtoull(argv[++i], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[i], "--verify-threads") == 0 && i + 1 < argc) {
+            options->verify_run_count = parseCountList(argv[++i], options->verify_threads, MAX_VERIFY_RUNS);
+            continue;
+        }
+        if (strcmp(argv[i], "--verify-cycles") == 0 && i + 1 < argc) {
+            options->verify_cycles = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (options->verify_cycles < 1)
+                options->verify_cycles = DEFAULT_VERIFY_CYCLES;
+            continue;
+        }
+        if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%u/%u", &shard_index, &shard_count) != 2 ||
+                shard_count < 1 || shard_count > SIM_SHARD_MAX || shard_index >= shard_count) {
+                fprintf(stderr, "--shard: expected k/N with k < N <= %d\n", SIM_SHARD_MAX);
+                return false;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--peers") == 0 && i + 1 < argc) {
+            options->peers = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--bench-distributed") == 0 && i + 1 < argc) {
+            options->bench_run_count = parseCountList(argv[++i], options->bench_processes, MAX_BENCH_RUNS);
+            continue;
+        }
+        if (strcmp(argv[i], "--bench-cycles") == 0 && i + 1 < argc) {
+            options->bench_cycles = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (options->bench_cycles < 1)
+                options->bench_cycles = DEFAULT_BENCH_CYCLES;
+            continue;
+        }
+        if (options->model_spec_count >= MAX_MODELS) {
+            fprintf(stderr, "Too many models (max %d)\n", MAX_MODELS);
+            return false;
+        }
+        options->model_specs[options->model_spec_count++] = argv[i];
+    }
+
+    if (shard_count > 1 && !options->peers) {
+        fprintf(stderr, "--shard needs --peers with one host:port per shard\n");
+        return false;
+    }
+    return true;
+}
+
+// Load the plugins given on the command line, then the config file (if
+// any) into *config, and build the streams. Unloads everything on failure.
+static bool Host_LoadPlant(UA_Server *server, const HostOptions *options, ConfigFile *config,
+                           ConfigFile **active) {
+    *active = NULL;
+    for (size_t i = 0; i < options->model_spec_count; i++) {
+        char path[MAX_PATH_LENGTH];
+        size_t count;
+        if (!parseModelSpec(options->model_specs[i], path, sizeof(path), &count) ||
+            !Host_LoadModel(server, path, count)) {
+            Host_UnloadAll(server);
+            return false;
+        }
+    }
+
+    if (options->config_path) {
+        if (!ConfigFile_Load(options->config_path, config)) {
+            fprintf(stderr, "Cannot read %s\n", options->config_path);
+            Host_UnloadAll(server);
+            return false;
+        }
+        *active = config;
+        Host_ApplyConfig(server, config, NULL);
+    }
+    if (!Host_BuildStreams(*active)) {
+        Host_FreeStreams();
+        Host_UnloadAll(server);
+        return false;
+    }
+    return true;
+}
+
+// One shard of --bench-distributed, in a child process
+static bool Host_BenchShard(const HostOptions *options, ShardBenchResult *result) {
+    static ConfigFile config;
+    ConfigFile *active;
+    char peers[SIM_SHARD_MAX * 24];
+    size_t used = 0;
+    for (uint32_t k = 0; k < shard_count; k++)
+        used += (size_t)snprintf(peers + used, sizeof(peers) - used, "%s127.0.0.1:%d",
+                                 k ? "," : "", BENCH_SHARD_PORT + (int)k);
+
+    if (shard_count > 1 && !SimShard_Open(&shard, shard_index, peers))
+        return false;
+    if (!Host_LoadPlant(NULL, options, &config, &active))
+        return false;
+    if (!SimExecutor_Start(&executor, options->thread_count))
+        return false;
+
+    // Cycle 0 also serves as the start barrier
+    Host_Step(DEFAULT_CYCLE_TIME_MS);
+    bool ok = Host_ExchangeStreams(NULL);
+    shard.wait_ns = 0;
+    shard.retransmits = 0;
+
+    uint64_t start = SimMetrics_Now();
+    for (uint32_t c = 0; ok && c < options->bench_cycles; c++) {
+        Host_Step(DEFAULT_CYCLE_TIME_MS);
+        ok = Host_ExchangeStreams(NULL);
+    }
+    result->elapsed_ns = SimMetrics_Now() - start;
+    if (ok && shard_count > 1)
+        SimShard_Finish(&shard, cycle_count);
+    result->wait_ns = shard.wait_ns;
+    result->retransmits = shard.retransmits;
+    result->plant_hash = Host_PlantHash();
+    for (size_t m = 0; m < model_count; m++)
+        result->instances += models[m].count;
+    result->streams = local_stream_count;
+    for (uint32_t p = 0; p < shard_count; p++)
+        result->streams += shard_streams[p].target_count;
+    return ok;
+}
+
+// Fork N shards on the loopback interface per entry of bench_processes and
+// compare cycle rate and plant hash with the first entry
+static bool Host_BenchDistributed(const HostOptions *options) {
+    double base_rate = 0.0;
+    uint32_t base_processes = 0;
+    uint64_t base_hash = 0;
+    bool identical = true;
+
+    printf("Distributed benchmark: %u cycles per run, %u thread(s) per process, partitions of %zu\n",
+           options->bench_cycles, options->thread_count, partition_size);
+    for (size_t r = 0; r < options->bench_run_count; r++) {
+        uint32_t processes = options->bench_processes[r];
+        pid_t pids[SIM_SHARD_MAX];
+        int pipes[SIM_SHARD_MAX];
+        uint32_t started = 0;
+        if (processes > SIM_SHARD_MAX) {
+            fprintf(stderr, "At most %d processes\n", SIM_SHARD_MAX);
+            return false;
+        }
+
+        fflush(stdout);
+        for (; started < processes; started++) {
+            int fds[2];
+            if (pipe(fds) < 0)
+                break;
+            pid_t pid = fork();
+            if (pid == 0) {
+                ShardBenchResult result = {0};
+                close(fds[0]);
+                shard_index = started;
+                shard_count = processes;
+                // Children only report; the parent prints the table
+                if (!freopen("/dev/null", "w", stdout))
+                    fprintf(stderr, "Cannot silence shard output\n");
+                result.ok = Host_BenchShard(options, &result);
+                if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+                    result.ok = false;
+                _exit(result.ok ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            close(fds[1]);
+            if (pid < 0) {
+                close(fds[0]);
+                break;
+            }
+            pids[started] = pid;
+            pipes[started] = fds[0];
+        }
+
+        // A failed shard would leave its neighbours waiting: stop them all
+        bool failed = started < processes;
+        for (uint32_t done = 0; done < started; done++) {
+            int status;
+            pid_t pid = wait(&status);
+            if (pid > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) && !failed) {
+                failed = true;
+                for (uint32_t k = 0; k < started; k++)
+                    kill(pids[k], SIGTERM);
+            }
+        }
+
+        ShardBenchResult total = {.ok = !failed};
+        for (uint32_t k = 0; k < started; k++) {
+            ShardBenchResult result = {0};
+            if (read(pipes[k], &result, sizeof(result)) != sizeof(result))
+                total.ok = false;
+            close(pipes[k]);
+            if (result.elapsed_ns > total.elapsed_ns)
+                total.elapsed_ns = result.elapsed_ns;
+            total.wait_ns += result.wait_ns;
+            total.retransmits += result.retransmits;
+            total.plant_hash += result.plant_hash;
+            total.instances += result.instances;
+            total.streams += result.streams;
+        }
+        if (!total.ok) {
+            printf("%3u processes: failed\n", processes);
+            return false;
+        }
+
+        double seconds = total.elapsed_ns / 1e9;
+        double rate = seconds > 0.0 ? options->bench_cycles / seconds : 0.0;
+        if (r == 0) {
+            base_rate = rate;
+            base_processes = processes;
+            base_hash = total.plant_hash;
+        }
+        double speedup = base_rate > 0.0 ? rate / base_rate : 0.0;
+        double waiting = 100.0 * total.wait_ns / ((double)total.elapsed_ns * processes);
+        printf("%3u processes: %llu instances, %llu streams, %9.1f cycles/s, speedup %5.2f, "
+               "efficiency %4.0f%%, waiting %4.1f%%, retransmits %llu, hash %016llx%s\n",
+               processes, (unsigned long long)total.instances, (unsigned long long)total.streams,
+               rate, speedup, 100.0 * speedup * base_processes / processes, waiting,
+               (unsigned long long)total.retransmits, (unsigned long long)total.plant_hash,
+               total.plant_hash == base_hash ? "" : "  DIFFERS");
+        identical = identical && total.plant_hash == base_hash;
+    }
+    return identical;
+}
+
+int main(int argc, char **argv) {
+    static ConfigFile config_files[2];
+    ConfigFile *active_config = NULL;
+    ConfigWatch config_watch = {.fd = -1};
+    HostOptions options;
+
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+    signal(SIGUSR1, reportHandler);
+
+    if (!parseHostOptions(argc, argv, &options))
+        return EXIT_FAILURE;
+    if (options.model_spec_count == 0 && !options.config_path) {
+        fprintf(stderr, "Usage: %s [--config <file>] [--profile <N>] [--top <K>] [--threads <T>] "
+                        "[--partition <N>] [--seed <S>] [--verify-threads <T,..>] [--verify-cycles <C>] "
+                        "[--shard <k>/<N> --peers <host:port,..>] [--bench-distributed <N,..>] "
+                        "[--bench-cycles <C>] [<plugin.so>[:instances] ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.bench_run_count > 0)
+        return Host_BenchDistributed(&options) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    // One hash log per shard; blocks default to whole partitions
+    char hash_suffix[16] = "";
+    if (shard_count > 1)
+        snprintf(hash_suffix, sizeof(hash_suffix), ".%u", shard_index);
+    if (!SimHashLog_OpenFromEnv(&hash_log, hash_suffix, (uint32_t)partition_size))
+        return EXIT_FAILURE;
+
+    if (shard_count > 1) {
+        if (!SimShard_Open(&shard, shard_index, options.peers))
+            return EXIT_FAILURE;
+        if (shard.count != shard_count) {
+            fprintf(stderr, "--peers lists %u shards, --shard says %u\n", shard.count, shard_count);
+            SimShard_Close(&shard);
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint16_t port = (uint16_t)(OPCUA_PORT + shard_index);
+    server = UA_Server_new();
+    if (SimSecurity_ConfigureFromEnv(UA_Server_getConfig(server), port) != UA_STATUSCODE_GOOD ||
+        !Host_LoadPlant(server, &options, &config_files[0], &active_config)) {
+        UA_Server_delete(server);
+        SimShard_Close(&shard);
+        return EXIT_FAILURE;
+    }
+    if (model_count == 0) {
+        fprintf(stderr, "No models loaded\n");
+        UA_Server_delete(server);
+        SimShard_Close(&shard);
+        return EXIT_FAILURE;
+    }
+    if (options.config_path && !ConfigWatch_Open(&config_watch, options.config_path))
+        fprintf(stderr, "Hot reload unavailable for %s\n", options.config_path);
+
+    if (!SimExecutor_Start(&executor, options.thread_count)) {
+        Host_FreeStreams();
+        Host_UnloadAll(server);
+        UA_Server_delete(server);
+        SimShard_Close(&shard);
+        return EXIT_FAILURE;
+    }
+
+    if (options.verify_run_count > 0) {
+        // Every run restarts at the same cycle number, which the shard
+        // exchange would take for retransmits of the previous run
+        bool identical = shard_count == 1;
+        if (!identical)
+            fprintf(stderr, "--verify-threads checks one process; run it without --shard\n");
+        else
+            identical = Host_VerifyDeterminism(options.verify_threads, options.verify_run_count,
+                                               options.verify_cycles);
+        SimExecutor_Stop(&executor);
+        Host_FreeStreams();
+        Host_UnloadAll(server);
+        UA_Server_delete(server);
+        SimShard_Close(&shard);
+        ConfigWatch_Close(&config_watch);
+        return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    addDiagnosticsObject(server);
+    Host_SetHashSegments();
+
+    if (shard_count > 1)
+        printf("OPC UA Model Host shard %u/%u running at opc.tcp://localhost:%u\n",
+               shard_index, shard_count, (unsigned)port);
+    else
+        printf("OPC UA Model Host running at opc.tcp://localhost:%u\n", (unsigned)port);
+    SimMetrics_StartFromEnv(server);
+
+    UA_StatusCode status = UA_Server_run_startup(server);
+    if (status != UA_STATUSCODE_GOOD) {
+        SimExecutor_Stop(&executor);
+        Host_FreeStreams();
+        Host_UnloadAll(server);
+        UA_Server_delete(server);
+        SimShard_Close(&shard);
+        return EXIT_FAILURE;
+    }
+
+    if (!SimLoop_Open(&loop, server, DEFAULT_CYCLE_TIME_MS))
+        running = false;
+    SimLoop_AddFd(&loop, config_watch.fd, ConfigWatch_OnReadable, &config_watch);
+
+    while (running) {
+        if (SimLoop_WaitTick(&loop) == 0)
+            continue;
+        uint64_t cycle_start = SimMetrics_Now();
+        bool profiled = Host_Step(DEFAULT_CYCLE_TIME_MS);
+        if (!Host_ExchangeStreams(server))
+            break;
+        SimHashLog_Record(&hash_log, cycle_count);
+        Host_PublishState(server);
+        if (profiled)
+            Host_PublishProfile(server);
+        SimMetrics_RecordServer(server);
+        SimMetrics_RecordCycle(SimMetrics_Now() - cycle_start, DEFAULT_CYCLE_TIME_MS);
+
+        if (report_requested) {
+            report_requested = 0;
+            Host_PrintProfile();
+        }
+
+        // Hot reload at the cycle boundary
+        if (config_watch.pending) {
+            config_watch.pending = false;
+            ConfigFile *next = active_config == &config_files[0] ? &config_files[1] : &config_files[0];
+            if (ConfigFile_Load(options.config_path, next)) {
+                Host_ApplyConfig(server, next, active_config);
+                Host_SetHashSegments();
+                if (shard_count == 1)
+                    Host_BuildStreams(next);
+                else if (!sameLinks(next, active_config))
+                    fprintf(stderr, "Config: links are fixed while distributed, restart all shards\n");
+                active_config = next;
+            }
+        }
+    }
+
+    if (shard_count > 1) {
+        SimShard_Finish(&shard, cycle_count);
+        printf("Shard %u/%u: %llu exchanges, %llu retransmits, %.1f ms waiting\n", shard_index, shard_count,
+               (unsigned long long)shard.exchanges, (unsigned long long)shard.retransmits, shard.wait_ns / 1e6);
+    }
+    SimLoop_Close(&loop);
+    UA_Server_run_shutdown(server);
+    SimMetrics_Stop();
+    if (profile_every)
+        Host_PrintProfile();
+    SimExecutor_Stop(&executor);
+    Host_FreeStreams();
+    Host_UnloadAll(server);
+    UA_Server_delete(server);
+    SimShard_Close(&shard);
+    ConfigWatch_Close(&config_watch);
+    SimHashLog_Close(&hash_log);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,118 @@
+// Centrifugal pump equipment model for model_host_opcua.
+// Build: gcc -shared -fPIC -o pump_model.so pump_model_plugin.c -lm
+#include "sim_model_plugin.h"
+#include <math.h>
+#include <string.h>
+
+#define GRAVITY 9.81
+#define PI 3.14159265358979323846
+
+typedef struct {
+    struct {
+        double speed_setpoint;   // % of rated speed
+        double rated_flow;       // m³/s at rated speed and head
+        double shutoff_head;     // m at rated speed and zero flow
+        double static_head;      // m, system static head
+        double efficiency;       // 0..1
+        double density;          // kg/m³
+        double speed_tau;        // s, motor speed time constant
+        double flow_noise;       // Relative std-dev of flow turbulence, 0 = off
+    } config;
+
+    struct {
+        double speed;            // % of rated speed
+        double flow;             // m³/s
+        double head;             // m
+        double power;            // W
+        bool running;
+    } state;
+} Pump;
+
+static void Pump_Init(void *instance, uint32_t index) {
+    Pump *pump = instance;
+    memset(pump, 0, sizeof(Pump));
+    pump->config.speed_setpoint = 0.0;
+    pump->config.rated_flow = 0.05;
+    pump->config.shutoff_head = 80.0;
+    pump->config.static_head = 20.0;
+    pump->config.efficiency = 0.7;
+    pump->config.density = 1000.0;
+    pump->config.speed_tau = 2.0;
+}
+
+// Standard normal draw (Box-Muller, one value per call)
+static double Pump_Normal(SimRandom *random) {
+    double u1 = 1.0 - SimRandom_Uniform(random);   // (0, 1]
+    double u2 = SimRandom_Uniform(random);
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * PI * u2);
+}
+
+static void Pump_StepBatchRandom(void *instances, size_t count, uint32_t cycle_time_ms,
+                                 SimRandom *random) {
+    Pump *pumps = instances;
+    double dt = cycle_time_ms / 1000.0;
+
+    for (size_t i = 0; i < count; i++) {
+        Pump *p = &pumps[i];
+
+        // Motor speed follows the setpoint with a first-order lag
+        double setpoint = fmin(fmax(p->config.speed_setpoint, 0.0), 100.0);
+        double alpha = dt / (p->config.speed_tau + dt);
+        p->state.speed += alpha * (setpoint - p->state.speed);
+
+        // Pump curve H = H0 n² - Kp Q² (affinity laws) against the system
+        // curve H = Hs + Ks Q², sized so both meet at rated flow and H0/2
+        double n = p->state.speed / 100.0;
+        double h0 = p->config.shutoff_head * n * n;
+        double k_pump = 0.5 * p->config.shutoff_head / (p->config.rated_flow * p->config.rated_flow);
+        double k_sys = fmax(0.5 * p->config.shutoff_head - p->config.static_head, 0.0) /
+                       (p->config.rated_flow * p->config.rated_flow);
+
+        double q2 = (h0 - p->config.static_head) / (k_pump + k_sys);
+        p->state.flow = q2 > 0.0 ? sqrt(q2) : 0.0;
+        if (random && p->config.flow_noise > 0.0)
+            p->state.flow = fmax(p->state.flow * (1.0 + p->config.flow_noise * Pump_Normal(random)), 0.0);
+        p->state.head = fmax(h0 - k_pump * p->state.flow * p->state.flow, 0.0);
+        p->state.power = p->config.density * GRAVITY * p->state.flow * p->state.head /
+                         fmax(p->config.efficiency, 0.05);
+        p->state.running = p->state.speed > 1.0;
+    }
+}
+
+static void Pump_StepBatch(void *instances, size_t count, uint32_t cycle_time_ms) {
+    Pump_StepBatchRandom(instances, count, cycle_time_ms, NULL);
+}
+
+static const SimFieldDescriptor pump_params[] = {
+    SIM_FIELD("SpeedSetpoint", "Speed Setpoint (%)", SIM_FIELD_DOUBLE, Pump, config.speed_setpoint),
+    SIM_FIELD("RatedFlow", "Rated Flow (m3/s)", SIM_FIELD_DOUBLE, Pump, config.rated_flow),
+    SIM_FIELD("ShutoffHead", "Shutoff Head (m)", SIM_FIELD_DOUBLE, Pump, config.shutoff_head),
+    SIM_FIELD("StaticHead", "Static Head (m)", SIM_FIELD_DOUBLE, Pump, config.static_head),
+    SIM_FIELD("Efficiency", "Efficiency", SIM_FIELD_DOUBLE, Pump, config.efficiency),
+    SIM_FIELD("FlowNoise", "Flow Noise (std-dev, fraction)", SIM_FIELD_DOUBLE, Pump, config.flow_noise),
+};
+
+static const SimFieldDescriptor pump_state[] = {
+    SIM_FIELD("Speed", "Speed (%)", SIM_FIELD_DOUBLE, Pump, state.speed),
+    SIM_FIELD("Flow", "Flow (m3/s)", SIM_FIELD_DOUBLE, Pump, state.flow),
+    SIM_FIELD("Head", "Head (m)", SIM_FIELD_DOUBLE, Pump, state.head),
+    SIM_FIELD("Power", "Power (W)", SIM_FIELD_DOUBLE, Pump, state.power),
+    SIM_FIELD("Running", "Running", SIM_FIELD_BOOLEAN, Pump, state.running),
+};
+
+static const SimModelDescriptor pump_descriptor = {
+    .abi_version = SIM_MODEL_ABI_VERSION,
+    .name = "Pump",
+    .instance_size = sizeof(Pump),
+    .params = pump_params,
+    .param_count = SIM_FIELD_COUNT(pump_params),
+    .state = pump_state,
+    .state_count = SIM_FIELD_COUNT(pump_state),
+    .init = Pump_Init,
+    .step_batch = Pump_StepBatch,
+    .step_batch_random = Pump_StepBatchRandom,
+};
+
+const SimModelDescriptor *sim_model_descriptor(void) {
+    return &pump_descriptor;
+}
@@ -7,16 +7,348 @@
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include "sim_config.h"
+#include "sim_dense.h"
+#include "sim_executor.h"
+#include "sim_golden.h"
+#include "sim_hash.h"
+#include "sim_loop.h"
+#include "sim_metrics.h"
+#include "sim_security.h"
+
+#define PI 3.14159265
 #define DEFAULT_CYCLE_TIME_MS 100
+#define SEPARATOR_MAX_CATCH_UP 50  // Cycles stepped at once after a stall (5 s)
 
 // Physical constants
 #define GAS_CONSTANT 8.314       // J/mol·K
-#define TEMPERATURE 300.0        // K (27°C)
+#define INITIAL_TEMPERATURE 300.0 // K (27°C)
 #define GAS_MOLAR_MASS 0.029     // kg/mol (approximate for natural gas)
 #define GAMMA 1.4                // Specific heat ratio (Cp/Cv)
 #define CRITICAL_PRESSURE_RATIO pow(2/(GAMMA+1), GAMMA/(GAMMA-1)) // ≈0.528 for air
 
+// --- Inflow Disturbance Model ---
+// Slug trains, correlated gas/liquid surges and Ornstein-Uhlenbeck noise on
+// the three inlets. Random numbers come from a counter-based generator keyed
+// by (seed, stream), so every separator gets its own reproducible stream
+// without shared generator state.
+#define DISTURBANCE_DRAWS_PER_STEP 3
+
+typedef struct {
+    // Parameters
+    bool enabled;
+    uint32_t seed;
+    uint32_t stream;           // Per-separator stream id
+    double slug_rate;          // 1/s, mean slug arrivals per second
+    double slug_duration;      // s, mean slug length
+    double slug_liquid_gain;   // Liquid inflow multiplier during a slug
+    double slug_gas_gain;      // Gas inflow multiplier during a slug
+    double gas_surge_gain;     // Relative gas blow-through when a slug ends
+    double gas_surge_tau;      // s, decay time of the gas blow-through
+    double noise_intensity;    // Relative std dev of the OU noise
+    double noise_tau;          // s, OU correlation time
+    double noise_correlation;  // Shared fraction of gas/liquid noise (0..1)
+
+    // State
+    uint64_t counter;
+    bool in_slug;
+    double gas_surge;
+    double ou[3];              // Oil, water, gas
+} InflowDisturbance;
+
+// --- Droplet Settling Model ---
+// Separation efficiency from binned droplet size distributions instead of
+// perfect phase separation. Part of the water inflow enters the oil layer
+// as droplets that settle, part of the oil inflow enters the water layer as
+// droplets that rise. A droplet with terminal velocity v crosses its layer
+// of height h within the residence time t = A h / Q_out when v t >= h, so
+// with an evenly spread inlet a bin is removed with probability
+// min(1, v A / Q_out). What is not removed leaves with the other phase.
+//
+// Terminal velocities cover the Stokes and intermediate regimes
+// (Schiller-Naumann drag, Newton's C_D = 0.44 above Re = 1000). The
+// particle Reynolds number depends only on the Archimedes number
+// Ar = g d³ ρ_c Δρ / μ², so Re/Ar is tabulated once over ln Ar and a bin
+// costs one interpolation instead of an iteration; with v = d² (g Δρ / μ)
+// (Re/Ar) the table is 1/18 in the Stokes limit. Velocities are only
+// recomputed when the fluid properties change, and the bins are plain
+// arrays stepped in unit-stride loops without branches, so they vectorize
+// (build with -O3 -fno-math-errno). Carry-over is reported only: the
+// level balances still move clean phases.
+#define SETTLING_BINS 16
+#define SETTLING_TABLE_SIZE 512
+#define SETTLING_LN_AR_MIN -30.0   // Ar ≈ 1e-13, Stokes
+#define SETTLING_LN_AR_MAX 30.0    // Ar ≈ 1e13, Newton
+#define SETTLING_D_MIN 1e-6        // m, lower edge of the first bin
+#define SETTLING_D_MAX 5e-3        // m, upper edge of the last bin
+
+typedef struct {
+    double diameter[SETTLING_BINS];   // m
+    double d2[SETTLING_BINS];         // m²
+    double ln_d3[SETTLING_BINS];      // ln(m³)
+    double fraction[SETTLING_BINS];   // Volume share of the dispersed phase, sums to 1
+    double velocity[SETTLING_BINS];   // m/s terminal velocity for the properties below
+    double rho_c, delta_rho, mu;      // Properties velocity was computed for
+} DropletBins;
+
+typedef struct {
+    // Parameters
+    bool enabled;
+    double water_dispersed;     // Share of the water inflow entering the oil layer as droplets
+    double oil_dispersed;       // Share of the oil inflow entering the water layer as droplets
+    double water_d50;           // m, volume median of the water droplets
+    double water_spread;        // Rosin-Rammler exponent of the water droplets
+    double oil_d50;             // m, volume median of the oil droplets
+    double oil_spread;          // Rosin-Rammler exponent of the oil droplets
+    double rho_oil;             // kg/m³
+    double rho_water;           // kg/m³
+    double mu_oil;              // Pa·s
+    double mu_water;            // Pa·s
+
+    // Distributions (Settling_Prepare)
+    DropletBins water_bins;     // Water droplets in oil
+    DropletBins oil_bins;       // Oil droplets in water
+
+    // Outputs
+    double oil_residence_time;    // s
+    double water_residence_time;  // s
+    double water_efficiency;      // Share of the dispersed water removed
+    double oil_efficiency;        // Share of the dispersed oil removed
+    double water_carry_over;      // m³/s of water leaving with the oil
+    double oil_carry_over;        // m³/s of oil leaving with the water
+    double water_in_oil;          // Volume fraction of water in the oil outlet
+    double oil_in_water_ppm;      // Oil in the water outlet, ppm by volume
+} DropletSettling;
+
+// --- Energy Balance ---
+// One lumped temperature for the vessel contents and shell. Heat capacity is
+// the sum of the oil, water and gas holdups (gas at constant volume) and the
+// wall; inlet streams bring their enthalpy at the inlet temperature, gas
+// leaving through valve_gas takes its flow work with it (expansion cooling
+// of what stays, the blowdown effect), and the shell exchanges heat with
+// the ambient. Downstream of valve_gas the gas is throttled isenthalpically:
+// its temperature drops by the Joule-Thomson coefficient times the pressure
+// drop. Heat capacities and the Joule-Thomson coefficient come from one
+// table over temperature built at startup, so a step costs one interpolation
+// instead of the correlations. Liquid densities are the settling model's.
+// With the balance off the temperature stays where it is (isothermal).
+#define PROPERTY_T_MIN 200.0       // K
+#define PROPERTY_T_MAX 500.0       // K
+#define PROPERTY_TABLE_SIZE 301    // 1 K steps
+#define GAS_VDW_A 0.2303           // Pa·m⁶/mol², van der Waals a (methane)
+#define GAS_VDW_B 4.31e-5          // m³/mol, van der Waals b (methane)
+
+typedef struct {
+    double cp_oil;      // J/kg·K at specific gravity 1 (divide by sqrt(SG))
+    double cp_water;    // J/kg·K
+    double cp_gas;      // J/kg·K
+    double mu_jt;       // K/Pa, Joule-Thomson coefficient of the gas
+} FluidProperties;
+
+typedef struct {
+    // Parameters
+    bool enabled;
+    double T_in;                  // K, temperature of the inlet streams
+    double T_ambient;             // K
+    double UA_ambient;            // W/K, shell-to-ambient conductance
+    double wall_heat_capacity;    // J/K, shell and internals
+
+    // Outputs
+    double gas_outlet_temperature;  // K, downstream of valve_gas
+    double heat_loss;               // W to the ambient
+} EnergyBalance;
+
+// --- Overpressure Protection ---
+// Pressure safety valves (PSVs) and a blowdown valve (BDV) on the gas space,
+// both relieving to the flare header at flare_back_pressure. A PSV lifts at
+// its set pressure and reseats at the set pressure less its blowdown (a
+// fraction of set). Relief rates use the API 520 Part I gas equations for
+// an ideal gas (Z = 1, K_b = K_c = 1):
+//   critical     W = A K_d P C sqrt(M / (R T))
+//                C = sqrt(k (2 / (k + 1))^((k + 1) / (k - 1)))
+//   subcritical  W = A K_d P F2 sqrt(2 M (1 - r) / (R T)),  r = P_back / P
+//                F2 = sqrt(k / (k - 1) r^(2/k) (1 - r^((k - 1)/k)) / (1 - r))
+// The rated capacity of a PSV is its critical flow at 10 % overpressure and
+// the vessel temperature. The BDV is an orifice on the same equations; it
+// opens on command or when the pressure reaches its trip pressure, and
+// stays open until commanded shut.
+#define SEPARATOR_MAX_PSV 2
+#define PSV_OVERPRESSURE 0.10        // Of set, for the rated capacity
+
+typedef struct {
+    // Parameters
+    double set_pressure;      // Pa
+    double blowdown;          // Reseat below set, fraction of set
+    double area;              // m², effective orifice; 0 = not fitted
+    double Kd;                // Effective coefficient of discharge
+
+    // State
+    bool open;
+    uint64_t lifts;
+
+    // Outputs
+    double flow;              // kg/s to the flare
+    double rated_capacity;    // kg/s
+} ReliefValve;
+
+typedef struct {
+    // Parameters
+    bool enabled;
+    ReliefValve psv[SEPARATOR_MAX_PSV];
+    double bdv_area;              // m²
+    double bdv_Cd;
+    double bdv_trip_pressure;     // Pa, 0 = opens on command only
+    double flare_back_pressure;   // Pa at the relief outlets
+
+    // State
+    bool bdv_open;                // Command, latched by the trip
+
+    // Outputs
+    double bdv_flow;              // kg/s
+    double relief_rate;           // kg/s, PSVs and BDV
+    double relieved_mass;         // kg since start
+} ReliefSystem;
+
+// --- Event-Locating Integrator ---
+// Alternative to the fixed-step Euler update with clamps: classical RK4 on
+// y = (h_oil, h_water, gas mass, temperature, relieved mass) with the
+// discontinuities of the model as events. Every event function is positive
+// while its mode holds. When one turns negative over a step, the crossing is located by
+// Illinois regula falsi on the step length (re-stepping from the start of
+// the step), the step is cut there, the event is applied exactly and
+// integration resumes. Modes only change at events, so the right-hand side
+// is smooth inside every step and RK4 keeps its order with steps of a
+// whole cycle or longer.
+//
+//   OIL_EMPTY, WATER_EMPTY  level reaches 0 (Torricelli drains in finite
+//                           time); it is set to exactly 0
+//   CHOKED                  gas outlet switches between choked and
+//                           subcritical flow
+//   AMBIENT                 pressure reaches ambient and is held there
+//                           (the outlet draws gas back in) until the
+//                           inflow alone would lift it
+//   PSV_1, PSV_2            pressure reaches the set pressure (lift) or the
+//                           reseat pressure (reseat)
+//   BDV_TRIP                pressure reaches the BDV trip pressure
+//
+// More than SEPARATOR_MAX_EVENTS_PER_CYCLE events in one cycle end event
+// location for the rest of it (clamps instead). The level at the top of the
+// vessel stays a clamp: the gas volume vanishes there, outside the model.
+#define SEPARATOR_Y 5
+#define SEPARATOR_MAX_EVENTS_PER_CYCLE 16
+#define SEPARATOR_EVENT_TOLERANCE 1e-12   // Of the step length
+#define SEPARATOR_MIN_GAS_VOLUME 1e-6     // m³, keeps the pressure finite
+
+typedef enum {
+    SEPARATOR_EVENT_OIL_EMPTY,
+    SEPARATOR_EVENT_WATER_EMPTY,
+    SEPARATOR_EVENT_CHOKED,
+    SEPARATOR_EVENT_AMBIENT,
+    SEPARATOR_EVENT_PSV_1,
+    SEPARATOR_EVENT_PSV_2,
+    SEPARATOR_EVENT_BDV_TRIP,
+    SEPARATOR_EVENT_COUNT
+} SeparatorEvent;
+
+typedef struct {
+    // Parameters
+    bool enabled;                 // Off: fixed-step Euler with clamps
+    uint32_t substeps;            // RK4 steps per cycle between events
+
+    // Modes
+    bool choked;
+    bool at_ambient;
+
+    // Diagnostics
+    double time;                                  // s simulated
+    uint64_t events;                              // All events so far
+    uint64_t event_count[SEPARATOR_EVENT_COUNT];
+    double event_time[SEPARATOR_EVENT_COUNT];     // s, last occurrence
+} SeparatorIntegrator;
+
+// --- Surrogate ---
+// A fitted replacement of the one-cycle map for screening studies
+// (--fit-surrogate writes one, SurrogateModel loads it). The envelope box
+// of the states (h_oil, h_water, pressure) is split in cells. In each cell
+// a polynomial of total degree `degree` in the nine inputs, each scaled to
+// [-1, 1] over the cell (states) or the envelope (valves and inflows),
+// gives the change of the three states over one cycle. A separator steps
+// on the surrogate only inside the envelope, at the geometry, temperature
+// and cycle time it was fitted for, with the energy balance off and no
+// relief valve open or reached; every other cycle runs the full model.
+// Settling only reports, so it is still evaluated on surrogate cycles.
+// Fleets step on it in blocks (see Surrogate Batch).
+//
+// Valve openings and inflows usually hold for many cycles. Each separator
+// keeps the polynomial of its cell with them substituted, a polynomial in
+// the three states alone, and rebuilds it when the cell or one of them
+// changes; a cycle then costs the few terms in the states.
+#define SURROGATE_INPUTS 9            // States, valve_*, Q_*_in
+#define SURROGATE_STATES 3            // h_oil, h_water, pressure; split in cells
+#define SURROGATE_OUTPUTS 3           // Changes of the states
+#define SURROGATE_MAX_DEGREE 4
+#define SURROGATE_MAX_TERMS 715       // C(9 + 4, 4)
+#define SURROGATE_MAX_STATE_TERMS 35  // C(3 + 4, 4)
+#define SURROGATE_MAX_CELLS 4096
+
+// Monomials of `variables` scaled inputs up to `degree` in graded order:
+// term 0 is 1, and the terms of degree d+1 are each term t of degree d
+// times the variables from first[t] on
+typedef struct {
+    uint32_t variables;
+    uint32_t degree;
+    uint32_t terms;
+    uint8_t first[SURROGATE_MAX_TERMS];
+} SurrogateBasis;
+
+typedef struct {
+    uint32_t cycle_time_ms;
+    uint32_t degree;
+    uint32_t cells[SURROGATE_STATES];
+    double lower[SURROGATE_INPUTS];
+    double upper[SURROGATE_INPUTS];
+    double scale[SURROGATE_INPUTS];   // 1 / (upper - lower)
+
+    // Model constants of the fit
+    double area;
+    double total_volume;
+    double Cd;
+    double A_valve_liquid;
+    double A_valve_gas;
+    double ambient_pressure;
+    double temperature;
+
+    // Bases in all inputs, the states and the other inputs; term t of the
+    // first is state_term[t] times input_term[t] of the others
+    SurrogateBasis basis;
+    SurrogateBasis state_basis;
+    SurrogateBasis input_basis;
+    uint8_t state_term[SURROGATE_MAX_TERMS];
+    uint8_t input_term[SURROGATE_MAX_TERMS];
+    double *coefficients;             // [cell][term][output]
+} SeparatorSurrogate;
+
+typedef struct {
+    const SeparatorSurrogate *model;  // NULL: full model only
+    uint64_t steps;                   // Cycles on the surrogate
+    uint64_t fallbacks;               // Cycles on the full model
+    uint64_t rebuilds;                // Cycles that rebuilt the polynomial
+
+    // Polynomial of the current cell in the states (model, cell and
+    // inputs it was built for)
+    const SeparatorSurrogate *built_model;
+    size_t built_cell;
+    double built_inputs[SURROGATE_INPUTS - SURROGATE_STATES];
+    double reduced[SURROGATE_MAX_STATE_TERMS][SURROGATE_OUTPUTS];
+} SurrogateUse;
+
 // --- Separator Model ---
 typedef struct {
     // Config (adjustable via OPC UA)
@@ -34,8 +366,19 @@ typedef struct {
         double h_oil;
         double h_water;
         double pressure;
+        double Q_oil_in;      // Inflows after disturbances
+        double Q_water_in;
+        double Q_gas_in;
+        double temperature;   // K
     } state;
 
+    InflowDisturbance disturbance;
+    DropletSettling settling;
+    EnergyBalance energy;
+    ReliefSystem relief;
+    SeparatorIntegrator integrator;
+    SurrogateUse surrogate;
+
     // Constants
     double area;
     double total_volume;
@@ -48,11 +391,375 @@ typedef struct {
 
 // Globals
 SeparatorSimulator separator;
+SeparatorSurrogate surrogate;
 volatile bool running = true;
 UA_Server *server;
+SimLoop loop = {.epoll_fd = -1, .timer_fd = -1, .wake_fd = -1};
+SimHashLog hash_log;
 
 void stopHandler(int sign) {
     running = false;
+    SimLoop_Wake(&loop);
+}
+
+// SplitMix64 evaluated at an arbitrary counter: draw n of a stream is a pure
+// function of (key, n), so streams can be stepped independently.
+static inline uint64_t Disturbance_Hash(uint64_t key, uint64_t counter) {
+    uint64_t z = key + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline double Disturbance_Uniform(uint32_t bits) {
+    return ((double)bits + 0.5) / 4294967296.0; // (0, 1)
+}
+
+// Two standard normals from one 64-bit draw (Box-Muller)
+static inline void Disturbance_Normal2(uint64_t bits, double *z0, double *z1) {
+    double u1 = Disturbance_Uniform((uint32_t)(bits >> 32));
+    double u2 = Disturbance_Uniform((uint32_t)bits);
+    double r = sqrt(-2.0 * log(u1));
+    *z0 = r * cos(2.0 * PI * u2);
+    *z1 = r * sin(2.0 * PI * u2);
+}
+
+void Disturbance_Init(InflowDisturbance *d, uint32_t stream) {
+    memset(d, 0, sizeof(InflowDisturbance));
+    d->enabled = false;
+    d->seed = 1;
+    d->stream = stream;
+    d->slug_rate = 1.0 / 120.0;       // One slug every two minutes
+    d->slug_duration = 20.0;          // s
+    d->slug_liquid_gain = 3.0;
+    d->slug_gas_gain = 0.2;
+    d->gas_surge_gain = 2.0;
+    d->gas_surge_tau = 10.0;          // s
+    d->noise_intensity = 0.05;        // 5 % of nominal inflow
+    d->noise_tau = 5.0;               // s
+    d->noise_correlation = 0.5;
+}
+
+// Apply the disturbance for one step of length dt to the nominal inflows.
+// Consumes exactly DISTURBANCE_DRAWS_PER_STEP counters per call.
+void Disturbance_Step(InflowDisturbance *d, double dt,
+                      double Q_oil, double Q_water, double Q_gas,
+                      double *out_oil, double *out_water, double *out_gas) {
+    if (!d->enabled) {
+        *out_oil = Q_oil;
+        *out_water = Q_water;
+        *out_gas = Q_gas;
+        return;
+    }
+
+    uint64_t key = Disturbance_Hash(((uint64_t)d->seed << 32) | d->stream, 0);
+    uint64_t base = d->counter;
+    d->counter += DISTURBANCE_DRAWS_PER_STEP;
+
+    // 1. Markov-modulated slug train (two-state continuous-time chain)
+    double u = Disturbance_Uniform((uint32_t)Disturbance_Hash(key, base));
+    if (d->in_slug) {
+        double p_end = 1.0 - exp(-dt / fmax(d->slug_duration, dt));
+        if (u < p_end) {
+            d->in_slug = false;
+            d->gas_surge = d->gas_surge_gain; // Gas blows through behind the slug
+        }
+    } else {
+        double p_start = 1.0 - exp(-d->slug_rate * dt);
+        if (u < p_start)
+            d->in_slug = true;
+    }
+    d->gas_surge *= exp(-dt / fmax(d->gas_surge_tau, dt));
+
+    // 2. Ornstein-Uhlenbeck noise (exact discretisation) with a shared factor
+    double z_common, z_oil, z_water, z_gas;
+    Disturbance_Normal2(Disturbance_Hash(key, base + 1), &z_common, &z_oil);
+    Disturbance_Normal2(Disturbance_Hash(key, base + 2), &z_water, &z_gas);
+
+    double rho = fmin(fmax(d->noise_correlation, 0.0), 1.0);
+    double a = sqrt(rho), b = sqrt(1.0 - rho);
+    double decay = exp(-dt / fmax(d->noise_tau, dt));
+    double diffusion = d->noise_intensity * sqrt(1.0 - decay * decay);
+
+    d->ou[0] = d->ou[0] * decay + diffusion * (a * z_common + b * z_oil);
+    d->ou[1] = d->ou[1] * decay + diffusion * (a * z_common + b * z_water);
+    d->ou[2] = d->ou[2] * decay + diffusion * (a * z_common + b * z_gas);
+
+    // 3. Combine
+    double liquid_gain = d->in_slug ? d->slug_liquid_gain : 1.0;
+    double gas_gain = (d->in_slug ? d->slug_gas_gain : 1.0) + d->gas_surge;
+
+    *out_oil = fmax(Q_oil * liquid_gain * (1.0 + d->ou[0]), 0.0);
+    *out_water = fmax(Q_water * liquid_gain * (1.0 + d->ou[1]), 0.0);
+    *out_gas = fmax(Q_gas * gas_gain * (1.0 + d->ou[2]), 0.0);
+}
+
+// Re/Ar against ln Ar on an even grid, shared by every separator
+static double settling_re_per_ar[SETTLING_TABLE_SIZE];
+static bool settling_table_ready = false;
+
+// Archimedes number of a droplet settling at Reynolds number re:
+// Ar = 3/4 C_D Re²
+static double Settling_Archimedes(double re) {
+    if (re > 1000.0)
+        return 0.33 * re * re;
+    return 18.0 * re * (1.0 + 0.15 * pow(re, 0.687));
+}
+
+static void Settling_BuildTable(void) {
+    if (settling_table_ready)
+        return;
+    double step = (SETTLING_LN_AR_MAX - SETTLING_LN_AR_MIN) / (SETTLING_TABLE_SIZE - 1);
+    for (int k = 0; k < SETTLING_TABLE_SIZE; k++) {
+        double ar = exp(SETTLING_LN_AR_MIN + k * step);
+        // Ar(Re) is increasing and Ar >= 18 Re, so Re lies in (0, Ar/18]
+        double lo = log(ar / 18.0) - 40.0, hi = log(ar / 18.0);
+        for (int i = 0; i < 100; i++) {
+            double mid = 0.5 * (lo + hi);
+            if (Settling_Archimedes(exp(mid)) < ar)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        settling_re_per_ar[k] = exp(0.5 * (lo + hi)) / ar;
+    }
+    settling_table_ready = true;
+}
+
+// Log-spaced bins between SETTLING_D_MIN and SETTLING_D_MAX holding a
+// Rosin-Rammler volume distribution F(d) = 1 - exp(-(d/d63)^n) with the
+// given median; the tails outside the range go to the end bins.
+static void Settling_Distribute(DropletBins *bins, double d50, double spread) {
+    double n = fmax(spread, 0.1);
+    double d63 = fmax(d50, 1e-9) / pow(log(2.0), 1.0 / n);
+    double ratio = pow(SETTLING_D_MAX / SETTLING_D_MIN, 1.0 / SETTLING_BINS);
+    double lower = SETTLING_D_MIN, F_lower = 0.0;
+    for (int i = 0; i < SETTLING_BINS; i++) {
+        double upper = lower * ratio;
+        double F_upper = i == SETTLING_BINS - 1 ? 1.0 : 1.0 - exp(-pow(upper / d63, n));
+        double d = sqrt(lower * upper);
+        bins->diameter[i] = d;
+        bins->d2[i] = d * d;
+        bins->ln_d3[i] = 3.0 * log(d);
+        bins->fraction[i] = F_upper - F_lower;
+        lower = upper;
+        F_lower = F_upper;
+    }
+    bins->mu = 0.0; // Velocities are stale
+}
+
+void Settling_Prepare(DropletSettling *s) {
+    Settling_BuildTable();
+    Settling_Distribute(&s->water_bins, s->water_d50, s->water_spread);
+    Settling_Distribute(&s->oil_bins, s->oil_d50, s->oil_spread);
+}
+
+void Settling_Init(DropletSettling *s) {
+    memset(s, 0, sizeof(DropletSettling));
+    s->enabled = true;
+    s->water_dispersed = 0.1;
+    s->oil_dispersed = 0.02;
+    s->water_d50 = 500e-6;      // m
+    s->water_spread = 2.6;
+    s->oil_d50 = 150e-6;        // m
+    s->oil_spread = 2.6;
+    s->rho_oil = 850.0;         // kg/m³
+    s->rho_water = 1000.0;      // kg/m³
+    s->mu_oil = 0.01;           // Pa·s (10 cP)
+    s->mu_water = 0.001;        // Pa·s (1 cP)
+    Settling_Prepare(s);
+}
+
+// Terminal velocities of the bins in a continuous phase of density rho_c
+// and viscosity mu, unless they are current
+static void Settling_Velocities(DropletBins *bins, double rho_c, double delta_rho, double mu) {
+    if (bins->rho_c == rho_c && bins->delta_rho == delta_rho && bins->mu == mu)
+        return;
+    const double g = 9.81;
+    const double inv_step = (SETTLING_TABLE_SIZE - 1) / (SETTLING_LN_AR_MAX - SETTLING_LN_AR_MIN);
+    const double x_max = SETTLING_TABLE_SIZE - 1.000001;
+    double ln_k = log(g * rho_c * delta_rho / (mu * mu));   // ln Ar = ln d³ + ln_k
+    double stokes_scale = g * delta_rho / mu;
+
+    for (int i = 0; i < SETTLING_BINS; i++) {
+        double x = (bins->ln_d3[i] + ln_k - SETTLING_LN_AR_MIN) * inv_step;
+        x = fmin(fmax(x, 0.0), x_max);
+        int k = (int)x;
+        double f = x - k;
+        double re_per_ar = settling_re_per_ar[k] + f * (settling_re_per_ar[k + 1] - settling_re_per_ar[k]);
+        bins->velocity[i] = bins->d2[i] * stokes_scale * re_per_ar;
+    }
+    bins->rho_c = rho_c;
+    bins->delta_rho = delta_rho;
+    bins->mu = mu;
+}
+
+// Share of the dispersed phase removed in a layer with settling ratio A/Q_out (s/m)
+static double Settling_Efficiency(const DropletBins *bins, double settling_ratio) {
+    double removed[SETTLING_BINS];
+    for (int i = 0; i < SETTLING_BINS; i++)
+        removed[i] = bins->fraction[i] * fmin(bins->velocity[i] * settling_ratio, 1.0);
+    // Summed apart so the loop above has no ordered reduction to keep
+    double efficiency = 0.0;
+    for (int i = 0; i < SETTLING_BINS; i++)
+        efficiency += removed[i];
+    return efficiency;
+}
+
+// Carry-over of both outlets for one step, from the layer heights and the
+// outflows of the start of the step
+void Settling_Update(DropletSettling *s, double area, double h_oil, double h_water,
+                     double Q_oil_in, double Q_water_in, double Q_out_oil, double Q_out_water) {
+    if (!s->enabled)
+        return;
+
+    // A stopped outlet holds the layer indefinitely: everything settles
+    double oil_ratio = area / fmax(Q_out_oil, 1e-12);
+    double water_ratio = area / fmax(Q_out_water, 1e-12);
+    s->oil_residence_time = oil_ratio * h_oil;
+    s->water_residence_time = water_ratio * h_water;
+
+    double delta_rho = fmax(s->rho_water - s->rho_oil, 1e-3);
+    Settling_Velocities(&s->water_bins, s->rho_oil, delta_rho, s->mu_oil);
+    Settling_Velocities(&s->oil_bins, s->rho_water, delta_rho, s->mu_water);
+    s->water_efficiency = Settling_Efficiency(&s->water_bins, oil_ratio);
+    s->oil_efficiency = Settling_Efficiency(&s->oil_bins, water_ratio);
+
+    s->water_carry_over = s->water_dispersed * Q_water_in * (1.0 - s->water_efficiency);
+    s->oil_carry_over = s->oil_dispersed * Q_oil_in * (1.0 - s->oil_efficiency);
+
+    double oil_outlet = Q_out_oil + s->water_carry_over;
+    double water_outlet = Q_out_water + s->oil_carry_over;
+    s->water_in_oil = oil_outlet > 0.0 ? s->water_carry_over / oil_outlet : 0.0;
+    s->oil_in_water_ppm = water_outlet > 0.0 ? 1e6 * s->oil_carry_over / water_outlet : 0.0;
+}
+
+// Properties per kelvin from PROPERTY_T_MIN, shared by every separator
+static FluidProperties fluid_properties[PROPERTY_TABLE_SIZE];
+static bool fluid_properties_ready = false;
+
+static void Energy_BuildTable(void) {
+    if (fluid_properties_ready)
+        return;
+    double R_specific = GAS_CONSTANT / GAS_MOLAR_MASS;
+    double cp_gas_ref = GAMMA / (GAMMA - 1.0) * R_specific;
+    for (int k = 0; k < PROPERTY_TABLE_SIZE; k++) {
+        double T = PROPERTY_T_MIN + k;
+        double t = T - 273.15;
+        double tw = fmin(fmax(t, 0.0), 100.0);
+        FluidProperties *p = &fluid_properties[k];
+        // Cragoe's correlation for petroleum liquids
+        p->cp_oil = 1684.8 + 3.39 * t;
+        // Liquid water, 0-100 °C fit, held at the ends
+        p->cp_water = 4217.4 - 3.720 * tw + 0.1412 * tw * tw - 2.654e-3 * tw * tw * tw +
+                      2.093e-5 * tw * tw * tw * tw;
+        // Matches GAMMA at the initial temperature, rising gently with T
+        p->cp_gas = cp_gas_ref * (1.0 + 1.0e-3 * (T - INITIAL_TEMPERATURE));
+        // Van der Waals low-pressure limit: (2a/RT - b) / molar cp
+        p->mu_jt = (2.0 * GAS_VDW_A / (GAS_CONSTANT * T) - GAS_VDW_B) / (GAS_MOLAR_MASS * p->cp_gas);
+    }
+    fluid_properties_ready = true;
+}
+
+static inline void Energy_Properties(double T, FluidProperties *out) {
+    double x = fmin(fmax(T - PROPERTY_T_MIN, 0.0), PROPERTY_TABLE_SIZE - 1.000001);
+    int k = (int)x;
+    double f = x - k;
+    const FluidProperties *a = &fluid_properties[k], *b = &fluid_properties[k + 1];
+    out->cp_oil = a->cp_oil + f * (b->cp_oil - a->cp_oil);
+    out->cp_water = a->cp_water + f * (b->cp_water - a->cp_water);
+    out->cp_gas = a->cp_gas + f * (b->cp_gas - a->cp_gas);
+    out->mu_jt = a->mu_jt + f * (b->mu_jt - a->mu_jt);
+}
+
+void Energy_Init(EnergyBalance *e) {
+    memset(e, 0, sizeof(EnergyBalance));
+    e->enabled = true;
+    e->T_in = INITIAL_TEMPERATURE;       // K
+    e->T_ambient = 288.15;               // K (15°C)
+    e->UA_ambient = 400.0;               // W/K (≈80 m² at 5 W/m²·K)
+    e->wall_heat_capacity = 1.0e7;       // J/K (≈20 t of steel)
+    e->gas_outlet_temperature = INITIAL_TEMPERATURE;
+    Energy_BuildTable();
+}
+
+void Relief_Init(ReliefSystem *r) {
+    memset(r, 0, sizeof(ReliefSystem));
+    r->enabled = true;
+    for (int i = 0; i < SEPARATOR_MAX_PSV; i++) {
+        r->psv[i].set_pressure = 1.0e6 + 0.05e6 * i;  // Pa (10 bar, second 5 % above)
+        r->psv[i].blowdown = 0.07;                    // 7 % of set
+        r->psv[i].Kd = 0.975;                         // API 520 for gas
+    }
+    r->psv[0].area = 8.303e-4;        // m² (API 526 "J" orifice); PSV 2 not fitted
+    r->bdv_area = 5.0e-4;             // m² (≈25 mm bore)
+    r->bdv_Cd = 0.8;
+    r->bdv_trip_pressure = 0.0;       // Command only
+    r->flare_back_pressure = 150000.0; // Pa (1.5 bar)
+}
+
+// API 520 gas relief capacity (kg/s) of an orifice from pressure to back
+// pressure at temperature T; critical or subcritical flow
+static double Relief_Capacity(double area, double Kd, double pressure, double back_pressure, double T) {
+    if (area <= 0.0 || pressure <= back_pressure)
+        return 0.0;
+    const double k = GAMMA;
+    double base = area * Kd * pressure * sqrt(GAS_MOLAR_MASS / (GAS_CONSTANT * T));
+    double r = back_pressure / pressure;
+    if (r <= CRITICAL_PRESSURE_RATIO)
+        return base * sqrt(k * pow(2 / (k + 1), (k + 1) / (k - 1)));
+    double F2 = sqrt(k / (k - 1) * pow(r, 2 / k) * (1 - pow(r, (k - 1) / k)) / (1 - r));
+    return base * F2 * sqrt(2 * (1 - r));
+}
+
+// Total relief (kg/s) from the open PSVs and the BDV at pressure and T;
+// optionally the flow of each
+static double Relief_Rate(const ReliefSystem *r, double pressure, double T, double *psv_flow, double *bdv_flow) {
+    double total = 0.0;
+    for (int i = 0; i < SEPARATOR_MAX_PSV; i++) {
+        const ReliefValve *v = &r->psv[i];
+        double flow = v->open ? Relief_Capacity(v->area, v->Kd, pressure, r->flare_back_pressure, T) : 0.0;
+        if (psv_flow)
+            psv_flow[i] = flow;
+        total += flow;
+    }
+    double flow = r->bdv_open ? Relief_Capacity(r->bdv_area, r->bdv_Cd, pressure, r->flare_back_pressure, T) : 0.0;
+    if (bdv_flow)
+        *bdv_flow = flow;
+    return total + flow;
+}
+
+static double Relief_ReseatPressure(const ReliefValve *v) {
+    return v->set_pressure * (1.0 - v->blowdown);
+}
+
+// Lift, reseat and trip on the pressure at the start of a fixed step
+static void Relief_UpdateModes(ReliefSystem *r, double pressure) {
+    for (int i = 0; i < SEPARATOR_MAX_PSV; i++) {
+        ReliefValve *v = &r->psv[i];
+        if (v->area <= 0.0) {
+            v->open = false;
+        } else if (!v->open && pressure >= v->set_pressure) {
+            v->open = true;
+            v->lifts++;
+        } else if (v->open && pressure <= Relief_ReseatPressure(v)) {
+            v->open = false;
+        }
+    }
+    if (r->bdv_trip_pressure > 0.0 && pressure >= r->bdv_trip_pressure)
+        r->bdv_open = true;
+}
+
+// Outputs at the end of a step
+static void Relief_Publish(ReliefSystem *r, double pressure, double T) {
+    double psv_flow[SEPARATOR_MAX_PSV];
+    r->relief_rate = Relief_Rate(r, pressure, T, psv_flow, &r->bdv_flow);
+    for (int i = 0; i < SEPARATOR_MAX_PSV; i++) {
+        ReliefValve *v = &r->psv[i];
+        v->flow = psv_flow[i];
+        v->rated_capacity = Relief_Capacity(v->area, v->Kd, v->set_pressure * (1.0 + PSV_OVERPRESSURE),
+                                            r->flare_back_pressure, T);
+    }
 }
 
 void Separator_Init(SeparatorSimulator *sep) {
@@ -81,144 +788,1343 @@ void Separator_Init(SeparatorSimulator *sep) {
     // Initialize gas mass
     double initial_gas_volume = sep->total_volume - sep->area * 
                               (sep->state.h_oil + sep->state.h_water);
+    sep->state.temperature = INITIAL_TEMPERATURE;
     sep->gas_mass = (sep->state.pressure * initial_gas_volume) * 
-                   GAS_MOLAR_MASS / (GAS_CONSTANT * TEMPERATURE);
+                   GAS_MOLAR_MASS / (GAS_CONSTANT * sep->state.temperature);
+
+    sep->state.Q_oil_in = sep->config.Q_in_oil;
+    sep->state.Q_water_in = sep->config.Q_in_water;
+    sep->state.Q_gas_in = sep->config.Q_in_gas;
+
+    Disturbance_Init(&sep->disturbance, 0);
+    Settling_Init(&sep->settling);
+    Energy_Init(&sep->energy);
+    Relief_Init(&sep->relief);
+
+    memset(&sep->integrator, 0, sizeof(sep->integrator));
+    sep->integrator.enabled = true;
+    sep->integrator.substeps = 1;
 }
 
-void Separator_Update(SeparatorSimulator *sep, uint32_t cycle_time_ms) {
-    double dt = cycle_time_ms / 1000.0;
-    const double g = 9.81;
+// Rate of change (K/s) of the lumped temperature T with the given holdups
+// and gas mass flows (kg/s). Optionally returns the heat loss and the
+// Joule-Thomson coefficient at T.
+static double Separator_EnergyRate(const SeparatorSimulator *sep, double T, double h_oil, double h_water,
+                                   double gas_mass, double gas_in, double gas_out,
+                                   double *heat_loss, double *mu_jt) {
+    const EnergyBalance *e = &sep->energy;
+    FluidProperties p;
+    Energy_Properties(T, &p);
 
-    // 1. Update liquid levels (existing Torricelli's law calculations)
-    double valve_oil_coeff = sep->config.valve_oil / 100.0;
-    double valve_water_coeff = sep->config.valve_water / 100.0;
+    double R_specific = GAS_CONSTANT / GAS_MOLAR_MASS;
+    double cp_oil = p.cp_oil / sqrt(sep->settling.rho_oil / 1000.0);
+    double cv_gas = p.cp_gas - R_specific;
+    double m_oil = sep->area * h_oil * sep->settling.rho_oil;
+    double m_water = sep->area * h_water * sep->settling.rho_water;
+    double heat_capacity = m_oil * cp_oil + m_water * p.cp_water + fmax(gas_mass, 0.0) * cv_gas +
+                           e->wall_heat_capacity;
 
-    double Q_out_oil = sep->Cd * sep->A_valve_liquid * valve_oil_coeff * sqrt(2 * g * sep->state.h_oil);
-    double Q_out_water = sep->Cd * sep->A_valve_liquid * valve_water_coeff * sqrt(2 * g * sep->state.h_water);
+    double oil_in = sep->state.Q_oil_in * sep->settling.rho_oil;
+    double water_in = sep->state.Q_water_in * sep->settling.rho_water;
+    double loss = e->UA_ambient * (T - e->T_ambient);
+    double power = (oil_in * cp_oil + water_in * p.cp_water) * (e->T_in - T)
+                 + gas_in * (p.cp_gas * e->T_in - cv_gas * T)
+                 - gas_out * R_specific * T
+                 - loss;
 
-    sep->state.h_oil += (sep->config.Q_in_oil - Q_out_oil) / sep->area * dt;
-    sep->state.h_water += (sep->config.Q_in_water - Q_out_water) / sep->area * dt;
+    if (heat_loss)
+        *heat_loss = loss;
+    if (mu_jt)
+        *mu_jt = p.mu_jt;
+    return power / fmax(heat_capacity, 1.0);
+}
 
-    // Clamp heights
-    double max_height = sep->total_volume / sep->area;
-    sep->state.h_oil = fmin(fmax(sep->state.h_oil, 0.0), max_height);
-    sep->state.h_water = fmin(fmax(sep->state.h_water, 0.0), max_height - sep->state.h_oil);
+// Advance the lumped temperature by dt with the temperature of the start of
+// the step and this step's holdups and flows (gas mass flows in kg/s)
+static void Separator_EnergyStep(SeparatorSimulator *sep, double dt, double gas_in, double gas_out) {
+    double T = sep->state.temperature;
+    double mu_jt;
+    double rate = Separator_EnergyRate(sep, T, sep->state.h_oil, sep->state.h_water, sep->gas_mass,
+                                       gas_in, gas_out, &sep->energy.heat_loss, &mu_jt);
 
-    // 2. Calculate current gas volume
-    double V_gas = sep->total_volume - sep->area * (sep->state.h_oil + sep->state.h_water);
-    
-    // 3. Calculate gas outflow (compressible flow equation)
+    // Held to the property table, like the levels to the vessel
+    sep->state.temperature = fmin(fmax(T + rate * dt, PROPERTY_T_MIN), PROPERTY_T_MAX);
+    sep->energy.gas_outlet_temperature = sep->state.temperature -
+                                         mu_jt * (sep->state.pressure - sep->ambient_pressure);
+}
+
+// Gas outflow through valve_gas at the given vessel pressure, choked or
+// subcritical (times GAS_MOLAR_MASS for kg/s)
+static double Separator_GasOutflow(const SeparatorSimulator *sep, double pressure, bool choked) {
     double valve_gas_coeff = sep->config.valve_gas / 100.0;
-    double P_ratio = sep->ambient_pressure / sep->state.pressure;
-    
-    double Q_out_gas;
-    if (P_ratio <= CRITICAL_PRESSURE_RATIO) {
+    if (choked) {
         // Critical flow (choked)
-        Q_out_gas = sep->Cd * sep->A_valve_gas * valve_gas_coeff * 
-                   sqrt(GAMMA * sep->state.pressure / GAS_MOLAR_MASS * 
-                   pow(2/(GAMMA+1), (GAMMA+1)/(GAMMA-1)));
+        return sep->Cd * sep->A_valve_gas * valve_gas_coeff * 
+               sqrt(GAMMA * pressure / GAS_MOLAR_MASS * 
+               pow(2/(GAMMA+1), (GAMMA+1)/(GAMMA-1)));
+    }
+    // Subcritical flow
+    double P_ratio = fmin(sep->ambient_pressure / pressure, 1.0);
+    return sep->Cd * sep->A_valve_gas * valve_gas_coeff * 
+           sqrt(2 * pressure / GAS_MOLAR_MASS * 
+           (GAMMA/(GAMMA-1)) * 
+           (pow(P_ratio, 2/GAMMA) - pow(P_ratio, (GAMMA+1)/GAMMA)));
+}
+
+static double Separator_GasPressure(const SeparatorSimulator *sep, const double *y) {
+    double V_gas = fmax(sep->total_volume - sep->area * (y[0] + y[1]), SEPARATOR_MIN_GAS_VOLUME);
+    return y[2] * GAS_CONSTANT * y[3] / (V_gas * GAS_MOLAR_MASS);
+}
+
+// Right-hand side at y in the current modes. Also returns the gas inflow
+// and, at ambient, the gas mass rate that holds ambient pressure.
+static void Separator_Derivatives(const SeparatorSimulator *sep, const double *y, double *dydt,
+                                  double *gas_in_out, double *hold_out) {
+    const double g = 9.81;
+    const SeparatorIntegrator *it = &sep->integrator;
+    double h_oil = fmax(y[0], 0.0), h_water = fmax(y[1], 0.0);
+    // Below 0 (past empty, inside the step that empties a level) the
+    // outflow continues as sqrt(|h|), matching Separator_DrainLevel
+    double Q_out_oil = sep->Cd * sep->A_valve_liquid * (sep->config.valve_oil / 100.0) * sqrt(2 * g * fabs(y[0]));
+    double Q_out_water = sep->Cd * sep->A_valve_liquid * (sep->config.valve_water / 100.0) * sqrt(2 * g * fabs(y[1]));
+    dydt[0] = (sep->state.Q_oil_in - Q_out_oil) / sep->area;
+    dydt[1] = (sep->state.Q_water_in - Q_out_water) / sep->area;
+
+    double T = y[3];
+    double pressure = it->at_ambient ? sep->ambient_pressure : Separator_GasPressure(sep, y);
+    double T_gas_in = sep->energy.enabled ? sep->energy.T_in : T;
+    double gas_in = sep->state.Q_gas_in * pressure * GAS_MOLAR_MASS / (GAS_CONSTANT * T_gas_in);
+    double gas_out = Separator_GasOutflow(sep, pressure, it->choked) * GAS_MOLAR_MASS;
+    double relief = sep->relief.enabled ? Relief_Rate(&sep->relief, pressure, T, NULL, NULL) : 0.0;
+    dydt[3] = sep->energy.enabled
+            ? Separator_EnergyRate(sep, T, h_oil, h_water, y[2], gas_in, gas_out + relief, NULL, NULL)
+            : 0.0;
+    dydt[4] = relief;
+
+    double hold = 0.0;
+    if (it->at_ambient) {
+        // Gas mass that keeps ambient pressure in the changing gas volume
+        double V_gas = sep->total_volume - sep->area * (h_oil + h_water);
+        double dV_gas = -sep->area * (dydt[0] + dydt[1]);
+        hold = sep->ambient_pressure * GAS_MOLAR_MASS / GAS_CONSTANT * (dV_gas / T - V_gas * dydt[3] / (T * T));
+        dydt[2] = hold;
     } else {
-        // Subcritical flow
-        Q_out_gas = sep->Cd * sep->A_valve_gas * valve_gas_coeff * 
-                   sqrt(2 * sep->state.pressure / GAS_MOLAR_MASS * 
-                   (GAMMA/(GAMMA-1)) * 
-                   (pow(P_ratio, 2/GAMMA) - pow(P_ratio, (GAMMA+1)/GAMMA)));
+        dydt[2] = gas_in - gas_out - relief;
     }
+    if (gas_in_out)
+        *gas_in_out = gas_in;
+    if (hold_out)
+        *hold_out = hold;
+}
 
-    // 4. Update gas mass (convert Q_in_gas from volumetric to mass flow)
-    double Q_in_gas_mass = sep->config.Q_in_gas * sep->state.pressure * GAS_MOLAR_MASS / 
-                          (GAS_CONSTANT * TEMPERATURE);
-    sep->gas_mass += (Q_in_gas_mass - Q_out_gas * GAS_MOLAR_MASS) * dt;
+// A level without inflow drains exactly as sqrt(h) = sqrt(h0) - k t (and
+// only such a level can reach empty). RK4 loses its order on the sqrt
+// near empty, so these levels take the exact solution in every stage;
+// the signed square continues it through empty for the event location.
+static double Separator_DrainLevel(double h0, double valve, double t, const SeparatorSimulator *sep) {
+    const double g = 9.81;
+    if (h0 <= 0.0)
+        return 0.0;  // Stays empty
+    double k = sep->Cd * sep->A_valve_liquid * (valve / 100.0) * sqrt(2 * g) / (2.0 * sep->area);
+    double s = sqrt(h0) - k * t;
+    return s * fabs(s);
+}
 
-    // 5. Calculate new pressure (ideal gas law)
-    sep->state.pressure = (sep->gas_mass * GAS_CONSTANT * TEMPERATURE) / 
-                         (V_gas * GAS_MOLAR_MASS);
+static void Separator_RK4(const SeparatorSimulator *sep, const double *y, double h, double *out) {
+    double k1[SEPARATOR_Y], k2[SEPARATOR_Y], k3[SEPARATOR_Y], k4[SEPARATOR_Y], tmp[SEPARATOR_Y];
+    bool drain_oil = sep->state.Q_oil_in == 0.0, drain_water = sep->state.Q_water_in == 0.0;
+    Separator_Derivatives(sep, y, k1, NULL, NULL);
+    for (int i = 0; i < SEPARATOR_Y; i++)
+        tmp[i] = y[i] + 0.5 * h * k1[i];
+    if (drain_oil)
+        tmp[0] = Separator_DrainLevel(y[0], sep->config.valve_oil, 0.5 * h, sep);
+    if (drain_water)
+        tmp[1] = Separator_DrainLevel(y[1], sep->config.valve_water, 0.5 * h, sep);
+    Separator_Derivatives(sep, tmp, k2, NULL, NULL);
+    for (int i = 0; i < SEPARATOR_Y; i++)
+        tmp[i] = y[i] + 0.5 * h * k2[i];
+    if (drain_oil)
+        tmp[0] = Separator_DrainLevel(y[0], sep->config.valve_oil, 0.5 * h, sep);
+    if (drain_water)
+        tmp[1] = Separator_DrainLevel(y[1], sep->config.valve_water, 0.5 * h, sep);
+    Separator_Derivatives(sep, tmp, k3, NULL, NULL);
+    for (int i = 0; i < SEPARATOR_Y; i++)
+        tmp[i] = y[i] + h * k3[i];
+    if (drain_oil)
+        tmp[0] = Separator_DrainLevel(y[0], sep->config.valve_oil, h, sep);
+    if (drain_water)
+        tmp[1] = Separator_DrainLevel(y[1], sep->config.valve_water, h, sep);
+    Separator_Derivatives(sep, tmp, k4, NULL, NULL);
+    for (int i = 0; i < SEPARATOR_Y; i++)
+        out[i] = y[i] + h / 6.0 * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+    if (drain_oil)
+        out[0] = Separator_DrainLevel(y[0], sep->config.valve_oil, h, sep);
+    if (drain_water)
+        out[1] = Separator_DrainLevel(y[1], sep->config.valve_water, h, sep);
+}
 
-    // Ensure pressure doesn't drop below ambient
-    sep->state.pressure = fmax(sep->state.pressure, sep->ambient_pressure);
+// Event functions at y, positive while the current modes hold
+static void Separator_EventValues(const SeparatorSimulator *sep, const double *y, double *values) {
+    const SeparatorIntegrator *it = &sep->integrator;
+    // Torricelli drains are quadratic in time at empty: the signed root is
+    // linear there, which keeps regula falsi fast
+    values[SEPARATOR_EVENT_OIL_EMPTY] = copysign(sqrt(fabs(y[0])), y[0]);
+    values[SEPARATOR_EVENT_WATER_EMPTY] = copysign(sqrt(fabs(y[1])), y[1]);
+    if (it->at_ambient) {
+        double dydt[SEPARATOR_Y], gas_in, hold;
+        Separator_Derivatives(sep, y, dydt, &gas_in, &hold);
+        values[SEPARATOR_EVENT_CHOKED] = 1.0;               // Subcritical by definition
+        values[SEPARATOR_EVENT_AMBIENT] = hold - gas_in;    // Inflow alone lifts the pressure
+    } else {
+        double pressure = Separator_GasPressure(sep, y);
+        double P_ratio = sep->ambient_pressure / pressure;
+        values[SEPARATOR_EVENT_CHOKED] = it->choked ? CRITICAL_PRESSURE_RATIO - P_ratio
+                                                    : P_ratio - CRITICAL_PRESSURE_RATIO;
+        values[SEPARATOR_EVENT_AMBIENT] = pressure - sep->ambient_pressure;
+    }
+
+    double pressure = it->at_ambient ? sep->ambient_pressure : Separator_GasPressure(sep, y);
+    const ReliefSystem *r = &sep->relief;
+    for (int i = 0; i < SEPARATOR_MAX_PSV; i++) {
+        const ReliefValve *v = &r->psv[i];
+        if (!r->enabled || v->area <= 0.0)
+            values[SEPARATOR_EVENT_PSV_1 + i] = 1.0;
+        else
+            values[SEPARATOR_EVENT_PSV_1 + i] = v->open ? pressure - Relief_ReseatPressure(v)
+                                                        : v->set_pressure - pressure;
+    }
+    values[SEPARATOR_EVENT_BDV_TRIP] = r->enabled && !r->bdv_open && r->bdv_trip_pressure > 0.0
+                                     ? r->bdv_trip_pressure - pressure
+                                     : 1.0;
 }
 
-// --- OPC UA Callbacks ---
-static void onConfigChanged(UA_Server *server, const UA_NodeId *sessionId,
-                            void *sessionContext, const UA_NodeId *nodeId,
-                            void *nodeContext, const UA_NumericRange *range,
-                            const UA_DataValue *data) {
-    if (!data || !data->hasValue || !UA_Variant_isScalar(&data->value)) return;
+// Put the modes in line with y at the start of a step (after a config
+// change, or when the integrator was just switched on)
+static void Separator_SyncModes(SeparatorSimulator *sep, double *y) {
+    SeparatorIntegrator *it = &sep->integrator;
+    y[0] = fmax(y[0], 0.0);
+    y[1] = fmax(y[1], 0.0);
+    double values[SEPARATOR_EVENT_COUNT];
+    for (int pass = 0; pass < 2; pass++) {
+        Separator_EventValues(sep, y, values);
+        if (values[SEPARATOR_EVENT_AMBIENT] < 0.0)
+            it->at_ambient = !it->at_ambient;
+        else if (values[SEPARATOR_EVENT_CHOKED] < 0.0)
+            it->choked = !it->choked;
+    }
+    if (it->at_ambient) {
+        double V_gas = fmax(sep->total_volume - sep->area * (y[0] + y[1]), SEPARATOR_MIN_GAS_VOLUME);
+        y[2] = sep->ambient_pressure * V_gas * GAS_MOLAR_MASS / (GAS_CONSTANT * y[3]);
+        it->choked = false;
+    }
+    if (sep->relief.enabled)
+        Relief_UpdateModes(&sep->relief, it->at_ambient ? sep->ambient_pressure : Separator_GasPressure(sep, y));
+}
 
-    UA_QualifiedName browseName;
-    UA_Server_readBrowseName(server, *nodeId, &browseName);
+static void Separator_ApplyEvent(SeparatorSimulator *sep, SeparatorEvent event, double *y, double time) {
+    SeparatorIntegrator *it = &sep->integrator;
+    switch (event) {
+    case SEPARATOR_EVENT_OIL_EMPTY:
+        y[0] = 0.0;
+        break;
+    case SEPARATOR_EVENT_WATER_EMPTY:
+        y[1] = 0.0;
+        break;
+    case SEPARATOR_EVENT_CHOKED:
+        it->choked = !it->choked;
+        break;
+    case SEPARATOR_EVENT_AMBIENT:
+        it->at_ambient = !it->at_ambient;
+        if (it->at_ambient) {
+            double V_gas = fmax(sep->total_volume - sep->area * (y[0] + y[1]), SEPARATOR_MIN_GAS_VOLUME);
+            y[2] = sep->ambient_pressure * V_gas * GAS_MOLAR_MASS / (GAS_CONSTANT * y[3]);
+            it->choked = false;
+        }
+        break;
+    case SEPARATOR_EVENT_PSV_1:
+    case SEPARATOR_EVENT_PSV_2: {
+        ReliefValve *v = &sep->relief.psv[event - SEPARATOR_EVENT_PSV_1];
+        v->open = !v->open;
+        if (v->open)
+            v->lifts++;
+        break;
+    }
+    case SEPARATOR_EVENT_BDV_TRIP:
+        sep->relief.bdv_open = true;
+        break;
+    default:
+        break;
+    }
+    it->events++;
+    it->event_count[event]++;
+    it->event_time[event] = time;
+}
 
-    UA_String q_in_oil_str = UA_STRING("Q_in_oil");
-    UA_String q_in_water_str = UA_STRING("Q_in_water");
-    UA_String q_in_gas_str = UA_STRING("Q_in_gas");
-    UA_String valve_oil_str = UA_STRING("valve_oil");
-    UA_String valve_water_str = UA_STRING("valve_water");
-    UA_String valve_gas_str = UA_STRING("valve_gas");
+// Step length fraction in (0, 1] at which event e crosses zero over the
+// RK4 step h from y (values0 >= 0 at the start, values1 < 0 at the end).
+// Returns the right end of the final bracket, so the event has happened.
+static double Separator_LocateEvent(const SeparatorSimulator *sep, const double *y, double h, int e,
+                                    double value0, double value1) {
+    double a = 0.0, b = 1.0, ga = value0, gb = value1;
+    int side = 0;
+    for (int i = 0; i < 100 && b - a > SEPARATOR_EVENT_TOLERANCE; i++) {
+        double theta = (a * gb - b * ga) / (gb - ga);
+        if (!(theta > a && theta < b))
+            theta = 0.5 * (a + b);
+        double y_theta[SEPARATOR_Y], values[SEPARATOR_EVENT_COUNT];
+        Separator_RK4(sep, y, theta * h, y_theta);
+        Separator_EventValues(sep, y_theta, values);
+        double g = values[e];
+        if (g < 0.0) {
+            b = theta;
+            gb = g;
+            if (side == -1)
+                ga *= 0.5;  // Illinois: halve the retained end
+            side = -1;
+        } else {
+            a = theta;
+            ga = g;
+            if (side == 1)
+                gb *= 0.5;
+            side = 1;
+        }
+    }
+    return b;
+}
 
-    if (UA_String_equal(&browseName.name, &q_in_oil_str))
-        separator.config.Q_in_oil = *(UA_Double*)data->value.data;
-    else if (UA_String_equal(&browseName.name, &q_in_water_str))
-        separator.config.Q_in_water = *(UA_Double*)data->value.data;
-    else if (UA_String_equal(&browseName.name, &q_in_gas_str))
-        separator.config.Q_in_gas = *(UA_Double*)data->value.data;
-    else if (UA_String_equal(&browseName.name, &valve_oil_str))
-        separator.config.valve_oil = *(UA_Double*)data->value.data;
-    else if (UA_String_equal(&browseName.name, &valve_water_str))
-        separator.config.valve_water = *(UA_Double*)data->value.data;
-    else if (UA_String_equal(&browseName.name, &valve_gas_str))
-        separator.config.valve_gas = *(UA_Double*)data->value.data;
+// Advance the continuous state by dt with RK4 and event location
+static void Separator_Integrate(SeparatorSimulator *sep, double dt) {
+    SeparatorIntegrator *it = &sep->integrator;
+    double y[SEPARATOR_Y] = {sep->state.h_oil, sep->state.h_water, sep->gas_mass, sep->state.temperature,
+                             sep->relief.relieved_mass};
+    double h = dt / (it->substeps ? it->substeps : 1);
+    double t = 0.0;
+    int events = 0;
 
-    UA_QualifiedName_clear(&browseName);
+    Separator_SyncModes(sep, y);
+    while (dt - t > SEPARATOR_EVENT_TOLERANCE * dt) {
+        double step = fmin(h, dt - t);
+        double y1[SEPARATOR_Y];
+        Separator_RK4(sep, y, step, y1);
+        if (events >= SEPARATOR_MAX_EVENTS_PER_CYCLE) {
+            memcpy(y, y1, sizeof(y));
+            t += step;
+            continue;
+        }
+
+        double values0[SEPARATOR_EVENT_COUNT], values1[SEPARATOR_EVENT_COUNT];
+        Separator_EventValues(sep, y, values0);
+        Separator_EventValues(sep, y1, values1);
+        int first = -1;
+        double first_theta = 2.0;
+        for (int e = 0; e < SEPARATOR_EVENT_COUNT; e++) {
+            if (!(values0[e] >= 0.0 && values1[e] < 0.0))
+                continue;  // No crossing (or a state gone NaN)
+            double theta = Separator_LocateEvent(sep, y, step, e, values0[e], values1[e]);
+            if (theta < first_theta) {
+                first_theta = theta;
+                first = e;
+            }
+        }
+
+        if (first < 0) {
+            memcpy(y, y1, sizeof(y));
+            t += step;
+            continue;
+        }
+        Separator_RK4(sep, y, first_theta * step, y1);
+        memcpy(y, y1, sizeof(y));
+        t += first_theta * step;
+        Separator_ApplyEvent(sep, (SeparatorEvent)first, y, it->time + t);
+        events++;
+    }
+    it->time += dt;
+
+    // Write back, with the clamps as the guard after too many events
+    double max_height = sep->total_volume / sep->area;
+    sep->state.h_oil = fmin(fmax(y[0], 0.0), max_height);
+    sep->state.h_water = fmin(fmax(y[1], 0.0), max_height - sep->state.h_oil);
+    sep->gas_mass = y[2];
+    sep->state.temperature = fmin(fmax(y[3], PROPERTY_T_MIN), PROPERTY_T_MAX);
+    sep->relief.relieved_mass = y[4];
+    y[0] = sep->state.h_oil;
+    y[1] = sep->state.h_water;
+    sep->state.pressure = it->at_ambient ? sep->ambient_pressure
+                                         : fmax(Separator_GasPressure(sep, y), sep->ambient_pressure);
+
+    if (sep->relief.enabled)
+        Relief_Publish(&sep->relief, sep->state.pressure, sep->state.temperature);
+    if (sep->energy.enabled) {
+        double mu_jt;
+        Separator_EnergyRate(sep, sep->state.temperature, sep->state.h_oil, sep->state.h_water, sep->gas_mass,
+                             0.0, 0.0, &sep->energy.heat_loss, &mu_jt);
+        sep->energy.gas_outlet_temperature = sep->state.temperature -
+                                             mu_jt * (sep->state.pressure - sep->ambient_pressure);
+    }
 }
 
-static void addVariableWithCallback(UA_Server *server, UA_NodeId parentNode,
-                                    const char *nodeIdStr, const char *displayName,
-                                    void *value, const UA_DataType *type) {
-    UA_VariableAttributes attr = UA_VariableAttributes_default;
-    attr.displayName = UA_LOCALIZEDTEXT("en-US", displayName);
-    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
-    UA_Variant_setScalar(&attr.value, value, type);
+// Set the pressure together with the gas mass that holds it
+static void Separator_SetPressure(SeparatorSimulator *sep, double pressure) {
+    double V_gas = sep->total_volume - sep->area * (sep->state.h_oil + sep->state.h_water);
+    sep->state.pressure = pressure;
+    sep->gas_mass = pressure * V_gas * GAS_MOLAR_MASS / (GAS_CONSTANT * sep->state.temperature);
+}
 
-    UA_Server_addVariableNode(server, UA_NODEID_STRING(1, nodeIdStr), parentNode,
-                              UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
-                              UA_QUALIFIEDNAME(1, nodeIdStr),
-                              UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
-                              attr, NULL, NULL);
+static size_t Surrogate_Cells(const SeparatorSurrogate *s) {
+    return (size_t)s->cells[0] * s->cells[1] * s->cells[2];
+}
 
-    UA_ValueCallback callback = {.onRead = NULL, .onWrite = onConfigChanged};
-    UA_Server_setVariableNode_valueCallback(server, UA_NODEID_STRING(1, nodeIdStr), callback);
+// Optionally the exponents of every term
+static void SurrogateBasis_Build(SurrogateBasis *b, uint32_t variables, uint32_t degree,
+                                 uint8_t (*exponents)[SURROGATE_INPUTS]) {
+    uint32_t begin = 0, end = 1, n = 1;
+    b->variables = variables;
+    b->degree = degree;
+    b->first[0] = 0;
+    if (exponents)
+        memset(exponents[0], 0, SURROGATE_INPUTS);
+    for (uint32_t d = 1; d <= degree; d++) {
+        for (uint32_t t = begin; t < end; t++) {
+            for (uint8_t v = b->first[t]; v < variables; v++) {
+                if (exponents) {
+                    memcpy(exponents[n], exponents[t], SURROGATE_INPUTS);
+                    exponents[n][v]++;
+                }
+                b->first[n++] = v;
+            }
+        }
+        begin = end;
+        end = n;
+    }
+    b->terms = n;
 }
 
-static void addSeparatorObject(UA_Server *server) {
-    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Separator"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
-                            UA_QUALIFIEDNAME(1, "Separator"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
-                            UA_ObjectAttributes_default, NULL, NULL);
+static void SurrogateBasis_Evaluate(const SurrogateBasis *b, const double *u, double *m) {
+    uint32_t begin = 0, end = 1, n = 1;
+    m[0] = 1.0;
+    for (uint32_t d = 1; d <= b->degree; d++) {
+        for (uint32_t t = begin; t < end; t++) {
+            double mt = m[t];
+            for (uint32_t v = b->first[t]; v < b->variables; v++)
+                m[n++] = mt * u[v];
+        }
+        begin = end;
+        end = n;
+    }
+}
 
-    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Config"),
-                            UA_NODEID_STRING(1, "Separator"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
-                            UA_QUALIFIEDNAME(1, "Config"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
-                            UA_ObjectAttributes_default, NULL, NULL);
+static uint32_t SurrogateBasis_Find(const SurrogateBasis *b, uint8_t (*exponents)[SURROGATE_INPUTS],
+                                    const uint8_t *e) {
+    for (uint32_t t = 0; t < b->terms; t++) {
+        if (memcmp(exponents[t], e, b->variables) == 0)
+            return t;
+    }
+    return 0;
+}
 
-    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "Q_in_oil", "Oil Inflow", &separator.config.Q_in_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
-    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "Q_in_water", "Water Inflow", &separator.config.Q_in_water, &UA_TYPES[UA_TYPES_DOUBLE]);
-    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "Q_in_gas", "Gas Inflow", &separator.config.Q_in_gas, &UA_TYPES[UA_TYPES_DOUBLE]);
-    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "valve_oil", "Oil Valve", &separator.config.valve_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
-    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "valve_water", "Water Valve", &separator.config.valve_water, &UA_TYPES[UA_TYPES_DOUBLE]);
-    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "valve_gas", "Gas Valve", &separator.config.valve_gas, &UA_TYPES[UA_TYPES_DOUBLE]);
+// Scales, bases and the split of every term into states and other inputs
+static void Surrogate_Prepare(SeparatorSurrogate *s) {
+    static uint8_t all[SURROGATE_MAX_TERMS][SURROGATE_INPUTS];
+    static uint8_t states[SURROGATE_MAX_TERMS][SURROGATE_INPUTS];
+    static uint8_t inputs[SURROGATE_MAX_TERMS][SURROGATE_INPUTS];
+    for (int i = 0; i < SURROGATE_INPUTS; i++)
+        s->scale[i] = 1.0 / (s->upper[i] - s->lower[i]);
+    SurrogateBasis_Build(&s->basis, SURROGATE_INPUTS, s->degree, all);
+    SurrogateBasis_Build(&s->state_basis, SURROGATE_STATES, s->degree, states);
+    SurrogateBasis_Build(&s->input_basis, SURROGATE_INPUTS - SURROGATE_STATES, s->degree, inputs);
+    for (uint32_t t = 0; t < s->basis.terms; t++) {
+        s->state_term[t] = (uint8_t)SurrogateBasis_Find(&s->state_basis, states, all[t]);
+        s->input_term[t] = (uint8_t)SurrogateBasis_Find(&s->input_basis, inputs, all[t] + SURROGATE_STATES);
+    }
+}
 
-    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "State"),
-                            UA_NODEID_STRING(1, "Separator"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
-                            UA_QUALIFIEDNAME(1, "State"),
-                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
-                            UA_ObjectAttributes_default, NULL, NULL);
+// Inputs of sep to its surrogate. The discharge coefficient only enters
+// the model as a factor of the three valve openings, so another Cd than
+// the fit's is the fit's Cd at scaled openings.
+static void Surrogate_Inputs(const SeparatorSimulator *sep, double *x) {
+    double cd = sep->Cd == sep->surrogate.model->Cd ? 1.0 : sep->Cd / sep->surrogate.model->Cd;
+    x[0] = sep->state.h_oil;
+    x[1] = sep->state.h_water;
+    x[2] = sep->state.pressure;
+    x[3] = sep->config.valve_oil * cd;
+    x[4] = sep->config.valve_water * cd;
+    x[5] = sep->config.valve_gas * cd;
+    x[6] = sep->state.Q_oil_in;
+    x[7] = sep->state.Q_water_in;
+    x[8] = sep->state.Q_gas_in;
+}
 
-    // h_oil
+// Cell of x and its first `count` inputs scaled (count >= the states);
+// false outside the envelope (or NaN)
+static bool Surrogate_Scale(const SeparatorSurrogate *s, const double *x, int count, size_t *cell, double *u) {
+    size_t index = 0;
+    for (int i = 0; i < count; i++) {
+        if (!(x[i] >= s->lower[i] && x[i] <= s->upper[i]))
+            return false;
+        double w = (x[i] - s->lower[i]) * s->scale[i];
+        if (i < SURROGATE_STATES) {
+            w *= s->cells[i];
+            uint32_t k = w < s->cells[i] ? (uint32_t)w : s->cells[i] - 1;
+            index = index * s->cells[i] + k;
+            w -= k;
+        }
+        u[i] = 2.0 * w - 1.0;
+    }
+    *cell = index;
+    return true;
+}
+
+// Changes of the states over one cycle from x, by the full polynomial
+static bool Surrogate_Evaluate(const SeparatorSurrogate *s, const double *x, double *delta) {
+    double u[SURROGATE_INPUTS], m[SURROGATE_MAX_TERMS];
+    size_t cell;
+    if (!Surrogate_Scale(s, x, SURROGATE_INPUTS, &cell, u))
+        return false;
+    SurrogateBasis_Evaluate(&s->basis, u, m);
+    const double *c = &s->coefficients[cell * s->basis.terms * SURROGATE_OUTPUTS];
+    double sum[SURROGATE_OUTPUTS] = {0.0, 0.0, 0.0};
+    for (uint32_t t = 0; t < s->basis.terms; t++, c += SURROGATE_OUTPUTS) {
+        for (int o = 0; o < SURROGATE_OUTPUTS; o++)
+            sum[o] += c[o] * m[t];
+    }
+    memcpy(delta, sum, sizeof(sum));
+    return true;
+}
+
+// Substitute the scaled valve openings and inflows u into the polynomial
+// of cell, leaving one in the states
+static void Surrogate_Reduce(const SeparatorSurrogate *s, size_t cell, const double *u,
+                             double (*reduced)[SURROGATE_OUTPUTS]) {
+    double m[SURROGATE_MAX_TERMS];
+    SurrogateBasis_Evaluate(&s->input_basis, u + SURROGATE_STATES, m);
+    memset(reduced, 0, s->state_basis.terms * sizeof(reduced[0]));
+    const double *c = &s->coefficients[cell * s->basis.terms * SURROGATE_OUTPUTS];
+    for (uint32_t t = 0; t < s->basis.terms; t++, c += SURROGATE_OUTPUTS) {
+        double mt = m[s->input_term[t]];
+        double *r = reduced[s->state_term[t]];
+        for (int o = 0; o < SURROGATE_OUTPUTS; o++)
+            r[o] += c[o] * mt;
+    }
+}
+
+// Liquid outflows through the oil and water valves at the current levels
+static void Separator_LiquidOutflows(const SeparatorSimulator *sep, double *Q_out_oil, double *Q_out_water) {
+    const double g = 9.81;
+    double valve_oil_coeff = sep->config.valve_oil / 100.0;
+    double valve_water_coeff = sep->config.valve_water / 100.0;
+    *Q_out_oil = sep->Cd * sep->A_valve_liquid * valve_oil_coeff * sqrt(2 * g * sep->state.h_oil);
+    *Q_out_water = sep->Cd * sep->A_valve_liquid * valve_water_coeff * sqrt(2 * g * sep->state.h_water);
+}
+
+// No relief valve open, and none reaches its set or trip pressure
+static bool Relief_Quiet(const ReliefSystem *r, double pressure) {
+    if (r->bdv_open || (r->bdv_trip_pressure > 0.0 && pressure >= r->bdv_trip_pressure))
+        return false;
+    for (int i = 0; i < SEPARATOR_MAX_PSV; i++) {
+        const ReliefValve *v = &r->psv[i];
+        if (v->area > 0.0 && (v->open || pressure >= v->set_pressure))
+            return false;
+    }
+    return true;
+}
+
+// Cell, scaled states and inputs of a cycle of sep on its surrogate, with
+// the polynomial of the cell in sep->surrogate.reduced; false (nothing
+// changed) where the surrogate does not apply
+static bool Separator_SurrogatePrepare(SeparatorSimulator *sep, uint32_t cycle_time_ms, double *x, double *u) {
+    SurrogateUse *use = &sep->surrogate;
+    const SeparatorSurrogate *s = use->model;
+    if (cycle_time_ms != s->cycle_time_ms || sep->energy.enabled ||
+        sep->area != s->area || sep->total_volume != s->total_volume ||
+        sep->A_valve_liquid != s->A_valve_liquid || sep->A_valve_gas != s->A_valve_gas ||
+        sep->ambient_pressure != s->ambient_pressure || sep->state.temperature != s->temperature)
+        return false;
+
+    // The valve openings and inflows are checked and scaled only for a
+    // rebuild: unchanged, they are inside the envelope
+    size_t cell;
+    Surrogate_Inputs(sep, x);
+    if (!Surrogate_Scale(s, x, SURROGATE_STATES, &cell, u))
+        return false;
+    if (use->built_model != s || use->built_cell != cell ||
+        memcmp(use->built_inputs, x + SURROGATE_STATES, sizeof(use->built_inputs)) != 0) {
+        if (!Surrogate_Scale(s, x, SURROGATE_INPUTS, &cell, u))
+            return false;
+        Surrogate_Reduce(s, cell, u, use->reduced);
+        use->built_model = s;
+        use->built_cell = cell;
+        memcpy(use->built_inputs, x + SURROGATE_STATES, sizeof(use->built_inputs));
+        use->rebuilds++;
+    }
+    return true;
+}
+
+// States after a cycle on the surrogate from x with the changes delta:
+// the levels, the pressure and the gas mass (Separator_SetPressure)
+static void Separator_SurrogateNext(const SeparatorSimulator *sep, const double *x, const double *delta,
+                                    double *next) {
+    double max_height = sep->total_volume / sep->area;
+    next[0] = fmin(fmax(x[0] + delta[0], 0.0), max_height);
+    next[1] = fmin(fmax(x[1] + delta[1], 0.0), max_height - next[0]);
+    next[2] = fmax(x[2] + delta[2], sep->ambient_pressure);
+    double V_gas = sep->total_volume - sep->area * (next[0] + next[1]);
+    next[3] = next[2] * V_gas * GAS_MOLAR_MASS / (GAS_CONSTANT * sep->state.temperature);
+}
+
+// Move sep from x to the states next; false (nothing changed) if a relief
+// valve opens or is reached, where the full model has to run
+static bool Separator_SurrogateFinish(SeparatorSimulator *sep, const double *x, const double *next,
+                                      uint32_t cycle_time_ms) {
+    if (sep->relief.enabled && !(Relief_Quiet(&sep->relief, x[2]) && Relief_Quiet(&sep->relief, next[2])))
+        return false;
+    // Settling only reads the cycle: evaluate it at the start levels as the
+    // full model does
+    if (sep->settling.enabled) {
+        double Q_out_oil, Q_out_water;
+        Separator_LiquidOutflows(sep, &Q_out_oil, &Q_out_water);
+        Settling_Update(&sep->settling, sep->area, x[0], x[1], x[6], x[7], Q_out_oil, Q_out_water);
+    }
+    sep->state.h_oil = next[0];
+    sep->state.h_water = next[1];
+    sep->state.pressure = next[2];
+    sep->gas_mass = next[3];
+    sep->integrator.time += cycle_time_ms / 1000.0;
+    if (sep->relief.enabled)
+        Relief_Publish(&sep->relief, sep->state.pressure, sep->state.temperature);
+    return true;
+}
+
+// One cycle on the surrogate; false (nothing changed) where it does not apply
+static bool Separator_SurrogateStep(SeparatorSimulator *sep, uint32_t cycle_time_ms) {
+    const SeparatorSurrogate *s = sep->surrogate.model;
+    double x[SURROGATE_INPUTS], u[SURROGATE_INPUTS];
+    if (!Separator_SurrogatePrepare(sep, cycle_time_ms, x, u))
+        return false;
+    double m[SURROGATE_MAX_STATE_TERMS];
+    SurrogateBasis_Evaluate(&s->state_basis, u, m);
+    double delta[SURROGATE_OUTPUTS] = {0.0, 0.0, 0.0}, next[SURROGATE_OUTPUTS + 1];
+    for (uint32_t t = 0; t < s->state_basis.terms; t++) {
+        for (int o = 0; o < SURROGATE_OUTPUTS; o++)
+            delta[o] += sep->surrogate.reduced[t][o] * m[t];
+    }
+    Separator_SurrogateNext(sep, x, delta, next);
+    return Separator_SurrogateFinish(sep, x, next, cycle_time_ms);
+}
+
+static void Surrogate_Free(SeparatorSurrogate *s) {
+    free(s->coefficients);
+    s->coefficients = NULL;
+}
+
+static bool Surrogate_Expect(FILE *file, const char *word) {
+    char token[32];
+    return fscanf(file, "%31s", token) == 1 && strcmp(token, word) == 0;
+}
+
+// Surrogate file: text, "separator-surrogate 1" then the keyed header
+// lines and one line of coefficients per cell and term (one per output),
+// round-trip exact (%.17g)
+static bool Surrogate_Load(SeparatorSurrogate *s, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot read surrogate %s\n", path);
+        return false;
+    }
+    memset(s, 0, sizeof(*s));
+    int version = 0;
+    bool ok = fscanf(file, " separator-surrogate %d", &version) == 1 && version == 1 &&
+              fscanf(file, " cycle_time_ms %u degree %u cells %u %u %u", &s->cycle_time_ms, &s->degree,
+                     &s->cells[0], &s->cells[1], &s->cells[2]) == 5 &&
+              fscanf(file, " constants %lf %lf %lf %lf %lf %lf %lf", &s->area, &s->total_volume, &s->Cd,
+                     &s->A_valve_liquid, &s->A_valve_gas, &s->ambient_pressure, &s->temperature) == 7 &&
+              Surrogate_Expect(file, "lower");
+    for (int i = 0; ok && i < SURROGATE_INPUTS; i++)
+        ok = fscanf(file, "%lf", &s->lower[i]) == 1;
+    ok = ok && Surrogate_Expect(file, "upper");
+    for (int i = 0; ok && i < SURROGATE_INPUTS; i++)
+        ok = fscanf(file, "%lf", &s->upper[i]) == 1 && s->upper[i] > s->lower[i];
+    ok = ok && s->degree <= SURROGATE_MAX_DEGREE && s->cycle_time_ms > 0 && s->cells[0] > 0 &&
+         s->cells[1] > 0 && s->cells[2] > 0 && Surrogate_Cells(s) <= SURROGATE_MAX_CELLS;
+
+    size_t count = 0;
+    if (ok) {
+        Surrogate_Prepare(s);
+        count = Surrogate_Cells(s) * s->basis.terms * SURROGATE_OUTPUTS;
+        s->coefficients = malloc(count * sizeof(double));
+        ok = s->coefficients != NULL && Surrogate_Expect(file, "coefficients");
+    }
+    for (size_t i = 0; ok && i < count; i++)
+        ok = fscanf(file, "%lf", &s->coefficients[i]) == 1;
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Surrogate %s: malformed\n", path);
+        Surrogate_Free(s);
+    }
+    return ok;
+}
+
+// SurrogateModel of cfg (--fit-surrogate), if set, loaded into surrogate
+// for sep and every copy of it (the twin's members, the optimizer's
+// candidates); false if it cannot be read
+static bool Separator_UseSurrogate(SeparatorSimulator *sep, const ConfigFile *cfg) {
+    const char *path = ConfigFile_Get(cfg, "SurrogateModel");
+    if (!path || !*path)
+        return true;
+    if (!Surrogate_Load(&surrogate, path))
+        return false;
+    sep->surrogate.model = &surrogate;
+    printf("Surrogate %s: degree %u, %zu cells\n", path, surrogate.degree, Surrogate_Cells(&surrogate));
+    if (sep->energy.enabled)
+        fprintf(stderr, "Surrogate %s: fitted isothermal, every cycle runs the full model while "
+                        "EnergyBalanceEnabled is on\n", path);
+    return true;
+}
+
+// 0. Disturbed inflows
+static void Separator_Disturb(SeparatorSimulator *sep, uint32_t cycle_time_ms) {
+    Disturbance_Step(&sep->disturbance, cycle_time_ms / 1000.0,
+                     sep->config.Q_in_oil, sep->config.Q_in_water, sep->config.Q_in_gas,
+                     &sep->state.Q_oil_in, &sep->state.Q_water_in, &sep->state.Q_gas_in);
+}
+
+// One cycle of the full model on the disturbed inflows
+static void Separator_Step(SeparatorSimulator *sep, uint32_t cycle_time_ms) {
+    double dt = cycle_time_ms / 1000.0;
+
+    // 1. Update liquid levels (existing Torricelli's law calculations)
+    double Q_out_oil, Q_out_water;
+    Separator_LiquidOutflows(sep, &Q_out_oil, &Q_out_water);
+
+    Settling_Update(&sep->settling, sep->area, sep->state.h_oil, sep->state.h_water,
+                    sep->state.Q_oil_in, sep->state.Q_water_in, Q_out_oil, Q_out_water);
+
+    if (sep->integrator.enabled) {
+        Separator_Integrate(sep, dt);
+        return;
+    }
+
+    sep->state.h_oil += (sep->state.Q_oil_in - Q_out_oil) / sep->area * dt;
+    sep->state.h_water += (sep->state.Q_water_in - Q_out_water) / sep->area * dt;
+
+    // Clamp heights
+    double max_height = sep->total_volume / sep->area;
+    sep->state.h_oil = fmin(fmax(sep->state.h_oil, 0.0), max_height);
+    sep->state.h_water = fmin(fmax(sep->state.h_water, 0.0), max_height - sep->state.h_oil);
+
+    // 2. Calculate current gas volume
+    double V_gas = sep->total_volume - sep->area * (sep->state.h_oil + sep->state.h_water);
+    
+    // 3. Calculate gas outflow (compressible flow equation)
+    double P_ratio = sep->ambient_pressure / sep->state.pressure;
+    double Q_out_gas = Separator_GasOutflow(sep, sep->state.pressure, P_ratio <= CRITICAL_PRESSURE_RATIO);
+
+    // Relief to the flare (kg/s) at the pressure of the start of the step
+    double relief = 0.0;
+    if (sep->relief.enabled) {
+        Relief_UpdateModes(&sep->relief, sep->state.pressure);
+        relief = Relief_Rate(&sep->relief, sep->state.pressure, sep->state.temperature, NULL, NULL);
+        sep->relief.relieved_mass += relief * dt;
+    }
+
+    // 4. Update gas mass (convert Q_in_gas from volumetric to mass flow at
+    // the inlet temperature)
+    double T_gas_in = sep->energy.enabled ? sep->energy.T_in : sep->state.temperature;
+    double Q_in_gas_mass = sep->state.Q_gas_in * sep->state.pressure * GAS_MOLAR_MASS / 
+                          (GAS_CONSTANT * T_gas_in);
+    if (sep->energy.enabled)
+        Separator_EnergyStep(sep, dt, Q_in_gas_mass, Q_out_gas * GAS_MOLAR_MASS + relief);
+    sep->gas_mass += (Q_in_gas_mass - Q_out_gas * GAS_MOLAR_MASS - relief) * dt;
+
+    // 5. Calculate new pressure (ideal gas law)
+    sep->state.pressure = (sep->gas_mass * GAS_CONSTANT * sep->state.temperature) / 
+                         (V_gas * GAS_MOLAR_MASS);
+
+    // Ensure pressure doesn't drop below ambient
+    sep->state.pressure = fmax(sep->state.pressure, sep->ambient_pressure);
+
+    if (sep->relief.enabled)
+        Relief_Publish(&sep->relief, sep->state.pressure, sep->state.temperature);
+}
+
+// Apply every key in cfg that is new or changed relative to previous (the
+// configuration currently running). Keys match the OPC UA browse names for
+// the writable nodes, and the struct member names for the constants.
+void Separator_ApplyConfig(SeparatorSimulator *sep, const ConfigFile *cfg,
+                           const ConfigFile *previous) {
+    // Geometry is checked as a whole below, before it is applied
+    double area = sep->area, total_volume = sep->total_volume;
+    struct { const char *key; double *value; } doubles[] = {
+        {"Q_in_oil", &sep->config.Q_in_oil},
+        {"Q_in_water", &sep->config.Q_in_water},
+        {"Q_in_gas", &sep->config.Q_in_gas},
+        {"valve_oil", &sep->config.valve_oil},
+        {"valve_water", &sep->config.valve_water},
+        {"valve_gas", &sep->config.valve_gas},
+        {"area", &area},
+        {"total_volume", &total_volume},
+        {"Cd", &sep->Cd},
+        {"A_valve_liquid", &sep->A_valve_liquid},
+        {"A_valve_gas", &sep->A_valve_gas},
+        {"ambient_pressure", &sep->ambient_pressure},
+        {"SlugRate", &sep->disturbance.slug_rate},
+        {"SlugDuration", &sep->disturbance.slug_duration},
+        {"SlugLiquidGain", &sep->disturbance.slug_liquid_gain},
+        {"SlugGasGain", &sep->disturbance.slug_gas_gain},
+        {"GasSurgeGain", &sep->disturbance.gas_surge_gain},
+        {"GasSurgeTau", &sep->disturbance.gas_surge_tau},
+        {"NoiseIntensity", &sep->disturbance.noise_intensity},
+        {"NoiseTau", &sep->disturbance.noise_tau},
+        {"NoiseCorrelation", &sep->disturbance.noise_correlation},
+        {"WaterDispersed", &sep->settling.water_dispersed},
+        {"OilDispersed", &sep->settling.oil_dispersed},
+        {"WaterDropletD50", &sep->settling.water_d50},
+        {"WaterDropletSpread", &sep->settling.water_spread},
+        {"OilDropletD50", &sep->settling.oil_d50},
+        {"OilDropletSpread", &sep->settling.oil_spread},
+        {"OilDensity", &sep->settling.rho_oil},
+        {"WaterDensity", &sep->settling.rho_water},
+        {"OilViscosity", &sep->settling.mu_oil},
+        {"WaterViscosity", &sep->settling.mu_water},
+        {"InletTemperature", &sep->energy.T_in},
+        {"AmbientTemperature", &sep->energy.T_ambient},
+        {"AmbientUA", &sep->energy.UA_ambient},
+        {"WallHeatCapacity", &sep->energy.wall_heat_capacity},
+        {"Psv1SetPressure", &sep->relief.psv[0].set_pressure},
+        {"Psv1Blowdown", &sep->relief.psv[0].blowdown},
+        {"Psv1Area", &sep->relief.psv[0].area},
+        {"Psv1Kd", &sep->relief.psv[0].Kd},
+        {"Psv2SetPressure", &sep->relief.psv[1].set_pressure},
+        {"Psv2Blowdown", &sep->relief.psv[1].blowdown},
+        {"Psv2Area", &sep->relief.psv[1].area},
+        {"Psv2Kd", &sep->relief.psv[1].Kd},
+        {"BdvArea", &sep->relief.bdv_area},
+        {"BdvCd", &sep->relief.bdv_Cd},
+        {"BdvTripPressure", &sep->relief.bdv_trip_pressure},
+        {"FlareBackPressure", &sep->relief.flare_back_pressure},
+    };
+
+    // Geometry and flow coefficients: zero or negative is rejected
+    const double *const positives[] = {&area, &total_volume, &sep->Cd, &sep->A_valve_liquid, &sep->A_valve_gas};
+    double old_area = sep->area;
+    double old_volume = sep->total_volume;
+
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+        if (!ConfigFile_Changed(cfg, previous, doubles[i].key))
+            continue;
+        char *end;
+        const char *text = ConfigFile_Get(cfg, doubles[i].key);
+        double value = strtod(text, &end);
+        if (end == text) {
+            fprintf(stderr, "Config: %s: not a number: %s\n", doubles[i].key, text);
+            continue;
+        }
+        bool positive = false;
+        for (size_t k = 0; k < sizeof(positives) / sizeof(positives[0]); k++)
+            positive |= doubles[i].value == positives[k];
+        if (positive && !(value > 0.0 && isfinite(value))) {
+            fprintf(stderr, "Config: %s: must be positive: %s\n", doubles[i].key, text);
+            continue;
+        }
+        printf("Config: %s %g -> %g\n", doubles[i].key, *doubles[i].value, value);
+        *doubles[i].value = value;
+    }
+    if (total_volume > area * (sep->state.h_oil + sep->state.h_water)) {
+        sep->area = area;
+        sep->total_volume = total_volume;
+    } else if (area != sep->area || total_volume != sep->total_volume) {
+        fprintf(stderr, "Config: area %g, total_volume %g: the liquid (%g m) would fill the vessel, "
+                        "keeping area %g, total_volume %g\n", area, total_volume,
+                sep->state.h_oil + sep->state.h_water, sep->area, sep->total_volume);
+    }
+
+    if (ConfigFile_Changed(cfg, previous, "DisturbanceEnabled")) {
+        const char *text = ConfigFile_Get(cfg, "DisturbanceEnabled");
+        sep->disturbance.enabled = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+        printf("Config: DisturbanceEnabled -> %d\n", sep->disturbance.enabled);
+    }
+    if (ConfigFile_Changed(cfg, previous, "DisturbanceSeed")) {
+        sep->disturbance.seed = (uint32_t)strtoul(ConfigFile_Get(cfg, "DisturbanceSeed"), NULL, 10);
+        sep->disturbance.counter = 0;
+        printf("Config: DisturbanceSeed -> %u\n", sep->disturbance.seed);
+    }
+    if (ConfigFile_Changed(cfg, previous, "SettlingEnabled")) {
+        const char *text = ConfigFile_Get(cfg, "SettlingEnabled");
+        sep->settling.enabled = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+        printf("Config: SettlingEnabled -> %d\n", sep->settling.enabled);
+    }
+    if (ConfigFile_Changed(cfg, previous, "EnergyBalanceEnabled")) {
+        const char *text = ConfigFile_Get(cfg, "EnergyBalanceEnabled");
+        sep->energy.enabled = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+        printf("Config: EnergyBalanceEnabled -> %d\n", sep->energy.enabled);
+    }
+    if (ConfigFile_Changed(cfg, previous, "ReliefEnabled")) {
+        const char *text = ConfigFile_Get(cfg, "ReliefEnabled");
+        sep->relief.enabled = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+        printf("Config: ReliefEnabled -> %d\n", sep->relief.enabled);
+    }
+    if (ConfigFile_Changed(cfg, previous, "BdvOpen")) {
+        const char *text = ConfigFile_Get(cfg, "BdvOpen");
+        sep->relief.bdv_open = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+        printf("Config: BdvOpen -> %d\n", sep->relief.bdv_open);
+    }
+    if (ConfigFile_Changed(cfg, previous, "EventLocation")) {
+        const char *text = ConfigFile_Get(cfg, "EventLocation");
+        sep->integrator.enabled = strcmp(text, "true") == 0 || strcmp(text, "1") == 0;
+        printf("Config: EventLocation -> %d\n", sep->integrator.enabled);
+    }
+    if (ConfigFile_Changed(cfg, previous, "IntegratorSubsteps")) {
+        unsigned long substeps = strtoul(ConfigFile_Get(cfg, "IntegratorSubsteps"), NULL, 10);
+        sep->integrator.substeps = substeps ? (uint32_t)substeps : 1;
+        printf("Config: IntegratorSubsteps -> %u\n", sep->integrator.substeps);
+    }
+    Settling_Prepare(&sep->settling);
+
+    // New geometry (the levels still fit): keep levels and pressure,
+    // re-derive the gas inventory
+    if (sep->area != old_area || sep->total_volume != old_volume) {
+        double V_gas = sep->total_volume - sep->area * (sep->state.h_oil + sep->state.h_water);
+        sep->gas_mass = (sep->state.pressure * V_gas) * GAS_MOLAR_MASS /
+                        (GAS_CONSTANT * sep->state.temperature);
+    }
+}
+
+// --- Surrogate Batch ---
+// Fleets (the studies, the twin's ensemble, the optimizer's candidates)
+// step many separators on one surrogate. Separator_UpdateBatch takes them
+// in blocks of SURROGATE_BATCH_BLOCK. Each separator draws its inflows,
+// finds its cell and rebuilds its polynomial in the states as in
+// Separator_Update; the separators of the block on the same surrogate are
+// then gathered, the state polynomials as [state term][output][separator],
+// so their monomials and changes are a few unit-stride loops that
+// vectorize (build with -O3 -fno-math-errno); last each finishes its cycle
+// (settling, the relief check, the clamps). A separator without a
+// surrogate, one the surrogate does not fit and one that reaches a relief
+// valve run the full model for the cycle. A separator's result is the one
+// of Separator_Update whichever block it is in, to the last bits where the
+// compiler contracts the vector loops into FMAs (see sim_dense.h).
+// On one core a fleet cycle inside the envelope measured 2.7x (-O2) to
+// 4.7x (-O3 -march=native) faster than the full model and about 2x with
+// settling, which then costs as much as the rest (--fit-surrogate).
+#define SURROGATE_BATCH_BLOCK 64
+
+// Separator_Update after the disturbance
+static void Separator_UpdateDisturbed(SeparatorSimulator *sep, uint32_t cycle_time_ms) {
+    if (sep->surrogate.model) {
+        if (Separator_SurrogateStep(sep, cycle_time_ms)) {
+            sep->surrogate.steps++;
+            return;
+        }
+        sep->surrogate.fallbacks++;
+    }
+    Separator_Step(sep, cycle_time_ms);
+}
+
+void Separator_Update(SeparatorSimulator *sep, uint32_t cycle_time_ms) {
+    Separator_Disturb(sep, cycle_time_ms);
+    Separator_UpdateDisturbed(sep, cycle_time_ms);
+}
+
+// One cycle of seps[0..n), n <= SURROGATE_BATCH_BLOCK
+static void Separator_UpdateBlock(SeparatorSimulator *seps, size_t n, uint32_t cycle_time_ms) {
+    const SeparatorSurrogate *s = NULL;
+    SeparatorSimulator *batched[SURROGATE_BATCH_BLOCK];
+    double x[SURROGATE_BATCH_BLOCK][SURROGATE_INPUTS];
+    double state[SURROGATE_STATES][SURROGATE_BATCH_BLOCK], u[SURROGATE_STATES][SURROGATE_BATCH_BLOCK];
+    double reduced[SURROGATE_MAX_STATE_TERMS][SURROGATE_OUTPUTS][SURROGATE_BATCH_BLOCK];
+    size_t count = 0;
+
+    // The separators on the surrogate of the first one are gathered, any
+    // other steps on its own
+    for (size_t i = 0; i < n; i++) {
+        SeparatorSimulator *sep = &seps[i];
+        Separator_Disturb(sep, cycle_time_ms);
+        if (!sep->surrogate.model || (s && sep->surrogate.model != s)) {
+            Separator_UpdateDisturbed(sep, cycle_time_ms);
+            continue;
+        }
+        double v[SURROGATE_INPUTS];
+        if (!Separator_SurrogatePrepare(sep, cycle_time_ms, x[count], v)) {
+            sep->surrogate.fallbacks++;
+            Separator_Step(sep, cycle_time_ms);
+            continue;
+        }
+        s = sep->surrogate.model;
+        for (int k = 0; k < SURROGATE_STATES; k++) {
+            state[k][count] = x[count][k];
+            u[k][count] = v[k];
+        }
+        for (uint32_t t = 0; t < s->state_basis.terms; t++) {
+            for (int o = 0; o < SURROGATE_OUTPUTS; o++)
+                reduced[t][o][count] = sep->surrogate.reduced[t][o];
+        }
+        batched[count++] = sep;
+    }
+    if (count == 0)
+        return;
+
+    // State monomials in the basis order (SurrogateBasis_Evaluate), one
+    // row per term
+    double m[SURROGATE_MAX_STATE_TERMS][SURROGATE_BATCH_BLOCK];
+    uint32_t first = 0, end = 1, next = 1;
+    for (size_t j = 0; j < count; j++)
+        m[0][j] = 1.0;
+    for (uint32_t d = 1; d <= s->degree; d++) {
+        for (uint32_t t = first; t < end; t++) {
+            for (uint32_t k = s->state_basis.first[t]; k < SURROGATE_STATES; k++, next++) {
+                for (size_t j = 0; j < count; j++)
+                    m[next][j] = m[t][j] * u[k][j];
+            }
+        }
+        first = end;
+        end = next;
+    }
+
+    double delta[SURROGATE_OUTPUTS][SURROGATE_BATCH_BLOCK];
+    memset(delta, 0, sizeof(delta));
+    for (uint32_t t = 0; t < s->state_basis.terms; t++) {
+        for (int o = 0; o < SURROGATE_OUTPUTS; o++) {
+            for (size_t j = 0; j < count; j++)
+                delta[o][j] += reduced[t][o][j] * m[t][j];
+        }
+    }
+
+    // Separator_SurrogateNext; the separators gathered share the geometry
+    // and temperature of the surrogate
+    double after[SURROGATE_OUTPUTS + 1][SURROGATE_BATCH_BLOCK];
+    double max_height = s->total_volume / s->area;
+    for (size_t j = 0; j < count; j++) {
+        double oil = state[0][j] + delta[0][j];
+        oil = oil > 0.0 ? oil : 0.0;
+        oil = oil < max_height ? oil : max_height;
+        double water = state[1][j] + delta[1][j];
+        water = water > 0.0 ? water : 0.0;
+        water = water < max_height - oil ? water : max_height - oil;
+        double p = state[2][j] + delta[2][j];
+        p = p > s->ambient_pressure ? p : s->ambient_pressure;
+        double V_gas = s->total_volume - s->area * (oil + water);
+        after[0][j] = oil;
+        after[1][j] = water;
+        after[2][j] = p;
+        after[3][j] = p * V_gas * GAS_MOLAR_MASS / (GAS_CONSTANT * s->temperature);
+    }
+
+    for (size_t j = 0; j < count; j++) {
+        SeparatorSimulator *sep = batched[j];
+        double states[SURROGATE_OUTPUTS + 1] = {after[0][j], after[1][j], after[2][j], after[3][j]};
+        if (Separator_SurrogateFinish(sep, x[j], states, cycle_time_ms)) {
+            sep->surrogate.steps++;
+        } else {
+            sep->surrogate.fallbacks++;
+            Separator_Step(sep, cycle_time_ms);
+        }
+    }
+}
+
+// Step a contiguous array of separators. Each separator draws from its own
+// disturbance stream, so the result does not depend on the stepping order.
+void Separator_UpdateBatch(SeparatorSimulator *seps, size_t count, uint32_t cycle_time_ms) {
+    for (size_t begin = 0; begin < count; begin += SURROGATE_BATCH_BLOCK) {
+        size_t n = count - begin < SURROGATE_BATCH_BLOCK ? count - begin : SURROGATE_BATCH_BLOCK;
+        Separator_UpdateBlock(seps + begin, n, cycle_time_ms);
+    }
+}
+
+// --- Flare Header ---
+// The relief of every separator goes to one flare header. A fleet steps in
+// fixed partitions on a SimExecutor; each partition sums the relief of its
+// own separators and the partial sums are reduced in partition order, so the
+// header load is bit-identical for any thread count.
+#define FLARE_PARTITION_SIZE 64
+#define FLARE_PARTIALS 2            // Per partition: load, relieving count
+
+typedef struct {
+    double load;                // kg/s this cycle
+    double peak_load;           // kg/s since start
+    double peak_time;           // s
+    double relieved_mass;       // kg since start
+    uint32_t relieving;         // Separators with a PSV or the BDV flowing
+    uint32_t peak_relieving;
+    double time;                // s
+} FlareHeader;
+
+typedef struct {
+    SeparatorSimulator *seps;
+    size_t count;
+    uint32_t cycle_time_ms;
+    double *partials;           // FLARE_PARTIALS per partition
+} FleetStepJob;
+
+// Executor job: step one partition and sum its relief
+static void Fleet_StepPartition(void *context, size_t partition) {
+    FleetStepJob *job = context;
+    size_t begin, end;
+    SimPartition_Range(job->count, FLARE_PARTITION_SIZE, partition, &begin, &end);
+    Separator_UpdateBatch(job->seps + begin, end - begin, job->cycle_time_ms);
+
+    double load = 0.0, relieving = 0.0;
+    for (size_t i = begin; i < end; i++) {
+        double rate = job->seps[i].relief.enabled ? job->seps[i].relief.relief_rate : 0.0;
+        load += rate;
+        relieving += rate > 0.0;
+    }
+    job->partials[partition * FLARE_PARTIALS] = load;
+    job->partials[partition * FLARE_PARTIALS + 1] = relieving;
+}
+
+static size_t Fleet_Partitions(size_t count) {
+    return SimPartition_Count(count, FLARE_PARTITION_SIZE);
+}
+
+// Step count separators one cycle and update the flare header. partials
+// holds FLARE_PARTIALS * Fleet_Partitions(count) doubles.
+void Separator_UpdateFleet(SimExecutor *executor, SeparatorSimulator *seps, size_t count,
+                           uint32_t cycle_time_ms, double *partials, FlareHeader *flare) {
+    FleetStepJob job = {.seps = seps, .count = count, .cycle_time_ms = cycle_time_ms, .partials = partials};
+    size_t partitions = Fleet_Partitions(count);
+    SimExecutor_Run(executor, Fleet_StepPartition, &job, partitions);
+
+    // Fixed-order reduction: partition 0 first, whatever thread ran it
+    double load = 0.0, relieving = 0.0;
+    for (size_t p = 0; p < partitions; p++) {
+        load += partials[p * FLARE_PARTIALS];
+        relieving += partials[p * FLARE_PARTIALS + 1];
+    }
+    double dt = cycle_time_ms / 1000.0;
+    flare->time += dt;
+    flare->load = load;
+    flare->relieving = (uint32_t)relieving;
+    flare->relieved_mass += load * dt;
+    if (load > flare->peak_load) {
+        flare->peak_load = load;
+        flare->peak_time = flare->time;
+    }
+    if (flare->relieving > flare->peak_relieving)
+        flare->peak_relieving = flare->relieving;
+}
+
+// The server's separator is a fleet of one on the calling thread
+SimExecutor executor;
+FlareHeader flare;
+double flare_partials[FLARE_PARTIALS];
+
+// --- OPC UA Callbacks ---
+static void onConfigChanged(UA_Server *server, const UA_NodeId *sessionId,
+                            void *sessionContext, const UA_NodeId *nodeId,
+                            void *nodeContext, const UA_NumericRange *range,
+                            const UA_DataValue *data) {
+    if (!data || !data->hasValue || !UA_Variant_isScalar(&data->value)) return;
+
+    UA_QualifiedName browseName;
+    UA_Server_readBrowseName(server, *nodeId, &browseName);
+
+    UA_String q_in_oil_str = UA_STRING("Q_in_oil");
+    UA_String q_in_water_str = UA_STRING("Q_in_water");
+    UA_String q_in_gas_str = UA_STRING("Q_in_gas");
+    UA_String valve_oil_str = UA_STRING("valve_oil");
+    UA_String valve_water_str = UA_STRING("valve_water");
+    UA_String valve_gas_str = UA_STRING("valve_gas");
+    UA_String dist_enabled_str = UA_STRING("DisturbanceEnabled");
+    UA_String slug_rate_str = UA_STRING("SlugRate");
+    UA_String slug_duration_str = UA_STRING("SlugDuration");
+    UA_String slug_liquid_gain_str = UA_STRING("SlugLiquidGain");
+    UA_String gas_surge_gain_str = UA_STRING("GasSurgeGain");
+    UA_String noise_intensity_str = UA_STRING("NoiseIntensity");
+    UA_String noise_tau_str = UA_STRING("NoiseTau");
+    UA_String settling_enabled_str = UA_STRING("SettlingEnabled");
+    UA_String water_dispersed_str = UA_STRING("WaterDispersed");
+    UA_String oil_dispersed_str = UA_STRING("OilDispersed");
+    UA_String water_d50_str = UA_STRING("WaterDropletD50");
+    UA_String oil_d50_str = UA_STRING("OilDropletD50");
+    UA_String energy_enabled_str = UA_STRING("EnergyBalanceEnabled");
+    UA_String inlet_temperature_str = UA_STRING("InletTemperature");
+    UA_String ambient_temperature_str = UA_STRING("AmbientTemperature");
+    UA_String relief_enabled_str = UA_STRING("ReliefEnabled");
+    UA_String psv1_set_str = UA_STRING("Psv1SetPressure");
+    UA_String psv2_set_str = UA_STRING("Psv2SetPressure");
+    UA_String bdv_open_str = UA_STRING("BdvOpen");
+    UA_String bdv_trip_str = UA_STRING("BdvTripPressure");
+    UA_String event_location_str = UA_STRING("EventLocation");
+    UA_String substeps_str = UA_STRING("IntegratorSubsteps");
+
+    if (UA_String_equal(&browseName.name, &q_in_oil_str))
+        separator.config.Q_in_oil = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &q_in_water_str))
+        separator.config.Q_in_water = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &q_in_gas_str))
+        separator.config.Q_in_gas = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &valve_oil_str))
+        separator.config.valve_oil = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &valve_water_str))
+        separator.config.valve_water = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &valve_gas_str))
+        separator.config.valve_gas = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &dist_enabled_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+            separator.disturbance.enabled = *(UA_Boolean*)data->value.data;
+    }
+    else if (UA_String_equal(&browseName.name, &slug_rate_str))
+        separator.disturbance.slug_rate = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &slug_duration_str))
+        separator.disturbance.slug_duration = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &slug_liquid_gain_str))
+        separator.disturbance.slug_liquid_gain = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &gas_surge_gain_str))
+        separator.disturbance.gas_surge_gain = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &noise_intensity_str))
+        separator.disturbance.noise_intensity = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &noise_tau_str))
+        separator.disturbance.noise_tau = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &settling_enabled_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+            separator.settling.enabled = *(UA_Boolean*)data->value.data;
+    }
+    else if (UA_String_equal(&browseName.name, &water_dispersed_str))
+        separator.settling.water_dispersed = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &oil_dispersed_str))
+        separator.settling.oil_dispersed = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &water_d50_str)) {
+        separator.settling.water_d50 = *(UA_Double*)data->value.data;
+        Settling_Prepare(&separator.settling);
+    }
+    else if (UA_String_equal(&browseName.name, &oil_d50_str)) {
+        separator.settling.oil_d50 = *(UA_Double*)data->value.data;
+        Settling_Prepare(&separator.settling);
+    }
+    else if (UA_String_equal(&browseName.name, &energy_enabled_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+            separator.energy.enabled = *(UA_Boolean*)data->value.data;
+    }
+    else if (UA_String_equal(&browseName.name, &inlet_temperature_str))
+        separator.energy.T_in = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &ambient_temperature_str))
+        separator.energy.T_ambient = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &relief_enabled_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+            separator.relief.enabled = *(UA_Boolean*)data->value.data;
+    }
+    else if (UA_String_equal(&browseName.name, &psv1_set_str))
+        separator.relief.psv[0].set_pressure = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &psv2_set_str))
+        separator.relief.psv[1].set_pressure = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &bdv_open_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+            separator.relief.bdv_open = *(UA_Boolean*)data->value.data;
+    }
+    else if (UA_String_equal(&browseName.name, &bdv_trip_str))
+        separator.relief.bdv_trip_pressure = *(UA_Double*)data->value.data;
+    else if (UA_String_equal(&browseName.name, &event_location_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN])
+            separator.integrator.enabled = *(UA_Boolean*)data->value.data;
+    }
+    else if (UA_String_equal(&browseName.name, &substeps_str)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_UINT32] && *(UA_UInt32*)data->value.data > 0)
+            separator.integrator.substeps = *(UA_UInt32*)data->value.data;
+    }
+
+    UA_QualifiedName_clear(&browseName);
+}
+
+static void addVariableWithCallback(UA_Server *server, UA_NodeId parentNode,
+                                    const char *nodeIdStr, const char *displayName,
+                                    void *value, const UA_DataType *type) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", displayName);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    UA_Variant_setScalar(&attr.value, value, type);
+
+    UA_Server_addVariableNode(server, UA_NODEID_STRING(1, nodeIdStr), parentNode,
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                              UA_QUALIFIEDNAME(1, nodeIdStr),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                              attr, NULL, NULL);
+
+    UA_ValueCallback callback = {.onRead = NULL, .onWrite = onConfigChanged};
+    UA_Server_setVariableNode_valueCallback(server, UA_NODEID_STRING(1, nodeIdStr), callback);
+}
+
+static void addStateVariable(UA_Server *server, UA_NodeId parentNode,
+                             const char *nodeIdStr, void *value, const UA_DataType *type) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", nodeIdStr);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    attr.minimumSamplingInterval = 100.0;
+    UA_Variant_setScalar(&attr.value, value, type);
+    UA_Server_addVariableNode(server, UA_NODEID_STRING(1, nodeIdStr), parentNode,
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                              UA_QUALIFIEDNAME(1, nodeIdStr),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                              attr, NULL, NULL);
+}
+
+static void writeStateValue(UA_Server *server, const char *nodeIdStr,
+                            void *value, const UA_DataType *type) {
+    UA_Variant v;
+    UA_Variant_setScalar(&v, value, type);
+    UA_Server_writeValue(server, UA_NODEID_STRING(1, nodeIdStr), v);
+}
+
+// Push the writable values back to their nodes after a config reload
+static void writeConfigValues(UA_Server *server) {
+    writeStateValue(server, "Q_in_oil", &separator.config.Q_in_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "Q_in_water", &separator.config.Q_in_water, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "Q_in_gas", &separator.config.Q_in_gas, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "valve_oil", &separator.config.valve_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "valve_water", &separator.config.valve_water, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "valve_gas", &separator.config.valve_gas, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "DisturbanceEnabled", &separator.disturbance.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeStateValue(server, "SlugRate", &separator.disturbance.slug_rate, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "SlugDuration", &separator.disturbance.slug_duration, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "SlugLiquidGain", &separator.disturbance.slug_liquid_gain, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "GasSurgeGain", &separator.disturbance.gas_surge_gain, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "NoiseIntensity", &separator.disturbance.noise_intensity, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "NoiseTau", &separator.disturbance.noise_tau, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "SettlingEnabled", &separator.settling.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeStateValue(server, "WaterDispersed", &separator.settling.water_dispersed, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "OilDispersed", &separator.settling.oil_dispersed, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "WaterDropletD50", &separator.settling.water_d50, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "OilDropletD50", &separator.settling.oil_d50, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "EnergyBalanceEnabled", &separator.energy.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeStateValue(server, "InletTemperature", &separator.energy.T_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "AmbientTemperature", &separator.energy.T_ambient, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "ReliefEnabled", &separator.relief.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeStateValue(server, "Psv1SetPressure", &separator.relief.psv[0].set_pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "Psv2SetPressure", &separator.relief.psv[1].set_pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "BdvOpen", &separator.relief.bdv_open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeStateValue(server, "BdvTripPressure", &separator.relief.bdv_trip_pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
+    writeStateValue(server, "EventLocation", &separator.integrator.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    writeStateValue(server, "IntegratorSubsteps", &separator.integrator.substeps, &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+static void addSeparatorObject(UA_Server *server) {
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                            UA_QUALIFIEDNAME(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Config"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Config"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "Q_in_oil", "Oil Inflow", &separator.config.Q_in_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "Q_in_water", "Water Inflow", &separator.config.Q_in_water, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "Q_in_gas", "Gas Inflow", &separator.config.Q_in_gas, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "valve_oil", "Oil Valve", &separator.config.valve_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "valve_water", "Water Valve", &separator.config.valve_water, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Config"), "valve_gas", "Gas Valve", &separator.config.valve_gas, &UA_TYPES[UA_TYPES_DOUBLE]);
+
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "State"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "State"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    // h_oil
     UA_VariableAttributes oilAttr = UA_VariableAttributes_default;
     oilAttr.displayName = UA_LOCALIZEDTEXT("en-US", "h_oil");
     oilAttr.accessLevel = UA_ACCESSLEVELMASK_READ;
@@ -256,43 +2162,2433 @@ static void addSeparatorObject(UA_Server *server) {
                               UA_QUALIFIEDNAME(1, "pressure"),
                               UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
                               pressureAttr, NULL, NULL);
-}
-
-int main(void) {
-    signal(SIGINT, stopHandler);
-    signal(SIGTERM, stopHandler);
 
-    Separator_Init(&separator);
-    server = UA_Server_new();
-    UA_ServerConfig_setDefault(UA_Server_getConfig(server));
+    addStateVariable(server, UA_NODEID_STRING(1, "State"), "Q_oil_in", &separator.state.Q_oil_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "State"), "Q_water_in", &separator.state.Q_water_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "State"), "Q_gas_in", &separator.state.Q_gas_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "State"), "SlugActive", &separator.disturbance.in_slug, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addStateVariable(server, UA_NODEID_STRING(1, "State"), "temperature", &separator.state.temperature, &UA_TYPES[UA_TYPES_DOUBLE]);
 
-    addSeparatorObject(server);
-    printf("OPC UA Separator Server running at opc.tcp://localhost:4840\n");
+    // Inflow disturbance generator (disabled by default)
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Disturbance"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Disturbance"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
 
-    UA_Server_run_startup(server);
-    while (running) {
-        UA_Server_run_iterate(server, true);
-        Separator_Update(&separator, DEFAULT_CYCLE_TIME_MS);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "DisturbanceEnabled", "Disturbance Enabled", &separator.disturbance.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "SlugRate", "Slug Rate (1/s)", &separator.disturbance.slug_rate, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "SlugDuration", "Slug Duration (s)", &separator.disturbance.slug_duration, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "SlugLiquidGain", "Slug Liquid Gain", &separator.disturbance.slug_liquid_gain, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "GasSurgeGain", "Gas Surge Gain", &separator.disturbance.gas_surge_gain, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "NoiseIntensity", "Noise Intensity", &separator.disturbance.noise_intensity, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Disturbance"), "NoiseTau", "Noise Time Constant (s)", &separator.disturbance.noise_tau, &UA_TYPES[UA_TYPES_DOUBLE]);
 
-        UA_Variant value;
+    // Droplet settling: inlet dispersion and separation efficiency
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Settling"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Settling"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
 
-        UA_Variant_setScalar(&value, &separator.state.h_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
-        UA_Server_writeValue(server, UA_NODEID_STRING(1, "h_oil"), value);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Settling"), "SettlingEnabled", "Settling Enabled", &separator.settling.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Settling"), "WaterDispersed", "Water Dispersed in Oil (share)", &separator.settling.water_dispersed, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Settling"), "OilDispersed", "Oil Dispersed in Water (share)", &separator.settling.oil_dispersed, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Settling"), "WaterDropletD50", "Water Droplet d50 (m)", &separator.settling.water_d50, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Settling"), "OilDropletD50", "Oil Droplet d50 (m)", &separator.settling.oil_d50, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Settling"), "WaterInOil", &separator.settling.water_in_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Settling"), "OilInWaterPpm", &separator.settling.oil_in_water_ppm, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Settling"), "WaterEfficiency", &separator.settling.water_efficiency, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Settling"), "OilEfficiency", &separator.settling.oil_efficiency, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Settling"), "OilResidenceTime", &separator.settling.oil_residence_time, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Settling"), "WaterResidenceTime", &separator.settling.water_residence_time, &UA_TYPES[UA_TYPES_DOUBLE]);
 
-        UA_Variant_setScalar(&value, &separator.state.h_water, &UA_TYPES[UA_TYPES_DOUBLE]);
+    // Energy balance (temperature itself is under State)
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Thermal"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Thermal"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Thermal"), "EnergyBalanceEnabled", "Energy Balance Enabled", &separator.energy.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Thermal"), "InletTemperature", "Inlet Temperature (K)", &separator.energy.T_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Thermal"), "AmbientTemperature", "Ambient Temperature (K)", &separator.energy.T_ambient, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Thermal"), "GasOutletTemperature", &separator.energy.gas_outlet_temperature, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Thermal"), "HeatLoss", &separator.energy.heat_loss, &UA_TYPES[UA_TYPES_DOUBLE]);
+
+    // Overpressure protection and the flare header it relieves to
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Relief"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Relief"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Relief"), "ReliefEnabled", "Relief Enabled", &separator.relief.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Relief"), "Psv1SetPressure", "PSV 1 Set Pressure (Pa)", &separator.relief.psv[0].set_pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Relief"), "Psv2SetPressure", "PSV 2 Set Pressure (Pa)", &separator.relief.psv[1].set_pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Relief"), "BdvOpen", "Blowdown Valve Open", &separator.relief.bdv_open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Relief"), "BdvTripPressure", "Blowdown Valve Trip Pressure (Pa)", &separator.relief.bdv_trip_pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "Psv1Open", &separator.relief.psv[0].open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "Psv2Open", &separator.relief.psv[1].open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "Psv1Flow", &separator.relief.psv[0].flow, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "Psv2Flow", &separator.relief.psv[1].flow, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "Psv1RatedCapacity", &separator.relief.psv[0].rated_capacity, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "Psv2RatedCapacity", &separator.relief.psv[1].rated_capacity, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "BdvFlow", &separator.relief.bdv_flow, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "ReliefRate", &separator.relief.relief_rate, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "RelievedMass", &separator.relief.relieved_mass, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "FlareLoad", &flare.load, &UA_TYPES[UA_TYPES_DOUBLE]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Relief"), "FlarePeakLoad", &flare.peak_load, &UA_TYPES[UA_TYPES_DOUBLE]);
+
+    // Integrator: event location on/off and the events located so far
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Integrator"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Integrator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Integrator"), "EventLocation", "Event Location", &separator.integrator.enabled, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    addVariableWithCallback(server, UA_NODEID_STRING(1, "Integrator"), "IntegratorSubsteps", "RK4 Steps per Cycle", &separator.integrator.substeps, &UA_TYPES[UA_TYPES_UINT32]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Integrator"), "Events", &separator.integrator.events, &UA_TYPES[UA_TYPES_UINT64]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Integrator"), "SurrogateSteps", &separator.surrogate.steps, &UA_TYPES[UA_TYPES_UINT64]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Integrator"), "SurrogateFallbacks", &separator.surrogate.fallbacks, &UA_TYPES[UA_TYPES_UINT64]);
+}
+
+// ==================== STEP BENCHMARKS ====================
+// seperator --bench-settling|--bench-thermal [--vessels 1000,10000] [--cycles 1000]
+//
+// Steps a fleet of separators headless through Separator_UpdateBatch, once
+// with one submodel off and once with it on (every other submodel off), and
+// prints the time per vessel-cycle of both. Every vessel gets its own
+// disturbance stream so the levels, residence times and temperatures differ.
+
+#define BENCH_MAX_LIST 8
+
+typedef enum {
+    STEP_BENCH_SETTLING,
+    STEP_BENCH_THERMAL
+} StepBenchModel;
+
+// Comma-separated list of positive integers
+static size_t parseBenchList(const char *text, uint32_t *out) {
+    size_t count = 0;
+    char *end;
+    while (*text && count < BENCH_MAX_LIST) {
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || value == 0)
+            break;
+        out[count++] = (uint32_t)value;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+static double StepBench_Run(SeparatorSimulator *fleet, uint32_t vessels, uint32_t cycles,
+                            StepBenchModel model, bool on) {
+    for (uint32_t i = 0; i < vessels; i++) {
+        Separator_Init(&fleet[i]);
+        fleet[i].disturbance.enabled = true;
+        fleet[i].disturbance.stream = i;
+        fleet[i].settling.enabled = model == STEP_BENCH_SETTLING && on;
+        fleet[i].energy.enabled = model == STEP_BENCH_THERMAL && on;
+        fleet[i].energy.T_in = 330.0;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t c = 0; c < cycles; c++)
+        Separator_UpdateBatch(fleet, vessels, DEFAULT_CYCLE_TIME_MS);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+    return ns / ((double)vessels * cycles);
+}
+
+static int StepBench_Main(int argc, char **argv, StepBenchModel model) {
+    uint32_t vessel_counts[BENCH_MAX_LIST] = {1000, 10000};
+    size_t vessel_count_n = 2;
+    uint32_t cycles = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vessels") == 0 && i + 1 < argc) {
+            vessel_count_n = parseBenchList(argv[++i], vessel_counts);
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--vessels N,..] [--cycles C]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!vessel_count_n || cycles == 0) {
+        fprintf(stderr, "Empty --vessels list or no --cycles\n");
+        return EXIT_FAILURE;
+    }
+
+    if (model == STEP_BENCH_SETTLING) {
+        printf("Separator step with droplet settling (%d bins per phase), %u cycles\n", SETTLING_BINS, cycles);
+        printf("%9s %14s %14s %8s %14s %14s\n", "vessels", "off_ns/vessel", "on_ns/vessel", "ratio",
+               "mean_BSW_%", "mean_OiW_ppm");
+    } else {
+        printf("Separator step, isothermal vs energy balance (inlet 330 K), %u cycles\n", cycles);
+        printf("%9s %14s %14s %8s %14s %14s\n", "vessels", "off_ns/vessel", "on_ns/vessel", "ratio",
+               "mean_T_K", "mean_JT_drop_K");
+    }
+    for (size_t v = 0; v < vessel_count_n; v++) {
+        uint32_t vessels = vessel_counts[v];
+        SeparatorSimulator *fleet = calloc(vessels, sizeof(SeparatorSimulator));
+        if (!fleet) {
+            fprintf(stderr, "Cannot allocate %u separators\n", vessels);
+            return EXIT_FAILURE;
+        }
+        double off = StepBench_Run(fleet, vessels, cycles, model, false);
+        double on = StepBench_Run(fleet, vessels, cycles, model, true);
+
+        double a = 0.0, b = 0.0;
+        for (uint32_t i = 0; i < vessels; i++) {
+            if (model == STEP_BENCH_SETTLING) {
+                a += 100.0 * fleet[i].settling.water_in_oil;
+                b += fleet[i].settling.oil_in_water_ppm;
+            } else {
+                a += fleet[i].state.temperature;
+                b += fleet[i].state.temperature - fleet[i].energy.gas_outlet_temperature;
+            }
+        }
+        printf("%9u %14.1f %14.1f %7.2fx %14.3f %14.3f\n", vessels, off, on, on / off, a / vessels, b / vessels);
+        free(fleet);
+    }
+    return EXIT_SUCCESS;
+}
+
+// ==================== EVENT LOCATION BENCHMARK ====================
+// seperator --bench-events [--horizon 1500] [--steps 30,150,1500]
+//
+// Accuracy against step count for one drain-and-vent run: the fixed-step
+// Euler update with clamps and the RK4 integrator with event location,
+// each at cycle times of horizon/steps. The reference is event location
+// at 10 ms. Reports the largest level and pressure errors over ten
+// checkpoints, the error in the time the oil runs empty, how often a level
+// or the pressure hit its limit (clamps on the fixed step, events on the
+// integrator) and the time per run. Step counts are multiples of the ten
+// checkpoints so every run samples at the same times.
+
+#define EVENT_BENCH_CHECKPOINTS 10
+
+// No oil or gas inflow, a water trickle, every outlet wide open, 4 bar
+static void EventBench_Scenario(SeparatorSimulator *sep) {
+    sep->config.Q_in_oil = 0.0;
+    sep->config.Q_in_water = 0.002;
+    sep->config.Q_in_gas = 0.0;
+    sep->config.valve_oil = sep->config.valve_water = sep->config.valve_gas = 100.0;
+    sep->state.h_oil = 1.2;
+    sep->state.h_water = 0.8;
+    Separator_SetPressure(sep, 400000.0);
+}
+
+typedef struct {
+    double h_oil[EVENT_BENCH_CHECKPOINTS];
+    double h_water[EVENT_BENCH_CHECKPOINTS];
+    double pressure[EVENT_BENCH_CHECKPOINTS];
+    double oil_empty_time;   // s, NAN if never
+    uint64_t limit_hits;
+    double seconds;
+} EventBenchResult;
+
+static void EventBench_Run(double horizon, uint32_t steps, bool events, EventBenchResult *out) {
+    SeparatorSimulator sep;
+    memset(&sep, 0, sizeof(sep));
+    Separator_Init(&sep);
+    sep.settling.enabled = false;
+    sep.energy.enabled = false;
+    sep.integrator.enabled = events;
+    EventBench_Scenario(&sep);
+
+    uint32_t cycle_time_ms = (uint32_t)(horizon * 1000.0 / steps);
+    out->oil_empty_time = NAN;
+    out->limit_hits = 0;
+    bool oil_empty = false, water_empty = false, at_ambient = false;
+    uint32_t checkpoint = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 1; i <= steps; i++) {
+        Separator_Update(&sep, cycle_time_ms);
+        if (!events) {
+            // A limit hit is the first step that ends on it
+            if (sep.state.h_oil <= 0.0 && !oil_empty && isnan(out->oil_empty_time))
+                out->oil_empty_time = i * cycle_time_ms / 1000.0;
+            out->limit_hits += (sep.state.h_oil <= 0.0 && !oil_empty) + (sep.state.h_water <= 0.0 && !water_empty) +
+                               (sep.state.pressure <= sep.ambient_pressure && !at_ambient);
+            oil_empty = sep.state.h_oil <= 0.0;
+            water_empty = sep.state.h_water <= 0.0;
+            at_ambient = sep.state.pressure <= sep.ambient_pressure;
+        }
+        if (i % (steps / EVENT_BENCH_CHECKPOINTS) == 0) {
+            out->h_oil[checkpoint] = sep.state.h_oil;
+            out->h_water[checkpoint] = sep.state.h_water;
+            out->pressure[checkpoint] = sep.state.pressure;
+            checkpoint++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    out->seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (events) {
+        const SeparatorIntegrator *it = &sep.integrator;
+        if (it->event_count[SEPARATOR_EVENT_OIL_EMPTY])
+            out->oil_empty_time = it->event_time[SEPARATOR_EVENT_OIL_EMPTY];
+        out->limit_hits = it->event_count[SEPARATOR_EVENT_OIL_EMPTY] + it->event_count[SEPARATOR_EVENT_WATER_EMPTY] +
+                          it->event_count[SEPARATOR_EVENT_AMBIENT];
+    }
+}
+
+static int EventBench_Main(int argc, char **argv) {
+    uint32_t step_counts[BENCH_MAX_LIST] = {30, 60, 150, 300, 1500, 15000};
+    size_t step_count_n = 6;
+    uint32_t horizon = 1500;   // s
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            step_count_n = parseBenchList(argv[++i], step_counts);
+        } else if (strcmp(argv[i], "--horizon") == 0 && i + 1 < argc) {
+            horizon = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--horizon S] [--steps N,..]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!step_count_n || horizon == 0) {
+        fprintf(stderr, "Empty --steps list or no --horizon\n");
+        return EXIT_FAILURE;
+    }
+
+    EventBenchResult reference;
+    EventBench_Run(horizon, horizon * 100, true, &reference);
+    printf("Drain and vent over %u s, reference: event location at 10 ms (oil empty at %.3f s)\n", horizon,
+           reference.oil_empty_time);
+    printf("%-8s %7s %9s %12s %12s %12s %12s %6s %10s\n", "method", "steps", "dt_s", "err_h_oil_m",
+           "err_h_water_m", "err_P_Pa", "err_empty_s", "hits", "us/run");
+    for (size_t s = 0; s < step_count_n; s++) {
+        for (int events = 0; events <= 1; events++) {
+            uint32_t steps = step_counts[s];
+            if (steps % EVENT_BENCH_CHECKPOINTS || horizon * 1000.0 / steps < 1.0) {
+                if (events)
+                    fprintf(stderr, "Skipping %u steps: not a multiple of %d or under 1 ms\n", steps,
+                            EVENT_BENCH_CHECKPOINTS);
+                continue;
+            }
+            EventBenchResult r;
+            EventBench_Run(horizon, steps, events, &r);
+            double err_oil = 0.0, err_water = 0.0, err_pressure = 0.0;
+            for (int c = 0; c < EVENT_BENCH_CHECKPOINTS; c++) {
+                err_oil = fmax(err_oil, fabs(r.h_oil[c] - reference.h_oil[c]));
+                err_water = fmax(err_water, fabs(r.h_water[c] - reference.h_water[c]));
+                err_pressure = fmax(err_pressure, fabs(r.pressure[c] - reference.pressure[c]));
+            }
+            printf("%-8s %7u %9.3f %12.3e %12.3e %12.3e %12.3e %6llu %10.1f\n", events ? "events" : "euler",
+                   steps, (uint32_t)(horizon * 1000.0 / steps) / 1000.0, err_oil, err_water, err_pressure,
+                   fabs(r.oil_empty_time - reference.oil_empty_time), (unsigned long long)r.limit_hits,
+                   r.seconds * 1e6);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// ==================== RELIEF STUDY ====================
+// seperator --relief-study [--vessels 1000] [--threads 1,4] [--cycles 6000]
+//
+// Plant-wide relief load on one flare header. Every separator has its gas
+// outlet blocked and takes gas at its own rate, with its own disturbance
+// stream, from its own starting pressure: the PSVs lift and cycle as the
+// vessels reach their set pressure. Halfway through, an emergency shutdown
+// opens every blowdown valve. Prints the header load over time, the peak
+// and the relieved mass, once per thread count; the results are identical
+// for every thread count.
+
+static void ReliefStudy_Init(SeparatorSimulator *fleet, uint32_t vessels) {
+    for (uint32_t i = 0; i < vessels; i++) {
+        SeparatorSimulator *sep = &fleet[i];
+        Separator_Init(sep);
+        sep->settling.enabled = false;
+        sep->disturbance.enabled = true;
+        sep->disturbance.stream = i;
+        sep->config.Q_in_oil = sep->config.Q_in_water = 0.0;
+        sep->config.valve_oil = sep->config.valve_water = sep->config.valve_gas = 0.0;
+        sep->config.Q_in_gas = 0.05 + 0.1 * (double)((i * 37) % 100) / 100.0;
+        Separator_SetPressure(sep, 600000.0 + 300000.0 * (double)(i % 7) / 7.0);
+    }
+}
+
+static int ReliefStudy_Main(int argc, char **argv) {
+    uint32_t thread_counts[BENCH_MAX_LIST] = {1, 4};
+    size_t thread_count_n = 2;
+    uint32_t vessels = 1000, cycles = 6000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vessels") == 0 && i + 1 < argc) {
+            vessels = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count_n = parseBenchList(argv[++i], thread_counts);
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--vessels N] [--threads T,..] [--cycles C]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!thread_count_n || vessels == 0 || cycles == 0) {
+        fprintf(stderr, "Empty --threads list, no --vessels or no --cycles\n");
+        return EXIT_FAILURE;
+    }
+
+    SeparatorSimulator *fleet = calloc(vessels, sizeof(SeparatorSimulator));
+    double *partials = calloc(Fleet_Partitions(vessels) * FLARE_PARTIALS, sizeof(double));
+    if (!fleet || !partials) {
+        fprintf(stderr, "Cannot allocate %u separators\n", vessels);
+        free(fleet);
+        free(partials);
+        return EXIT_FAILURE;
+    }
+
+    printf("Relief study: %u separators, gas outlets blocked, ESD (all BDVs open) at %.0f s\n", vessels,
+           cycles / 2 * DEFAULT_CYCLE_TIME_MS / 1000.0);
+    int status = EXIT_SUCCESS;
+    for (size_t t = 0; t < thread_count_n; t++) {
+        SimExecutor study_executor;
+        if (!SimExecutor_Start(&study_executor, thread_counts[t])) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        ReliefStudy_Init(fleet, vessels);
+        FlareHeader header;
+        memset(&header, 0, sizeof(header));
+
+        printf("\n%u threads\n%9s %14s %10s\n", thread_counts[t], "time_s", "flare_kg/s", "relieving");
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t c = 0; c < cycles; c++) {
+            if (c == cycles / 2) {
+                for (uint32_t i = 0; i < vessels; i++)
+                    fleet[i].relief.bdv_open = true;
+            }
+            Separator_UpdateFleet(&study_executor, fleet, vessels, DEFAULT_CYCLE_TIME_MS, partials, &header);
+            if ((c + 1) % (cycles / 10 ? cycles / 10 : 1) == 0)
+                printf("%9.1f %14.3f %10u\n", header.time, header.load, header.relieving);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        SimExecutor_Stop(&study_executor);
+
+        double ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+        printf("peak %.17g kg/s at %.1f s, %u relieving at most, %.17g kg relieved, %.1f ns/vessel-cycle\n",
+               header.peak_load, header.peak_time, header.peak_relieving, header.relieved_mass,
+               ns / ((double)vessels * cycles));
+    }
+    free(fleet);
+    free(partials);
+    return status;
+}
+
+// ==================== DIGITAL TWIN ====================
+// seperator --twin <measurements|-> [--members 64] [--threads 1] [--seed 1]
+//           [--sigma-level 0.01] [--sigma-pressure 2000] [--inflation 1.005]
+//           [--headless] [config]
+//
+// Tracks a field separator with an ensemble Kalman filter (stochastic EnKF,
+// perturbed observations). The ensemble is `members` separators whose
+// unmeasured inputs (the three inflows) and liquid discharge coefficient
+// are drawn around the configured values. Each member gets its own
+// disturbance stream (inflow noise, no slugs) as process noise, and the
+// ensemble steps through Separator_UpdateFleet. At every measurement the
+// augmented state
+//   x = (h_oil, h_water, pressure, Q_in_oil, Q_in_water, Q_in_gas, Cd)
+// of every member is corrected from the measured levels and pressure:
+//   A = X - mean(X) (inflated), HA its measured rows, D = y + e, e ~ N(0, R)
+//   P_yy = HA HA^T / (N - 1) + R,   P_xy = A HA^T / (N - 1)
+//   X += P_xy P_yy^-1 (D - HX)
+// with SimDense_Gemm and a Cholesky solve of P_yy (sim_dense.h). The
+// corrected pressure sets each member's gas inventory.
+//
+// Measurements are text lines "<time_s> <h_oil> <h_water> <pressure>
+// [<valve_oil> <valve_water> <valve_gas>]", with '#' comments and "nan" for
+// a channel that was not measured. Valve openings, when given, are the
+// known inputs from that time on. "-" reads standard input, so a replay
+// service can pipe a recording in. A measurement is assimilated at the
+// first cycle that ends at or after its time.
+//
+// --headless runs as fast as the measurements arrive and prints the
+// estimate after each analysis. Otherwise the server runs paced, with the
+// estimate and its spread in the Twin folder; the State nodes show the
+// ensemble mean, and valve writes drive every member.
+
+#define TWIN_STATES 7
+#define TWIN_MEASURED 3           // The first TWIN_STATES rows: levels, pressure
+#define TWIN_LINE_BUFFER 4096
+
+static const char *const twin_state_names[TWIN_STATES] = {
+    "h_oil", "h_water", "pressure", "Q_in_oil", "Q_in_water", "Q_in_gas", "Cd"};
+
+typedef struct {
+    double time;                      // s
+    double values[TWIN_MEASURED];     // NAN: not measured
+    bool has_valves;
+    double valves[3];                 // %, oil, water, gas
+} TwinMeasurement;
+
+typedef struct {
+    int fd;
+    bool eof;
+    size_t length;
+    char buffer[TWIN_LINE_BUFFER];
+} TwinSource;
+
+typedef struct {
+    // Options
+    bool enabled;
+    bool headless;
+    const char *source_path;
+    uint32_t members;
+    uint32_t threads;
+    uint32_t seed;
+    double sigma[TWIN_MEASURED];      // Measurement noise, m, m, Pa
+    double inflation;                 // Of the anomalies, per analysis
+
+    // Ensemble
+    SeparatorSimulator *ensemble;
+    double *partials;
+    SimExecutor executor;
+    FlareHeader flare;
+    TwinSource source;
+    TwinMeasurement pending;
+    bool has_pending;
+    double time;                      // s
+
+    // Analysis work arrays, row-major with one column per member
+    double *X;                        // TWIN_STATES x N
+    double *HA;                       // TWIN_MEASURED x N
+    double *innovation;               // TWIN_MEASURED x N
+    double P_yy[TWIN_MEASURED * TWIN_MEASURED];
+    double P_xy[TWIN_STATES * TWIN_MEASURED];
+
+    // Estimate (published)
+    double mean[TWIN_STATES];
+    double spread[TWIN_STATES];       // Ensemble standard deviation
+    double innovation_rms;            // Normalized, ≈1 when consistent
+    uint64_t analyses;
+    uint32_t member_count;
+} SeparatorTwin;
+
+SeparatorTwin twin;
+
+// Read what is available; true and the next measurement if a whole line
+// parsed (blank, comment and malformed lines are skipped)
+static bool TwinSource_Next(TwinSource *src, TwinMeasurement *out) {
+    for (;;) {
+        char *newline = memchr(src->buffer, '\n', src->length);
+        if (!newline) {
+            if (src->eof) {
+                if (src->length == 0)
+                    return false;
+                src->buffer[src->length++] = '\n';  // Last line without a newline
+                continue;
+            }
+            if (src->length == sizeof(src->buffer) - 1) {
+                fprintf(stderr, "Twin: measurement line too long, skipped\n");
+                src->length = 0;
+            }
+            ssize_t got = read(src->fd, src->buffer + src->length, sizeof(src->buffer) - src->length - 1);
+            if (got > 0) {
+                src->length += (size_t)got;
+                continue;
+            }
+            if (got == 0)
+                src->eof = true;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                src->eof = true;
+            if (src->eof)
+                continue;
+            return false;
+        }
+
+        *newline = '\0';
+        char line[TWIN_LINE_BUFFER];
+        memcpy(line, src->buffer, (size_t)(newline - src->buffer) + 1);
+        src->length -= (size_t)(newline - src->buffer) + 1;
+        memmove(src->buffer, newline + 1, src->length);
+
+        const char *p = line;
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        if (*p == '\0' || *p == '#')
+            continue;
+        int fields = sscanf(p, "%lf %lf %lf %lf %lf %lf %lf", &out->time, &out->values[0], &out->values[1],
+                            &out->values[2], &out->valves[0], &out->valves[1], &out->valves[2]);
+        if (fields != 4 && fields != 7) {
+            fprintf(stderr, "Twin: skipping malformed measurement: %s\n", p);
+            continue;
+        }
+        out->has_valves = fields == 7;
+        return true;
+    }
+}
+
+static void Twin_GetState(const SeparatorSimulator *sep, double *x, size_t stride) {
+    x[0 * stride] = sep->state.h_oil;
+    x[1 * stride] = sep->state.h_water;
+    x[2 * stride] = sep->state.pressure;
+    x[3 * stride] = sep->config.Q_in_oil;
+    x[4 * stride] = sep->config.Q_in_water;
+    x[5 * stride] = sep->config.Q_in_gas;
+    x[6 * stride] = sep->Cd;
+}
+
+// Write an analysed state back, held to what the model accepts
+static void Twin_SetState(SeparatorSimulator *sep, const double *x, size_t stride) {
+    double max_height = sep->total_volume / sep->area;
+    sep->state.h_oil = fmin(fmax(x[0 * stride], 0.0), max_height);
+    sep->state.h_water = fmin(fmax(x[1 * stride], 0.0), max_height - sep->state.h_oil);
+    sep->config.Q_in_oil = fmax(x[3 * stride], 0.0);
+    sep->config.Q_in_water = fmax(x[4 * stride], 0.0);
+    sep->config.Q_in_gas = fmax(x[5 * stride], 0.0);
+    sep->Cd = fmin(fmax(x[6 * stride], 0.05), 1.0);
+    Separator_SetPressure(sep, fmax(x[2 * stride], sep->ambient_pressure));
+}
+
+// Standard normal number `index` of analysis `analysis`
+static double Twin_Normal(const SeparatorTwin *t, uint64_t analysis, uint64_t index) {
+    uint64_t key = Disturbance_Hash(((uint64_t)t->seed << 32) | 0xFFFFFFFFu, analysis);
+    double z0, z1;
+    Disturbance_Normal2(Disturbance_Hash(key, index), &z0, &z1);
+    return z0;
+}
+
+static void Twin_Estimate(SeparatorTwin *t) {
+    size_t N = t->member_count;
+    double x[TWIN_STATES];
+    double sum[TWIN_STATES] = {0}, sum2[TWIN_STATES] = {0};
+    for (size_t j = 0; j < N; j++) {
+        Twin_GetState(&t->ensemble[j], x, 1);
+        for (int s = 0; s < TWIN_STATES; s++)
+            sum[s] += x[s];
+    }
+    for (int s = 0; s < TWIN_STATES; s++)
+        t->mean[s] = sum[s] / N;
+    for (size_t j = 0; j < N; j++) {
+        Twin_GetState(&t->ensemble[j], x, 1);
+        for (int s = 0; s < TWIN_STATES; s++)
+            sum2[s] += (x[s] - t->mean[s]) * (x[s] - t->mean[s]);
+    }
+    for (int s = 0; s < TWIN_STATES; s++)
+        t->spread[s] = N > 1 ? sqrt(sum2[s] / (N - 1)) : 0.0;
+}
+
+// EnKF analysis of measurement z
+static void Twin_Analysis(SeparatorTwin *t, const TwinMeasurement *z) {
+    size_t N = t->member_count;
+    int rows[TWIN_MEASURED], m = 0;
+    for (int r = 0; r < TWIN_MEASURED; r++) {
+        if (isfinite(z->values[r]))
+            rows[m++] = r;
+    }
+    if (m == 0 || N < 2)
+        return;
+
+    // Inflated ensemble and its anomalies
+    for (size_t j = 0; j < N; j++)
+        Twin_GetState(&t->ensemble[j], &t->X[j], N);
+    Twin_Estimate(t);
+    for (int s = 0; s < TWIN_STATES; s++) {
+        double *row = &t->X[s * N];
+        for (size_t j = 0; j < N; j++)
+            row[j] = t->mean[s] + t->inflation * (row[j] - t->mean[s]);
+    }
+    double *A = t->X;  // Anomalies in place: X = mean + A
+    for (int s = 0; s < TWIN_STATES; s++) {
+        double *row = &A[s * N];
+        for (size_t j = 0; j < N; j++)
+            row[j] -= t->mean[s];
+    }
+    double innovation_sum = 0.0;
+    for (int r = 0; r < m; r++) {
+        int s = rows[r];
+        const double *a = &A[s * N];
+        double *ha = &t->HA[r * N];
+        double *d = &t->innovation[r * N];
+        for (size_t j = 0; j < N; j++) {
+            ha[j] = a[j];
+            double e = t->sigma[s] * Twin_Normal(t, t->analyses, (uint64_t)s * N + j);
+            d[j] = z->values[s] + e - (t->mean[s] + a[j]);
+        }
+    }
+
+    // P_yy = HA HA^T / (N - 1) + R, P_xy = A HA^T / (N - 1)
+    double scale = 1.0 / (double)(N - 1);
+    SimDense_Gemm(false, true, m, m, N, scale, t->HA, N, t->HA, N, 0.0, t->P_yy, m);
+    for (int r = 0; r < m; r++) {
+        t->P_yy[r * m + r] += t->sigma[rows[r]] * t->sigma[rows[r]];
+        double mean_innovation = z->values[rows[r]] - t->mean[rows[r]];
+        innovation_sum += mean_innovation * mean_innovation / t->P_yy[r * m + r];
+    }
+    t->innovation_rms = sqrt(innovation_sum / m);
+    SimDense_Gemm(false, true, TWIN_STATES, m, N, scale, A, N, t->HA, N, 0.0, t->P_xy, m);
+
+    // W = P_yy^-1 (D - HX), then X = mean + A + P_xy W
+    if (!SimDense_Cholesky(t->P_yy, m, m)) {
+        fprintf(stderr, "Twin: innovation covariance not positive definite at %.1f s, analysis skipped\n",
+                t->time);
+        return;
+    }
+    SimDense_CholeskySolve(t->P_yy, m, m, t->innovation, N, N);
+    SimDense_Gemm(false, false, TWIN_STATES, N, m, 1.0, t->P_xy, m, t->innovation, N, 1.0, A, N);
+    for (int s = 0; s < TWIN_STATES; s++) {
+        double *row = &A[s * N];
+        for (size_t j = 0; j < N; j++)
+            row[j] += t->mean[s];
+    }
+    for (size_t j = 0; j < N; j++)
+        Twin_SetState(&t->ensemble[j], &t->X[j], N);
+    t->analyses++;
+}
+
+// Ensemble drawn around base (the configured separator)
+static bool Twin_Start(SeparatorTwin *t, const SeparatorSimulator *base) {
+    size_t N = t->members;
+    t->member_count = t->members;
+    t->ensemble = calloc(N, sizeof(SeparatorSimulator));
+    t->partials = calloc(Fleet_Partitions(N) * FLARE_PARTIALS, sizeof(double));
+    t->X = calloc(TWIN_STATES * N, sizeof(double));
+    t->HA = calloc(TWIN_MEASURED * N, sizeof(double));
+    t->innovation = calloc(TWIN_MEASURED * N, sizeof(double));
+    if (!t->ensemble || !t->partials || !t->X || !t->HA || !t->innovation) {
+        fprintf(stderr, "Cannot allocate a twin of %u members\n", t->members);
+        return false;
+    }
+    if (strcmp(t->source_path, "-") == 0) {
+        t->source.fd = STDIN_FILENO;
+    } else {
+        t->source.fd = open(t->source_path, O_RDONLY);
+        if (t->source.fd < 0) {
+            fprintf(stderr, "Cannot read measurements %s\n", t->source_path);
+            return false;
+        }
+    }
+    if (!t->headless)
+        fcntl(t->source.fd, F_SETFL, fcntl(t->source.fd, F_GETFL) | O_NONBLOCK);
+    if (!SimExecutor_Start(&t->executor, t->threads))
+        return false;
+
+    for (size_t j = 0; j < N; j++) {
+        SeparatorSimulator *sep = &t->ensemble[j];
+        *sep = *base;
+        sep->settling.enabled = false;        // Not observed, not needed for the balances
+        Disturbance_Init(&sep->disturbance, (uint32_t)j);
+        sep->disturbance.enabled = true;
+        sep->disturbance.seed = t->seed;
+        sep->disturbance.slug_rate = 0.0;
+        sep->disturbance.noise_intensity = base->disturbance.noise_intensity;
+        sep->disturbance.noise_tau = base->disturbance.noise_tau;
+
+        uint64_t draw = (uint64_t)j * TWIN_STATES;
+        sep->state.h_oil += 0.05 * Twin_Normal(t, UINT64_MAX, draw + 0);
+        sep->state.h_water += 0.05 * Twin_Normal(t, UINT64_MAX, draw + 1);
+        double pressure = base->state.pressure * (1.0 + 0.05 * Twin_Normal(t, UINT64_MAX, draw + 2));
+        sep->config.Q_in_oil *= exp(0.3 * Twin_Normal(t, UINT64_MAX, draw + 3));
+        sep->config.Q_in_water *= exp(0.3 * Twin_Normal(t, UINT64_MAX, draw + 4));
+        sep->config.Q_in_gas *= exp(0.3 * Twin_Normal(t, UINT64_MAX, draw + 5));
+        sep->Cd *= 1.0 + 0.1 * Twin_Normal(t, UINT64_MAX, draw + 6);
+        double x[TWIN_STATES];
+        Twin_GetState(sep, x, 1);
+        x[2] = pressure;
+        Twin_SetState(sep, x, 1);
+    }
+    Twin_Estimate(t);
+    return true;
+}
+
+static void Twin_Stop(SeparatorTwin *t) {
+    SimExecutor_Stop(&t->executor);
+    if (t->source.fd > STDIN_FILENO)
+        close(t->source.fd);
+    free(t->ensemble);
+    free(t->partials);
+    free(t->X);
+    free(t->HA);
+    free(t->innovation);
+}
+
+// Ensemble mean into the published separator
+static void Twin_Publish(const SeparatorTwin *t, SeparatorSimulator *sep) {
+    sep->state.h_oil = t->mean[0];
+    sep->state.h_water = t->mean[1];
+    sep->state.pressure = t->mean[2];
+    sep->config.Q_in_oil = sep->state.Q_oil_in = t->mean[3];
+    sep->config.Q_in_water = sep->state.Q_water_in = t->mean[4];
+    sep->config.Q_in_gas = sep->state.Q_gas_in = t->mean[5];
+    sep->Cd = t->mean[6];
+}
+
+// One cycle: step the ensemble under the valve openings of sep, assimilate
+// every measurement that is due; returns the number assimilated
+static int Twin_Step(SeparatorTwin *t, SeparatorSimulator *sep, uint32_t cycle_time_ms) {
+    for (size_t j = 0; j < t->member_count; j++) {
+        t->ensemble[j].config.valve_oil = sep->config.valve_oil;
+        t->ensemble[j].config.valve_water = sep->config.valve_water;
+        t->ensemble[j].config.valve_gas = sep->config.valve_gas;
+    }
+    Separator_UpdateFleet(&t->executor, t->ensemble, t->member_count, cycle_time_ms, t->partials, &t->flare);
+    t->time += cycle_time_ms / 1000.0;
+
+    int assimilated = 0;
+    for (;;) {
+        if (!t->has_pending)
+            t->has_pending = TwinSource_Next(&t->source, &t->pending);
+        if (!t->has_pending || t->pending.time > t->time + 1e-9)
+            break;
+        if (t->pending.has_valves) {
+            sep->config.valve_oil = t->pending.valves[0];
+            sep->config.valve_water = t->pending.valves[1];
+            sep->config.valve_gas = t->pending.valves[2];
+            for (size_t j = 0; j < t->member_count; j++) {
+                t->ensemble[j].config.valve_oil = sep->config.valve_oil;
+                t->ensemble[j].config.valve_water = sep->config.valve_water;
+                t->ensemble[j].config.valve_gas = sep->config.valve_gas;
+            }
+        }
+        Twin_Analysis(t, &t->pending);
+        t->has_pending = false;
+        assimilated++;
+    }
+    Twin_Estimate(t);
+    Twin_Publish(t, sep);
+    return assimilated;
+}
+
+// --twin <measurements|-> [options]: argv[0] is "--twin". Returns the
+// number of arguments used, or -1.
+static int Twin_ParseArgs(SeparatorTwin *t, int argc, char **argv) {
+    memset(t, 0, sizeof(*t));
+    t->members = 64;
+    t->threads = 1;
+    t->seed = 1;
+    t->sigma[0] = t->sigma[1] = 0.01;
+    t->sigma[2] = 2000.0;
+    t->inflation = 1.005;
+    if (argc < 2) {
+        fprintf(stderr, "Usage: --twin <measurements|-> [--members N] [--threads T] [--seed S] "
+                        "[--sigma-level M] [--sigma-pressure PA] [--inflation F] [--headless] [config]\n");
+        return -1;
+    }
+    t->enabled = true;
+    t->source_path = argv[1];
+    int i = 2;
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "--members") == 0 && i + 1 < argc)
+            t->members = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            t->threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            t->seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--sigma-level") == 0 && i + 1 < argc)
+            t->sigma[0] = t->sigma[1] = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--sigma-pressure") == 0 && i + 1 < argc)
+            t->sigma[2] = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--inflation") == 0 && i + 1 < argc)
+            t->inflation = strtod(argv[++i], NULL);
+        else if (strcmp(argv[i], "--headless") == 0)
+            t->headless = true;
+        else
+            break;  // Config file
+    }
+    if (t->members < 2 || !(t->sigma[0] > 0.0) || !(t->sigma[2] > 0.0) || !(t->inflation >= 1.0)) {
+        fprintf(stderr, "Twin needs 2 or more members, positive noise and an inflation of at least 1\n");
+        return -1;
+    }
+    return i;
+}
+
+static int Twin_RunHeadless(SeparatorTwin *t, SeparatorSimulator *sep) {
+    printf("%9s", "time_s");
+    for (int s = 0; s < TWIN_STATES; s++)
+        printf(" %12s %10s", twin_state_names[s], "std");
+    printf(" %8s\n", "innov");
+    while (!t->source.eof || t->has_pending || t->source.length > 0) {
+        if (Twin_Step(t, sep, DEFAULT_CYCLE_TIME_MS) == 0)
+            continue;
+        printf("%9.1f", t->time);
+        for (int s = 0; s < TWIN_STATES; s++)
+            printf(" %12.6g %10.3g", t->mean[s], t->spread[s]);
+        printf(" %8.3f\n", t->innovation_rms);
+    }
+    printf("%llu analyses, %u members\n", (unsigned long long)t->analyses, t->member_count);
+    Twin_Stop(t);
+    return EXIT_SUCCESS;
+}
+
+// Node ids "<state>_est" and "<state>_std"
+static void Twin_NodeId(char *out, size_t size, int s, const char *suffix) {
+    snprintf(out, size, "%s_%s", twin_state_names[s], suffix);
+}
+
+static void addTwinObject(UA_Server *server) {
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, "Twin"),
+                            UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                            UA_QUALIFIEDNAME(1, "Twin"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                            UA_ObjectAttributes_default, NULL, NULL);
+
+    addStateVariable(server, UA_NODEID_STRING(1, "Twin"), "TwinMembers", &twin.member_count, &UA_TYPES[UA_TYPES_UINT32]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Twin"), "TwinAnalyses", &twin.analyses, &UA_TYPES[UA_TYPES_UINT64]);
+    addStateVariable(server, UA_NODEID_STRING(1, "Twin"), "TwinInnovation", &twin.innovation_rms, &UA_TYPES[UA_TYPES_DOUBLE]);
+    for (int s = 0; s < TWIN_STATES; s++) {
+        char id[64];
+        Twin_NodeId(id, sizeof(id), s, "est");
+        addStateVariable(server, UA_NODEID_STRING(1, "Twin"), id, &twin.mean[s], &UA_TYPES[UA_TYPES_DOUBLE]);
+        Twin_NodeId(id, sizeof(id), s, "std");
+        addStateVariable(server, UA_NODEID_STRING(1, "Twin"), id, &twin.spread[s], &UA_TYPES[UA_TYPES_DOUBLE]);
+    }
+}
+
+static void writeTwinValues(UA_Server *server) {
+    writeStateValue(server, "TwinAnalyses", &twin.analyses, &UA_TYPES[UA_TYPES_UINT64]);
+    writeStateValue(server, "TwinInnovation", &twin.innovation_rms, &UA_TYPES[UA_TYPES_DOUBLE]);
+    for (int s = 0; s < TWIN_STATES; s++) {
+        char id[64];
+        Twin_NodeId(id, sizeof(id), s, "est");
+        writeStateValue(server, id, &twin.mean[s], &UA_TYPES[UA_TYPES_DOUBLE]);
+        Twin_NodeId(id, sizeof(id), s, "std");
+        writeStateValue(server, id, &twin.spread[s], &UA_TYPES[UA_TYPES_DOUBLE]);
+    }
+}
+
+// ==================== SURROGATE FIT ====================
+// seperator --fit-surrogate <model> [--degree 2] [--cells 4,4,4] [--samples 3]
+//           [--seed 1] [--trajectories 200] [--cycles 600]
+//           [--h-oil LO,HI] [--h-water LO,HI] [--pressure LO,HI]
+//           [--valve-oil LO,HI] [--valve-water LO,HI] [--valve-gas LO,HI]
+//           [--q-oil LO,HI] [--q-water LO,HI] [--q-gas LO,HI] [config]
+//
+// Fits the surrogate of the one-cycle map (see Surrogate) of the configured
+// separator over the envelope and writes it to <model>. The separator is
+// fitted isothermal, without settling, relief or disturbances. In each cell
+// `samples` x terms points drawn uniformly in the cell are stepped with the
+// full model, and the polynomial is the least-squares fit of the changes
+// (normal equations with a Cholesky solve, sim_dense.h). The error report:
+//   - one-cycle errors on as many fresh points: the RMS and largest error
+//     of each change, and the RMS error relative to the RMS change;
+//   - trajectories: runs of `cycles` cycles from random points with
+//     constant random inputs, full model against surrogate (which falls
+//     back outside the envelope): the largest level and pressure
+//     deviation, the share of cycles on the surrogate and the time per
+//     cycle of both;
+//   - the same trajectories as one fleet (see Surrogate Batch), which
+//     must match them, and the end-to-end time per separator-cycle of
+//     such a fleet on the full model and on the surrogate, with settling
+//     off and on, along the trajectories and held inside the envelope.
+
+#define SURROGATE_RIDGE 1e-12     // Of the mean diagonal of the normal equations
+
+static const char *const surrogate_options[SURROGATE_INPUTS] = {
+    "--h-oil", "--h-water", "--pressure", "--valve-oil", "--valve-water", "--valve-gas",
+    "--q-oil", "--q-water", "--q-gas"};
+static const char *const surrogate_inputs[SURROGATE_INPUTS] = {
+    "h_oil", "h_water", "pressure", "valve_oil", "valve_water", "valve_gas",
+    "Q_oil_in", "Q_water_in", "Q_gas_in"};
+
+// Full model change over one cycle from x
+static void SurrogateFit_Target(const SeparatorSimulator *base, const double *x, uint32_t cycle_time_ms,
+                                double *delta) {
+    static SeparatorSimulator sep;
+    sep = *base;
+    sep.state.h_oil = x[0];
+    sep.state.h_water = x[1];
+    sep.config.valve_oil = x[3];
+    sep.config.valve_water = x[4];
+    sep.config.valve_gas = x[5];
+    sep.config.Q_in_oil = x[6];
+    sep.config.Q_in_water = x[7];
+    sep.config.Q_in_gas = x[8];
+    Separator_SetPressure(&sep, x[2]);
+    Separator_Update(&sep, cycle_time_ms);
+    delta[0] = sep.state.h_oil - x[0];
+    delta[1] = sep.state.h_water - x[1];
+    delta[2] = sep.state.pressure - x[2];
+}
+
+// Point n of a cell: x and its inputs scaled as in Surrogate_Scale
+static void SurrogateFit_Point(const SeparatorSurrogate *s, size_t cell, uint64_t key, uint64_t n,
+                               double *x, double *u) {
+    uint32_t k[SURROGATE_STATES] = {(uint32_t)(cell / ((size_t)s->cells[1] * s->cells[2])),
+                                       (uint32_t)(cell / s->cells[2] % s->cells[1]),
+                                       (uint32_t)(cell % s->cells[2])};
+    for (int i = 0; i < SURROGATE_INPUTS; i++) {
+        double w = Disturbance_Uniform((uint32_t)(Disturbance_Hash(key, n * SURROGATE_INPUTS + i) >> 32));
+        double lower = s->lower[i], width = s->upper[i] - s->lower[i];
+        if (i < SURROGATE_STATES) {
+            width /= s->cells[i];
+            lower += k[i] * width;
+        }
+        x[i] = lower + width * w;
+        u[i] = 2.0 * w - 1.0;
+    }
+}
+
+// Least-squares fit of one cell from `samples` points. V (samples x terms),
+// Y (samples x outputs), G (terms x terms) and R (terms x outputs) are work
+// arrays.
+static bool SurrogateFit_Cell(SeparatorSurrogate *s, const SeparatorSimulator *base, size_t cell,
+                              size_t samples, uint64_t key, double *V, double *Y, double *G, double *R) {
+    size_t terms = s->basis.terms;
+    for (size_t j = 0; j < samples; j++) {
+        double x[SURROGATE_INPUTS], u[SURROGATE_INPUTS];
+        SurrogateFit_Point(s, cell, key, j, x, u);
+        SurrogateBasis_Evaluate(&s->basis, u, &V[j * terms]);
+        SurrogateFit_Target(base, x, s->cycle_time_ms, &Y[j * SURROGATE_OUTPUTS]);
+    }
+
+    // G = V^T V, R = V^T Y, solve G C = R
+    SimDense_Gemm(true, false, terms, terms, samples, 1.0, V, terms, V, terms, 0.0, G, terms);
+    SimDense_Gemm(true, false, terms, SURROGATE_OUTPUTS, samples, 1.0, V, terms, Y, SURROGATE_OUTPUTS, 0.0,
+                  R, SURROGATE_OUTPUTS);
+    double trace = 0.0;
+    for (size_t t = 0; t < terms; t++)
+        trace += G[t * terms + t];
+    for (size_t t = 0; t < terms; t++)
+        G[t * terms + t] += SURROGATE_RIDGE * trace / terms;
+    if (!SimDense_Cholesky(G, terms, terms))
+        return false;
+    SimDense_CholeskySolve(G, terms, terms, R, SURROGATE_OUTPUTS, SURROGATE_OUTPUTS);
+
+    memcpy(&s->coefficients[cell * terms * SURROGATE_OUTPUTS], R, terms * SURROGATE_OUTPUTS * sizeof(double));
+    return true;
+}
+
+static bool Surrogate_Save(const SeparatorSurrogate *s, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Cannot create surrogate %s\n", path);
+        return false;
+    }
+    fprintf(file, "separator-surrogate 1\n");
+    fprintf(file, "cycle_time_ms %u degree %u cells %u %u %u\n", s->cycle_time_ms, s->degree, s->cells[0],
+            s->cells[1], s->cells[2]);
+    fprintf(file, "constants %.17g %.17g %.17g %.17g %.17g %.17g %.17g\n", s->area, s->total_volume, s->Cd,
+            s->A_valve_liquid, s->A_valve_gas, s->ambient_pressure, s->temperature);
+    fprintf(file, "lower");
+    for (int i = 0; i < SURROGATE_INPUTS; i++)
+        fprintf(file, " %.17g", s->lower[i]);
+    fprintf(file, "\nupper");
+    for (int i = 0; i < SURROGATE_INPUTS; i++)
+        fprintf(file, " %.17g", s->upper[i]);
+    fprintf(file, "\ncoefficients\n");
+    size_t rows = Surrogate_Cells(s) * s->basis.terms;
+    for (size_t r = 0; r < rows; r++) {
+        const double *c = &s->coefficients[r * SURROGATE_OUTPUTS];
+        fprintf(file, "%.17g %.17g %.17g\n", c[0], c[1], c[2]);
+    }
+    bool ok = !ferror(file);
+    return fclose(file) == 0 && ok;
+}
+
+// sep at the start x of a trajectory (inputs included), on surrogate s
+static void SurrogateFit_Start(SeparatorSimulator *sep, const SeparatorSimulator *base, const SeparatorSurrogate *s,
+                               const double *x) {
+    *sep = *base;
+    sep->surrogate.model = s;
+    sep->state.h_oil = x[0];
+    sep->state.h_water = x[1];
+    sep->config.valve_oil = x[3];
+    sep->config.valve_water = x[4];
+    sep->config.valve_gas = x[5];
+    sep->config.Q_in_oil = x[6];
+    sep->config.Q_in_water = x[7];
+    sep->config.Q_in_gas = x[8];
+    Separator_SetPressure(sep, x[2]);
+}
+
+// Seconds of `cycles` cycles of every trajectory from the starts in x0
+// (inputs included); the states after each cycle go to states
+static double SurrogateFit_Trajectories(const SeparatorSimulator *base, const SeparatorSurrogate *s,
+                                        uint32_t cycle_time_ms, const double *x0, uint32_t trajectories,
+                                        uint32_t cycles, double *states, uint64_t *surrogate_steps,
+                                        uint64_t *rebuilds) {
+    static SeparatorSimulator sep;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < trajectories; r++) {
+        SurrogateFit_Start(&sep, base, s, &x0[r * SURROGATE_INPUTS]);
+        double *out = &states[(size_t)r * cycles * SURROGATE_OUTPUTS];
+        for (uint32_t c = 0; c < cycles; c++, out += SURROGATE_OUTPUTS) {
+            Separator_Update(&sep, cycle_time_ms);
+            out[0] = sep.state.h_oil;
+            out[1] = sep.state.h_water;
+            out[2] = sep.state.pressure;
+        }
+        *surrogate_steps += sep.surrogate.steps;
+        *rebuilds += sep.surrogate.rebuilds;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Seconds of `cycles` cycles of all trajectories as one fleet through
+// Separator_UpdateFleet, on surrogate s (NULL: the full model) and with
+// settling as given; zero if the fleet cannot be allocated. The states go
+// to states, if given, by cycle: [cycle][trajectory][state]. With inside,
+// every separator is put back to its start before each cycle, so no cycle
+// leaves the envelope.
+static double SurrogateFit_Fleet(SimExecutor *executor, const SeparatorSimulator *base,
+                                 const SeparatorSurrogate *s, uint32_t cycle_time_ms, const double *x0,
+                                 uint32_t trajectories, uint32_t cycles, bool settling, bool inside,
+                                 double *states, uint64_t *surrogate_steps) {
+    SeparatorSimulator *fleet = malloc(trajectories * sizeof(SeparatorSimulator));
+    double *partials = calloc(Fleet_Partitions(trajectories) * FLARE_PARTIALS, sizeof(double));
+    if (!fleet || !partials) {
+        free(fleet);
+        free(partials);
+        return 0.0;
+    }
+    for (uint32_t r = 0; r < trajectories; r++) {
+        SurrogateFit_Start(&fleet[r], base, s, &x0[r * SURROGATE_INPUTS]);
+        fleet[r].settling.enabled = settling;
+    }
+    FlareHeader header;
+    memset(&header, 0, sizeof(header));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double *out = states;
+    for (uint32_t c = 0; c < cycles; c++) {
+        for (uint32_t r = 0; inside && r < trajectories; r++) {
+            const double *x = &x0[r * SURROGATE_INPUTS];
+            fleet[r].state.h_oil = x[0];
+            fleet[r].state.h_water = x[1];
+            Separator_SetPressure(&fleet[r], x[2]);
+        }
+        Separator_UpdateFleet(executor, fleet, trajectories, cycle_time_ms, partials, &header);
+        for (uint32_t r = 0; out && r < trajectories; r++, out += SURROGATE_OUTPUTS) {
+            out[0] = fleet[r].state.h_oil;
+            out[1] = fleet[r].state.h_water;
+            out[2] = fleet[r].state.pressure;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (uint32_t r = 0; r < trajectories; r++)
+        *surrogate_steps += fleet[r].surrogate.steps;
+    free(fleet);
+    free(partials);
+    return (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int SurrogateFit_Main(int argc, char **argv) {
+    SeparatorSurrogate s;
+    memset(&s, 0, sizeof(s));
+    s.cycle_time_ms = DEFAULT_CYCLE_TIME_MS;
+    s.degree = 2;
+    s.cells[0] = s.cells[1] = s.cells[2] = 4;
+    const double lower[SURROGATE_INPUTS] = {0.2, 0.2, 120000.0, 10.0, 10.0, 10.0, 0.0, 0.0, 0.0};
+    const double upper[SURROGATE_INPUTS] = {1.5, 1.5, 800000.0, 100.0, 100.0, 100.0, 0.1, 0.06, 0.3};
+    memcpy(s.lower, lower, sizeof(lower));
+    memcpy(s.upper, upper, sizeof(upper));
+    uint32_t oversampling = 3, seed = 1, trajectories = 200, cycles = 600;
+    const char *config_path = NULL;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: --fit-surrogate <model> [--degree D] [--cells A,B,C] [--samples K] [--seed S] "
+                        "[--trajectories R] [--cycles C] [--<input> LO,HI].. [config]\n");
+        return EXIT_FAILURE;
+    }
+    const char *model_path = argv[1];
+    for (int i = 2; i < argc; i++) {
+        int input = -1;
+        for (int k = 0; k < SURROGATE_INPUTS; k++) {
+            if (strcmp(argv[i], surrogate_options[k]) == 0)
+                input = k;
+        }
+        if (input >= 0 && i + 1 < argc) {
+            char *end;
+            s.lower[input] = strtod(argv[++i], &end);
+            s.upper[input] = *end == ',' ? strtod(end + 1, NULL) : s.lower[input];
+        } else if (strcmp(argv[i], "--degree") == 0 && i + 1 < argc) {
+            s.degree = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cells") == 0 && i + 1 < argc) {
+            if (parseBenchList(argv[++i], s.cells) != SURROGATE_STATES) {
+                fprintf(stderr, "--cells needs three counts\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            oversampling = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--trajectories") == 0 && i + 1 < argc) {
+            trajectories = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !config_path) {
+            config_path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The separator to fit
+    SeparatorSimulator *base = calloc(1, sizeof(SeparatorSimulator));
+    if (!base)
+        return EXIT_FAILURE;
+    Separator_Init(base);
+    if (config_path) {
+        static ConfigFile config;
+        if (!ConfigFile_Load(config_path, &config)) {
+            fprintf(stderr, "Cannot read %s\n", config_path);
+            return EXIT_FAILURE;
+        }
+        Separator_ApplyConfig(base, &config, NULL);
+    }
+    base->disturbance.enabled = false;
+    base->settling.enabled = false;
+    base->energy.enabled = false;
+    base->relief.enabled = false;
+    s.area = base->area;
+    s.total_volume = base->total_volume;
+    s.Cd = base->Cd;
+    s.A_valve_liquid = base->A_valve_liquid;
+    s.A_valve_gas = base->A_valve_gas;
+    s.ambient_pressure = base->ambient_pressure;
+    s.temperature = base->state.temperature;
+
+    for (int i = 0; i < SURROGATE_INPUTS; i++) {
+        if (!(s.upper[i] > s.lower[i])) {
+            fprintf(stderr, "Empty envelope for %s\n", surrogate_inputs[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (s.lower[0] < 0.0 || s.lower[1] < 0.0 || s.upper[0] + s.upper[1] >= s.total_volume / s.area ||
+        s.lower[2] <= s.ambient_pressure || s.lower[3] < 0.0 || s.lower[4] < 0.0 || s.lower[5] < 0.0 ||
+        s.lower[6] < 0.0 || s.lower[7] < 0.0 || s.lower[8] < 0.0) {
+        fprintf(stderr, "The envelope needs non-negative levels below the top, a pressure above ambient "
+                        "and non-negative valve openings and inflows\n");
+        return EXIT_FAILURE;
+    }
+    if (s.degree > SURROGATE_MAX_DEGREE || Surrogate_Cells(&s) == 0 || Surrogate_Cells(&s) > SURROGATE_MAX_CELLS ||
+        oversampling < 2 || trajectories == 0 || cycles == 0) {
+        fprintf(stderr, "Degree up to %d, 1 to %d cells, 2 or more samples per term, 1 or more trajectories "
+                        "and cycles\n", SURROGATE_MAX_DEGREE, SURROGATE_MAX_CELLS);
+        return EXIT_FAILURE;
+    }
+
+    Surrogate_Prepare(&s);
+    size_t cells = Surrogate_Cells(&s), terms = s.basis.terms, samples = (size_t)oversampling * terms;
+    s.coefficients = calloc(cells * SURROGATE_OUTPUTS * terms, sizeof(double));
+    double *V = malloc(samples * terms * sizeof(double));
+    double *Y = malloc(samples * SURROGATE_OUTPUTS * sizeof(double));
+    double *G = malloc(terms * terms * sizeof(double));
+    double *R = malloc(terms * SURROGATE_OUTPUTS * sizeof(double));
+    double *x0 = malloc((size_t)trajectories * SURROGATE_INPUTS * sizeof(double));
+    double *full = malloc((size_t)trajectories * cycles * SURROGATE_OUTPUTS * sizeof(double));
+    double *fast = malloc((size_t)trajectories * cycles * SURROGATE_OUTPUTS * sizeof(double));
+    double *batched = malloc((size_t)trajectories * cycles * SURROGATE_OUTPUTS * sizeof(double));
+    if (!s.coefficients || !V || !Y || !G || !R || !x0 || !full || !fast || !batched) {
+        fprintf(stderr, "Cannot allocate the fit\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Separator one-cycle surrogate (%u ms): degree %u, %ux%ux%u cells, %zu terms, %zu samples per cell\n",
+           s.cycle_time_ms, s.degree, s.cells[0], s.cells[1], s.cells[2], terms, samples);
+    printf("  %-12s %12s %12s\n", "input", "lower", "upper");
+    for (int i = 0; i < SURROGATE_INPUTS; i++)
+        printf("  %-12s %12g %12g\n", surrogate_inputs[i], s.lower[i], s.upper[i]);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t fit_key = Disturbance_Hash(seed, 1), check_key = Disturbance_Hash(seed, 2);
+    for (size_t cell = 0; cell < cells; cell++) {
+        if (!SurrogateFit_Cell(&s, base, cell, samples, Disturbance_Hash(fit_key, cell), V, Y, G, R)) {
+            fprintf(stderr, "Cell %zu: normal equations singular, lower the degree\n", cell);
+            return EXIT_FAILURE;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Fitted in %.2f s\n", (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    // One-cycle errors on fresh points
+    double sum_change[SURROGATE_OUTPUTS] = {0}, sum_error[SURROGATE_OUTPUTS] = {0};
+    double max_error[SURROGATE_OUTPUTS] = {0};
+    for (size_t cell = 0; cell < cells; cell++) {
+        uint64_t key = Disturbance_Hash(check_key, cell);
+        for (size_t j = 0; j < samples; j++) {
+            double x[SURROGATE_INPUTS], u[SURROGATE_INPUTS], target[SURROGATE_OUTPUTS], delta[SURROGATE_OUTPUTS];
+            SurrogateFit_Point(&s, cell, key, j, x, u);
+            SurrogateFit_Target(base, x, s.cycle_time_ms, target);
+            Surrogate_Evaluate(&s, x, delta);
+            for (int o = 0; o < SURROGATE_OUTPUTS; o++) {
+                double error = fabs(delta[o] - target[o]);
+                sum_change[o] += target[o] * target[o];
+                sum_error[o] += error * error;
+                max_error[o] = fmax(max_error[o], error);
+            }
+        }
+    }
+    static const char *const changes[SURROGATE_OUTPUTS] = {"h_oil m", "h_water m", "pressure Pa"};
+    printf("One-cycle change, %zu fresh points\n", cells * samples);
+    printf("  %-12s %12s %12s %12s %10s\n", "change", "rms_change", "rms_error", "max_error", "rel_rms");
+    for (int o = 0; o < SURROGATE_OUTPUTS; o++) {
+        double rms_change = sqrt(sum_change[o] / (cells * samples));
+        double rms_error = sqrt(sum_error[o] / (cells * samples));
+        printf("  %-12s %12.4g %12.4g %12.4g %10.2e\n", changes[o], rms_change, rms_error, max_error[o],
+               rms_change > 0.0 ? rms_error / rms_change : 0.0);
+    }
+
+    // Trajectories from random points, constant inputs
+    uint64_t trajectory_key = Disturbance_Hash(seed, 3);
+    for (uint32_t r = 0; r < trajectories; r++) {
+        for (int i = 0; i < SURROGATE_INPUTS; i++) {
+            double w = Disturbance_Uniform(
+                (uint32_t)(Disturbance_Hash(trajectory_key, (uint64_t)r * SURROGATE_INPUTS + i) >> 32));
+            x0[r * SURROGATE_INPUTS + i] = s.lower[i] + (s.upper[i] - s.lower[i]) * w;
+        }
+    }
+    uint64_t full_steps = 0, fast_steps = 0, full_rebuilds = 0, rebuilds = 0;
+    double full_seconds = SurrogateFit_Trajectories(base, NULL, s.cycle_time_ms, x0, trajectories, cycles, full,
+                                                    &full_steps, &full_rebuilds);
+    double fast_seconds = SurrogateFit_Trajectories(base, &s, s.cycle_time_ms, x0, trajectories, cycles, fast,
+                                                    &fast_steps, &rebuilds);
+    double deviation[SURROGATE_OUTPUTS] = {0};
+    for (size_t k = 0; k < (size_t)trajectories * cycles * SURROGATE_OUTPUTS; k++)
+        deviation[k % SURROGATE_OUTPUTS] = fmax(deviation[k % SURROGATE_OUTPUTS], fabs(fast[k] - full[k]));
+    double total = (double)trajectories * cycles;
+    printf("Trajectories: %u x %u cycles, %.1f %% of cycles on the surrogate, %.1f %% rebuilt it\n",
+           trajectories, cycles, 100.0 * fast_steps / total, 100.0 * rebuilds / total);
+    printf("  largest deviation: h_oil %.3g m, h_water %.3g m, pressure %.3g Pa\n", deviation[0], deviation[1],
+           deviation[2]);
+    printf("  full model %.1f ns/cycle, with surrogate %.1f ns/cycle, %.1fx\n", full_seconds * 1e9 / total,
+           fast_seconds * 1e9 / total, fast_seconds > 0.0 ? full_seconds / fast_seconds : 0.0);
+
+    // The same trajectories as one fleet, which steps in blocks on the
+    // surrogate (Surrogate Batch): it must follow the separate runs. Then
+    // the end-to-end time per separator-cycle of the fleet on the full
+    // model and on the surrogate, with settling off and on, along the
+    // trajectories and held inside the envelope.
+    SimExecutor fleet_executor;
+    uint64_t batched_steps = 0;
+    if (SimExecutor_Start(&fleet_executor, 1) &&
+        SurrogateFit_Fleet(&fleet_executor, base, &s, s.cycle_time_ms, x0, trajectories, cycles, false, false,
+                           batched, &batched_steps) > 0.0) {
+        double difference = 0.0;
+        for (uint32_t r = 0; r < trajectories; r++) {
+            for (uint32_t c = 0; c < cycles; c++) {
+                for (int o = 0; o < SURROGATE_OUTPUTS; o++) {
+                    double a = fast[((size_t)r * cycles + c) * SURROGATE_OUTPUTS + o];
+                    double b = batched[((size_t)c * trajectories + r) * SURROGATE_OUTPUTS + o];
+                    difference = fmax(difference, fabs(a - b));
+                }
+            }
+        }
+        printf("Fleet of %u, 1 thread: %.1f %% of cycles on the surrogate, largest difference from the "
+               "separate runs %.3g\n", trajectories, 100.0 * batched_steps / total, difference);
+        printf("  %-28s %10s %10s %8s\n", "ns/separator-cycle", "full", "surrogate", "speedup");
+        static const char *const runs[4] = {"trajectories", "trajectories, settling", "inside the envelope",
+                                            "inside, settling"};
+        for (int run = 0; run < 4; run++) {
+            bool settling = run % 2, inside = run >= 2;
+            uint64_t unused = 0;
+            double full_ns = SurrogateFit_Fleet(&fleet_executor, base, NULL, s.cycle_time_ms, x0, trajectories,
+                                                cycles, settling, inside, NULL, &unused) * 1e9 / total;
+            double fast_ns = SurrogateFit_Fleet(&fleet_executor, base, &s, s.cycle_time_ms, x0, trajectories,
+                                                cycles, settling, inside, NULL, &unused) * 1e9 / total;
+            printf("  %-28s %10.1f %10.1f %7.1fx\n", runs[run], full_ns, fast_ns,
+                   fast_ns > 0.0 ? full_ns / fast_ns : 0.0);
+        }
+    }
+    SimExecutor_Stop(&fleet_executor);
+
+    bool ok = Surrogate_Save(&s, model_path);
+    if (ok)
+        printf("Wrote %s\n", model_path);
+    Surrogate_Free(&s);
+    free(base);
+    free(V);
+    free(Y);
+    free(G);
+    free(R);
+    free(x0);
+    free(full);
+    free(fast);
+    free(batched);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// ==================== VALVE OPTIMIZER ====================
+// seperator --optimize-valves <h_oil> <h_water> <pressure>
+//           [--inflows Q_OIL,Q_WATER,Q_GAS] [--start OIL,WATER,GAS]
+//           [--population 16] [--generations 60] [--restarts 2]
+//           [--horizon 300] [--threads 1] [--seed 1] [config]
+//
+// The valve openings that hold target levels and pressure for given
+// inflows. A candidate (valve_oil, valve_water, valve_gas) runs the
+// separator from the targets for `horizon` seconds, without disturbances
+// or settling, and scores
+//   J = mean over the cycles of ((h_oil - h_oil*) / 1 cm)^2
+//       + ((h_water - h_water*) / 1 cm)^2 + ((pressure - pressure*) / 1 kPa)^2
+// which is zero for openings in equilibrium at the targets and grows with
+// the drift away from them. The search is CMA-ES ((mu/mu_w, lambda), with
+// the Cholesky factor of the covariance, sim_dense.h) over the openings
+// scaled to [0, 1]; a candidate outside runs at the nearest opening and
+// pays a penalty. One run can settle in a local minimum, so the search
+// restarts as IPOP-CMA-ES does: once a run converges or uses up its
+// generations, the next starts from a random point with twice the
+// population (up to VALVE_OPT_MAX_POPULATION), `restarts` times, and the
+// result is the best candidate of all runs. A generation is one batch:
+// partitions of VALVE_OPT_PARTITION_SIZE candidates on a SimExecutor, each
+// stepped through Separator_UpdateBatch for the whole horizon, so the
+// larger populations of the restarts spread over more threads and the
+// result is the same for any thread count. The sensitivity is the change of the levels
+// and pressure at the end of the horizon per percent of each opening at
+// the optimum (central differences, one more batch). With SurrogateModel
+// set and EnergyBalanceEnabled off the candidates step on the surrogate
+// wherever it fits.
+//
+// Inflows and start default to the configured ones. In the server the
+// search is the OptimizeValves method of the Separator object, from the
+// running separator (the ensemble mean with --twin) and its current
+// openings; it only returns openings, it does not write them.
+// OptimizerThreads, OptimizerHorizon and OptimizerRestarts in the
+// configuration file (read at startup) set its threads, horizon and
+// restarts. With a multithreaded open62541 the search runs on a worker
+// thread (see Optimizer Worker); otherwise the server waits for it, and
+// the simulation steps the cycles it missed once the call returns.
+
+#define VALVE_OPT_N 3                     // Openings: oil, water, gas
+#define VALVE_OPT_MAX_POPULATION 256
+#define VALVE_OPT_PARTITION_SIZE 4
+#define VALVE_OPT_LEVEL_SCALE 0.01        // m
+#define VALVE_OPT_PRESSURE_SCALE 1000.0   // Pa
+#define VALVE_OPT_PENALTY 1e6             // Per squared scaled distance outside [0, 1]
+#define VALVE_OPT_SIGMA0 0.2              // Initial step, scaled
+#define VALVE_OPT_TOLERANCE 1e-5          // Scaled step at convergence (0.001 %)
+#define VALVE_OPT_STEP 0.5                // %, sensitivity differences
+
+typedef struct {
+    // Options
+    uint32_t population;
+    uint32_t generations;                 // Per run
+    uint32_t restarts;
+    uint32_t threads;
+    uint32_t seed;
+    double horizon;                       // s
+
+    SimExecutor executor;
+    SeparatorSimulator *seps;             // One per candidate
+    size_t capacity;
+} ValveOptimizer;
+
+typedef struct {
+    double valves[VALVE_OPT_N];           // %
+    double cost;
+    double sensitivity[3 * VALVE_OPT_N];  // d(h_oil, h_water, pressure) / d(valve), row per state
+    uint32_t evaluations;
+    uint32_t generations;                 // Of all runs
+    uint32_t searches;                    // CMA-ES runs: 1 + restarts
+    double seconds;
+} ValveOptResult;
+
+typedef struct {
+    SeparatorSimulator *seps;
+    size_t count;
+    const SeparatorSimulator *base;
+    const double *target;
+    const double *inflow;
+    const double (*valves)[VALVE_OPT_N];
+    uint32_t cycles;
+    uint32_t cycle_time_ms;
+    double *cost;
+} ValveOptBatch;
+
+ValveOptimizer optimizer;
+
+static void ValveOpt_Defaults(ValveOptimizer *o) {
+    memset(o, 0, sizeof(*o));
+    o->population = 16;
+    o->generations = 60;
+    o->restarts = 2;
+    o->threads = 1;
+    o->seed = 1;
+    o->horizon = 300.0;
+}
+
+// Population of run `run`: doubled per restart
+static size_t ValveOpt_Population(const ValveOptimizer *o, uint32_t run) {
+    size_t lambda = o->population;
+    for (uint32_t k = 0; k < run && lambda < VALVE_OPT_MAX_POPULATION; k++)
+        lambda *= 2;
+    return lambda < VALVE_OPT_MAX_POPULATION ? lambda : VALVE_OPT_MAX_POPULATION;
+}
+
+static bool ValveOpt_Start(ValveOptimizer *o) {
+    if (o->population < 4 || o->population > VALVE_OPT_MAX_POPULATION) {
+        fprintf(stderr, "Optimizer population must be 4 to %d\n", VALVE_OPT_MAX_POPULATION);
+        return false;
+    }
+    // The largest population of the restarts, and the sensitivity batch:
+    // the optimum and two per opening
+    o->capacity = ValveOpt_Population(o, o->restarts);
+    if (o->capacity < 2 * VALVE_OPT_N + 1)
+        o->capacity = 2 * VALVE_OPT_N + 1;
+    o->seps = calloc(o->capacity, sizeof(SeparatorSimulator));
+    if (!o->seps) {
+        fprintf(stderr, "Cannot allocate %zu optimizer candidates\n", o->capacity);
+        return false;
+    }
+    if (!SimExecutor_Start(&o->executor, o->threads)) {
+        free(o->seps);
+        o->seps = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void ValveOpt_Stop(ValveOptimizer *o) {
+    if (o->seps)
+        SimExecutor_Stop(&o->executor);
+    free(o->seps);
+    o->seps = NULL;
+}
+
+// Executor job: run the candidates of one partition over the horizon
+static void ValveOpt_RunPartition(void *context, size_t partition) {
+    ValveOptBatch *b = context;
+    size_t begin, end;
+    SimPartition_Range(b->count, VALVE_OPT_PARTITION_SIZE, partition, &begin, &end);
+    for (size_t i = begin; i < end; i++) {
+        SeparatorSimulator *sep = &b->seps[i];
+        *sep = *b->base;
+        sep->disturbance.enabled = false;
+        sep->settling.enabled = false;
+        sep->config.Q_in_oil = b->inflow[0];
+        sep->config.Q_in_water = b->inflow[1];
+        sep->config.Q_in_gas = b->inflow[2];
+        sep->config.valve_oil = b->valves[i][0];
+        sep->config.valve_water = b->valves[i][1];
+        sep->config.valve_gas = b->valves[i][2];
+        sep->state.h_oil = b->target[0];
+        sep->state.h_water = b->target[1];
+        Separator_SetPressure(sep, b->target[2]);
+        b->cost[i] = 0.0;
+    }
+    for (uint32_t c = 0; c < b->cycles; c++) {
+        Separator_UpdateBatch(b->seps + begin, end - begin, b->cycle_time_ms);
+        for (size_t i = begin; i < end; i++) {
+            double e_oil = (b->seps[i].state.h_oil - b->target[0]) / VALVE_OPT_LEVEL_SCALE;
+            double e_water = (b->seps[i].state.h_water - b->target[1]) / VALVE_OPT_LEVEL_SCALE;
+            double e_pressure = (b->seps[i].state.pressure - b->target[2]) / VALVE_OPT_PRESSURE_SCALE;
+            b->cost[i] += e_oil * e_oil + e_water * e_water + e_pressure * e_pressure;
+        }
+    }
+    for (size_t i = begin; i < end; i++)
+        b->cost[i] /= b->cycles;
+}
+
+// Cost of count candidates; the separators keep their end-of-horizon state
+static void ValveOpt_Evaluate(ValveOptimizer *o, const SeparatorSimulator *base, const double *target,
+                              const double *inflow, const double (*valves)[VALVE_OPT_N], size_t count,
+                              double *cost) {
+    uint32_t cycles = (uint32_t)ceil(o->horizon * 1000.0 / DEFAULT_CYCLE_TIME_MS);
+    ValveOptBatch batch = {.seps = o->seps, .count = count, .base = base, .target = target, .inflow = inflow,
+                           .valves = valves, .cycles = cycles ? cycles : 1,
+                           .cycle_time_ms = DEFAULT_CYCLE_TIME_MS, .cost = cost};
+    SimExecutor_Run(&o->executor, ValveOpt_RunPartition, &batch,
+                    SimPartition_Count(count, VALVE_OPT_PARTITION_SIZE));
+}
+
+// Standard normal number `index` of generation `generation`
+static double ValveOpt_Normal(const ValveOptimizer *o, uint64_t generation, uint64_t index) {
+    uint64_t key = Disturbance_Hash(((uint64_t)o->seed << 32) | 0xFFFFFFFEu, generation);
+    double z0, z1;
+    Disturbance_Normal2(Disturbance_Hash(key, index), &z0, &z1);
+    return z0;
+}
+
+// Uniform number in (0, 1) `index` of restart `run`
+static double ValveOpt_Uniform(const ValveOptimizer *o, uint64_t run, uint64_t index) {
+    uint64_t key = Disturbance_Hash(((uint64_t)o->seed << 32) | 0xFFFFFFFDu, run);
+    return Disturbance_Uniform((uint32_t)(Disturbance_Hash(key, index) >> 32));
+}
+
+// One CMA-ES run with lambda candidates from the scaled openings start;
+// generations are numbered on from first, and the best candidate goes to
+// r. Returns the generations run.
+static uint32_t ValveOpt_Search(ValveOptimizer *o, const SeparatorSimulator *base, const double *target,
+                                const double *inflow, const double *start, size_t lambda, uint32_t first,
+                                FILE *trace, ValveOptResult *r) {
+    enum { n = VALVE_OPT_N };
+    static double z[VALVE_OPT_MAX_POPULATION][n], y[VALVE_OPT_MAX_POPULATION][n];
+    static double valves[VALVE_OPT_MAX_POPULATION][n];
+    static double cost[VALVE_OPT_MAX_POPULATION], fitness[VALVE_OPT_MAX_POPULATION];
+    static size_t order[VALVE_OPT_MAX_POPULATION];
+
+    // Strategy parameters (Hansen's defaults)
+    size_t mu = lambda / 2;
+    double weights[VALVE_OPT_MAX_POPULATION / 2], sum = 0.0, sum_sq = 0.0;
+    for (size_t i = 0; i < mu; i++) {
+        weights[i] = log(mu + 0.5) - log(i + 1.0);
+        sum += weights[i];
+    }
+    for (size_t i = 0; i < mu; i++) {
+        weights[i] /= sum;
+        sum_sq += weights[i] * weights[i];
+    }
+    double mu_eff = 1.0 / sum_sq;
+    double c_sigma = (mu_eff + 2.0) / (n + mu_eff + 5.0);
+    double d_sigma = 1.0 + 2.0 * fmax(0.0, sqrt((mu_eff - 1.0) / (n + 1.0)) - 1.0) + c_sigma;
+    double c_c = (4.0 + mu_eff / n) / (n + 4.0 + 2.0 * mu_eff / n);
+    double c_1 = 2.0 / ((n + 1.3) * (n + 1.3) + mu_eff);
+    double c_mu = fmin(1.0 - c_1, 2.0 * (mu_eff - 2.0 + 1.0 / mu_eff) / ((n + 2.0) * (n + 2.0) + mu_eff));
+    double chi_n = sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+    double mean[n], C[n * n], L[n * n], p_sigma[n] = {0}, p_c[n] = {0}, sigma = VALVE_OPT_SIGMA0;
+    for (int j = 0; j < n; j++)
+        mean[j] = fmin(fmax(start[j], 0.0), 1.0);
+    for (int k = 0; k < n * n; k++)
+        C[k] = L[k] = k % (n + 1) == 0 ? 1.0 : 0.0;
+
+    uint32_t g;
+    for (g = 0; g < o->generations; g++) {
+        // Sample x = mean + sigma L z, run it clamped to [0, 1]
+        for (size_t k = 0; k < lambda; k++) {
+            double outside = 0.0;
+            for (int j = 0; j < n; j++)
+                z[k][j] = ValveOpt_Normal(o, first + g, k * n + j);
+            for (int j = 0; j < n; j++) {
+                y[k][j] = 0.0;
+                for (int p = 0; p <= j; p++)
+                    y[k][j] += L[j * n + p] * z[k][p];
+                double x = mean[j] + sigma * y[k][j];
+                double clamped = fmin(fmax(x, 0.0), 1.0);
+                outside += (x - clamped) * (x - clamped);
+                valves[k][j] = 100.0 * clamped;
+            }
+            fitness[k] = VALVE_OPT_PENALTY * outside;
+        }
+        ValveOpt_Evaluate(o, base, target, inflow, (const double (*)[n])valves, lambda, cost);
+        r->evaluations += (uint32_t)lambda;
+
+        for (size_t k = 0; k < lambda; k++) {
+            fitness[k] += cost[k];
+            if (cost[k] < r->cost) {
+                r->cost = cost[k];
+                memcpy(r->valves, valves[k], sizeof(r->valves));
+            }
+            // Insertion sort by fitness, ties in candidate order
+            size_t i = k;
+            while (i > 0 && fitness[order[i - 1]] > fitness[k]) {
+                order[i] = order[i - 1];
+                i--;
+            }
+            order[i] = k;
+        }
+
+        // Recombination; z_w = L^-1 y_w drives the step-size path
+        double y_w[n] = {0}, z_w[n] = {0}, norm = 0.0;
+        for (size_t i = 0; i < mu; i++) {
+            for (int j = 0; j < n; j++) {
+                y_w[j] += weights[i] * y[order[i]][j];
+                z_w[j] += weights[i] * z[order[i]][j];
+            }
+        }
+        for (int j = 0; j < n; j++) {
+            mean[j] += sigma * y_w[j];
+            p_sigma[j] = (1.0 - c_sigma) * p_sigma[j] + sqrt(c_sigma * (2.0 - c_sigma) * mu_eff) * z_w[j];
+            norm += p_sigma[j] * p_sigma[j];
+        }
+        norm = sqrt(norm);
+        bool h_sigma = norm / sqrt(1.0 - pow(1.0 - c_sigma, 2.0 * (g + 1))) / chi_n < 1.4 + 2.0 / (n + 1.0);
+        for (int j = 0; j < n; j++)
+            p_c[j] = (1.0 - c_c) * p_c[j] + (h_sigma ? sqrt(c_c * (2.0 - c_c) * mu_eff) * y_w[j] : 0.0);
+
+        // Covariance: rank-one and rank-mu updates
+        double keep = 1.0 - c_1 - c_mu + (h_sigma ? 0.0 : c_1 * c_c * (2.0 - c_c));
+        for (int a = 0; a < n; a++) {
+            for (int b = 0; b < n; b++) {
+                double rank_mu = 0.0;
+                for (size_t i = 0; i < mu; i++)
+                    rank_mu += weights[i] * y[order[i]][a] * y[order[i]][b];
+                C[a * n + b] = keep * C[a * n + b] + c_1 * p_c[a] * p_c[b] + c_mu * rank_mu;
+            }
+        }
+        double factor[n * n];
+        memcpy(factor, C, sizeof(factor));
+        if (SimDense_Cholesky(factor, n, n)) {
+            for (int a = 0; a < n; a++)
+                for (int b = 0; b < n; b++)
+                    L[a * n + b] = b <= a ? factor[a * n + b] : 0.0;
+        }
+        sigma *= exp(c_sigma / d_sigma * (norm / chi_n - 1.0));
+
+        double spread = 0.0;
+        for (int j = 0; j < n; j++)
+            spread = fmax(spread, sigma * sqrt(C[j * n + j]));
+        if (trace)
+            fprintf(trace, "%5u %14.6g %10.4f %10.4f %10.4f %12.3g\n", first + g + 1, r->cost, r->valves[0],
+                    r->valves[1], r->valves[2], 100.0 * spread);
+        if (spread < VALVE_OPT_TOLERANCE) {
+            g++;
+            break;
+        }
+    }
+    return g;
+}
+
+// Search from the openings start (%); trace, if not NULL, gets a line per
+// generation and per restart
+static void ValveOpt_Run(ValveOptimizer *o, const SeparatorSimulator *base, const double *target,
+                         const double *inflow, const double *start, FILE *trace, ValveOptResult *r) {
+    enum { n = VALVE_OPT_N };
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    memset(r, 0, sizeof(*r));
+    r->cost = INFINITY;
+
+    double from[n];
+    for (int j = 0; j < n; j++)
+        from[j] = start[j] / 100.0;
+    for (uint32_t run = 0; run <= o->restarts; run++) {
+        size_t lambda = ValveOpt_Population(o, run);
+        if (run > 0) {
+            for (int j = 0; j < n; j++)
+                from[j] = ValveOpt_Uniform(o, run, j);
+            if (trace)
+                fprintf(trace, "restart %u, population %zu, from %.4f %.4f %.4f %%\n", run, lambda,
+                        100.0 * from[0], 100.0 * from[1], 100.0 * from[2]);
+        }
+        r->generations += ValveOpt_Search(o, base, target, inflow, from, lambda, r->generations, trace, r);
+        r->searches++;
+    }
+
+    // Sensitivity: the optimum and a step down and up in each opening
+    double probe[2 * n + 1][n], probe_cost[2 * n + 1];
+    for (int k = 0; k < 2 * n + 1; k++)
+        memcpy(probe[k], r->valves, sizeof(r->valves));
+    for (int j = 0; j < n; j++) {
+        probe[1 + 2 * j][j] = fmax(r->valves[j] - VALVE_OPT_STEP, 0.0);
+        probe[2 + 2 * j][j] = fmin(r->valves[j] + VALVE_OPT_STEP, 100.0);
+    }
+    ValveOpt_Evaluate(o, base, target, inflow, (const double (*)[n])probe, 2 * n + 1, probe_cost);
+    r->evaluations += 2 * n + 1;
+    for (int j = 0; j < n; j++) {
+        const SeparatorSimulator *down = &o->seps[1 + 2 * j], *up = &o->seps[2 + 2 * j];
+        double step = probe[2 + 2 * j][j] - probe[1 + 2 * j][j];
+        r->sensitivity[0 * n + j] = (up->state.h_oil - down->state.h_oil) / step;
+        r->sensitivity[1 * n + j] = (up->state.h_water - down->state.h_water) / step;
+        r->sensitivity[2 * n + j] = (up->state.pressure - down->state.pressure) / step;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r->seconds = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+// Targets and inflows the separator can hold at all
+static bool ValveOpt_Valid(const SeparatorSimulator *sep, const double *target, const double *inflow) {
+    double max_height = sep->total_volume / sep->area;
+    return target[0] > 0.0 && target[1] > 0.0 && target[0] + target[1] < max_height &&
+           target[2] > sep->ambient_pressure && inflow[0] >= 0.0 && inflow[1] >= 0.0 && inflow[2] >= 0.0;
+}
+
+static void ValveOpt_Print(const ValveOptResult *r) {
+    static const char *const states[3] = {"h_oil m", "h_water m", "pressure Pa"};
+    printf("valves  oil %.4f %%  water %.4f %%  gas %.4f %%\n", r->valves[0], r->valves[1], r->valves[2]);
+    printf("cost %.6g after %u generations (%u restarts), %u runs, %.3f s\n", r->cost, r->generations,
+           r->searches - 1, r->evaluations, r->seconds);
+    printf("sensitivity per %% %14s %14s %14s\n", "valve_oil", "valve_water", "valve_gas");
+    for (int i = 0; i < 3; i++)
+        printf("%-17s %14.6g %14.6g %14.6g\n", states[i], r->sensitivity[i * VALVE_OPT_N],
+               r->sensitivity[i * VALVE_OPT_N + 1], r->sensitivity[i * VALVE_OPT_N + 2]);
+}
+
+static bool ValveOpt_ParseTriple(const char *text, double *out) {
+    char *end;
+    for (int j = 0; j < 3; j++) {
+        out[j] = strtod(text, &end);
+        if (end == text || (j < 2 && *end != ','))
+            return false;
+        text = end + 1;
+    }
+    return *end == '\0';
+}
+
+static int ValveOpt_Main(int argc, char **argv) {
+    ValveOptimizer o;
+    ValveOpt_Defaults(&o);
+    double target[3], inflow[3], start[3];
+    bool has_inflow = false, has_start = false;
+    const char *config_path = NULL;
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: --optimize-valves <h_oil> <h_water> <pressure> [--inflows Q,Q,Q] "
+                        "[--start V,V,V] [--population P] [--generations G] [--restarts R] [--horizon S] "
+                        "[--threads T] [--seed S] [config]\n");
+        return EXIT_FAILURE;
+    }
+    for (int j = 0; j < 3; j++)
+        target[j] = strtod(argv[1 + j], NULL);
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--inflows") == 0 && i + 1 < argc) {
+            has_inflow = ValveOpt_ParseTriple(argv[++i], inflow);
+            if (!has_inflow) {
+                fprintf(stderr, "--inflows needs three flows\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
+            has_start = ValveOpt_ParseTriple(argv[++i], start);
+            if (!has_start) {
+                fprintf(stderr, "--start needs three openings\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--population") == 0 && i + 1 < argc) {
+            o.population = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--generations") == 0 && i + 1 < argc) {
+            o.generations = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--restarts") == 0 && i + 1 < argc) {
+            o.restarts = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--horizon") == 0 && i + 1 < argc) {
+            o.horizon = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            o.threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            o.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !config_path) {
+            config_path = argv[i];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    SeparatorSimulator *base = calloc(1, sizeof(SeparatorSimulator));
+    if (!base)
+        return EXIT_FAILURE;
+    Separator_Init(base);
+    if (config_path) {
+        static ConfigFile config;
+        if (!ConfigFile_Load(config_path, &config)) {
+            fprintf(stderr, "Cannot read %s\n", config_path);
+            free(base);
+            return EXIT_FAILURE;
+        }
+        Separator_ApplyConfig(base, &config, NULL);
+        if (!Separator_UseSurrogate(base, &config)) {
+            free(base);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!has_inflow) {
+        inflow[0] = base->config.Q_in_oil;
+        inflow[1] = base->config.Q_in_water;
+        inflow[2] = base->config.Q_in_gas;
+    }
+    if (!has_start) {
+        start[0] = base->config.valve_oil;
+        start[1] = base->config.valve_water;
+        start[2] = base->config.valve_gas;
+    }
+    if (!ValveOpt_Valid(base, target, inflow) || o.horizon <= 0.0) {
+        fprintf(stderr, "Targets outside the vessel, negative inflows or no horizon\n");
+        free(base);
+        return EXIT_FAILURE;
+    }
+    if (!ValveOpt_Start(&o)) {
+        free(base);
+        return EXIT_FAILURE;
+    }
+
+    printf("Valve optimizer: h_oil %.3f m, h_water %.3f m, pressure %.0f Pa, inflows %.4f %.4f %.4f m3/s\n",
+           target[0], target[1], target[2], inflow[0], inflow[1], inflow[2]);
+    printf("IPOP-CMA-ES, population %u, %u restarts, horizon %.0f s, %u threads\n", o.population, o.restarts,
+           o.horizon, o.threads);
+    printf("%5s %14s %10s %10s %10s %12s\n", "gen", "best_cost", "oil_%", "water_%", "gas_%", "step_%");
+    ValveOptResult r;
+    ValveOpt_Run(&o, base, target, inflow, start, stdout, &r);
+    ValveOpt_Print(&r);
+    ValveOpt_Stop(&o);
+    Surrogate_Free(&surrogate);
+    free(base);
+    return EXIT_SUCCESS;
+}
+
+// OptimizeValves(h_oil, h_water, pressure, Q_in_oil, Q_in_water, Q_in_gas)
+//   -> Valves[3], Cost, Sensitivity[9], Runs, searched from base
+static UA_StatusCode ValveOpt_Call(const SeparatorSimulator *base, size_t inputSize, const UA_Variant *input,
+                                   size_t outputSize, UA_Variant *output) {
+    double args[6];
+    if (inputSize != 6 || outputSize != 4)
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    for (size_t i = 0; i < 6; i++) {
+        if (!UA_Variant_hasScalarType(&input[i], &UA_TYPES[UA_TYPES_DOUBLE]))
+            return UA_STATUSCODE_BADINVALIDARGUMENT;
+        args[i] = *(UA_Double*)input[i].data;
+    }
+    if (!ValveOpt_Valid(base, args, args + 3))
+        return UA_STATUSCODE_BADOUTOFRANGE;
+
+    double start[3] = {base->config.valve_oil, base->config.valve_water, base->config.valve_gas};
+    ValveOptResult r;
+    ValveOpt_Run(&optimizer, base, args, args + 3, start, NULL, &r);
+    printf("OptimizeValves: %.4f %.4f %.4f %%, cost %.6g, %u runs in %.3f s\n", r.valves[0], r.valves[1],
+           r.valves[2], r.cost, r.evaluations, r.seconds);
+
+    UA_Variant_setArrayCopy(&output[0], r.valves, VALVE_OPT_N, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Variant_setScalarCopy(&output[1], &r.cost, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Variant_setArrayCopy(&output[2], r.sensitivity, 3 * VALVE_OPT_N, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_Variant_setScalarCopy(&output[3], &r.evaluations, &UA_TYPES[UA_TYPES_UINT32]);
+    return UA_STATUSCODE_GOOD;
+}
+
+// Synchronous method callback, for builds without async methods: the
+// server and the simulation wait for the search
+static UA_StatusCode onOptimizeValves(UA_Server *server, const UA_NodeId *sessionId, void *sessionContext,
+                                      const UA_NodeId *methodId, void *methodContext,
+                                      const UA_NodeId *objectId, void *objectContext,
+                                      size_t inputSize, const UA_Variant *input,
+                                      size_t outputSize, UA_Variant *output) {
+    return ValveOpt_Call(&separator, inputSize, input, outputSize, output);
+}
+
+// --- Optimizer Worker ---
+// With a multithreaded open62541 (UA_MULTITHREADING >= 100) OptimizeValves
+// is an async method: the server queues each call and a worker thread runs
+// the search and posts the result, so the server keeps answering and the
+// simulation keeps stepping meanwhile. The search starts from a snapshot
+// of the separator that the main loop refreshes after every cycle. Other
+// builds keep the synchronous callback.
+typedef struct {
+    bool started;
+    bool stopping;
+    uint32_t queued;                  // Notifications not yet handled
+    UA_Server *server;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    SeparatorSimulator snapshot;      // Under lock
+    SeparatorSimulator base;          // The worker's copy for one search
+} OptimizerWorker;
+
+OptimizerWorker optimizer_worker;
+
+#if UA_MULTITHREADING >= 100
+// Server callback: an async operation was queued
+static void OptimizerWorker_Notify(UA_Server *server) {
+    pthread_mutex_lock(&optimizer_worker.lock);
+    optimizer_worker.queued++;
+    pthread_cond_signal(&optimizer_worker.wake);
+    pthread_mutex_unlock(&optimizer_worker.lock);
+}
+
+static void *OptimizerWorker_Run(void *arg) {
+    OptimizerWorker *w = arg;
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (!w->queued && !w->stopping)
+            pthread_cond_wait(&w->wake, &w->lock);
+        if (w->stopping) {
+            pthread_mutex_unlock(&w->lock);
+            return NULL;
+        }
+        w->queued = 0;
+        pthread_mutex_unlock(&w->lock);
+
+        UA_AsyncOperationType type;
+        const UA_AsyncOperationRequest *request;
+        void *context;
+        while (UA_Server_getAsyncOperationNonBlocking(w->server, &type, &request, &context, NULL)) {
+            UA_AsyncOperationResponse response;
+            UA_CallMethodResult *result = &response.callMethodResult;
+            UA_CallMethodResult_init(result);
+            result->outputArguments = UA_Array_new(4, &UA_TYPES[UA_TYPES_VARIANT]);
+            if (type != UA_ASYNCOPERATIONTYPE_CALL) {
+                result->statusCode = UA_STATUSCODE_BADNOTSUPPORTED;
+            } else if (!result->outputArguments) {
+                result->statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
+            } else {
+                pthread_mutex_lock(&w->lock);
+                w->base = w->snapshot;
+                pthread_mutex_unlock(&w->lock);
+                result->outputArgumentsSize = 4;
+                const UA_CallMethodRequest *call = &request->callMethodRequest;
+                result->statusCode = ValveOpt_Call(&w->base, call->inputArgumentsSize, call->inputArguments,
+                                                   result->outputArgumentsSize, result->outputArguments);
+            }
+            UA_Server_setAsyncOperationResult(w->server, &response, context);
+            UA_CallMethodResult_clear(result);
+            SimLoop_Wake(&loop);
+        }
+    }
+}
+
+static void OptimizerWorker_Start(OptimizerWorker *w, UA_Server *server, const SeparatorSimulator *sep) {
+    w->server = server;
+    w->snapshot = *sep;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    UA_Server_getConfig(server)->asyncOperationNotifyCallback = OptimizerWorker_Notify;
+    if (pthread_create(&w->thread, NULL, OptimizerWorker_Run, w) != 0) {
+        fprintf(stderr, "Cannot start the optimizer thread, OptimizeValves runs synchronously\n");
+        return;
+    }
+    UA_Server_setMethodNodeAsync(server, UA_NODEID_STRING(1, "OptimizeValves"), true);
+    w->started = true;
+}
+
+static void OptimizerWorker_Stop(OptimizerWorker *w) {
+    if (!w->started)
+        return;
+    pthread_mutex_lock(&w->lock);
+    w->stopping = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    w->started = false;
+}
+
+// After every cycle
+static void OptimizerWorker_Publish(OptimizerWorker *w, const SeparatorSimulator *sep) {
+    if (!w->started)
+        return;
+    pthread_mutex_lock(&w->lock);
+    w->snapshot = *sep;
+    pthread_mutex_unlock(&w->lock);
+}
+#else
+static void OptimizerWorker_Start(OptimizerWorker *w, UA_Server *server, const SeparatorSimulator *sep) {
+}
+
+static void OptimizerWorker_Stop(OptimizerWorker *w) {
+}
+
+static void OptimizerWorker_Publish(OptimizerWorker *w, const SeparatorSimulator *sep) {
+}
+#endif
+
+static void setMethodArgument(UA_Argument *arg, char *name, char *description, const UA_DataType *type,
+                              UA_UInt32 *length) {
+    UA_Argument_init(arg);
+    arg->name = UA_STRING(name);
+    arg->description = UA_LOCALIZEDTEXT("en-US", description);
+    arg->dataType = type->typeId;
+    arg->valueRank = length ? UA_VALUERANK_ONE_DIMENSION : UA_VALUERANK_SCALAR;
+    arg->arrayDimensionsSize = length ? 1 : 0;
+    arg->arrayDimensions = length;
+}
+
+static void addOptimizerMethod(UA_Server *server) {
+    static UA_UInt32 valve_count = VALVE_OPT_N, sensitivity_count = 3 * VALVE_OPT_N;
+    const UA_DataType *real = &UA_TYPES[UA_TYPES_DOUBLE];
+    UA_Argument inputs[6], outputs[4];
+    setMethodArgument(&inputs[0], "h_oil", "Target oil level, m", real, NULL);
+    setMethodArgument(&inputs[1], "h_water", "Target water level, m", real, NULL);
+    setMethodArgument(&inputs[2], "pressure", "Target pressure, Pa", real, NULL);
+    setMethodArgument(&inputs[3], "Q_in_oil", "Oil inflow, m3/s", real, NULL);
+    setMethodArgument(&inputs[4], "Q_in_water", "Water inflow, m3/s", real, NULL);
+    setMethodArgument(&inputs[5], "Q_in_gas", "Gas inflow, m3/s", real, NULL);
+    setMethodArgument(&outputs[0], "Valves", "valve_oil, valve_water, valve_gas, %", real, &valve_count);
+    setMethodArgument(&outputs[1], "Cost", "Mean squared deviation from the targets, 1 cm and 1 kPa units",
+                      real, NULL);
+    setMethodArgument(&outputs[2], "Sensitivity",
+                      "d(h_oil, h_water, pressure)/d(valve_oil, valve_water, valve_gas) per %, row-major",
+                      real, &sensitivity_count);
+    setMethodArgument(&outputs[3], "Runs", "Separator runs of the search", &UA_TYPES[UA_TYPES_UINT32], NULL);
+
+    UA_MethodAttributes attr = UA_MethodAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", "Optimize Valves");
+    attr.description = UA_LOCALIZEDTEXT("en-US", "Valve openings that hold target levels and pressure");
+    attr.executable = true;
+    attr.userExecutable = true;
+    UA_Server_addMethodNode(server, UA_NODEID_STRING(1, "OptimizeValves"), UA_NODEID_STRING(1, "Separator"),
+                            UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT), UA_QUALIFIEDNAME(1, "OptimizeValves"),
+                            attr, onOptimizeValves, 6, inputs, 4, outputs, NULL, NULL);
+}
+
+// ==================== GOLDEN SCENARIOS ====================
+// Canonical runs for --golden record|check <trace> (sim_golden.h),
+// with tolerances scaled to each signal's full scale. Inlet flows come
+// straight from the disturbance model; everything else depends on the
+// integrated levels, pressure or temperature. Pressure also gets a relative
+// tolerance because the slug scenarios drive it through many decades.
+#define GOLDEN_LEVEL_TOL (5.0 * SIM_GOLDEN_INTEGRATED)         // m, full vessel
+#define GOLDEN_PRESSURE_TOL (1e6 * SIM_GOLDEN_INTEGRATED)      // Pa, PSV set pressure
+#define GOLDEN_PRESSURE_REL_TOL SIM_GOLDEN_INTEGRATED
+#define GOLDEN_FLOW_TOL (0.5 * SIM_GOLDEN_ALGEBRAIC)           // m³/s
+#define GOLDEN_FRACTION_TOL SIM_GOLDEN_INTEGRATED              // Efficiency, water cut
+#define GOLDEN_PPM_TOL (1e5 * SIM_GOLDEN_INTEGRATED)           // ppm
+#define GOLDEN_TEMPERATURE_TOL (350.0 * SIM_GOLDEN_INTEGRATED) // K
+#define GOLDEN_MASS_FLOW_TOL (2.0 * SIM_GOLDEN_INTEGRATED)     // kg/s, PSV capacity
+#define GOLDEN_MASS_TOL (1e3 * SIM_GOLDEN_INTEGRATED)          // kg
+
+// Settling, the energy balance, event location and relief are off unless
+// a scenario turns them on, so the scenarios that predate them keep their
+// samples
+static void Separator_GoldenInit(SeparatorSimulator *sep) {
+    memset(sep, 0, sizeof(*sep));
+    Separator_Init(sep);
+    sep->settling.enabled = false;
+    sep->energy.enabled = false;
+    sep->integrator.enabled = false;
+    sep->relief.enabled = false;
+}
+
+// Step sep `steps` cycles, sampling every `every` steps
+static void Separator_GoldenRun(SimGolden *golden, const char *scenario, SeparatorSimulator *sep,
+                                uint32_t steps, uint32_t every) {
+    SimGolden_Begin(golden, scenario);
+    for (uint32_t step = 0; step <= steps; step++) {
+        if (step % every == 0) {
+            SimGolden_Signal(golden, step, "h_oil", sep->state.h_oil, GOLDEN_LEVEL_TOL, 0.0);
+            SimGolden_Signal(golden, step, "h_water", sep->state.h_water, GOLDEN_LEVEL_TOL, 0.0);
+            SimGolden_Signal(golden, step, "pressure", sep->state.pressure, GOLDEN_PRESSURE_TOL, GOLDEN_PRESSURE_REL_TOL);
+            SimGolden_Signal(golden, step, "Q_oil_in", sep->state.Q_oil_in, GOLDEN_FLOW_TOL, 0.0);
+            SimGolden_Signal(golden, step, "Q_water_in", sep->state.Q_water_in, GOLDEN_FLOW_TOL, 0.0);
+            SimGolden_Signal(golden, step, "Q_gas_in", sep->state.Q_gas_in, GOLDEN_FLOW_TOL, 0.0);
+            SimGolden_Signal(golden, step, "SlugActive", sep->disturbance.in_slug, 0.0, 0.0);
+            if (sep->settling.enabled) {
+                SimGolden_Signal(golden, step, "WaterEfficiency", sep->settling.water_efficiency, GOLDEN_FRACTION_TOL, 0.0);
+                SimGolden_Signal(golden, step, "OilEfficiency", sep->settling.oil_efficiency, GOLDEN_FRACTION_TOL, 0.0);
+                SimGolden_Signal(golden, step, "WaterInOil", sep->settling.water_in_oil, GOLDEN_FRACTION_TOL, 0.0);
+                SimGolden_Signal(golden, step, "OilInWaterPpm", sep->settling.oil_in_water_ppm, GOLDEN_PPM_TOL, 0.0);
+            }
+            if (sep->energy.enabled) {
+                SimGolden_Signal(golden, step, "temperature", sep->state.temperature, GOLDEN_TEMPERATURE_TOL, 0.0);
+                SimGolden_Signal(golden, step, "GasOutletTemperature", sep->energy.gas_outlet_temperature,
+                                 GOLDEN_TEMPERATURE_TOL, 0.0);
+            }
+            if (sep->integrator.enabled)
+                SimGolden_Signal(golden, step, "Events", (double)sep->integrator.events, 0.0, 0.0);
+            if (sep->relief.enabled) {
+                SimGolden_Signal(golden, step, "Psv1Open", sep->relief.psv[0].open, 0.0, 0.0);
+                SimGolden_Signal(golden, step, "BdvOpen", sep->relief.bdv_open, 0.0, 0.0);
+                SimGolden_Signal(golden, step, "ReliefRate", sep->relief.relief_rate, GOLDEN_MASS_FLOW_TOL, 0.0);
+                SimGolden_Signal(golden, step, "RelievedMass", sep->relief.relieved_mass, GOLDEN_MASS_TOL, 0.0);
+            }
+        }
+        if (step < steps)
+            Separator_Update(sep, DEFAULT_CYCLE_TIME_MS);
+    }
+    SimGolden_End(golden);
+}
+
+static void Separator_GoldenScenarios(SimGolden *golden) {
+    SeparatorSimulator sep;
+
+    // Liquid outlets shut: both levels rise, the gas space is compressed
+    Separator_GoldenInit(&sep);
+    sep.config.valve_oil = 0.0;
+    sep.config.valve_water = 0.0;
+    Separator_GoldenRun(golden, "separator_fill", &sep, 1200, 10);
+
+    // No inflow, outlets wide open: levels drain to the clamp at 0 and the
+    // pressure falls to the ambient clamp
+    Separator_GoldenInit(&sep);
+    sep.config.Q_in_oil = sep.config.Q_in_water = sep.config.Q_in_gas = 0.0;
+    sep.config.valve_oil = sep.config.valve_water = sep.config.valve_gas = 100.0;
+    Separator_GoldenRun(golden, "separator_drain", &sep, 8000, 50);
+
+    // Blowdown from 4 bar with the liquid held: choked gas outflow until the
+    // pressure ratio crosses the critical ratio, subcritical after that
+    Separator_GoldenInit(&sep);
+    sep.config.Q_in_oil = sep.config.Q_in_water = sep.config.Q_in_gas = 0.0;
+    sep.config.valve_oil = sep.config.valve_water = 0.0;
+    sep.config.valve_gas = 100.0;
+    Separator_SetPressure(&sep, 400000.0);
+    Separator_GoldenRun(golden, "separator_gas_choked", &sep, 8000, 20);
+
+    // Near ambient with the liquid held: subcritical gas outflow only,
+    // settling at the balance with the gas inflow
+    Separator_GoldenInit(&sep);
+    sep.config.Q_in_oil = sep.config.Q_in_water = 0.0;
+    sep.config.valve_oil = sep.config.valve_water = 0.0;
+    sep.config.Q_in_gas = 0.02;
+    sep.config.valve_gas = 50.0;
+    Separator_SetPressure(&sep, 120000.0);
+    Separator_GoldenRun(golden, "separator_gas_subcritical", &sep, 3000, 10);
+
+    // Slug train and correlated inflow noise from a fixed seed
+    Separator_GoldenInit(&sep);
+    sep.disturbance.enabled = true;
+    sep.disturbance.seed = 7;
+    sep.disturbance.slug_rate = 1.0 / 30.0;
+    Separator_GoldenRun(golden, "separator_slugs", &sep, 6000, 10);
+
+    // Droplet settling while the oil outlet opens up: shorter residence
+    // time, more water carried over; oil droplets under a slug train
+    Separator_GoldenInit(&sep);
+    sep.settling.enabled = true;
+    sep.disturbance.enabled = true;
+    sep.disturbance.seed = 11;
+    sep.disturbance.slug_rate = 1.0 / 60.0;
+    sep.config.valve_oil = 100.0;
+    Separator_GoldenRun(golden, "separator_settling", &sep, 6000, 20);
+
+    // Hot inlet at steady levels: the contents warm towards the inlet
+    // temperature less the ambient losses
+    Separator_GoldenInit(&sep);
+    sep.energy.enabled = true;
+    sep.energy.T_in = 340.0;
+    sep.config.Q_in_oil = 0.02;
+    sep.config.Q_in_water = 0.015;
+    sep.config.Q_in_gas = 0.02;
+    sep.config.valve_oil = sep.config.valve_water = 100.0;
+    sep.config.valve_gas = 50.0;
+    Separator_GoldenRun(golden, "separator_hot_inlet", &sep, 12000, 50);
+
+    // Blowdown of a gas-filled vessel with the energy balance: expansion
+    // cools the gas, Joule-Thomson cooling downstream of the valve shrinks
+    // with the pressure drop
+    Separator_GoldenInit(&sep);
+    sep.energy.enabled = true;
+    sep.config.Q_in_oil = sep.config.Q_in_water = sep.config.Q_in_gas = 0.0;
+    sep.config.valve_oil = sep.config.valve_water = 0.0;
+    sep.config.valve_gas = 100.0;
+    sep.state.h_oil = sep.state.h_water = 0.0;
+    Separator_SetPressure(&sep, 400000.0);
+    Separator_GoldenRun(golden, "separator_thermal_blowdown", &sep, 8000, 20);
+
+    // Drain and vent with event location: the oil runs empty, the water
+    // drains towards its trickle inflow, the gas vents from choked to
+    // subcritical flow and comes to rest at ambient
+    Separator_GoldenInit(&sep);
+    EventBench_Scenario(&sep);
+    sep.integrator.enabled = true;
+    Separator_GoldenRun(golden, "separator_events", &sep, 15000, 50);
+
+    // Blocked gas outlet under gas inflow: PSV 1 lifts at its set pressure
+    // and reseats at the blowdown, over and over (event location)
+    Separator_GoldenInit(&sep);
+    sep.relief.enabled = true;
+    sep.integrator.enabled = true;
+    sep.config.Q_in_oil = sep.config.Q_in_water = 0.0;
+    sep.config.valve_oil = sep.config.valve_water = sep.config.valve_gas = 0.0;
+    sep.config.Q_in_gas = 0.1;
+    Separator_SetPressure(&sep, 800000.0);
+    Separator_GoldenRun(golden, "separator_psv_cycling", &sep, 6000, 20);
+
+    // Depressurization through the blowdown valve from just under the PSV
+    // set pressure, critical then subcritical against the flare back
+    // pressure (fixed step)
+    Separator_GoldenInit(&sep);
+    sep.relief.enabled = true;
+    sep.relief.bdv_open = true;
+    sep.config.Q_in_oil = sep.config.Q_in_water = sep.config.Q_in_gas = 0.0;
+    sep.config.valve_oil = sep.config.valve_water = sep.config.valve_gas = 0.0;
+    Separator_SetPressure(&sep, 950000.0);
+    Separator_GoldenRun(golden, "separator_blowdown_valve", &sep, 8000, 20);
+}
+
+int main(int argc, char **argv) {
+    static ConfigFile config_files[2];
+    ConfigFile *active_config = NULL;
+    ConfigWatch config_watch = {.fd = -1};
+    const char *config_path = argc > 1 ? argv[1] : NULL;
+    uint64_t cycle_count = 0;
+
+    signal(SIGINT, stopHandler);
+    signal(SIGTERM, stopHandler);
+
+    if (argc > 1 && strcmp(argv[1], "--golden") == 0)
+        return SimGolden_Main(argc - 1, argv + 1, Separator_GoldenScenarios);
+    if (argc > 1 && strcmp(argv[1], "--bench-settling") == 0)
+        return StepBench_Main(argc - 1, argv + 1, STEP_BENCH_SETTLING);
+    if (argc > 1 && strcmp(argv[1], "--bench-thermal") == 0)
+        return StepBench_Main(argc - 1, argv + 1, STEP_BENCH_THERMAL);
+    if (argc > 1 && strcmp(argv[1], "--bench-events") == 0)
+        return EventBench_Main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "--relief-study") == 0)
+        return ReliefStudy_Main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "--fit-surrogate") == 0)
+        return SurrogateFit_Main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "--optimize-valves") == 0)
+        return ValveOpt_Main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "--twin") == 0) {
+        int used = Twin_ParseArgs(&twin, argc - 1, argv + 1);
+        if (used < 0)
+            return EXIT_FAILURE;
+        argc -= used;
+        argv += used;
+        config_path = argc > 1 ? argv[1] : NULL;
+    }
+
+    Separator_Init(&separator);
+    ValveOpt_Defaults(&optimizer);
+    if (!SimExecutor_Start(&executor, 1))
+        return EXIT_FAILURE;
+
+    // Optional per-cycle state hashes (SIM_HASH_LOG)
+    if (!SimHashLog_OpenFromEnv(&hash_log, NULL, 1))
+        return EXIT_FAILURE;
+    SimHashLog_SetSegment(&hash_log, "Separator.config", &separator.config, sizeof(separator.config), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.state", &separator.state, sizeof(separator.state), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.disturbance", &separator.disturbance,
+                          sizeof(separator.disturbance), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.settling", &separator.settling,
+                          sizeof(separator.settling), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.energy", &separator.energy,
+                          sizeof(separator.energy), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.relief", &separator.relief,
+                          sizeof(separator.relief), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.integrator", &separator.integrator,
+                          sizeof(separator.integrator), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Separator.constants", &separator.area,
+                          sizeof(separator) - offsetof(SeparatorSimulator, area), 1, 0);
+
+    // Optional configuration file, reloaded whenever it is rewritten
+    if (config_path) {
+        if (!ConfigFile_Load(config_path, &config_files[0])) {
+            fprintf(stderr, "Cannot read %s\n", config_path);
+            return EXIT_FAILURE;
+        }
+        active_config = &config_files[0];
+        Separator_ApplyConfig(&separator, active_config, NULL);
+        if (!ConfigWatch_Open(&config_watch, config_path))
+            fprintf(stderr, "Hot reload unavailable for %s\n", config_path);
+
+        // Surrogate of the one-cycle map (--fit-surrogate), read at startup
+        if (!Separator_UseSurrogate(&separator, active_config))
+            return EXIT_FAILURE;
+
+        // OptimizeValves method, read at startup
+        const char *value = ConfigFile_Get(active_config, "OptimizerThreads");
+        if (value && strtoul(value, NULL, 10) > 0)
+            optimizer.threads = (uint32_t)strtoul(value, NULL, 10);
+        value = ConfigFile_Get(active_config, "OptimizerHorizon");
+        if (value && strtod(value, NULL) > 0.0)
+            optimizer.horizon = strtod(value, NULL);
+        value = ConfigFile_Get(active_config, "OptimizerRestarts");
+        if (value)
+            optimizer.restarts = (uint32_t)strtoul(value, NULL, 10);
+    }
+
+    // Digital twin: the ensemble starts from the configured separator
+    if (twin.enabled) {
+        if (!Twin_Start(&twin, &separator))
+            return EXIT_FAILURE;
+        Twin_Publish(&twin, &separator);
+        if (twin.headless)
+            return Twin_RunHeadless(&twin, &separator);
+    }
+
+    if (!ValveOpt_Start(&optimizer))
+        return EXIT_FAILURE;
+
+    server = UA_Server_new();
+    if (SimSecurity_ConfigureFromEnv(UA_Server_getConfig(server), 4840) != UA_STATUSCODE_GOOD) {
+        UA_Server_delete(server);
+        return EXIT_FAILURE;
+    }
+
+    addSeparatorObject(server);
+    addOptimizerMethod(server);
+    OptimizerWorker_Start(&optimizer_worker, server, &separator);
+    if (twin.enabled)
+        addTwinObject(server);
+    printf("OPC UA Separator Server running at opc.tcp://localhost:4840\n");
+
+    SimMetrics_StartFromEnv(server);
+    int metrics_model = SimMetrics_RegisterModel("Separator");
+
+    UA_Server_run_startup(server);
+    if (!SimLoop_Open(&loop, server, DEFAULT_CYCLE_TIME_MS))
+        running = false;
+    SimLoop_AddFd(&loop, config_watch.fd, ConfigWatch_OnReadable, &config_watch);
+
+    while (running) {
+        uint64_t ticks = SimLoop_WaitTick(&loop);
+        if (ticks == 0)
+            continue;
+        // Ticks that expired while the server was busy (a slow request, a
+        // synchronous OptimizeValves) are stepped now, up to
+        // SEPARATOR_MAX_CATCH_UP; simulated time falls behind by the rest
+        if (ticks > SEPARATOR_MAX_CATCH_UP) {
+            fprintf(stderr, "Dropped %llu cycles behind real time\n",
+                    (unsigned long long)(ticks - SEPARATOR_MAX_CATCH_UP));
+            ticks = SEPARATOR_MAX_CATCH_UP;
+        }
+        uint64_t cycle_start = SimMetrics_Now();
+        for (uint64_t tick = 0; tick < ticks; tick++) {
+            uint64_t step_start = SimMetrics_Now();
+            if (twin.enabled)
+                Twin_Step(&twin, &separator, DEFAULT_CYCLE_TIME_MS);
+            else
+                Separator_UpdateFleet(&executor, &separator, 1, DEFAULT_CYCLE_TIME_MS, flare_partials, &flare);
+            SimMetrics_RecordModelStep(metrics_model, SimMetrics_Now() - step_start);
+            if (tick + 1 < ticks)
+                SimHashLog_Record(&hash_log, ++cycle_count);
+        }
+        OptimizerWorker_Publish(&optimizer_worker, &separator);
+
+        UA_Variant value;
+
+        UA_Variant_setScalar(&value, &separator.state.h_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+        UA_Server_writeValue(server, UA_NODEID_STRING(1, "h_oil"), value);
+
+        UA_Variant_setScalar(&value, &separator.state.h_water, &UA_TYPES[UA_TYPES_DOUBLE]);
         UA_Server_writeValue(server, UA_NODEID_STRING(1, "h_water"), value);
 
         UA_Variant_setScalar(&value, &separator.state.pressure, &UA_TYPES[UA_TYPES_DOUBLE]);
         UA_Server_writeValue(server, UA_NODEID_STRING(1, "pressure"), value);
 
-#ifdef _WIN32
-        Sleep(DEFAULT_CYCLE_TIME_MS);
-#else
-        usleep(DEFAULT_CYCLE_TIME_MS * 1000);
-#endif
+        writeStateValue(server, "Q_oil_in", &separator.state.Q_oil_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Q_water_in", &separator.state.Q_water_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Q_gas_in", &separator.state.Q_gas_in, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "SlugActive", &separator.disturbance.in_slug, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        writeStateValue(server, "WaterInOil", &separator.settling.water_in_oil, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "OilInWaterPpm", &separator.settling.oil_in_water_ppm, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "WaterEfficiency", &separator.settling.water_efficiency, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "OilEfficiency", &separator.settling.oil_efficiency, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "OilResidenceTime", &separator.settling.oil_residence_time, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "WaterResidenceTime", &separator.settling.water_residence_time, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "temperature", &separator.state.temperature, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "GasOutletTemperature", &separator.energy.gas_outlet_temperature, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "HeatLoss", &separator.energy.heat_loss, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Psv1Open", &separator.relief.psv[0].open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        writeStateValue(server, "Psv2Open", &separator.relief.psv[1].open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        writeStateValue(server, "Psv1Flow", &separator.relief.psv[0].flow, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Psv2Flow", &separator.relief.psv[1].flow, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Psv1RatedCapacity", &separator.relief.psv[0].rated_capacity, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Psv2RatedCapacity", &separator.relief.psv[1].rated_capacity, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "BdvOpen", &separator.relief.bdv_open, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        writeStateValue(server, "BdvFlow", &separator.relief.bdv_flow, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "ReliefRate", &separator.relief.relief_rate, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "RelievedMass", &separator.relief.relieved_mass, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "FlareLoad", &flare.load, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "FlarePeakLoad", &flare.peak_load, &UA_TYPES[UA_TYPES_DOUBLE]);
+        writeStateValue(server, "Events", &separator.integrator.events, &UA_TYPES[UA_TYPES_UINT64]);
+        writeStateValue(server, "SurrogateSteps", &separator.surrogate.steps, &UA_TYPES[UA_TYPES_UINT64]);
+        writeStateValue(server, "SurrogateFallbacks", &separator.surrogate.fallbacks, &UA_TYPES[UA_TYPES_UINT64]);
+        if (twin.enabled)
+            writeTwinValues(server);
+
+        // Hot reload at the cycle boundary
+        if (config_watch.pending) {
+            config_watch.pending = false;
+            ConfigFile *next = active_config == &config_files[0] ? &config_files[1] : &config_files[0];
+            if (ConfigFile_Load(config_path, next)) {
+                Separator_ApplyConfig(&separator, next, active_config);
+                writeConfigValues(server);
+                active_config = next;
+            }
+        }
+        SimHashLog_Record(&hash_log, ++cycle_count);
+
+        SimMetrics_RecordServer(server);
+        SimMetrics_RecordCycle(SimMetrics_Now() - cycle_start, DEFAULT_CYCLE_TIME_MS);
     }
 
+    OptimizerWorker_Stop(&optimizer_worker);
+    SimLoop_Close(&loop);
     UA_Server_run_shutdown(server);
+    SimMetrics_Stop();
     UA_Server_delete(server);
+    ConfigWatch_Close(&config_watch);
+    SimHashLog_Close(&hash_log);
+    SimExecutor_Stop(&executor);
+    if (twin.enabled)
+        Twin_Stop(&twin);
+    ValveOpt_Stop(&optimizer);
+    Surrogate_Free(&surrogate);
     return 0;
 }
@@ -0,0 +1,180 @@
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// ==================== CONFIGURATION FILE + HOT RELOAD ====================
+// Plain "key = value" files, '#' starts a comment. Keys may repeat; entries
+// are kept in file order. ConfigWatch reports when the file was rewritten
+// (in place or by rename, as editors do) so a server can reload it between
+// two simulation cycles.
+
+#define CONFIG_MAX_ENTRIES 256
+#define CONFIG_MAX_KEY 96
+#define CONFIG_MAX_VALUE 256
+
+typedef struct {
+    char key[CONFIG_MAX_KEY];
+    char value[CONFIG_MAX_VALUE];
+} ConfigEntry;
+
+typedef struct {
+    ConfigEntry entries[CONFIG_MAX_ENTRIES];
+    size_t count;
+} ConfigFile;
+
+typedef struct {
+    int fd;
+    int wd;
+    bool pending;       // Set by ConfigWatch_OnReadable, cleared by the caller
+    char dir[512];
+    char name[256];
+} ConfigWatch;
+
+static inline char *Config_Trim(char *s) {
+    while (*s == ' ' || *s == '\t')
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+        *--end = '\0';
+    return s;
+}
+
+static inline bool ConfigFile_Load(const char *path, ConfigFile *cfg) {
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char line[CONFIG_MAX_KEY + CONFIG_MAX_VALUE + 8];
+    int line_no = 0;
+    cfg->count = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+        char *text = Config_Trim(line);
+        if (*text == '\0')
+            continue;
+
+        char *eq = strchr(text, '=');
+        if (!eq) {
+            fprintf(stderr, "%s:%d: expected key = value\n", path, line_no);
+            continue;
+        }
+        *eq = '\0';
+        if (cfg->count >= CONFIG_MAX_ENTRIES) {
+            fprintf(stderr, "%s: more than %d entries, rest ignored\n", path, CONFIG_MAX_ENTRIES);
+            break;
+        }
+
+        ConfigEntry *entry = &cfg->entries[cfg->count++];
+        snprintf(entry->key, sizeof(entry->key), "%s", Config_Trim(text));
+        snprintf(entry->value, sizeof(entry->value), "%s", Config_Trim(eq + 1));
+    }
+    fclose(file);
+    return true;
+}
+
+// Last value for key, or NULL
+static inline const char *ConfigFile_Get(const ConfigFile *cfg, const char *key) {
+    for (size_t i = cfg->count; i-- > 0;) {
+        if (strcmp(cfg->entries[i].key, key) == 0)
+            return cfg->entries[i].value;
+    }
+    return NULL;
+}
+
+// True if key is set in cfg and differs from (or is missing in) previous
+static inline bool ConfigFile_Changed(const ConfigFile *cfg, const ConfigFile *previous, const char *key) {
+    const char *value = ConfigFile_Get(cfg, key);
+    if (!value)
+        return false;
+    const char *old = previous ? ConfigFile_Get(previous, key) : NULL;
+    return !old || strcmp(old, value) != 0;
+}
+
+#ifdef __linux__
+// Watch the directory so that replace-by-rename is seen as well
+static inline bool ConfigWatch_Open(ConfigWatch *watch, const char *path) {
+    char dir_buf[512], name_buf[512];
+    snprintf(dir_buf, sizeof(dir_buf), "%s", path);
+    snprintf(name_buf, sizeof(name_buf), "%s", path);
+    snprintf(watch->dir, sizeof(watch->dir), "%s", dirname(dir_buf));
+    snprintf(watch->name, sizeof(watch->name), "%s", basename(name_buf));
+    watch->pending = false;
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0)
+        return false;
+    watch->wd = inotify_add_watch(watch->fd, watch->dir,
+                                  IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch->wd < 0) {
+        close(watch->fd);
+        watch->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Non-blocking: drains pending events, true if the watched file changed
+static inline bool ConfigWatch_Poll(ConfigWatch *watch) {
+    if (watch->fd < 0)
+        return false;
+
+    bool changed = false;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t len = read(watch->fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (event->len && strcmp(event->name, watch->name) == 0)
+                changed = true;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+// Readiness callback for SimLoop_AddFd (sim_loop.h); context is the watch.
+// The reload itself still happens between cycles, when pending is seen.
+static inline void ConfigWatch_OnReadable(int fd, void *context) {
+    ConfigWatch *watch = context;
+    if (ConfigWatch_Poll(watch))
+        watch->pending = true;
+}
+
+static inline void ConfigWatch_Close(ConfigWatch *watch) {
+    if (watch->fd >= 0)
+        close(watch->fd);
+    watch->fd = -1;
+}
+#else
+// No inotify: the file is read once at startup
+static inline bool ConfigWatch_Open(ConfigWatch *watch, const char *path) {
+    watch->fd = -1;
+    watch->pending = false;
+    return false;
+}
+
+static inline bool ConfigWatch_Poll(ConfigWatch *watch) {
+    return false;
+}
+
+static inline void ConfigWatch_OnReadable(int fd, void *context) {
+}
+
+static inline void ConfigWatch_Close(ConfigWatch *watch) {
+}
+#endif
+
+#endif // SIM_CONFIG_H
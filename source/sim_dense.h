@@ -0,0 +1,131 @@
+#ifndef SIM_DENSE_H
+#define SIM_DENSE_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// ==================== DENSE LINEAR ALGEBRA KERNELS ====================
+// The few BLAS/LAPACK-style kernels the estimators need, with the reference
+// semantics of their namesakes but row-major storage (element (i, j) of a
+// matrix with leading dimension ld is a[i * ld + j]):
+//   SimDense_Gemm            dgemm   C = alpha op(A) op(B) + beta C
+//   SimDense_Cholesky        dpotrf  A = L L^T, lower triangle in place
+//   SimDense_CholeskySolve   dpotrs  A X = B with the factor, B in place
+// No external BLAS: the matrices here are ensemble- or sample-sized
+// (tens to a few thousand rows, a handful of columns), where a blocked
+// loop nest the compiler vectorizes is within reach of a tuned library.
+// The summation order is fixed by the loops, not by the thread count or a
+// library's dispatch, so one binary gives the same bits wherever it runs.
+// Different compilers or flags may not: GCC fuses a * b + c into an FMA
+// when the target has one (-ffp-contract=fast is its default), which
+// changes the last bits. Build with -ffp-contract=off to compare results
+// across builds. The inner loops run along rows of B and C, so keep B
+// untransposed where a choice exists.
+
+#define SIM_DENSE_BLOCK 64
+
+// C (m x n) = alpha op(A) op(B) + beta C, op(A) m x k, op(B) k x n
+static inline void SimDense_Gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, double alpha,
+                                 const double *a, size_t lda, const double *b, size_t ldb, double beta,
+                                 double *c, size_t ldc) {
+    for (size_t i = 0; i < m; i++) {
+        double *row = &c[i * ldc];
+        if (beta == 0.0) {
+            for (size_t j = 0; j < n; j++)
+                row[j] = 0.0;
+        } else if (beta != 1.0) {
+            for (size_t j = 0; j < n; j++)
+                row[j] *= beta;
+        }
+    }
+    if (alpha == 0.0 || k == 0)
+        return;
+
+    for (size_t k0 = 0; k0 < k; k0 += SIM_DENSE_BLOCK) {
+        size_t k1 = k0 + SIM_DENSE_BLOCK < k ? k0 + SIM_DENSE_BLOCK : k;
+        for (size_t i = 0; i < m; i++) {
+            double *row = &c[i * ldc];
+            if (!trans_b) {
+                // Row i of C accumulates rows of B: unit stride, vectorizes
+                for (size_t p = k0; p < k1; p++) {
+                    double aip = alpha * (trans_a ? a[p * lda + i] : a[i * lda + p]);
+                    const double *brow = &b[p * ldb];
+                    for (size_t j = 0; j < n; j++)
+                        row[j] += aip * brow[j];
+                }
+            } else {
+                // Dot products of row i of op(A) with rows of B
+                for (size_t j = 0; j < n; j++) {
+                    const double *brow = &b[j * ldb];
+                    double sum = 0.0;
+                    if (trans_a) {
+                        for (size_t p = k0; p < k1; p++)
+                            sum += a[p * lda + i] * brow[p];
+                    } else {
+                        const double *arow = &a[i * lda];
+                        for (size_t p = k0; p < k1; p++)
+                            sum += arow[p] * brow[p];
+                    }
+                    row[j] += alpha * sum;
+                }
+            }
+        }
+    }
+}
+
+// Lower Cholesky factor of the symmetric positive definite n x n matrix A,
+// in place (the strict upper triangle is left alone). False if A is not
+// positive definite.
+static inline bool SimDense_Cholesky(double *a, size_t n, size_t lda) {
+    for (size_t j = 0; j < n; j++) {
+        double d = a[j * lda + j];
+        for (size_t p = 0; p < j; p++)
+            d -= a[j * lda + p] * a[j * lda + p];
+        if (!(d > 0.0))
+            return false;
+        d = sqrt(d);
+        a[j * lda + j] = d;
+        for (size_t i = j + 1; i < n; i++) {
+            double s = a[i * lda + j];
+            for (size_t p = 0; p < j; p++)
+                s -= a[i * lda + p] * a[j * lda + p];
+            a[i * lda + j] = s / d;
+        }
+    }
+    return true;
+}
+
+// Solve A X = B for the n x nrhs matrix B in place, given the lower
+// Cholesky factor L of A (SimDense_Cholesky)
+static inline void SimDense_CholeskySolve(const double *l, size_t n, size_t ldl, double *b, size_t nrhs,
+                                          size_t ldb) {
+    // L Y = B, forward substitution, row by row of B
+    for (size_t i = 0; i < n; i++) {
+        double *row = &b[i * ldb];
+        for (size_t p = 0; p < i; p++) {
+            double lip = l[i * ldl + p];
+            const double *prow = &b[p * ldb];
+            for (size_t j = 0; j < nrhs; j++)
+                row[j] -= lip * prow[j];
+        }
+        double inv = 1.0 / l[i * ldl + i];
+        for (size_t j = 0; j < nrhs; j++)
+            row[j] *= inv;
+    }
+    // L^T X = Y, back substitution
+    for (size_t i = n; i-- > 0;) {
+        double *row = &b[i * ldb];
+        for (size_t p = i + 1; p < n; p++) {
+            double lpi = l[p * ldl + i];
+            const double *prow = &b[p * ldb];
+            for (size_t j = 0; j < nrhs; j++)
+                row[j] -= lpi * prow[j];
+        }
+        double inv = 1.0 / l[i * ldl + i];
+        for (size_t j = 0; j < nrhs; j++)
+            row[j] *= inv;
+    }
+}
+
+#endif // SIM_DENSE_H
@@ -0,0 +1,166 @@
+#ifndef SIM_EXECUTOR_H
+#define SIM_EXECUTOR_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// ==================== DETERMINISTIC PARALLEL EXECUTOR ====================
+// Runs a job over a fixed list of partitions on a fixed set of threads.
+// Results are bit-identical for any thread count because:
+//   - partitions are cut from the instance count and a fixed partition
+//     size, never from the thread count,
+//   - partition p always runs on thread p % thread_count, and a job may
+//     only use what is derived from p (its range, its random stream),
+//   - anything combining partitions is reduced afterwards by the caller,
+//     in partition order.
+// The calling thread works as thread 0, so one thread needs no workers.
+
+typedef void (*SimExecutorJob)(void *context, size_t partition);
+
+typedef struct {
+    size_t thread_count;
+    pthread_t *threads;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    bool stop;
+
+    // Workers wait here until every thread has started, so a failed start
+    // can still send the ones already running home
+    pthread_mutex_t gate_lock;
+    pthread_cond_t gate;
+    bool launched;
+
+    // Current job, set by SimExecutor_Run before the start barrier
+    SimExecutorJob job;
+    void *context;
+    size_t partition_count;
+} SimExecutor;
+
+typedef struct {
+    SimExecutor *executor;
+    size_t index;
+} SimExecutorWorker;
+
+static inline size_t SimPartition_Count(size_t count, size_t partition_size) {
+    return (count + partition_size - 1) / partition_size;
+}
+
+static inline void SimPartition_Range(size_t count, size_t partition_size, size_t partition,
+                                      size_t *begin, size_t *end) {
+    *begin = partition * partition_size;
+    *end = *begin + partition_size < count ? *begin + partition_size : count;
+}
+
+static inline void SimExecutor_RunShare(SimExecutor *executor, size_t index) {
+    for (size_t p = index; p < executor->partition_count; p += executor->thread_count)
+        executor->job(executor->context, p);
+}
+
+static inline void *SimExecutor_Worker(void *arg) {
+    SimExecutorWorker *worker = arg;
+    SimExecutor *executor = worker->executor;
+    pthread_mutex_lock(&executor->gate_lock);
+    while (!executor->launched)
+        pthread_cond_wait(&executor->gate, &executor->gate_lock);
+    bool abort = executor->stop;
+    pthread_mutex_unlock(&executor->gate_lock);
+
+    while (!abort) {
+        pthread_barrier_wait(&executor->start);
+        if (executor->stop)
+            break;
+        SimExecutor_RunShare(executor, worker->index);
+        pthread_barrier_wait(&executor->done);
+    }
+    free(worker);
+    return NULL;
+}
+
+static inline void SimExecutor_Stop(SimExecutor *executor) {
+    if (executor->thread_count > 1) {
+        executor->stop = true;
+        pthread_barrier_wait(&executor->start);
+        for (size_t i = 1; i < executor->thread_count; i++)
+            pthread_join(executor->threads[i], NULL);
+        pthread_barrier_destroy(&executor->start);
+        pthread_barrier_destroy(&executor->done);
+        pthread_mutex_destroy(&executor->gate_lock);
+        pthread_cond_destroy(&executor->gate);
+    }
+    free(executor->threads);
+    executor->threads = NULL;
+    executor->thread_count = 0;
+}
+
+// Open the gate; with abort set the workers exit without entering the loop
+static inline void SimExecutor_Launch(SimExecutor *executor, bool abort) {
+    pthread_mutex_lock(&executor->gate_lock);
+    executor->stop = abort;
+    executor->launched = true;
+    pthread_cond_broadcast(&executor->gate);
+    pthread_mutex_unlock(&executor->gate_lock);
+}
+
+// On failure the threads already started are joined and the executor is
+// left stopped, so SimExecutor_Stop stays safe to call
+static inline bool SimExecutor_Start(SimExecutor *executor, size_t thread_count) {
+    executor->thread_count = thread_count ? thread_count : 1;
+    executor->threads = calloc(executor->thread_count, sizeof(pthread_t));
+    executor->stop = false;
+    if (!executor->threads)
+        return false;
+    if (executor->thread_count == 1)
+        return true;
+
+    pthread_barrier_init(&executor->start, NULL, (unsigned)executor->thread_count);
+    pthread_barrier_init(&executor->done, NULL, (unsigned)executor->thread_count);
+    pthread_mutex_init(&executor->gate_lock, NULL);
+    pthread_cond_init(&executor->gate, NULL);
+    executor->launched = false;
+    for (size_t i = 1; i < executor->thread_count; i++) {
+        SimExecutorWorker *worker = malloc(sizeof(SimExecutorWorker));
+        if (worker) {
+            worker->executor = executor;
+            worker->index = i;
+        }
+        if (!worker || pthread_create(&executor->threads[i], NULL, SimExecutor_Worker, worker) != 0) {
+            fprintf(stderr, "Cannot start executor thread %zu\n", i);
+            free(worker);
+            SimExecutor_Launch(executor, true);
+            for (size_t j = 1; j < i; j++)
+                pthread_join(executor->threads[j], NULL);
+            pthread_barrier_destroy(&executor->start);
+            pthread_barrier_destroy(&executor->done);
+            pthread_mutex_destroy(&executor->gate_lock);
+            pthread_cond_destroy(&executor->gate);
+            free(executor->threads);
+            executor->threads = NULL;
+            executor->thread_count = 0;
+            return false;
+        }
+    }
+    SimExecutor_Launch(executor, false);
+    return true;
+}
+
+// Run job(context, p) for every p in [0, partition_count); returns when
+// all partitions are done
+static inline void SimExecutor_Run(SimExecutor *executor, SimExecutorJob job, void *context,
+                                   size_t partition_count) {
+    executor->job = job;
+    executor->context = context;
+    executor->partition_count = partition_count;
+    if (executor->thread_count <= 1 || partition_count <= 1) {
+        for (size_t p = 0; p < partition_count; p++)
+            job(context, p);
+        return;
+    }
+    pthread_barrier_wait(&executor->start);
+    SimExecutor_RunShare(executor, 0);
+    pthread_barrier_wait(&executor->done);
+}
+
+#endif // SIM_EXECUTOR_H
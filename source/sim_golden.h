@@ -0,0 +1,187 @@
+#ifndef SIM_GOLDEN_H
+#define SIM_GOLDEN_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ==================== GOLDEN TRAJECTORIES ====================
+// Headless regression check of a model's *_Update. Every server has a
+// --golden mode that runs its canonical scenarios without OPC UA:
+//   <server> --golden record <trace>   write the sampled signals
+//   <server> --golden check <trace>    compare with a recorded trace
+// Record the trace with the reference build before touching a model, then
+// check every build of the change against it. Exit status 0 means every
+// sample is within its tolerance.
+//
+// Trace file: text, one sample per line, "<scenario> <step> <signal>
+// <value>" with the value printed round-trip exact (%.17g). The tolerance
+// of a signal is given by the scenario, not stored: a sample passes when
+// |value - golden| <= abs_tol + rel_tol * |golden|. Use 0 for discrete
+// signals (states, flags, counters). Give a continuous signal an absolute
+// tolerance of its full-scale value times the noise fraction below, and a
+// relative one only when it spans decades (pressure, ppm). Reordered
+// floating-point arithmetic then passes and changed behavior fails.
+// A sample that is missing, extra or renamed fails the whole check.
+
+#define SIM_GOLDEN_NAME_LENGTH 64
+#define SIM_GOLDEN_MAX_REPORTED 5
+
+// Rounding noise as a fraction of a signal's full scale. An algebraic
+// signal is computed afresh each step from inputs and time; an integrated
+// one is, or depends on, state summed over thousands of steps, where
+// rounding accumulates. Cross-build error measured at -O0 against -O3
+// with FMA contraction: about 1e-15 of full scale for algebraic signals
+// and up to 2e-12 for integrated ones, so both leave a margin of 100x or
+// more for compilers and libm.
+#define SIM_GOLDEN_ALGEBRAIC 1e-10
+#define SIM_GOLDEN_INTEGRATED 1e-8
+
+typedef struct {
+    FILE *file;
+    bool record;
+    char scenario[SIM_GOLDEN_NAME_LENGTH];
+    size_t samples;
+    size_t failures;
+    bool misaligned;        // Trace and scenarios no longer line up
+
+    // Current scenario
+    size_t scenario_samples;
+    size_t scenario_failures;
+    double worst;           // Largest passing error as a fraction of its tolerance
+    char worst_signal[SIM_GOLDEN_NAME_LENGTH];
+    char failed_signal[SIM_GOLDEN_NAME_LENGTH];
+    uint32_t failed_step;   // First sample outside its tolerance
+} SimGolden;
+
+typedef void (*SimGoldenScenarios)(SimGolden *golden);
+
+static inline bool SimGolden_Open(SimGolden *golden, bool record, const char *path) {
+    memset(golden, 0, sizeof(*golden));
+    golden->record = record;
+    golden->file = fopen(path, record ? "w" : "r");
+    if (!golden->file)
+        fprintf(stderr, "Cannot %s golden trace %s\n", record ? "create" : "read", path);
+    return golden->file != NULL;
+}
+
+static inline void SimGolden_Begin(SimGolden *golden, const char *scenario) {
+    snprintf(golden->scenario, sizeof(golden->scenario), "%s", scenario);
+    golden->scenario_samples = 0;
+    golden->scenario_failures = 0;
+    golden->worst = 0.0;
+    golden->worst_signal[0] = '\0';
+}
+
+// Record or check one signal of the current scenario at step
+static inline void SimGolden_Signal(SimGolden *golden, uint32_t step, const char *signal, double value,
+                                    double abs_tol, double rel_tol) {
+    golden->samples++;
+    golden->scenario_samples++;
+    if (golden->record) {
+        fprintf(golden->file, "%s %u %s %.17g\n", golden->scenario, step, signal, value);
+        return;
+    }
+    if (golden->misaligned)
+        return;
+
+    char line[256], scenario[SIM_GOLDEN_NAME_LENGTH], name[SIM_GOLDEN_NAME_LENGTH], number[64];
+    unsigned trace_step;
+    if (!fgets(line, sizeof(line), golden->file) ||
+        sscanf(line, "%63s %u %63s %63s", scenario, &trace_step, name, number) != 4 ||
+        strcmp(scenario, golden->scenario) != 0 || trace_step != step || strcmp(name, signal) != 0) {
+        printf("  %s step %u %s: not in the trace (scenarios changed, record a new trace)\n",
+               golden->scenario, step, signal);
+        golden->misaligned = true;
+        snprintf(golden->failed_signal, sizeof(golden->failed_signal), "%s", signal);
+        golden->failed_step = step;
+        golden->failures++;
+        golden->scenario_failures++;
+        return;
+    }
+
+    double expected = strtod(number, NULL);
+    double error = fabs(value - expected);
+    double tolerance = abs_tol + rel_tol * fabs(expected);
+    if (error <= tolerance || value == expected || (isnan(value) && isnan(expected))) {
+        double fraction = tolerance > 0.0 && error > 0.0 ? error / tolerance : 0.0;
+        if (fraction > golden->worst) {
+            golden->worst = fraction;
+            snprintf(golden->worst_signal, sizeof(golden->worst_signal), "%s", signal);
+        }
+        return;
+    }
+
+    if (golden->scenario_failures == 0) {
+        snprintf(golden->failed_signal, sizeof(golden->failed_signal), "%s", signal);
+        golden->failed_step = step;
+    }
+    if (golden->scenario_failures < SIM_GOLDEN_MAX_REPORTED)
+        printf("  %s step %u %s: %.17g, golden %.17g (tolerance %g)\n", golden->scenario, step, signal,
+               value, expected, tolerance);
+    golden->failures++;
+    golden->scenario_failures++;
+}
+
+static inline void SimGolden_End(SimGolden *golden) {
+    if (golden->record) {
+        printf("%-28s %7zu samples recorded\n", golden->scenario, golden->scenario_samples);
+    } else if (golden->scenario_failures == 0) {
+        printf("%-28s %7zu samples ok   worst %.2f of tolerance (%s)\n", golden->scenario,
+               golden->scenario_samples, golden->worst, golden->worst_signal[0] ? golden->worst_signal : "-");
+    } else {
+        printf("%-28s %7zu samples FAIL %zu outside tolerance, first at step %u (%s)\n", golden->scenario,
+               golden->scenario_samples, golden->scenario_failures, golden->failed_step, golden->failed_signal);
+    }
+}
+
+// Close the trace; true if recording succeeded or every sample matched
+// and the trace has nothing left over
+static inline bool SimGolden_Close(SimGolden *golden) {
+    bool ok = golden->failures == 0;
+    if (!golden->record && !golden->misaligned) {
+        char line[256];
+        if (fgets(line, sizeof(line), golden->file)) {
+            printf("  trace has samples past the last scenario (scenarios changed, record a new trace)\n");
+            ok = false;
+        }
+    }
+    if (golden->record && ferror(golden->file))
+        ok = false;
+    fclose(golden->file);
+    golden->file = NULL;
+    return ok;
+}
+
+// --golden record|check <trace>: argv[0] is "--golden"
+static inline int SimGolden_Main(int argc, char **argv, SimGoldenScenarios scenarios) {
+    bool record = argc == 3 && strcmp(argv[1], "record") == 0;
+    if (argc != 3 || (!record && strcmp(argv[1], "check") != 0)) {
+        fprintf(stderr, "Usage: --golden record|check <trace>\n");
+        return EXIT_FAILURE;
+    }
+
+    SimGolden golden;
+    if (!SimGolden_Open(&golden, record, argv[2]))
+        return EXIT_FAILURE;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    scenarios(&golden);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    size_t samples = golden.samples, failures = golden.failures;
+    bool ok = SimGolden_Close(&golden);
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (record)
+        printf("Recorded %zu samples to %s in %.2f s\n", samples, argv[2], seconds);
+    else
+        printf("%s: %zu samples, %zu outside tolerance, %.2f s\n", ok ? "PASS" : "FAIL", samples, failures,
+               seconds);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif // SIM_GOLDEN_H
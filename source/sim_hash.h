@@ -0,0 +1,270 @@
+#ifndef SIM_HASH_H
+#define SIM_HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ==================== PER-CYCLE STATE HASH LOG ====================
+// Optional record of a hash of all model state after every cycle, to find
+// where two runs that should be identical (reference vs optimized kernel,
+// 1 vs N threads, 1 vs N shards) part ways. Enabled from the environment:
+//   SIM_HASH_LOG=<path>    append-only binary log, off when unset
+//   SIM_HASH_BLOCK=<n>     elements per block hash (server default)
+//
+// A server registers its state as named segments: an array of count
+// elements of element_size bytes, element 0 being plant-wide element
+// `first`. Each cycle every segment is hashed with XXH64 in blocks of
+// `block` elements, so a divergence can be traced to a block (with
+// SIM_HASH_BLOCK=1, to one instance) without storing the state itself.
+// Padding bytes are hashed too: keep state structs zero-initialised.
+//
+// File: "SIMHASH1", then records of {uint32 type, uint32 size, payload}:
+//   LAYOUT  uint32 block, uint32 segment count, SimHashLayoutEntry[count]
+//           (written before the first cycle and after every change)
+//   CYCLE   uint64 cycle, uint64 realtime ns, uint64 hash of the block
+//           hashes, then the block hashes of every segment in order
+// The wall-clock time lines a cycle up with other recordings of the run.
+// Native byte order. Compare two logs with sim_hash_diff.
+
+#define SIM_HASH_MAGIC "SIMHASH1"
+#define SIM_HASH_MAX_SEGMENTS 32
+#define SIM_HASH_NAME_LENGTH 48
+#define SIM_HASH_DEFAULT_BLOCK 256
+#define SIM_HASH_RECORD_LAYOUT 1u
+#define SIM_HASH_RECORD_CYCLE 2u
+
+#define SIM_XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define SIM_XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define SIM_XXH_PRIME3 0x165667B19E3779F9ULL
+#define SIM_XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define SIM_XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+typedef struct {
+    uint32_t type;
+    uint32_t size;      // Payload bytes
+} SimHashRecord;
+
+typedef struct {
+    char name[SIM_HASH_NAME_LENGTH];
+    uint64_t element_size;
+    uint64_t count;
+    uint64_t first;     // Plant-wide number of element 0
+} SimHashLayoutEntry;
+
+typedef struct {
+    uint64_t cycle;
+    uint64_t time_ns;
+    uint64_t combined;
+} SimHashCycle;
+
+typedef struct {
+    FILE *file;
+    uint32_t block;
+    SimHashLayoutEntry layout[SIM_HASH_MAX_SEGMENTS];
+    const void *data[SIM_HASH_MAX_SEGMENTS];
+    size_t segment_count;
+    bool layout_changed;
+    uint64_t *hashes;
+    size_t hash_capacity;
+} SimHashLog;
+
+static inline uint64_t SimXXH_Rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t SimXXH_Read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t SimXXH_Round(uint64_t acc, uint64_t input) {
+    acc += input * SIM_XXH_PRIME2;
+    return SimXXH_Rotl(acc, 31) * SIM_XXH_PRIME1;
+}
+
+static inline uint64_t SimXXH_Merge(uint64_t acc, uint64_t v) {
+    acc ^= SimXXH_Round(0, v);
+    return acc * SIM_XXH_PRIME1 + SIM_XXH_PRIME4;
+}
+
+// XXH64 (little-endian hosts give the reference values)
+static inline uint64_t SimHash_XXH64(const void *input, size_t length, uint64_t seed) {
+    const uint8_t *p = input;
+    const uint8_t *end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + SIM_XXH_PRIME1 + SIM_XXH_PRIME2;
+        uint64_t v2 = seed + SIM_XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - SIM_XXH_PRIME1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = SimXXH_Round(v1, SimXXH_Read64(p));
+            v2 = SimXXH_Round(v2, SimXXH_Read64(p + 8));
+            v3 = SimXXH_Round(v3, SimXXH_Read64(p + 16));
+            v4 = SimXXH_Round(v4, SimXXH_Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = SimXXH_Rotl(v1, 1) + SimXXH_Rotl(v2, 7) + SimXXH_Rotl(v3, 12) + SimXXH_Rotl(v4, 18);
+        h = SimXXH_Merge(h, v1);
+        h = SimXXH_Merge(h, v2);
+        h = SimXXH_Merge(h, v3);
+        h = SimXXH_Merge(h, v4);
+    } else {
+        h = seed + SIM_XXH_PRIME5;
+    }
+    h += (uint64_t)length;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= SimXXH_Round(0, SimXXH_Read64(p));
+        h = SimXXH_Rotl(h, 27) * SIM_XXH_PRIME1 + SIM_XXH_PRIME4;
+    }
+    if (p + 4 <= end) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        h ^= (uint64_t)v * SIM_XXH_PRIME1;
+        h = SimXXH_Rotl(h, 23) * SIM_XXH_PRIME2 + SIM_XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * SIM_XXH_PRIME5;
+        h = SimXXH_Rotl(h, 11) * SIM_XXH_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= SIM_XXH_PRIME2;
+    h ^= h >> 29;
+    h *= SIM_XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t SimHash_BlockCount(const SimHashLayoutEntry *entry, uint32_t block) {
+    return (entry->count + block - 1) / block;
+}
+
+static inline bool SimHashLog_Open(SimHashLog *log, const char *path, uint32_t block) {
+    memset(log, 0, sizeof(*log));
+    log->block = block ? block : 1;
+    log->file = fopen(path, "wb");
+    if (!log->file) {
+        fprintf(stderr, "Cannot create hash log %s\n", path);
+        return false;
+    }
+    fwrite(SIM_HASH_MAGIC, 1, 8, log->file);
+    log->layout_changed = true;
+    return true;
+}
+
+// Open $SIM_HASH_LOG with suffix appended (e.g. ".2" for shard 2). Returns
+// false only when the log was asked for and cannot be created.
+static inline bool SimHashLog_OpenFromEnv(SimHashLog *log, const char *suffix, uint32_t default_block) {
+    const char *path_env = getenv("SIM_HASH_LOG");
+    const char *block_env = getenv("SIM_HASH_BLOCK");
+    memset(log, 0, sizeof(*log));
+    if (!path_env || !*path_env)
+        return true;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s%s", path_env, suffix ? suffix : "");
+    uint32_t block = block_env && *block_env ? (uint32_t)strtoul(block_env, NULL, 10) : default_block;
+    if (!SimHashLog_Open(log, path, block))
+        return false;
+    printf("State hashes logged to %s (blocks of %u)\n", path, log->block);
+    return true;
+}
+
+static inline void SimHashLog_ClearSegments(SimHashLog *log) {
+    log->segment_count = 0;
+    log->layout_changed = true;
+}
+
+// Register or update the segment called name
+static inline bool SimHashLog_SetSegment(SimHashLog *log, const char *name, const void *data,
+                                         size_t element_size, size_t count, uint64_t first) {
+    size_t s = 0;
+    while (s < log->segment_count && strncmp(log->layout[s].name, name, SIM_HASH_NAME_LENGTH) != 0)
+        s++;
+    if (s == SIM_HASH_MAX_SEGMENTS)
+        return false;
+
+    SimHashLayoutEntry *entry = &log->layout[s];
+    if (s == log->segment_count || entry->element_size != element_size || entry->count != count ||
+        entry->first != first)
+        log->layout_changed = true;
+    if (s == log->segment_count) {
+        memset(entry, 0, sizeof(*entry));
+        snprintf(entry->name, sizeof(entry->name), "%s", name);
+        log->segment_count++;
+    }
+    entry->element_size = element_size;
+    entry->count = count;
+    entry->first = first;
+    log->data[s] = data;
+    return true;
+}
+
+static inline void SimHashLog_WriteRecord(SimHashLog *log, uint32_t type, uint32_t size) {
+    SimHashRecord record = {type, size};
+    fwrite(&record, sizeof(record), 1, log->file);
+}
+
+// Hash every segment and append a cycle record. No-op when the log is off.
+static inline void SimHashLog_Record(SimHashLog *log, uint64_t cycle) {
+    if (!log->file)
+        return;
+
+    size_t total = 0;
+    for (size_t s = 0; s < log->segment_count; s++)
+        total += SimHash_BlockCount(&log->layout[s], log->block);
+    if (total > log->hash_capacity) {
+        uint64_t *hashes = realloc(log->hashes, total * sizeof(uint64_t));
+        if (!hashes)
+            return;
+        log->hashes = hashes;
+        log->hash_capacity = total;
+    }
+
+    if (log->layout_changed) {
+        uint32_t header[2] = {log->block, (uint32_t)log->segment_count};
+        SimHashLog_WriteRecord(log, SIM_HASH_RECORD_LAYOUT,
+                               (uint32_t)(sizeof(header) + log->segment_count * sizeof(SimHashLayoutEntry)));
+        fwrite(header, sizeof(header), 1, log->file);
+        fwrite(log->layout, sizeof(SimHashLayoutEntry), log->segment_count, log->file);
+        log->layout_changed = false;
+    }
+
+    size_t used = 0;
+    for (size_t s = 0; s < log->segment_count; s++) {
+        const SimHashLayoutEntry *entry = &log->layout[s];
+        const uint8_t *data = log->data[s];
+        for (uint64_t begin = 0; begin < entry->count; begin += log->block) {
+            uint64_t n = entry->count - begin < log->block ? entry->count - begin : log->block;
+            log->hashes[used++] = SimHash_XXH64(data + begin * entry->element_size,
+                                                (size_t)(n * entry->element_size), 0);
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    SimHashCycle header = {cycle, (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec,
+                           SimHash_XXH64(log->hashes, used * sizeof(uint64_t), 0)};
+    SimHashLog_WriteRecord(log, SIM_HASH_RECORD_CYCLE, (uint32_t)(sizeof(header) + used * sizeof(uint64_t)));
+    fwrite(&header, sizeof(header), 1, log->file);
+    fwrite(log->hashes, sizeof(uint64_t), used, log->file);
+}
+
+static inline void SimHashLog_Close(SimHashLog *log) {
+    if (log->file)
+        fclose(log->file);
+    free(log->hashes);
+    memset(log, 0, sizeof(*log));
+}
+
+#endif // SIM_HASH_H
@@ -0,0 +1,336 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_hash.h"
+
+// ==================== STATE HASH LOG DIFF ====================
+// Usage: sim_hash_diff [--all] <run A> <run B>
+//
+// Compares two state hash logs (sim_hash.h) and reports the first cycle
+// whose state differs and the segments and instance blocks that differ in
+// it. A run is one log file, a comma-separated list of logs, or a path
+// whose shards exist as <path>.0, <path>.1, ... (model host --shard). The
+// logs of a run are merged by plant-wide instance number, so a run split
+// over shards compares against a single-process run as long as both use
+// the same block size. Cycles present in only one run are skipped.
+// --all keeps going and lists every divergent cycle instead of stopping.
+//
+// Exit status: 0 identical, 1 divergent, 2 unreadable or incomparable.
+//
+// Build: gcc -O2 -o sim_hash_diff source/sim_hash_diff.c
+
+#define MAX_RUN_LOGS 64
+#define MAX_PATH_LENGTH 512
+#define MAX_REPORTED_BLOCKS 10
+
+// One log file, positioned after its last cycle record
+typedef struct {
+    FILE *file;
+    char path[MAX_PATH_LENGTH];
+    uint32_t block;
+    SimHashLayoutEntry layout[SIM_HASH_MAX_SEGMENTS];
+    size_t segment_count;
+    SimHashCycle cycle;
+    uint64_t *hashes;
+    size_t hash_count;
+    size_t hash_capacity;
+} HashLogReader;
+
+// One block of one segment, keyed by segment name and plant-wide range
+typedef struct {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t hash;
+} BlockHash;
+
+typedef struct {
+    HashLogReader logs[MAX_RUN_LOGS];
+    size_t log_count;
+    BlockHash *blocks;
+    size_t block_count;
+    size_t block_capacity;
+} HashRun;
+
+static bool Reader_Open(HashLogReader *reader, const char *path) {
+    char magic[8];
+    memset(reader, 0, sizeof(*reader));
+    snprintf(reader->path, sizeof(reader->path), "%s", path);
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+        return false;
+    if (fread(magic, 1, sizeof(magic), reader->file) != sizeof(magic) || memcmp(magic, SIM_HASH_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a state hash log\n", path);
+        fclose(reader->file);
+        reader->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Read up to and including the next cycle record. False at the end of the
+// log; a truncated last record (run killed mid-write) also ends it.
+static bool Reader_Next(HashLogReader *reader) {
+    SimHashRecord record;
+    while (fread(&record, sizeof(record), 1, reader->file) == 1) {
+        if (record.type == SIM_HASH_RECORD_LAYOUT) {
+            uint32_t header[2];
+            if (fread(header, sizeof(header), 1, reader->file) != 1 || header[1] > SIM_HASH_MAX_SEGMENTS ||
+                fread(reader->layout, sizeof(SimHashLayoutEntry), header[1], reader->file) != header[1])
+                return false;
+            reader->block = header[0] ? header[0] : 1;
+            reader->segment_count = header[1];
+            for (size_t s = 0; s < reader->segment_count; s++)
+                reader->layout[s].name[SIM_HASH_NAME_LENGTH - 1] = '\0';
+        } else if (record.type == SIM_HASH_RECORD_CYCLE && record.size >= sizeof(SimHashCycle)) {
+            size_t count = (record.size - sizeof(SimHashCycle)) / sizeof(uint64_t);
+            if (count > reader->hash_capacity) {
+                uint64_t *hashes = realloc(reader->hashes, count * sizeof(uint64_t));
+                if (!hashes)
+                    return false;
+                reader->hashes = hashes;
+                reader->hash_capacity = count;
+            }
+            if (fread(&reader->cycle, sizeof(SimHashCycle), 1, reader->file) != 1 ||
+                fread(reader->hashes, sizeof(uint64_t), count, reader->file) != count)
+                return false;
+            reader->hash_count = count;
+            return true;
+        } else if (fseek(reader->file, record.size, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Open "a.log", "a.0,a.1" or the shard files of "a" (a.0, a.1, ...)
+static bool Run_Open(HashRun *run, const char *spec) {
+    char list[4096];
+    memset(run, 0, sizeof(*run));
+    snprintf(list, sizeof(list), "%s", spec);
+
+    if (!strchr(list, ',')) {
+        if (Reader_Open(&run->logs[0], list)) {
+            run->log_count = 1;
+            return true;
+        }
+        while (run->log_count < MAX_RUN_LOGS) {
+            char path[sizeof(list) + 24];
+            snprintf(path, sizeof(path), "%s.%zu", list, run->log_count);
+            if (!Reader_Open(&run->logs[run->log_count], path))
+                break;
+            run->log_count++;
+        }
+    } else {
+        for (char *path = strtok(list, ","); path && run->log_count < MAX_RUN_LOGS; path = strtok(NULL, ",")) {
+            if (!Reader_Open(&run->logs[run->log_count], path)) {
+                fprintf(stderr, "Cannot read %s\n", path);
+                return false;
+            }
+            run->log_count++;
+        }
+    }
+    if (run->log_count == 0)
+        fprintf(stderr, "Cannot read %s (nor %s.0)\n", spec, spec);
+    return run->log_count > 0;
+}
+
+static void Run_Close(HashRun *run) {
+    for (size_t i = 0; i < run->log_count; i++) {
+        fclose(run->logs[i].file);
+        free(run->logs[i].hashes);
+    }
+    free(run->blocks);
+}
+
+// Advance every log of the run to its next cycle, then the ones behind
+// until all logs are at the same cycle. False at the end of any log.
+static bool Run_Next(HashRun *run) {
+    uint64_t cycle = 0;
+    for (size_t i = 0; i < run->log_count; i++) {
+        if (!Reader_Next(&run->logs[i]))
+            return false;
+        if (run->logs[i].cycle.cycle > cycle)
+            cycle = run->logs[i].cycle.cycle;
+    }
+    for (size_t i = 0; i < run->log_count; i++) {
+        while (run->logs[i].cycle.cycle < cycle)
+            if (!Reader_Next(&run->logs[i]))
+                return false;
+        if (run->logs[i].cycle.cycle > cycle)
+            return Run_Next(run);
+    }
+    return true;
+}
+
+static uint64_t Run_Cycle(const HashRun *run) {
+    return run->logs[0].cycle.cycle;
+}
+
+static int compareBlocks(const void *a, const void *b) {
+    const BlockHash *x = a, *y = b;
+    int order = strcmp(x->name, y->name);
+    if (order != 0)
+        return order;
+    return x->begin < y->begin ? -1 : x->begin > y->begin;
+}
+
+// Flatten the current cycle of all logs into blocks sorted by segment
+// name and plant-wide range
+static bool Run_Blocks(HashRun *run) {
+    size_t total = 0;
+    for (size_t i = 0; i < run->log_count; i++)
+        total += run->logs[i].hash_count;
+    if (total > run->block_capacity) {
+        BlockHash *blocks = realloc(run->blocks, total * sizeof(BlockHash));
+        if (!blocks)
+            return false;
+        run->blocks = blocks;
+        run->block_capacity = total;
+    }
+
+    run->block_count = 0;
+    for (size_t i = 0; i < run->log_count; i++) {
+        const HashLogReader *reader = &run->logs[i];
+        size_t h = 0;
+        for (size_t s = 0; s < reader->segment_count; s++) {
+            const SimHashLayoutEntry *entry = &reader->layout[s];
+            for (uint64_t begin = 0; begin < entry->count && h < reader->hash_count; begin += reader->block) {
+                BlockHash *block = &run->blocks[run->block_count++];
+                block->name = entry->name;
+                block->begin = entry->first + begin;
+                block->end = entry->first + (begin + reader->block < entry->count ? begin + reader->block : entry->count);
+                block->hash = reader->hashes[h++];
+            }
+        }
+        if (h != reader->hash_count) {
+            fprintf(stderr, "%s: cycle %llu does not match its layout\n", reader->path,
+                    (unsigned long long)reader->cycle.cycle);
+            return false;
+        }
+    }
+    qsort(run->blocks, run->block_count, sizeof(BlockHash), compareBlocks);
+    return true;
+}
+
+static void printBlock(const char *prefix, const BlockHash *block) {
+    if (block->end - block->begin == 1)
+        printf("%s%s element %llu\n", prefix, block->name, (unsigned long long)block->begin);
+    else
+        printf("%s%s elements %llu..%llu\n", prefix, block->name, (unsigned long long)block->begin,
+               (unsigned long long)block->end - 1);
+}
+
+// Compare the current cycle of both runs; returns the number of differing
+// blocks, or -1 when the layouts cannot be compared
+static long compareCycle(HashRun *a, HashRun *b, bool print) {
+    // Fast path: one log per run and the same layout gives the same combined hash
+    if (a->log_count == 1 && b->log_count == 1 &&
+        a->logs[0].cycle.combined == b->logs[0].cycle.combined)
+        return 0;
+
+    if (!Run_Blocks(a) || !Run_Blocks(b))
+        return -1;
+    if (a->block_count != b->block_count) {
+        fprintf(stderr, "Cycle %llu: %zu blocks against %zu, the runs hold different state or block sizes\n",
+                (unsigned long long)Run_Cycle(a), a->block_count, b->block_count);
+        return -1;
+    }
+
+    long differing = 0;
+    for (size_t i = 0; i < a->block_count; i++) {
+        const BlockHash *x = &a->blocks[i], *y = &b->blocks[i];
+        if (strcmp(x->name, y->name) != 0 || x->begin != y->begin || x->end != y->end) {
+            fprintf(stderr, "Cycle %llu: layouts differ at %s %llu against %s %llu\n",
+                    (unsigned long long)Run_Cycle(a), x->name, (unsigned long long)x->begin, y->name,
+                    (unsigned long long)y->begin);
+            return -1;
+        }
+        if (x->hash == y->hash)
+            continue;
+        if (print && differing < MAX_REPORTED_BLOCKS)
+            printBlock("  ", x);
+        differing++;
+    }
+    if (print && differing > MAX_REPORTED_BLOCKS)
+        printf("  ... %ld blocks differ\n", differing);
+    return differing;
+}
+
+int main(int argc, char **argv) {
+    bool all = false;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--all") == 0) {
+        all = true;
+        arg++;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "Usage: %s [--all] <run A> <run B>\n"
+                        "A run is a hash log, a comma-separated list of shard logs, or <path> for <path>.0, <path>.1, ...\n",
+                argv[0]);
+        return 2;
+    }
+
+    static HashRun a, b;
+    if (!Run_Open(&a, argv[arg]) || !Run_Open(&b, argv[arg + 1]))
+        return 2;
+
+    uint64_t compared = 0, divergent = 0, first_divergent = 0, identical_before = 0;
+    uint32_t block = a.logs[0].block;
+    int status = 0;
+    bool more_a = Run_Next(&a), more_b = Run_Next(&b);
+    while (more_a && more_b) {
+        if (Run_Cycle(&a) < Run_Cycle(&b)) {
+            more_a = Run_Next(&a);
+            continue;
+        }
+        if (Run_Cycle(&b) < Run_Cycle(&a)) {
+            more_b = Run_Next(&b);
+            continue;
+        }
+
+        bool print = all || divergent == 0;
+        long differing = compareCycle(&a, &b, false);
+        if (differing < 0) {
+            status = 2;
+            break;
+        }
+        compared++;
+        if (differing > 0) {
+            if (print) {
+                printf("Cycle %llu differs in %ld block%s:\n", (unsigned long long)Run_Cycle(&a), differing,
+                       differing == 1 ? "" : "s");
+                compareCycle(&a, &b, true);
+            }
+            if (divergent++ == 0) {
+                first_divergent = Run_Cycle(&a);
+                identical_before = compared - 1;
+            }
+            block = a.logs[0].block;
+            status = 1;
+            if (!all)
+                break;
+        }
+        more_a = Run_Next(&a);
+        more_b = Run_Next(&b);
+    }
+
+    if (status == 0) {
+        printf("Identical over %llu common cycles\n", (unsigned long long)compared);
+    } else if (status == 1) {
+        printf("First divergent cycle: %llu (%llu identical cycles before it)\n",
+               (unsigned long long)first_divergent,
+               (unsigned long long)identical_before);
+        if (all)
+            printf("%llu of %llu common cycles differ\n", (unsigned long long)divergent,
+                   (unsigned long long)compared);
+        if (block > 1)
+            printf("Rerun both with SIM_HASH_BLOCK=1 to narrow the blocks down to single instances\n");
+    }
+    Run_Close(&a);
+    Run_Close(&b);
+    return status;
+}
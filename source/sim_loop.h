@@ -0,0 +1,200 @@
+#ifndef SIM_LOOP_H
+#define SIM_LOOP_H
+
+#include <open62541/server.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+// ==================== READINESS EVENT LOOP ====================
+// One epoll loop drives the OPC UA server, the simulation cycle and any
+// extra file descriptors (config watches, the metrics socket, ...):
+//   - a timerfd produces the cycle tick, so cycles do not drift with the
+//     time spent in the server or the model,
+//   - an eventfd lets other threads and signal handlers wake the loop,
+//   - registered fds get a callback when readable.
+//
+// open62541 keeps its sockets private (the public API has no way to hand
+// them to another epoll set or to add our fds to its event loop), so the
+// server is serviced with a non-blocking UA_Server_run_iterate every time
+// the loop wakes, and the epoll timeout is the server's own next deadline
+// capped at SIM_LOOP_NETWORK_POLL_MS. This is a polling cap, not a
+// readiness wake-up: a request that arrives between ticks waits up to
+// SIM_LOOP_NETWORK_POLL_MS before the server sees it, and an idle server
+// still wakes at that rate.
+//
+//   SimLoop loop;
+//   SimLoop_Open(&loop, server, 100);
+//   while (running) {
+//       if (SimLoop_WaitTick(&loop) == 0)
+//           continue;           // Woken up, not a tick
+//       ... one simulation cycle ...
+//   }
+//   SimLoop_Close(&loop);
+
+#define SIM_LOOP_MAX_SOURCES 16
+#define SIM_LOOP_MAX_EVENTS 16
+#define SIM_LOOP_NETWORK_POLL_MS 10   // Polling cap on OPC UA request latency
+
+typedef void (*SimLoopHandler)(int fd, void *context);
+
+typedef struct {
+    int fd;
+    SimLoopHandler handler;
+    void *context;
+} SimLoopSource;
+
+typedef struct {
+    UA_Server *server;
+    int epoll_fd;
+    int timer_fd;
+    int wake_fd;
+    uint32_t cycle_time_ms;
+    SimLoopSource sources[SIM_LOOP_MAX_SOURCES];
+    size_t source_count;
+    uint64_t missed_ticks;      // Ticks that expired while a cycle was running
+} SimLoop;
+
+// epoll user data for the two built-in descriptors; sources use their index
+#define SIM_LOOP_TIMER_TAG UINT32_MAX
+#define SIM_LOOP_WAKE_TAG (UINT32_MAX - 1)
+
+#ifdef __linux__
+static inline bool SimLoop_Watch(SimLoop *loop, int fd, uint32_t tag) {
+    struct epoll_event event = {.events = EPOLLIN, .data.u32 = tag};
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+static inline void SimLoop_Close(SimLoop *loop) {
+    int *fds[] = {&loop->timer_fd, &loop->wake_fd, &loop->epoll_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0)
+            close(*fds[i]);
+        *fds[i] = -1;
+    }
+    loop->source_count = 0;
+}
+
+static inline bool SimLoop_Open(SimLoop *loop, UA_Server *server, uint32_t cycle_time_ms) {
+    loop->server = server;
+    loop->cycle_time_ms = cycle_time_ms;
+    loop->source_count = 0;
+    loop->missed_ticks = 0;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct itimerspec period = {
+        .it_interval = {.tv_sec = cycle_time_ms / 1000, .tv_nsec = (long)(cycle_time_ms % 1000) * 1000000L},
+    };
+    period.it_value = period.it_interval;
+    if (loop->epoll_fd < 0 || loop->timer_fd < 0 || loop->wake_fd < 0 ||
+        timerfd_settime(loop->timer_fd, 0, &period, NULL) < 0 ||
+        !SimLoop_Watch(loop, loop->timer_fd, SIM_LOOP_TIMER_TAG) ||
+        !SimLoop_Watch(loop, loop->wake_fd, SIM_LOOP_WAKE_TAG)) {
+        perror("event loop");
+        SimLoop_Close(loop);
+        return false;
+    }
+    return true;
+}
+
+// Call handler(fd, context) from the loop thread whenever fd is readable
+static inline bool SimLoop_AddFd(SimLoop *loop, int fd, SimLoopHandler handler, void *context) {
+    if (fd < 0 || loop->source_count >= SIM_LOOP_MAX_SOURCES)
+        return false;
+    if (!SimLoop_Watch(loop, fd, (uint32_t)loop->source_count))
+        return false;
+    loop->sources[loop->source_count++] = (SimLoopSource){fd, handler, context};
+    return true;
+}
+
+// Safe from any thread and from signal handlers
+static inline void SimLoop_Wake(SimLoop *loop) {
+    uint64_t one = 1;
+    if (loop->wake_fd >= 0 && write(loop->wake_fd, &one, sizeof(one)) < 0) {
+        // Counter saturated: a wake-up is pending anyway
+    }
+}
+
+// Service the server and the registered fds until the next cycle tick.
+// Returns the number of ticks that elapsed (more than one after an
+// overrun), or 0 if the loop was woken through SimLoop_Wake.
+static inline uint64_t SimLoop_WaitTick(SimLoop *loop) {
+    struct epoll_event events[SIM_LOOP_MAX_EVENTS];
+    for (;;) {
+        UA_UInt16 server_ms = UA_Server_run_iterate(loop->server, false);
+        int timeout = server_ms < SIM_LOOP_NETWORK_POLL_MS ? server_ms : SIM_LOOP_NETWORK_POLL_MS;
+
+        int n = epoll_wait(loop->epoll_fd, events, SIM_LOOP_MAX_EVENTS, timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                return 0; // A signal handler ran; let the caller look at its flags
+            perror("epoll_wait");
+            return 0;
+        }
+
+        uint64_t ticks = 0;
+        bool woken = false;
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            uint64_t count = 0;
+            if (tag == SIM_LOOP_TIMER_TAG) {
+                if (read(loop->timer_fd, &count, sizeof(count)) == sizeof(count))
+                    ticks += count;
+            } else if (tag == SIM_LOOP_WAKE_TAG) {
+                if (read(loop->wake_fd, &count, sizeof(count)) == sizeof(count))
+                    woken = true;
+            } else if (tag < loop->source_count) {
+                SimLoopSource *source = &loop->sources[tag];
+                source->handler(source->fd, source->context);
+            }
+        }
+
+        if (ticks > 0) {
+            loop->missed_ticks += ticks - 1;
+            return ticks;
+        }
+        if (woken)
+            return 0;
+    }
+}
+#else
+// No epoll: blocking iterate plus a sleep per cycle, as before
+static inline bool SimLoop_Open(SimLoop *loop, UA_Server *server, uint32_t cycle_time_ms) {
+    loop->server = server;
+    loop->cycle_time_ms = cycle_time_ms;
+    loop->source_count = 0;
+    loop->missed_ticks = 0;
+    return true;
+}
+
+static inline bool SimLoop_AddFd(SimLoop *loop, int fd, SimLoopHandler handler, void *context) {
+    return false;
+}
+
+static inline void SimLoop_Wake(SimLoop *loop) {
+}
+
+static inline uint64_t SimLoop_WaitTick(SimLoop *loop) {
+    UA_Server_run_iterate(loop->server, true);
+#ifdef _WIN32
+    Sleep(loop->cycle_time_ms);
+#else
+    usleep(loop->cycle_time_ms * 1000);
+#endif
+    return 1;
+}
+
+static inline void SimLoop_Close(SimLoop *loop) {
+}
+#endif
+
+#endif // SIM_LOOP_H
@@ -0,0 +1,329 @@
+#ifndef SIM_METRICS_H
+#define SIM_METRICS_H
+
+#include <open62541/server.h>
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// ==================== PROMETHEUS METRICS ENDPOINT ====================
+// Optional HTTP endpoint serving GET /metrics in the Prometheus text
+// exposition format. Enabled by setting SIM_METRICS_PORT; it only ever binds
+// to 127.0.0.1.
+//
+// The simulation loop records into relaxed atomic counters and never blocks.
+// Scrapes run on their own thread and render into a preallocated buffer.
+// Monitored items are counted through the server's
+// monitoredItemRegisterCallback, installed by SimMetrics_StartFromEnv when
+// the server has no callback of its own.
+
+#define SIM_METRICS_MAX_MODELS 32
+#define SIM_METRICS_MODEL_NAME 64
+#define SIM_METRICS_BUFFER_SIZE 16384
+#define SIM_METRICS_BUCKETS 11
+
+// Upper bounds of the cycle-time histogram buckets in seconds (+Inf last)
+static const double sim_metrics_bucket_bounds[SIM_METRICS_BUCKETS - 1] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1
+};
+
+typedef struct {
+    char name[SIM_METRICS_MODEL_NAME];
+    atomic_uint_fast64_t steps;
+    atomic_uint_fast64_t step_ns;
+} SimMetricsModel;
+
+typedef struct {
+    bool enabled;
+    int listen_fd;
+    pthread_t thread;
+    atomic_bool stop;
+
+    // Written by the simulation thread
+    atomic_uint_fast64_t cycles;
+    atomic_uint_fast64_t overruns;
+    atomic_uint_fast64_t cycle_ns_sum;
+    atomic_uint_fast64_t cycle_buckets[SIM_METRICS_BUCKETS];
+    atomic_uint_fast64_t sessions;
+    atomic_uint_fast64_t sessions_total;
+    atomic_uint_fast64_t secure_channels;
+    atomic_uint_fast64_t connections;
+    atomic_uint_fast64_t connections_total;
+    atomic_uint_fast64_t monitored_items_created;   // Written by the server thread
+    atomic_uint_fast64_t monitored_items_deleted;
+    atomic_uint model_count;
+    SimMetricsModel models[SIM_METRICS_MAX_MODELS];
+
+    // Owned by the scrape thread
+    char buffer[SIM_METRICS_BUFFER_SIZE];
+} SimMetrics;
+
+static SimMetrics sim_metrics = {.listen_fd = -1};
+
+static inline uint64_t SimMetrics_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Returns a slot for per-model step times; the same name maps to the same
+// slot. Call from the simulation thread only.
+static inline int SimMetrics_RegisterModel(const char *name) {
+    unsigned count = atomic_load_explicit(&sim_metrics.model_count, memory_order_relaxed);
+    for (unsigned i = 0; i < count; i++) {
+        if (strcmp(sim_metrics.models[i].name, name) == 0)
+            return (int)i;
+    }
+    if (count >= SIM_METRICS_MAX_MODELS)
+        return -1;
+    snprintf(sim_metrics.models[count].name, SIM_METRICS_MODEL_NAME, "%s", name);
+    atomic_store_explicit(&sim_metrics.model_count, count + 1, memory_order_release);
+    return (int)count;
+}
+
+static inline void SimMetrics_RecordModelStep(int slot, uint64_t elapsed_ns) {
+    if (!sim_metrics.enabled || slot < 0)
+        return;
+    atomic_fetch_add_explicit(&sim_metrics.models[slot].steps, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sim_metrics.models[slot].step_ns, elapsed_ns, memory_order_relaxed);
+}
+
+// busy_ns: time spent on simulation and publishing in this cycle
+static inline void SimMetrics_RecordCycle(uint64_t busy_ns, uint32_t cycle_time_ms) {
+    if (!sim_metrics.enabled)
+        return;
+    double seconds = busy_ns / 1e9;
+    int bucket = 0;
+    while (bucket < SIM_METRICS_BUCKETS - 1 && seconds > sim_metrics_bucket_bounds[bucket])
+        bucket++;
+    atomic_fetch_add_explicit(&sim_metrics.cycle_buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sim_metrics.cycle_ns_sum, busy_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sim_metrics.cycles, 1, memory_order_relaxed);
+    if (busy_ns > (uint64_t)cycle_time_ms * 1000000ULL)
+        atomic_fetch_add_explicit(&sim_metrics.overruns, 1, memory_order_relaxed);
+}
+
+// Snapshot the server's session and connection counters
+static inline void SimMetrics_RecordServer(UA_Server *server) {
+    if (!sim_metrics.enabled)
+        return;
+    UA_ServerStatistics stats = UA_Server_getStatistics(server);
+    atomic_store_explicit(&sim_metrics.sessions, stats.ss.currentSessionCount, memory_order_relaxed);
+    atomic_store_explicit(&sim_metrics.sessions_total, stats.ss.cumulatedSessionCount, memory_order_relaxed);
+    atomic_store_explicit(&sim_metrics.secure_channels, stats.scs.currentChannelCount, memory_order_relaxed);
+    atomic_store_explicit(&sim_metrics.connections, stats.ns.currentConnectionCount, memory_order_relaxed);
+    atomic_store_explicit(&sim_metrics.connections_total, stats.ns.cumulatedConnectionCount, memory_order_relaxed);
+}
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+// monitoredItemRegisterCallback: called once when an item is created and
+// once when it is deleted (also when its session goes away)
+static inline void SimMetrics_OnMonitoredItem(UA_Server *server, const UA_NodeId *sessionId,
+                                              void *sessionContext, const UA_NodeId *nodeId,
+                                              void *nodeContext, UA_UInt32 attributeId, UA_Boolean removed) {
+    (void)server, (void)sessionId, (void)sessionContext, (void)nodeId, (void)nodeContext, (void)attributeId;
+    atomic_fetch_add_explicit(removed ? &sim_metrics.monitored_items_deleted : &sim_metrics.monitored_items_created,
+                              1, memory_order_relaxed);
+}
+#endif
+
+#define SIM_METRICS_LOAD(counter) \
+    ((unsigned long long)atomic_load_explicit(&(counter), memory_order_relaxed))
+
+// Render all metrics into sim_metrics.buffer; returns the length
+static inline size_t SimMetrics_Render(void) {
+    char *buf = sim_metrics.buffer;
+    size_t size = sizeof(sim_metrics.buffer);
+    size_t len = 0;
+
+#define SIM_METRICS_APPEND(...) \
+    do { \
+        if (len < size) { \
+            int n = snprintf(buf + len, size - len, __VA_ARGS__); \
+            if (n > 0) len += (size_t)n; \
+        } \
+    } while (0)
+
+    SIM_METRICS_APPEND("# HELP sim_cycle_seconds Simulation and publish time per cycle.\n"
+                       "# TYPE sim_cycle_seconds histogram\n");
+    unsigned long long cumulative = 0;
+    for (int i = 0; i < SIM_METRICS_BUCKETS; i++) {
+        cumulative += SIM_METRICS_LOAD(sim_metrics.cycle_buckets[i]);
+        if (i < SIM_METRICS_BUCKETS - 1)
+            SIM_METRICS_APPEND("sim_cycle_seconds_bucket{le=\"%g\"} %llu\n",
+                               sim_metrics_bucket_bounds[i], cumulative);
+        else
+            SIM_METRICS_APPEND("sim_cycle_seconds_bucket{le=\"+Inf\"} %llu\n", cumulative);
+    }
+    SIM_METRICS_APPEND("sim_cycle_seconds_sum %.9f\n", SIM_METRICS_LOAD(sim_metrics.cycle_ns_sum) / 1e9);
+    SIM_METRICS_APPEND("sim_cycle_seconds_count %llu\n", cumulative);
+
+    SIM_METRICS_APPEND("# HELP sim_cycle_overruns_total Cycles whose work exceeded the cycle time.\n"
+                       "# TYPE sim_cycle_overruns_total counter\n"
+                       "sim_cycle_overruns_total %llu\n", SIM_METRICS_LOAD(sim_metrics.overruns));
+
+    SIM_METRICS_APPEND("# HELP sim_model_step_seconds_total Time spent stepping each model type.\n"
+                       "# TYPE sim_model_step_seconds_total counter\n");
+    unsigned model_count = atomic_load_explicit(&sim_metrics.model_count, memory_order_acquire);
+    for (unsigned i = 0; i < model_count; i++)
+        SIM_METRICS_APPEND("sim_model_step_seconds_total{model=\"%s\"} %.9f\n",
+                           sim_metrics.models[i].name, SIM_METRICS_LOAD(sim_metrics.models[i].step_ns) / 1e9);
+    SIM_METRICS_APPEND("# HELP sim_model_steps_total Step calls per model type.\n"
+                       "# TYPE sim_model_steps_total counter\n");
+    for (unsigned i = 0; i < model_count; i++)
+        SIM_METRICS_APPEND("sim_model_steps_total{model=\"%s\"} %llu\n",
+                           sim_metrics.models[i].name, SIM_METRICS_LOAD(sim_metrics.models[i].steps));
+
+    SIM_METRICS_APPEND("# HELP opcua_sessions Current OPC UA sessions.\n"
+                       "# TYPE opcua_sessions gauge\n"
+                       "opcua_sessions %llu\n", SIM_METRICS_LOAD(sim_metrics.sessions));
+    SIM_METRICS_APPEND("# HELP opcua_sessions_total Sessions created since start.\n"
+                       "# TYPE opcua_sessions_total counter\n"
+                       "opcua_sessions_total %llu\n", SIM_METRICS_LOAD(sim_metrics.sessions_total));
+    SIM_METRICS_APPEND("# HELP opcua_secure_channels Current secure channels.\n"
+                       "# TYPE opcua_secure_channels gauge\n"
+                       "opcua_secure_channels %llu\n", SIM_METRICS_LOAD(sim_metrics.secure_channels));
+    SIM_METRICS_APPEND("# HELP opcua_connections Current TCP connections.\n"
+                       "# TYPE opcua_connections gauge\n"
+                       "opcua_connections %llu\n", SIM_METRICS_LOAD(sim_metrics.connections));
+    SIM_METRICS_APPEND("# HELP opcua_connections_total Connections accepted since start.\n"
+                       "# TYPE opcua_connections_total counter\n"
+                       "opcua_connections_total %llu\n", SIM_METRICS_LOAD(sim_metrics.connections_total));
+    unsigned long long items_created = SIM_METRICS_LOAD(sim_metrics.monitored_items_created);
+    unsigned long long items_deleted = SIM_METRICS_LOAD(sim_metrics.monitored_items_deleted);
+    SIM_METRICS_APPEND("# HELP opcua_monitored_items Current monitored items over all subscriptions.\n"
+                       "# TYPE opcua_monitored_items gauge\n"
+                       "opcua_monitored_items %llu\n",
+                       items_created > items_deleted ? items_created - items_deleted : 0);
+    SIM_METRICS_APPEND("# HELP opcua_monitored_items_total Monitored items created since start.\n"
+                       "# TYPE opcua_monitored_items_total counter\n"
+                       "opcua_monitored_items_total %llu\n", items_created);
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 heap = mallinfo2();
+    SIM_METRICS_APPEND("# HELP process_heap_bytes Heap bytes by state (glibc malloc).\n"
+                       "# TYPE process_heap_bytes gauge\n"
+                       "process_heap_bytes{state=\"in_use\"} %zu\n"
+                       "process_heap_bytes{state=\"free\"} %zu\n"
+                       "process_heap_bytes{state=\"mmapped\"} %zu\n",
+                       heap.uordblks, heap.fordblks, heap.hblkhd);
+#endif
+
+#undef SIM_METRICS_APPEND
+    return len < size ? len : size - 1;
+}
+
+static inline void SimMetrics_Serve(int client_fd) {
+    char request[1024];
+    ssize_t n = recv(client_fd, request, sizeof(request) - 1, 0);
+    if (n <= 0)
+        return;
+    request[n] = '\0';
+
+    char header[160];
+    if (strncmp(request, "GET /metrics", 12) == 0) {
+        size_t body_len = SimMetrics_Render();
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.1 200 OK\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n"
+                                  "Connection: close\r\n\r\n", body_len);
+        send(client_fd, header, (size_t)header_len, MSG_NOSIGNAL);
+        send(client_fd, sim_metrics.buffer, body_len, MSG_NOSIGNAL);
+    } else {
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.1 404 Not Found\r\n"
+                                  "Content-Length: 0\r\n"
+                                  "Connection: close\r\n\r\n");
+        send(client_fd, header, (size_t)header_len, MSG_NOSIGNAL);
+    }
+}
+
+static inline void *SimMetrics_Thread(void *arg) {
+    struct pollfd pfd = {.fd = sim_metrics.listen_fd, .events = POLLIN};
+    while (!atomic_load(&sim_metrics.stop)) {
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        int client_fd = accept(sim_metrics.listen_fd, NULL, NULL);
+        if (client_fd < 0)
+            continue;
+        struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        SimMetrics_Serve(client_fd);
+        close(client_fd);
+    }
+    return NULL;
+}
+
+// Start the endpoint if SIM_METRICS_PORT is set. Call before
+// UA_Server_run_startup, so every monitored item is counted. Returns false
+// on error.
+static inline bool SimMetrics_StartFromEnv(UA_Server *server) {
+    const char *port_env = getenv("SIM_METRICS_PORT");
+    if (!port_env || !*port_env)
+        return true;
+
+    int port = atoi(port_env);
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "SIM_METRICS_PORT: invalid port %s\n", port_env);
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("metrics endpoint");
+        close(fd);
+        return false;
+    }
+
+    sim_metrics.listen_fd = fd;
+    sim_metrics.enabled = true;
+    atomic_store(&sim_metrics.stop, false);
+    if (pthread_create(&sim_metrics.thread, NULL, SimMetrics_Thread, NULL) != 0) {
+        sim_metrics.enabled = false;
+        close(fd);
+        sim_metrics.listen_fd = -1;
+        return false;
+    }
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    if (!config->monitoredItemRegisterCallback)
+        config->monitoredItemRegisterCallback = SimMetrics_OnMonitoredItem;
+#else
+    (void)server;
+#endif
+    printf("Metrics at http://127.0.0.1:%d/metrics\n", port);
+    return true;
+}
+
+static inline void SimMetrics_Stop(void) {
+    if (!sim_metrics.enabled)
+        return;
+    atomic_store(&sim_metrics.stop, true);
+    pthread_join(sim_metrics.thread, NULL);
+    close(sim_metrics.listen_fd);
+    sim_metrics.listen_fd = -1;
+    sim_metrics.enabled = false;
+}
+
+#endif // SIM_METRICS_H
@@ -0,0 +1,90 @@
+#ifndef SIM_MODEL_PLUGIN_H
+#define SIM_MODEL_PLUGIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ==================== EQUIPMENT MODEL PLUGIN ABI ====================
+// An equipment model is a shared object exporting one function,
+// sim_model_descriptor(), that returns a SimModelDescriptor. The host
+// (model_host_opcua.c) loads it with dlopen, allocates the instances as one
+// contiguous array, builds the OPC UA address space from the field tables
+// and steps the instances of a model in fixed partitions, possibly on
+// several threads (see sim_executor.h).
+//
+// Bump SIM_MODEL_ABI_VERSION on any incompatible change to these structs.
+// Version 2 appended step_batch_random; version 1 plugins still load.
+#define SIM_MODEL_ABI_VERSION 2
+#define SIM_MODEL_ABI_MIN_VERSION 1
+#define SIM_MODEL_ENTRY_SYMBOL "sim_model_descriptor"
+
+typedef enum {
+    SIM_FIELD_DOUBLE,
+    SIM_FIELD_INT32,
+    SIM_FIELD_UINT32,
+    SIM_FIELD_BOOLEAN
+} SimFieldType;
+
+// One field of the instance struct exposed as an OPC UA variable
+typedef struct {
+    const char *name;           // Browse name, e.g. "Speed"
+    const char *display_name;   // e.g. "Speed (%)"
+    SimFieldType type;
+    size_t offset;              // Byte offset into the instance struct
+} SimFieldDescriptor;
+
+// Counter-based random stream (SplitMix64). The host hands one to every
+// step_batch_random call, keyed by (seed, model, partition, cycle), so the
+// draws do not depend on the thread that runs the partition. Draw in
+// instance order.
+typedef struct {
+    uint64_t key;
+    uint64_t counter;
+} SimRandom;
+
+static inline uint64_t SimRandom_Mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t SimRandom_Next(SimRandom *random) {
+    return SimRandom_Mix(random->key + 0x9E3779B97F4A7C15ULL * ++random->counter);
+}
+
+// Uniform in [0, 1)
+static inline double SimRandom_Uniform(SimRandom *random) {
+    return (SimRandom_Next(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+typedef struct {
+    uint32_t abi_version;             // Must be SIM_MODEL_ABI_VERSION
+    const char *name;                 // Model type name, e.g. "Pump"
+    size_t instance_size;             // sizeof the instance struct
+
+    const SimFieldDescriptor *params; // Writable parameters
+    size_t param_count;
+    const SimFieldDescriptor *state;  // Read-only state
+    size_t state_count;
+
+    // Set defaults for one instance. index is the instance number.
+    void (*init)(void *instance, uint32_t index);
+    // Advance count contiguous instances by one cycle. Instances must be
+    // independent: the host may call this on any sub-range of the array.
+    void (*step_batch)(void *instances, size_t count, uint32_t cycle_time_ms);
+
+    // ABI 2, optional: step_batch with a random stream for these instances.
+    // Used instead of step_batch when set.
+    void (*step_batch_random)(void *instances, size_t count, uint32_t cycle_time_ms,
+                              SimRandom *random);
+} SimModelDescriptor;
+
+typedef const SimModelDescriptor *(*SimModelEntryFn)(void);
+
+#define SIM_FIELD(browse_name, display, field_type, struct_type, member) \
+    { browse_name, display, field_type, offsetof(struct_type, member) }
+
+#define SIM_FIELD_COUNT(table) (sizeof(table) / sizeof((table)[0]))
+
+#endif // SIM_MODEL_PLUGIN_H
@@ -0,0 +1,258 @@
+#ifndef SIM_SECURITY_H
+#define SIM_SECURITY_H
+
+#include <open62541/server.h>
+#include <open62541/server_config_default.h>
+#include <open62541/plugin/log_stdout.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef UA_ENABLE_ENCRYPTION
+#include <open62541/plugin/create_certificate.h>
+#endif
+
+// ==================== ENCRYPTED ENDPOINTS ====================
+// Server security from the environment, next to SIM_METRICS_PORT:
+//   SIM_SECURITY=encrypt   Basic256Sha256 Sign&Encrypt endpoints only
+//   SIM_SECURITY=allow     secured endpoints plus the unencrypted one
+//   (unset)                unencrypted endpoint only, as before
+//   SIM_CERT_DIR=<dir>     where the certificate and key are kept (".")
+//   SIM_TRUST_DIR=<dir>    trusted client certificates (*.der)
+//
+// The server certificate and key are loaded from <dir>/server_cert.der and
+// <dir>/server_key.der. If they do not exist a self-signed pair is
+// generated and written there, so clients can pin it across restarts. The
+// key file is created owner-only (0600).
+//
+// Only clients whose certificate is in SIM_TRUST_DIR may open a secure
+// channel. Without SIM_TRUST_DIR the trust list is empty and open62541
+// accepts any client certificate; the server says so loudly at startup.
+// Requires open62541 built with UA_ENABLE_ENCRYPTION (mbedTLS).
+//
+// Throughput: the symmetric keys are derived once per security token, and
+// the token lifetime is raised to SIM_SECURITY_TOKEN_LIFETIME_MS so that
+// renewals stay rare. The stock Basic256Sha256 policy still runs the AES key
+// schedule and the HMAC setup on every message; nothing here caches them.
+// The only lever left is fewer, larger messages: several nodes per Read.
+// Notifications are batched no further than the client's publishing
+// interval and maxNotificationsPerPublish allow.
+
+#define SIM_SECURITY_POLICY_URI "http://opcfoundation.org/UA/SecurityPolicy#Basic256Sha256"
+#define SIM_SECURITY_SERVER_URI "urn:open62541.server.application"
+#define SIM_SECURITY_CLIENT_URI "urn:open62541.client.application"
+#define SIM_SECURITY_KEY_BITS 2048
+#define SIM_SECURITY_TOKEN_LIFETIME_MS (60 * 60 * 1000)
+#define SIM_SECURITY_MAX_TRUSTED 64
+
+typedef enum {
+    SIM_SECURITY_OFF,
+    SIM_SECURITY_ALLOW,
+    SIM_SECURITY_REQUIRE
+} SimSecurityMode;
+
+static inline bool SimSecurity_ReadFile(const char *path, UA_ByteString *out) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bool ok = size > 0 && UA_ByteString_allocBuffer(out, (size_t)size) == UA_STATUSCODE_GOOD;
+    if (ok && fread(out->data, 1, out->length, file) != out->length) {
+        UA_ByteString_clear(out);
+        ok = false;
+    }
+    fclose(file);
+    return ok;
+}
+
+// Create or replace path with the given permission bits. The mode is also
+// applied to an existing file, so a key never stays world-readable.
+static inline bool SimSecurity_WriteFile(const char *path, const UA_ByteString *data, unsigned mode) {
+#ifdef _WIN32
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(data->data, 1, data->length, file) == data->length;
+    return fclose(file) == 0 && ok;
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, (mode_t)mode);
+    if (fd < 0)
+        return false;
+    bool ok = fchmod(fd, (mode_t)mode) == 0;
+    for (size_t done = 0; ok && done < data->length;) {
+        ssize_t n = write(fd, data->data + done, data->length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        ok = n > 0;
+        if (ok)
+            done += (size_t)n;
+    }
+    return close(fd) == 0 && ok;
+#endif
+}
+
+// Load <dir>/<name>_cert.der and <dir>/<name>_key.der, or create a
+// self-signed pair for application_uri and store it there
+static inline bool SimSecurity_LoadOrCreate(const char *dir, const char *name, const char *application_uri,
+                                            UA_ByteString *cert, UA_ByteString *key) {
+    char cert_path[512], key_path[512];
+    snprintf(cert_path, sizeof(cert_path), "%s/%s_cert.der", dir, name);
+    snprintf(key_path, sizeof(key_path), "%s/%s_key.der", dir, name);
+    if (SimSecurity_ReadFile(cert_path, cert)) {
+        if (SimSecurity_ReadFile(key_path, key))
+            return true;
+        UA_ByteString_clear(cert);
+    }
+
+#ifdef UA_ENABLE_ENCRYPTION
+    char uri[256];
+    snprintf(uri, sizeof(uri), "URI:%s", application_uri);
+    UA_String subject[] = {UA_STRING_STATIC("C=DE"), UA_STRING_STATIC("O=Process Simulation"),
+                           UA_STRING_STATIC("CN=localhost")};
+    UA_String alt_names[] = {UA_STRING_STATIC("DNS:localhost"), UA_STRING(uri)};
+    if (UA_CreateCertificate(UA_Log_Stdout, subject, 3, alt_names, 2, SIM_SECURITY_KEY_BITS,
+                             UA_CERTIFICATEFORMAT_DER, key, cert) != UA_STATUSCODE_GOOD) {
+        fprintf(stderr, "Cannot create a certificate for %s\n", application_uri);
+        return false;
+    }
+    if (!SimSecurity_WriteFile(cert_path, cert, 0644) || !SimSecurity_WriteFile(key_path, key, 0600))
+        fprintf(stderr, "Cannot store %s, the certificate changes on restart\n", cert_path);
+    else
+        printf("Created self-signed certificate %s\n", cert_path);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Keep only the Sign&Encrypt endpoints. The None policy itself stays so
+// clients can still call GetEndpoints before opening a secure channel.
+static inline void SimSecurity_RequireEncryption(UA_ServerConfig *config) {
+    size_t kept = 0;
+    for (size_t i = 0; i < config->endpointsSize; i++) {
+        if (config->endpoints[i].securityMode == UA_MESSAGESECURITYMODE_SIGNANDENCRYPT)
+            config->endpoints[kept++] = config->endpoints[i];
+        else
+            UA_EndpointDescription_clear(&config->endpoints[i]);
+    }
+    config->endpointsSize = kept;
+}
+
+// Load every *.der file in dir into trusted[]; returns the count or -1 if
+// the directory cannot be read
+static inline int SimSecurity_LoadTrustList(const char *dir, UA_ByteString *trusted, size_t capacity) {
+#ifdef _WIN32
+    return -1;
+#else
+    DIR *handle = opendir(dir);
+    if (!handle)
+        return -1;
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(handle)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".der") != 0)
+            continue;
+        if (count == capacity) {
+            fprintf(stderr, "SIM_TRUST_DIR: more than %zu certificates, ignoring %s\n", capacity, entry->d_name);
+            continue;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (SimSecurity_ReadFile(path, &trusted[count]))
+            count++;
+        else
+            fprintf(stderr, "SIM_TRUST_DIR: cannot read %s\n", path);
+    }
+    closedir(handle);
+    return (int)count;
+#endif
+}
+
+// Configure a server on port with the given security mode. Falls back to
+// the plain default configuration for SIM_SECURITY_OFF. Client certificates
+// are checked against the *.der files in trust_dir; with trust_dir NULL
+// every client certificate is accepted.
+static inline UA_StatusCode SimSecurity_Configure(UA_ServerConfig *config, uint16_t port,
+                                                  SimSecurityMode mode, const char *cert_dir,
+                                                  const char *trust_dir) {
+    if (mode == SIM_SECURITY_OFF)
+        return UA_ServerConfig_setMinimal(config, port, NULL);
+
+#ifdef UA_ENABLE_ENCRYPTION
+    UA_ByteString trusted[SIM_SECURITY_MAX_TRUSTED];
+    int trusted_count = 0;
+    if (trust_dir) {
+        trusted_count = SimSecurity_LoadTrustList(trust_dir, trusted, SIM_SECURITY_MAX_TRUSTED);
+        if (trusted_count <= 0) {
+            // An empty list would silently trust everyone
+            fprintf(stderr, "SIM_TRUST_DIR %s: no readable client certificates (*.der)\n", trust_dir);
+            for (int i = 0; i < trusted_count; i++)
+                UA_ByteString_clear(&trusted[i]);
+            return UA_STATUSCODE_BADCERTIFICATEUNTRUSTED;
+        }
+    } else {
+        fprintf(stderr, "WARNING: SIM_TRUST_DIR is not set, so the trust list is empty and ANY client "
+                        "certificate is accepted on the encrypted endpoints\n");
+    }
+
+    UA_ByteString cert = UA_BYTESTRING_NULL, key = UA_BYTESTRING_NULL;
+    UA_StatusCode status = UA_STATUSCODE_BADCERTIFICATEINVALID;
+    if (SimSecurity_LoadOrCreate(cert_dir, "server", SIM_SECURITY_SERVER_URI, &cert, &key))
+        status = UA_ServerConfig_setDefaultWithSecurityPolicies(config, port, &cert, &key,
+                                                                trusted, (size_t)trusted_count,
+                                                                NULL, 0, NULL, 0);
+    UA_ByteString_clear(&cert);
+    UA_ByteString_clear(&key);
+    for (int i = 0; i < trusted_count; i++)
+        UA_ByteString_clear(&trusted[i]);
+    if (status != UA_STATUSCODE_GOOD)
+        return status;
+
+    config->maxSecurityTokenLifetime = SIM_SECURITY_TOKEN_LIFETIME_MS;
+    if (mode == SIM_SECURITY_REQUIRE)
+        SimSecurity_RequireEncryption(config);
+    return UA_STATUSCODE_GOOD;
+#else
+    fprintf(stderr, "Encrypted endpoints need open62541 built with UA_ENABLE_ENCRYPTION\n");
+    return UA_STATUSCODE_BADNOTSUPPORTED;
+#endif
+}
+
+// Server configuration from SIM_SECURITY / SIM_CERT_DIR / SIM_TRUST_DIR
+// (see above)
+static inline UA_StatusCode SimSecurity_ConfigureFromEnv(UA_ServerConfig *config, uint16_t port) {
+    const char *mode_env = getenv("SIM_SECURITY");
+    const char *dir_env = getenv("SIM_CERT_DIR");
+    const char *trust_env = getenv("SIM_TRUST_DIR");
+    const char *cert_dir = dir_env && *dir_env ? dir_env : ".";
+    const char *trust_dir = trust_env && *trust_env ? trust_env : NULL;
+
+    SimSecurityMode mode = SIM_SECURITY_OFF;
+    if (mode_env && strcmp(mode_env, "encrypt") == 0) {
+        mode = SIM_SECURITY_REQUIRE;
+    } else if (mode_env && strcmp(mode_env, "allow") == 0) {
+        mode = SIM_SECURITY_ALLOW;
+    } else if (mode_env && *mode_env && strcmp(mode_env, "none") != 0) {
+        fprintf(stderr, "SIM_SECURITY: expected encrypt, allow or none, got %s\n", mode_env);
+        return UA_STATUSCODE_BADINVALIDARGUMENT;
+    }
+
+    UA_StatusCode status = SimSecurity_Configure(config, port, mode, cert_dir, trust_dir);
+    if (status == UA_STATUSCODE_GOOD && mode != SIM_SECURITY_OFF)
+        printf("Basic256Sha256 endpoints enabled%s (certificates in %s, trust list %s)\n",
+               mode == SIM_SECURITY_REQUIRE ? ", Sign&Encrypt only" : "", cert_dir,
+               trust_dir ? trust_dir : "empty");
+    return status;
+}
+
+#endif // SIM_SECURITY_H
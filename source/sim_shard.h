@@ -0,0 +1,378 @@
+#ifndef SIM_SHARD_H
+#define SIM_SHARD_H
+
+#include <open62541/server.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// ==================== DISTRIBUTED SHARDS ====================
+// Boundary-stream exchange between simulator processes. Every process
+// (shard) simulates one part of the plant; after each cycle it sends the
+// values other shards read from it and waits for the values it reads from
+// them. That wait is the per-cycle barrier: a shard starts cycle c + 1 only
+// when all shards it shares streams with have finished cycle c. Shards
+// without shared streams do not wait for each other, so the cost per cycle
+// does not grow with the number of processes, only with the number of
+// neighbours.
+//
+// Transport is one UDP datagram per neighbour and cycle:
+//   SimShardHeader, then count doubles in the order both sides derived
+//   from the same plant description (native byte order)
+// Lost datagrams are recovered without acknowledgements:
+//   - a shard still waiting after SIM_SHARD_RETRANSMIT_MS resends its
+//     packet to the neighbours it has not heard from,
+//   - a packet for an older cycle means the sender missed ours for that
+//     cycle, so the packet of that cycle is sent again.
+// Neighbours are never more than one cycle apart, so two packet buffers
+// and two receive slots (by cycle parity) per neighbour are enough.
+//
+//   SimShard shard;
+//   SimShard_Open(&shard, 1, "10.0.0.1:4900,10.0.0.2:4900");
+//   shard.layout = hash of the plant description;
+//   SimShard_SetStreams(&shard, peer, out_count, in_count);
+//   each cycle: fill shard.peers[p].out, SimShard_Exchange, read .in
+//   SimShard_Finish(&shard, last_cycle); SimShard_Close(&shard);
+
+#define SIM_SHARD_MAX 64
+#define SIM_SHARD_MAGIC 0x31445348u             // "SHD1"
+#define SIM_SHARD_RETRANSMIT_MS 20
+#define SIM_SHARD_MAX_VALUES 8000               // Per neighbour and cycle, one datagram
+#define SIM_SHARD_LINGER_MS (5 * SIM_SHARD_RETRANSMIT_MS)
+#define SIM_SHARD_FINISH_MS 2000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t layout;        // Hash of the stream layout; must match on both sides
+    uint64_t cycle;
+    uint16_t shard;         // Sender
+    uint16_t reserved;
+    uint32_t count;
+} SimShardHeader;
+
+typedef struct {
+    struct sockaddr_in address;
+    bool linked;            // Shares at least one stream with this shard
+    double *out;            // Values sent to this neighbour, filled by the caller
+    size_t out_count;
+    double *in;             // Values received from it, valid after SimShard_Exchange
+    size_t in_count;
+
+    // Receive slots by cycle parity: a neighbour can be one cycle ahead
+    double *slot[2];
+    uint64_t slot_cycle[2];
+    bool slot_full[2];
+
+    // Sent packets of the current and the previous cycle, by parity
+    unsigned char *packet[2];
+    uint64_t packet_cycle[2];
+    bool packet_valid[2];
+} SimShardPeer;
+
+typedef struct {
+    int fd;
+    uint32_t index;
+    uint32_t count;
+    uint32_t layout;
+    SimShardPeer peers[SIM_SHARD_MAX];
+    unsigned char *receive_buffer;
+
+    uint64_t exchanges;
+    uint64_t retransmits;
+    uint64_t wait_ns;       // Time spent waiting for neighbours
+    bool layout_mismatch;   // Each reported once
+    bool link_mismatch;
+    bool count_mismatch;
+} SimShard;
+
+static inline size_t SimShard_PacketSize(size_t count) {
+    return sizeof(SimShardHeader) + count * sizeof(double);
+}
+
+static inline uint64_t SimShard_Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline void SimShard_FreeStreams(SimShardPeer *peer) {
+    free(peer->out);
+    free(peer->in);
+    for (int s = 0; s < 2; s++) {
+        free(peer->slot[s]);
+        free(peer->packet[s]);
+        peer->slot[s] = NULL;
+        peer->packet[s] = NULL;
+        peer->slot_full[s] = false;
+        peer->packet_valid[s] = false;
+    }
+    peer->out = NULL;
+    peer->in = NULL;
+    peer->out_count = 0;
+    peer->in_count = 0;
+    peer->linked = false;
+}
+
+static inline void SimShard_Close(SimShard *shard) {
+    for (uint32_t p = 0; p < shard->count; p++)
+        SimShard_FreeStreams(&shard->peers[p]);
+    free(shard->receive_buffer);
+    shard->receive_buffer = NULL;
+    if (shard->fd >= 0)
+        close(shard->fd);
+    shard->fd = -1;
+}
+
+static inline bool SimShard_Resolve(const char *text, size_t length, struct sockaddr_in *address) {
+    char host[256];
+    const char *colon = memchr(text, ':', length);
+    if (!colon || (size_t)(colon - text) >= sizeof(host))
+        return false;
+    memcpy(host, text, (size_t)(colon - text));
+    host[colon - text] = '\0';
+    unsigned long port = strtoul(colon + 1, NULL, 10);
+    if (port == 0 || port > 65535)
+        return false;
+
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0 || !result)
+        return false;
+    *address = *(struct sockaddr_in *)result->ai_addr;
+    address->sin_port = htons((uint16_t)port);
+    freeaddrinfo(result);
+    return true;
+}
+
+// peers: "host:port,host:port,..." with one entry per shard, in shard order.
+// Binds the port of entry `index` on all interfaces.
+static inline bool SimShard_Open(SimShard *shard, uint32_t index, const char *peers) {
+    memset(shard, 0, sizeof(*shard));
+    shard->fd = -1;
+    shard->index = index;
+
+    const char *entry = peers;
+    while (entry && *entry) {
+        const char *comma = strchr(entry, ',');
+        size_t length = comma ? (size_t)(comma - entry) : strlen(entry);
+        if (shard->count >= SIM_SHARD_MAX ||
+            !SimShard_Resolve(entry, length, &shard->peers[shard->count].address)) {
+            fprintf(stderr, "Shard peers: cannot use '%.*s'\n", (int)length, entry);
+            return false;
+        }
+        shard->count++;
+        entry = comma ? comma + 1 : NULL;
+    }
+    if (index >= shard->count) {
+        fprintf(stderr, "Shard %u is not in the peer list (%u entries)\n", index, shard->count);
+        return false;
+    }
+
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY),
+                                .sin_port = shard->peers[index].address.sin_port};
+    int buffer_size = 4 * 1024 * 1024;
+    shard->receive_buffer = malloc(SimShard_PacketSize(SIM_SHARD_MAX_VALUES));
+    shard->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (!shard->receive_buffer || shard->fd < 0 ||
+        bind(shard->fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        fcntl(shard->fd, F_SETFL, O_NONBLOCK) < 0) {
+        perror("shard socket");
+        SimShard_Close(shard);
+        return false;
+    }
+    setsockopt(shard->fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+    return true;
+}
+
+// Size the streams to and from one neighbour. Both sides must agree:
+// out_count here is in_count on the neighbour.
+static inline bool SimShard_SetStreams(SimShard *shard, uint32_t peer_index, size_t out_count, size_t in_count) {
+    SimShardPeer *peer = &shard->peers[peer_index];
+    SimShard_FreeStreams(peer);
+    if (peer_index == shard->index || (out_count == 0 && in_count == 0))
+        return true;
+    if (out_count > SIM_SHARD_MAX_VALUES || in_count > SIM_SHARD_MAX_VALUES) {
+        fprintf(stderr, "Shard %u: more than %d streams to shard %u\n",
+                shard->index, SIM_SHARD_MAX_VALUES, peer_index);
+        return false;
+    }
+
+    peer->linked = true;
+    peer->out_count = out_count;
+    peer->in_count = in_count;
+    peer->out = calloc(out_count + 1, sizeof(double));
+    peer->in = calloc(in_count + 1, sizeof(double));
+    bool ok = peer->out && peer->in;
+    for (int s = 0; s < 2; s++) {
+        peer->slot[s] = calloc(in_count + 1, sizeof(double));
+        peer->packet[s] = malloc(SimShard_PacketSize(out_count));
+        ok = ok && peer->slot[s] && peer->packet[s];
+    }
+    if (!ok)
+        SimShard_FreeStreams(peer);
+    return ok;
+}
+
+static inline void SimShard_Send(SimShard *shard, SimShardPeer *peer, int parity) {
+    size_t size = SimShard_PacketSize(peer->out_count);
+    sendto(shard->fd, peer->packet[parity], size, 0, (struct sockaddr *)&peer->address, sizeof(peer->address));
+}
+
+static inline void SimShard_Receive(SimShard *shard, uint64_t cycle) {
+    for (;;) {
+        ssize_t size = recv(shard->fd, shard->receive_buffer, SimShard_PacketSize(SIM_SHARD_MAX_VALUES), 0);
+        if (size < (ssize_t)sizeof(SimShardHeader))
+            return;     // EAGAIN, or a runt datagram ends this batch
+
+        SimShardHeader header;
+        memcpy(&header, shard->receive_buffer, sizeof(header));
+        if (header.magic != SIM_SHARD_MAGIC || header.shard >= shard->count || header.shard == shard->index)
+            continue;
+        SimShardPeer *peer = &shard->peers[header.shard];
+        if (header.layout != shard->layout) {
+            if (!shard->layout_mismatch)
+                fprintf(stderr, "Shard %u: shard %u runs a different plant layout, packets dropped\n",
+                        shard->index, header.shard);
+            shard->layout_mismatch = true;
+            continue;
+        }
+        if (!peer->linked) {
+            // Same plant, but the sender thinks it feeds this shard: the
+            // processes disagree on who is which shard
+            if (!shard->link_mismatch)
+                fprintf(stderr, "Shard %u: shard %u sends streams this shard does not read from it, "
+                                "check --shard and --peers on both, packets dropped\n",
+                        shard->index, header.shard);
+            shard->link_mismatch = true;
+            continue;
+        }
+        if (header.count != peer->in_count || (size_t)size != SimShard_PacketSize(header.count)) {
+            if (!shard->count_mismatch)
+                fprintf(stderr, "Shard %u: shard %u sent %u values in %zd bytes, expected %zu, packets dropped\n",
+                        shard->index, header.shard, header.count, size, peer->in_count);
+            shard->count_mismatch = true;
+            continue;
+        }
+
+        int parity = (int)(header.cycle & 1);
+        if (header.cycle < cycle) {
+            // The neighbour is behind: it lost our packet for that cycle
+            if (peer->packet_valid[parity] && peer->packet_cycle[parity] == header.cycle) {
+                SimShard_Send(shard, peer, parity);
+                shard->retransmits++;
+            }
+        } else if (header.cycle <= cycle + 1) {
+            memcpy(peer->slot[parity], shard->receive_buffer + sizeof(header), header.count * sizeof(double));
+            peer->slot_cycle[parity] = header.cycle;
+            peer->slot_full[parity] = true;
+        }
+    }
+}
+
+static inline bool SimShard_Ready(const SimShardPeer *peer, uint64_t cycle) {
+    int parity = (int)(cycle & 1);
+    return !peer->linked || (peer->slot_full[parity] && peer->slot_cycle[parity] == cycle);
+}
+
+// Send this cycle's out values and wait for every neighbour's values of the
+// same cycle. The server (optional) is serviced while waiting. Returns false
+// if *running was cleared or the deadline (0 = none) passed before all
+// values arrived.
+static inline bool SimShard_ExchangeUntil(SimShard *shard, uint64_t cycle, UA_Server *server,
+                                          volatile bool *running, uint64_t deadline_ns) {
+    int parity = (int)(cycle & 1);
+    for (uint32_t p = 0; p < shard->count; p++) {
+        SimShardPeer *peer = &shard->peers[p];
+        if (!peer->linked)
+            continue;
+        SimShardHeader header = {SIM_SHARD_MAGIC, shard->layout, cycle, (uint16_t)shard->index, 0,
+                                 (uint32_t)peer->out_count};
+        memcpy(peer->packet[parity], &header, sizeof(header));
+        memcpy(peer->packet[parity] + sizeof(header), peer->out, peer->out_count * sizeof(double));
+        peer->packet_cycle[parity] = cycle;
+        peer->packet_valid[parity] = true;
+        SimShard_Send(shard, peer, parity);
+    }
+
+    uint64_t start = SimShard_Now();
+    uint64_t last_send = start;
+    for (;;) {
+        SimShard_Receive(shard, cycle);
+        bool ready = true;
+        for (uint32_t p = 0; p < shard->count && ready; p++)
+            ready = SimShard_Ready(&shard->peers[p], cycle);
+        if (ready)
+            break;
+        uint64_t now = SimShard_Now();
+        if ((running && !*running) || (deadline_ns && now >= deadline_ns)) {
+            shard->wait_ns += now - start;
+            return false;
+        }
+
+        // Retransmit by deadline: packets from other neighbours must not
+        // keep postponing it
+        uint64_t due = last_send + SIM_SHARD_RETRANSMIT_MS * 1000000ULL;
+        if (now >= due) {
+            for (uint32_t p = 0; p < shard->count; p++) {
+                SimShardPeer *peer = &shard->peers[p];
+                if (!SimShard_Ready(peer, cycle)) {
+                    SimShard_Send(shard, peer, parity);
+                    shard->retransmits++;
+                }
+            }
+            if (server)
+                UA_Server_run_iterate(server, false);
+            last_send = now;
+            continue;
+        }
+
+        struct pollfd pfd = {.fd = shard->fd, .events = POLLIN};
+        if (poll(&pfd, 1, (int)((due - now) / 1000000ULL) + 1) < 0 && errno != EINTR) {
+            perror("shard poll");
+            return false;
+        }
+    }
+
+    for (uint32_t p = 0; p < shard->count; p++) {
+        SimShardPeer *peer = &shard->peers[p];
+        if (!peer->linked)
+            continue;
+        memcpy(peer->in, peer->slot[parity], peer->in_count * sizeof(double));
+        peer->slot_full[parity] = false;
+    }
+    shard->exchanges++;
+    shard->wait_ns += SimShard_Now() - start;
+    return true;
+}
+
+static inline bool SimShard_Exchange(SimShard *shard, uint64_t cycle, UA_Server *server,
+                                     volatile bool *running) {
+    return SimShard_ExchangeUntil(shard, cycle, server, running, 0);
+}
+
+// Leave after the exchange of `cycle`. A neighbour may still be waiting for
+// a retransmit of that cycle, so one more closing exchange is run: once a
+// neighbour's closing packet arrived it has everything it needs from us.
+// Then requests for the closing packet are answered until the neighbours
+// fall quiet. Bounded by SIM_SHARD_FINISH_MS in case a neighbour is gone.
+static inline void SimShard_Finish(SimShard *shard, uint64_t cycle) {
+    if (shard->fd < 0)
+        return;
+    SimShard_ExchangeUntil(shard, cycle + 1, NULL, NULL, SimShard_Now() + SIM_SHARD_FINISH_MS * 1000000ULL);
+    struct pollfd pfd = {.fd = shard->fd, .events = POLLIN};
+    while (poll(&pfd, 1, SIM_SHARD_LINGER_MS) > 0)
+        SimShard_Receive(shard, cycle + 2);
+}
+
+#endif // SIM_SHARD_H
@@ -4,12 +4,32 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <math.h>
 #include <time.h>
 #include <string.h>
 
+#include "sim_golden.h"
+#include "sim_hash.h"
+#include "sim_loop.h"
+#include "sim_metrics.h"
+#include "sim_security.h"
+
 #define PI 3.14159265
 #define DEFAULT_CYCLE_TIME_MS 100
+#define SCAN_TICK_MS 10
+#define BANK_MAX_CATCH_UP 100       // Bank ticks stepped at once after a stall (1 s)
+
+// Scan-rate classes, all multiples of SCAN_TICK_MS
+typedef enum {
+    SCAN_10MS,
+    SCAN_100MS,
+    SCAN_1S,
+    SCAN_10S,
+    SCAN_CLASS_COUNT
+} ScanClass;
+
+static const uint32_t scan_period_ticks[SCAN_CLASS_COUNT] = {1, 10, 100, 1000};
 
 // Transmitter data structure
 typedef struct {
@@ -24,12 +44,14 @@ typedef struct {
         bool sawtooth_wave;
         bool overflow;
         bool underflow;
+        uint32_t scan_class;    // ScanClass, used by the transmitter bank
     } config;
 
     struct {
         double current_value;
         double simulation_time;
         bool fault;
+        bool increasing;        // Ramp direction
     } state;
 } Transmitter;
 
@@ -37,9 +59,11 @@ typedef struct {
 Transmitter transmitter;
 volatile bool running = true;
 UA_Server *server;
+SimLoop loop = {.epoll_fd = -1, .timer_fd = -1, .wake_fd = -1};
 
 void stopHandler(int sign) {
     running = false;
+    SimLoop_Wake(&loop);
 }
 
 void Transmitter_Init(Transmitter *tx) {
@@ -57,10 +81,12 @@ void Transmitter_Init(Transmitter *tx) {
     tx->config.sawtooth_wave = true;
     tx->config.overflow = false;
     tx->config.underflow = false;
+    tx->config.scan_class = SCAN_100MS;
 
     tx->state.current_value = 0.0;
     tx->state.simulation_time = 0.0;
     tx->state.fault = false;
+    tx->state.increasing = true;
 }
 
 void Transmitter_Update(Transmitter *tx, uint32_t cycle_time_ms) {
@@ -91,17 +117,16 @@ void Transmitter_Update(Transmitter *tx, uint32_t cycle_time_ms) {
             (tx->config.max_range - tx->config.min_range) * phase;
     }
     else {
-        static bool increasing = true;
-        if (increasing) {
+        if (tx->state.increasing) {
             tx->state.current_value += tx->config.step_size;
             if (tx->state.current_value >= tx->config.max_range) {
-                increasing = false;
+                tx->state.increasing = false;
                 tx->state.current_value = tx->config.max_range;
             }
         } else {
             tx->state.current_value -= tx->config.step_size;
             if (tx->state.current_value <= tx->config.min_range) {
-                increasing = true;
+                tx->state.increasing = true;
                 tx->state.current_value = tx->config.min_range;
             }
         }
@@ -111,6 +136,363 @@ void Transmitter_Update(Transmitter *tx, uint32_t cycle_time_ms) {
                        tx->state.current_value > tx->config.max_scale);
 }
 
+// ==================== SCAN SCHEDULER ====================
+// Timer wheel per scan class: a class with a period of P ticks has P slots
+// and every tag of that class sits in exactly one slot (tags are spread
+// evenly so a class costs the same on every tick). The slots are stored as
+// offsets into one index array sorted by (class, slot), so the tags due on
+// a tick form one contiguous batch per class and a tick only touches the
+// tags that are due.
+typedef struct {
+    uint32_t *index;                                // Tag numbers, sorted by (class, slot)
+    uint32_t *slot_start[SCAN_CLASS_COUNT];         // period + 1 offsets per class
+    uint64_t tick;
+    bool dirty;                                     // Rebuild before the next tick
+} ScanScheduler;
+
+// One contiguous run of due tags
+typedef struct {
+    const uint32_t *index;
+    size_t first;                                   // Position of index[0] in the sorted order
+    size_t count;
+    uint32_t slot;                                  // Wheel slot, unique across classes
+    uint32_t cycle_time_ms;
+} ScanBatch;
+
+#define SCAN_SLOT_COUNT (1 + 10 + 100 + 1000)       // Sum of scan_period_ticks
+
+static bool ScanScheduler_Init(ScanScheduler *sched, size_t tag_count) {
+    memset(sched, 0, sizeof(*sched));
+    sched->index = calloc(tag_count ? tag_count : 1, sizeof(uint32_t));
+    if (!sched->index)
+        return false;
+    for (int c = 0; c < SCAN_CLASS_COUNT; c++) {
+        sched->slot_start[c] = calloc(scan_period_ticks[c] + 1, sizeof(uint32_t));
+        if (!sched->slot_start[c])
+            return false;
+    }
+    sched->dirty = true;
+    return true;
+}
+
+static void ScanScheduler_Free(ScanScheduler *sched) {
+    free(sched->index);
+    for (int c = 0; c < SCAN_CLASS_COUNT; c++)
+        free(sched->slot_start[c]);
+    memset(sched, 0, sizeof(*sched));
+}
+
+// Counting sort of the tags into (class, slot) order. Runs at startup and
+// after a ScanClass change, never on an ordinary tick. On an allocation
+// failure the scheduler stays dirty and nothing is dealt.
+static bool ScanScheduler_Build(ScanScheduler *sched, const Transmitter *tags, size_t tag_count) {
+    size_t class_count[SCAN_CLASS_COUNT] = {0};
+    for (size_t i = 0; i < tag_count; i++)
+        class_count[tags[i].config.scan_class]++;
+
+    // Slot sizes: the n tags of a class are dealt round-robin over its slots
+    uint32_t offset = 0;
+    for (int c = 0; c < SCAN_CLASS_COUNT; c++) {
+        uint32_t period = scan_period_ticks[c];
+        for (uint32_t k = 0; k < period; k++) {
+            sched->slot_start[c][k] = offset;
+            offset += (uint32_t)(class_count[c] / period + (k < class_count[c] % period ? 1 : 0));
+        }
+        sched->slot_start[c][period] = offset;
+    }
+
+    // Deal each class round-robin over its slots
+    size_t rank[SCAN_CLASS_COUNT] = {0};
+    uint32_t *cursor[SCAN_CLASS_COUNT];
+    for (int c = 0; c < SCAN_CLASS_COUNT; c++) {
+        cursor[c] = malloc(scan_period_ticks[c] * sizeof(uint32_t));
+        if (!cursor[c]) {
+            while (c-- > 0)
+                free(cursor[c]);
+            return false;
+        }
+        memcpy(cursor[c], sched->slot_start[c], scan_period_ticks[c] * sizeof(uint32_t));
+    }
+    for (size_t i = 0; i < tag_count; i++) {
+        uint32_t c = tags[i].config.scan_class;
+        uint32_t slot = (uint32_t)(rank[c]++ % scan_period_ticks[c]);
+        sched->index[cursor[c][slot]++] = (uint32_t)i;
+    }
+    for (int c = 0; c < SCAN_CLASS_COUNT; c++)
+        free(cursor[c]);
+    sched->dirty = false;
+    return true;
+}
+
+// Batches due on the current tick (at most one per class), then advance
+static size_t ScanScheduler_Due(ScanScheduler *sched, ScanBatch *batches) {
+    size_t batch_count = 0;
+    uint32_t slot_base = 0;
+    for (int c = 0; c < SCAN_CLASS_COUNT; slot_base += scan_period_ticks[c++]) {
+        uint32_t slot = (uint32_t)(sched->tick % scan_period_ticks[c]);
+        uint32_t begin = sched->slot_start[c][slot];
+        uint32_t end = sched->slot_start[c][slot + 1];
+        if (end > begin) {
+            batches[batch_count].index = sched->index + begin;
+            batches[batch_count].first = begin;
+            batches[batch_count].count = end - begin;
+            batches[batch_count].slot = slot_base + slot;
+            batches[batch_count].cycle_time_ms = scan_period_ticks[c] * SCAN_TICK_MS;
+            batch_count++;
+        }
+    }
+    sched->tick++;
+    return batch_count;
+}
+
+void Transmitter_UpdateBatch(Transmitter *tags, const ScanBatch *batch) {
+    for (size_t i = 0; i < batch->count; i++)
+        Transmitter_Update(&tags[batch->index[i]], batch->cycle_time_ms);
+}
+
+// ==================== SLIDING-WINDOW STATISTICS ====================
+// Mean, standard deviation, min, max and rate of change over the last
+// `window` samples of every tag. State is indexed by the tag's position in
+// the scheduler order, so a due batch is a contiguous range. All tags of a
+// batch are sampled on the same ticks and share one sample counter per
+// wheel slot, which lets the ring buffer be stored slot-major
+// (ring[k * count + position]) and the mean/variance/rate pass run as one
+// unit-stride loop over the batch. The sums are taken around a per-tag
+// reference value, so a signal riding on a large offset does not lose its
+// variance to cancellation in sum_sq / n - mean^2. The reference starts at
+// the first sample and moves to the window mean each time the window turns
+// over, when the sums are recomputed exactly from the ring (O(window) once
+// per window). In between they are Neumaier-compensated. Min and max use a monotonic deque per
+// tag (amortized O(1), scalar). The statistics restart whenever the
+// scheduler is rebuilt.
+typedef struct {
+    uint32_t window;            // Samples, 0 = off
+    size_t count;               // Positions (one per tag)
+    uint32_t seq[SCAN_SLOT_COUNT]; // Samples taken per wheel slot
+
+    double *ring;               // window * count, slot-major
+    double *ref;                // Shift of the sums below
+    double *sum, *sum_comp;
+    double *sum_sq, *sum_sq_comp;
+
+    // Monotonic deques of sample numbers, window entries per position
+    uint32_t *min_deque, *max_deque;
+    uint32_t *min_head, *min_len;
+    uint32_t *max_head, *max_len;
+
+    // Outputs, by position
+    double *mean, *stddev, *min, *max, *rate;
+} WindowStats;
+
+static bool WindowStats_Init(WindowStats *ws, uint32_t window, size_t count) {
+    memset(ws, 0, sizeof(*ws));
+    ws->window = window;
+    ws->count = count;
+    if (window == 0)
+        return true;
+
+    double **doubles[] = {&ws->ref, &ws->sum, &ws->sum_comp, &ws->sum_sq, &ws->sum_sq_comp,
+                          &ws->mean, &ws->stddev, &ws->min, &ws->max, &ws->rate};
+    uint32_t **counters[] = {&ws->min_head, &ws->min_len, &ws->max_head, &ws->max_len};
+    ws->ring = calloc((size_t)window * count, sizeof(double));
+    ws->min_deque = calloc((size_t)window * count, sizeof(uint32_t));
+    ws->max_deque = calloc((size_t)window * count, sizeof(uint32_t));
+    bool ok = ws->ring && ws->min_deque && ws->max_deque;
+    for (size_t f = 0; f < sizeof(doubles) / sizeof(doubles[0]); f++)
+        ok = (*doubles[f] = calloc(count, sizeof(double))) && ok;
+    for (size_t f = 0; f < sizeof(counters) / sizeof(counters[0]); f++)
+        ok = (*counters[f] = calloc(count, sizeof(uint32_t))) && ok;
+    return ok;
+}
+
+static void WindowStats_Free(WindowStats *ws) {
+    void *arrays[] = {ws->ring, ws->min_deque, ws->max_deque, ws->ref, ws->sum, ws->sum_comp,
+                      ws->sum_sq, ws->sum_sq_comp, ws->mean, ws->stddev, ws->min,
+                      ws->max, ws->rate, ws->min_head, ws->min_len, ws->max_head, ws->max_len};
+    for (size_t f = 0; f < sizeof(arrays) / sizeof(arrays[0]); f++)
+        free(arrays[f]);
+    memset(ws, 0, sizeof(*ws));
+}
+
+// Positions changed: start every window over
+static void WindowStats_Reset(WindowStats *ws) {
+    if (ws->window == 0)
+        return;
+    size_t n = ws->count;
+    memset(ws->seq, 0, sizeof(ws->seq));
+    double *doubles[] = {ws->ref, ws->sum, ws->sum_comp, ws->sum_sq, ws->sum_sq_comp,
+                         ws->mean, ws->stddev, ws->min, ws->max, ws->rate};
+    for (size_t f = 0; f < sizeof(doubles) / sizeof(doubles[0]); f++)
+        memset(doubles[f], 0, n * sizeof(double));
+    memset(ws->min_len, 0, n * sizeof(uint32_t));
+    memset(ws->max_len, 0, n * sizeof(uint32_t));
+}
+
+// Neumaier compensated s += v, branch-free so it vectorizes
+static inline void neumaierAdd(double *s, double *c, double v) {
+    double t = *s + v;
+    *c += fabs(*s) >= fabs(v) ? (*s - t) + v : (v - t) + *s;
+    *s = t;
+}
+
+// Push sample `seq` with value x into a monotonic deque: increasing values
+// for the minimum, decreasing for the maximum. The front is the extremum.
+static inline void monotonicPush(uint32_t *deque, uint32_t *head, uint32_t *len, uint32_t window,
+                                 const double *ring, size_t count, size_t position,
+                                 uint32_t seq, double x, bool is_min) {
+    // Drop the front once it has left the window. This must happen before
+    // any value is read: its ring slot already holds the new sample.
+    if (*len > 0 && deque[*head] + window <= seq) {
+        *head = (*head + 1) % window;
+        (*len)--;
+    }
+    while (*len > 0) {
+        uint32_t back = deque[(*head + *len - 1) % window];
+        double v = ring[(size_t)(back % window) * count + position];
+        if (is_min ? v < x : v > x)
+            break;
+        (*len)--;
+    }
+    deque[(*head + *len) % window] = seq;
+    (*len)++;
+}
+
+// Unit-stride pass over one batch: compensated shifted sums, mean, stddev
+// and rate. rate[] holds the sample leaving the window on entry.
+static void windowMoments(size_t count, uint32_t filled, double span_s,
+                          const double *restrict x_new, const double *restrict x_oldest,
+                          double *restrict rate, const double *restrict ref,
+                          double *restrict sum, double *restrict sum_comp,
+                          double *restrict sum_sq, double *restrict sum_sq_comp,
+                          double *restrict mean, double *restrict stddev) {
+    for (size_t j = 0; j < count; j++) {
+        double x = x_new[j] - ref[j];
+        double old = rate[j] - ref[j];
+        double s1 = sum[j], c1 = sum_comp[j], s2 = sum_sq[j], c2 = sum_sq_comp[j];
+        neumaierAdd(&s1, &c1, x);
+        neumaierAdd(&s1, &c1, -old);
+        neumaierAdd(&s2, &c2, x * x);
+        neumaierAdd(&s2, &c2, -old * old);
+        sum[j] = s1;
+        sum_comp[j] = c1;
+        sum_sq[j] = s2;
+        sum_sq_comp[j] = c2;
+
+        double d = (s1 + c1) / filled;
+        double var = (s2 + c2) / filled - d * d;
+        mean[j] = ref[j] + d;
+        stddev[j] = sqrt(var > 0.0 ? var : 0.0);
+        rate[j] = span_s > 0.0 ? (x_new[j] - x_oldest[j]) / span_s : 0.0; // Per second
+    }
+}
+
+// The window has turned over: shift the sums of positions [p0, p0 + count)
+// to the current mean and recompute them from the ring
+static void windowRecenter(WindowStats *ws, size_t p0, size_t count) {
+    const size_t n = ws->count;
+    double *restrict ref = ws->ref + p0;
+    double *restrict s1 = ws->sum + p0;
+    double *restrict s2 = ws->sum_sq + p0;
+    for (size_t j = 0; j < count; j++) {
+        ref[j] = ws->mean[p0 + j];
+        s1[j] = s2[j] = 0.0;
+        ws->sum_comp[p0 + j] = ws->sum_sq_comp[p0 + j] = 0.0;
+    }
+    for (uint32_t k = 0; k < ws->window; k++) {
+        const double *restrict row = ws->ring + (size_t)k * n + p0;
+        for (size_t j = 0; j < count; j++) {
+            double d = row[j] - ref[j];
+            s1[j] += d;
+            s2[j] += d * d;
+        }
+    }
+}
+
+void WindowStats_UpdateBatch(WindowStats *ws, const Transmitter *tags, const ScanBatch *batch) {
+    if (ws->window == 0 || batch->count == 0)
+        return;
+
+    const uint32_t W = ws->window;
+    const size_t n = ws->count;
+    const size_t p0 = batch->first;
+    const uint32_t s = ws->seq[batch->slot]++;
+    const bool full = s >= W;
+    const uint32_t filled = full ? W : s + 1;
+    const double span_s = (filled - 1) * batch->cycle_time_ms / 1000.0;
+
+    double *newest = ws->ring + (size_t)(s % W) * n + p0;
+    const double *oldest = ws->ring + (size_t)((s + 1 - filled) % W) * n + p0;
+
+    // Gather the new samples into this slot's ring row, keeping the value
+    // that drops out of the window in the output array for one moment (the
+    // reference while the window fills, which adds nothing to the sums)
+    double *dropped = ws->rate + p0;
+    double *ref = ws->ref + p0;
+    for (size_t j = 0; j < batch->count; j++) {
+        double leaving = newest[j];
+        newest[j] = tags[batch->index[j]].state.current_value;
+        if (s == 0)
+            ref[j] = newest[j];
+        dropped[j] = full ? leaving : ref[j];
+    }
+
+    windowMoments(batch->count, filled, span_s, newest, oldest, dropped, ref,
+                  ws->sum + p0, ws->sum_comp + p0, ws->sum_sq + p0, ws->sum_sq_comp + p0,
+                  ws->mean + p0, ws->stddev + p0);
+    if ((s + 1) % W == 0)
+        windowRecenter(ws, p0, batch->count);
+
+    // Min/max deques, one tag at a time
+    for (size_t j = 0; j < batch->count; j++) {
+        size_t p = p0 + j;
+        double x = newest[j];
+        monotonicPush(ws->min_deque + p * W, &ws->min_head[p], &ws->min_len[p], W,
+                      ws->ring, n, p, s, x, true);
+        monotonicPush(ws->max_deque + p * W, &ws->max_head[p], &ws->max_len[p], W,
+                      ws->ring, n, p, s, x, false);
+        ws->min[p] = ws->ring[(size_t)(ws->min_deque[p * W + ws->min_head[p]] % W) * n + p];
+        ws->max[p] = ws->ring[(size_t)(ws->max_deque[p * W + ws->max_head[p]] % W) * n + p];
+    }
+}
+
+// ==================== TRANSMITTER BANK ====================
+// transmitter_opcua --bank N [--scan-mix p10ms,p100ms,p1s,p10s] [--stats-window W]
+// serves N tags under Objects/TransmitterBank/Tag_<i>, each with its own
+// writable ScanClass (0 = 10 ms, 1 = 100 ms, 2 = 1 s, 3 = 10 s). The bank
+// ticks every SCAN_TICK_MS and only due tags are stepped and written. With
+// --stats-window each tag also publishes Mean, StdDev, Min, Max and
+// RateOfChange over its last W samples under Status.
+typedef struct {
+    Transmitter *tags;
+    size_t count;
+    ScanScheduler scheduler;
+    WindowStats stats;
+    UA_NodeId *value_nodes;
+    UA_NodeId *fault_nodes;
+    UA_NodeId *stats_nodes;     // WINDOW_STAT_COUNT per tag when stats are on
+} TransmitterBank;
+
+#define WINDOW_STAT_COUNT 5
+static const char *window_stat_names[WINDOW_STAT_COUNT] = {"Mean", "StdDev", "Min", "Max", "RateOfChange"};
+
+TransmitterBank bank;
+SimHashLog hash_log;
+
+// Assign scan classes so that mix[c] percent of the tags are in class c
+static void TransmitterBank_AssignClasses(TransmitterBank *b, const double *mix) {
+    double total = 0.0;
+    for (int c = 0; c < SCAN_CLASS_COUNT; c++)
+        total += mix[c];
+    for (size_t i = 0; i < b->count; i++) {
+        double position = (i + 0.5) / b->count * total;
+        int c = 0;
+        double upper = mix[0];
+        while (c < SCAN_CLASS_COUNT - 1 && position >= upper)
+            upper += mix[++c];
+        b->tags[i].config.scan_class = (uint32_t)c;
+    }
+}
+
 static void onConfigChanged(UA_Server *server,
                             const UA_NodeId *sessionId, void *sessionContext,
                             const UA_NodeId *nodeId, void *nodeContext,
@@ -120,6 +502,9 @@ static void onConfigChanged(UA_Server *server,
         return;
     }
 
+    // Bank tags carry their transmitter as node context
+    Transmitter *tx = nodeContext ? (Transmitter *)nodeContext : &transmitter;
+
     UA_QualifiedName browseName;
     UA_StatusCode retval = UA_Server_readBrowseName(server, *nodeId, &browseName);
     if (retval != UA_STATUSCODE_GOOD) {
@@ -133,38 +518,45 @@ static void onConfigChanged(UA_Server *server,
     UA_String sawtoothWaveStr = UA_STRING("SawtoothWave");
     UA_String overflowStr = UA_STRING("Overflow");
     UA_String underflowStr = UA_STRING("Underflow");
+    UA_String scanClassStr = UA_STRING("ScanClass");
 
     if (UA_String_equal(&browseName.name, &stepSizeStr)) {
         if (data->value.type == &UA_TYPES[UA_TYPES_DOUBLE]) {
-            transmitter.config.step_size = *(UA_Double*)data->value.data;
+            tx->config.step_size = *(UA_Double*)data->value.data;
         }
     } else if (UA_String_equal(&browseName.name, &simulationActiveStr)) {
         if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) {
-            transmitter.config.simulation_active = *(UA_Boolean*)data->value.data;
+            tx->config.simulation_active = *(UA_Boolean*)data->value.data;
         }
     } else if (UA_String_equal(&browseName.name, &sineWaveStr)) {
         if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) {
-            transmitter.config.sine_wave = *(UA_Boolean*)data->value.data;
-            if (transmitter.config.sine_wave)
-                transmitter.config.sawtooth_wave = false;
+            tx->config.sine_wave = *(UA_Boolean*)data->value.data;
+            if (tx->config.sine_wave)
+                tx->config.sawtooth_wave = false;
         }
     } else if (UA_String_equal(&browseName.name, &sawtoothWaveStr)) {
         if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) {
-            transmitter.config.sawtooth_wave = *(UA_Boolean*)data->value.data;
-            if (transmitter.config.sawtooth_wave)
-                transmitter.config.sine_wave = false;
+            tx->config.sawtooth_wave = *(UA_Boolean*)data->value.data;
+            if (tx->config.sawtooth_wave)
+                tx->config.sine_wave = false;
         }
     } else if (UA_String_equal(&browseName.name, &overflowStr)) {
         if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) {
-            transmitter.config.overflow = *(UA_Boolean*)data->value.data;
-            if (transmitter.config.overflow)
-                transmitter.config.underflow = false;
+            tx->config.overflow = *(UA_Boolean*)data->value.data;
+            if (tx->config.overflow)
+                tx->config.underflow = false;
         }
     } else if (UA_String_equal(&browseName.name, &underflowStr)) {
         if (data->value.type == &UA_TYPES[UA_TYPES_BOOLEAN]) {
-            transmitter.config.underflow = *(UA_Boolean*)data->value.data;
-            if (transmitter.config.underflow)
-                transmitter.config.overflow = false;
+            tx->config.underflow = *(UA_Boolean*)data->value.data;
+            if (tx->config.underflow)
+                tx->config.overflow = false;
+        }
+    } else if (UA_String_equal(&browseName.name, &scanClassStr)) {
+        if (data->value.type == &UA_TYPES[UA_TYPES_UINT32] &&
+            *(UA_UInt32*)data->value.data < SCAN_CLASS_COUNT) {
+            tx->config.scan_class = *(UA_UInt32*)data->value.data;
+            bank.scheduler.dirty = true;
         }
     }
 
@@ -268,28 +660,439 @@ static void addTransmitterObject(UA_Server *server) {
                             statusAttr, NULL, NULL);
 }
 
-int main(void) {
+// Tag variable with the transmitter as node context, e.g. "Tag_7.StepSize"
+static void addTagVariable(UA_Server *server, UA_NodeId parentNode, const char *tagName,
+                           const char *name, const char *displayName,
+                           void *value, const UA_DataType *type,
+                           Transmitter *tx, bool writable, UA_NodeId *outNodeId) {
+    char nodeIdStr[96];
+    snprintf(nodeIdStr, sizeof(nodeIdStr), "%s.%s", tagName, name);
+
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)displayName);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ;
+    if (writable)
+        attr.accessLevel |= UA_ACCESSLEVELMASK_WRITE;
+    UA_Variant_setScalar(&attr.value, value, type);
+
+    UA_NodeId nodeId = UA_NODEID_STRING(1, nodeIdStr);
+    UA_Server_addVariableNode(server, nodeId, parentNode,
+                             UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                             UA_QUALIFIEDNAME(1, (char *)name),
+                             UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                             attr, tx, NULL);
+
+    if (writable) {
+        UA_ValueCallback callback = {.onRead = NULL, .onWrite = onConfigChanged};
+        UA_Server_setVariableNode_valueCallback(server, nodeId, callback);
+    }
+    if (outNodeId)
+        *outNodeId = UA_NODEID_STRING_ALLOC(1, nodeIdStr);
+}
+
+static void addTagFolder(UA_Server *server, UA_NodeId parentNode, const char *nodeIdStr,
+                         const char *browseName, UA_NodeId typeId) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", (char *)browseName);
+    UA_Server_addObjectNode(server, UA_NODEID_STRING(1, (char *)nodeIdStr), parentNode,
+                           UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                           UA_QUALIFIEDNAME(1, (char *)browseName), typeId, attr, NULL, NULL);
+}
+
+static void addTransmitterBank(UA_Server *server, TransmitterBank *b) {
+    UA_ObjectAttributes objAttr = UA_ObjectAttributes_default;
+    objAttr.displayName = UA_LOCALIZEDTEXT("en-US", "TransmitterBank");
+    UA_NodeId bankId = UA_NODEID_STRING(1, "TransmitterBank");
+    UA_Server_addObjectNode(server, bankId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                           UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                           UA_QUALIFIEDNAME(1, "TransmitterBank"),
+                           UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE), objAttr, NULL, NULL);
+
+    for (size_t i = 0; i < b->count; i++) {
+        Transmitter *tx = &b->tags[i];
+        char tagName[32], configName[48], statusName[48];
+        snprintf(tagName, sizeof(tagName), "Tag_%zu", i);
+        snprintf(configName, sizeof(configName), "%s.Configuration", tagName);
+        snprintf(statusName, sizeof(statusName), "%s.Status", tagName);
+
+        addTagFolder(server, bankId, tagName, tagName, UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE));
+        UA_NodeId tagId = UA_NODEID_STRING(1, tagName);
+        addTagFolder(server, tagId, configName, "Configuration", UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE));
+        addTagFolder(server, tagId, statusName, "Status", UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE));
+        UA_NodeId configId = UA_NODEID_STRING(1, configName);
+        UA_NodeId statusId = UA_NODEID_STRING(1, statusName);
+
+        addTagVariable(server, configId, tagName, "ScanClass", "Scan Class (0=10ms, 1=100ms, 2=1s, 3=10s)",
+                       &tx->config.scan_class, &UA_TYPES[UA_TYPES_UINT32], tx, true, NULL);
+        addTagVariable(server, configId, tagName, "StepSize", "Step Size",
+                       &tx->config.step_size, &UA_TYPES[UA_TYPES_DOUBLE], tx, true, NULL);
+        addTagVariable(server, configId, tagName, "SimulationActive", "Simulation Active",
+                       &tx->config.simulation_active, &UA_TYPES[UA_TYPES_BOOLEAN], tx, true, NULL);
+        addTagVariable(server, configId, tagName, "SineWave", "Sine Wave",
+                       &tx->config.sine_wave, &UA_TYPES[UA_TYPES_BOOLEAN], tx, true, NULL);
+        addTagVariable(server, configId, tagName, "SawtoothWave", "Sawtooth Wave",
+                       &tx->config.sawtooth_wave, &UA_TYPES[UA_TYPES_BOOLEAN], tx, true, NULL);
+
+        addTagVariable(server, statusId, tagName, "CurrentValue", "CurrentValue",
+                       &tx->state.current_value, &UA_TYPES[UA_TYPES_DOUBLE], tx, false, &b->value_nodes[i]);
+        addTagVariable(server, statusId, tagName, "Fault", "Fault",
+                       &tx->state.fault, &UA_TYPES[UA_TYPES_BOOLEAN], tx, false, &b->fault_nodes[i]);
+
+        if (b->stats.window > 0) {
+            double zero = 0.0;
+            for (int k = 0; k < WINDOW_STAT_COUNT; k++)
+                addTagVariable(server, statusId, tagName, window_stat_names[k], window_stat_names[k],
+                               &zero, &UA_TYPES[UA_TYPES_DOUBLE], tx, false,
+                               &b->stats_nodes[i * WINDOW_STAT_COUNT + k]);
+        }
+    }
+}
+
+static bool TransmitterBank_Init(TransmitterBank *b, size_t count, const double *mix,
+                                 uint32_t stats_window) {
+    memset(b, 0, sizeof(*b));
+    b->count = count;
+    b->tags = calloc(count, sizeof(Transmitter));
+    b->value_nodes = calloc(count, sizeof(UA_NodeId));
+    b->fault_nodes = calloc(count, sizeof(UA_NodeId));
+    b->stats_nodes = calloc(stats_window ? count * WINDOW_STAT_COUNT : 1, sizeof(UA_NodeId));
+    if (!b->tags || !b->value_nodes || !b->fault_nodes || !b->stats_nodes ||
+        !ScanScheduler_Init(&b->scheduler, count) || !WindowStats_Init(&b->stats, stats_window, count))
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        Transmitter_Init(&b->tags[i]);
+        b->tags[i].config.simulation_active = true;
+    }
+    TransmitterBank_AssignClasses(b, mix);
+    return true;
+}
+
+static void TransmitterBank_Free(TransmitterBank *b) {
+    for (size_t i = 0; i < b->count; i++) {
+        UA_NodeId_clear(&b->value_nodes[i]);
+        UA_NodeId_clear(&b->fault_nodes[i]);
+    }
+    for (size_t k = 0; b->stats.window && k < b->count * WINDOW_STAT_COUNT; k++)
+        UA_NodeId_clear(&b->stats_nodes[k]);
+    free(b->value_nodes);
+    free(b->fault_nodes);
+    free(b->stats_nodes);
+    free(b->tags);
+    ScanScheduler_Free(&b->scheduler);
+    WindowStats_Free(&b->stats);
+}
+
+// Step the tags due on this tick and their window statistics; returns the
+// number of batches
+static size_t TransmitterBank_Step(TransmitterBank *b, ScanBatch *batches) {
+    if (b->scheduler.dirty) {
+        if (!ScanScheduler_Build(&b->scheduler, b->tags, b->count)) {
+            fprintf(stderr, "Cannot rebuild the scan schedule, tick skipped\n");
+            return 0;
+        }
+        WindowStats_Reset(&b->stats);
+    }
+
+    size_t batch_count = ScanScheduler_Due(&b->scheduler, batches);
+    for (size_t k = 0; k < batch_count; k++) {
+        Transmitter_UpdateBatch(b->tags, &batches[k]);
+        WindowStats_UpdateBatch(&b->stats, b->tags, &batches[k]);
+    }
+    return batch_count;
+}
+
+// Step and publish the tags due on this tick; returns how many were due
+static size_t TransmitterBank_Tick(UA_Server *server, TransmitterBank *b) {
+    ScanBatch batches[SCAN_CLASS_COUNT];
+    size_t batch_count = TransmitterBank_Step(b, batches);
+    size_t due = 0;
+
+    UA_Variant value;
+    for (size_t k = 0; k < batch_count; k++) {
+        due += batches[k].count;
+        for (size_t j = 0; j < batches[k].count; j++) {
+            uint32_t i = batches[k].index[j];
+            UA_Variant_setScalar(&value, &b->tags[i].state.current_value, &UA_TYPES[UA_TYPES_DOUBLE]);
+            UA_Server_writeValue(server, b->value_nodes[i], value);
+            UA_Variant_setScalar(&value, &b->tags[i].state.fault, &UA_TYPES[UA_TYPES_BOOLEAN]);
+            UA_Server_writeValue(server, b->fault_nodes[i], value);
+
+            if (b->stats.window > 0) {
+                size_t p = batches[k].first + j;
+                double stats[WINDOW_STAT_COUNT] = {b->stats.mean[p], b->stats.stddev[p], b->stats.min[p],
+                                                   b->stats.max[p], b->stats.rate[p]};
+                for (int s = 0; s < WINDOW_STAT_COUNT; s++) {
+                    UA_Variant_setScalar(&value, &stats[s], &UA_TYPES[UA_TYPES_DOUBLE]);
+                    UA_Server_writeValue(server, b->stats_nodes[i * WINDOW_STAT_COUNT + s], value);
+                }
+            }
+        }
+    }
+    return due;
+}
+
+static int runTransmitterBank(size_t count, const double *mix, uint32_t stats_window) {
+    if (!TransmitterBank_Init(&bank, count, mix, stats_window)) {
+        fprintf(stderr, "Cannot allocate a bank of %zu transmitters\n", count);
+        return EXIT_FAILURE;
+    }
+
+    server = UA_Server_new();
+    if (SimSecurity_ConfigureFromEnv(UA_Server_getConfig(server), 4840) != UA_STATUSCODE_GOOD) {
+        UA_Server_delete(server);
+        return EXIT_FAILURE;
+    }
+    addTransmitterBank(server, &bank);
+
+    printf("OPC UA Transmitter Bank (%zu tags, %d ms tick) running at opc.tcp://localhost:4840\n",
+           count, SCAN_TICK_MS);
+
+    SimMetrics_StartFromEnv(server);
+    int metrics_model = SimMetrics_RegisterModel("TransmitterBank");
+
+    // Optional per-tick state hashes (SIM_HASH_LOG), one block per 256 tags
+    if (!SimHashLog_OpenFromEnv(&hash_log, NULL, SIM_HASH_DEFAULT_BLOCK)) {
+        UA_Server_delete(server);
+        TransmitterBank_Free(&bank);
+        return EXIT_FAILURE;
+    }
+    SimHashLog_SetSegment(&hash_log, "TransmitterBank.Tag", bank.tags, sizeof(Transmitter), bank.count, 0);
+    uint64_t tick_count = 0;
+
+    if (UA_Server_run_startup(server) != UA_STATUSCODE_GOOD) {
+        UA_Server_delete(server);
+        TransmitterBank_Free(&bank);
+        return EXIT_FAILURE;
+    }
+
+    if (!SimLoop_Open(&loop, server, SCAN_TICK_MS))
+        running = false;
+
+    while (running) {
+        uint64_t ticks = SimLoop_WaitTick(&loop);
+        if (ticks == 0)
+            continue;
+        // Ticks that expired while the server was busy are stepped now, up
+        // to BANK_MAX_CATCH_UP; simulated time falls behind by the rest
+        if (ticks > BANK_MAX_CATCH_UP) {
+            fprintf(stderr, "Dropped %llu ticks behind real time\n",
+                    (unsigned long long)(ticks - BANK_MAX_CATCH_UP));
+            ticks = BANK_MAX_CATCH_UP;
+        }
+        uint64_t cycle_start = SimMetrics_Now();
+        for (uint64_t tick = 0; tick < ticks; tick++) {
+            uint64_t step_start = SimMetrics_Now();
+            TransmitterBank_Tick(server, &bank);
+            SimMetrics_RecordModelStep(metrics_model, SimMetrics_Now() - step_start);
+            SimHashLog_Record(&hash_log, ++tick_count);
+        }
+
+        SimMetrics_RecordServer(server);
+        SimMetrics_RecordCycle(SimMetrics_Now() - cycle_start, SCAN_TICK_MS);
+    }
+
+    SimLoop_Close(&loop);
+    UA_Server_run_shutdown(server);
+    SimMetrics_Stop();
+    UA_Server_delete(server);
+    TransmitterBank_Free(&bank);
+    SimHashLog_Close(&hash_log);
+    return EXIT_SUCCESS;
+}
+
+// ==================== GOLDEN SCENARIOS ====================
+// Canonical runs for --golden record|check <trace> (sim_golden.h): every
+// waveform, the fault limits and a tag with simulation off. The waveforms
+// run on accumulated simulated time, so a value is held to the integrated
+// tolerance of its tag's span, not of its magnitude (the 1e6 offset tags).
+#define GOLDEN_STEPS 300            // 30 s: three sine and sawtooth periods
+
+static double Transmitter_GoldenTolerance(const Transmitter *tx) {
+    return (tx->config.max_scale - tx->config.min_scale) * SIM_GOLDEN_INTEGRATED;
+}
+
+static void Transmitter_GoldenRun(SimGolden *golden, const char *scenario, Transmitter *tx) {
+    SimGolden_Begin(golden, scenario);
+    for (uint32_t step = 0; step < GOLDEN_STEPS; step++) {
+        Transmitter_Update(tx, DEFAULT_CYCLE_TIME_MS);
+        SimGolden_Signal(golden, step, "CurrentValue", tx->state.current_value, Transmitter_GoldenTolerance(tx),
+                         0.0);
+        SimGolden_Signal(golden, step, "Fault", tx->state.fault, 0.0, 0.0);
+    }
+    SimGolden_End(golden);
+}
+
+// A small bank over all four scan classes with window statistics: sawtooth,
+// sine and ramp tags, half of them on a 1e6 offset (the variance must not
+// cancel), and a ScanClass change half way that rebuilds the schedule.
+// RateOfChange scales with the span over the shortest window.
+#define GOLDEN_BANK_TAGS 12
+#define GOLDEN_BANK_WINDOW 8
+#define GOLDEN_BANK_TICKS 2500      // 25 s: three samples of the 10 s class
+#define GOLDEN_BANK_SAMPLE_EVERY 10
+
+static void Transmitter_GoldenBank(SimGolden *golden) {
+    static const double mix[SCAN_CLASS_COUNT] = {25.0, 25.0, 25.0, 25.0};
+    TransmitterBank b;
+    if (!TransmitterBank_Init(&b, GOLDEN_BANK_TAGS, mix, GOLDEN_BANK_WINDOW)) {
+        TransmitterBank_Free(&b);
+        return;
+    }
+    for (size_t i = 0; i < b.count; i++) {
+        Transmitter *tx = &b.tags[i];
+        tx->config.sine_wave = i % 3 == 1;
+        tx->config.sawtooth_wave = i % 3 == 0;
+        tx->config.step_size = 3.0;
+        if (i % 2) {
+            tx->config.min_range += 1e6;
+            tx->config.max_range += 1e6;
+            tx->config.min_scale += 1e6;
+            tx->config.max_scale += 1e6;
+        }
+    }
+
+    SimGolden_Begin(golden, "transmitter_bank");
+    ScanBatch batches[SCAN_CLASS_COUNT];
+    for (uint32_t tick = 0; tick < GOLDEN_BANK_TICKS; tick++) {
+        if (tick == GOLDEN_BANK_TICKS / 2) {
+            b.tags[5].config.scan_class = SCAN_10MS;
+            b.scheduler.dirty = true;
+        }
+        TransmitterBank_Step(&b, batches);
+        if (tick % GOLDEN_BANK_SAMPLE_EVERY)
+            continue;
+        for (size_t p = 0; p < b.count; p++) {
+            const Transmitter *tx = &b.tags[b.scheduler.index[p]];
+            char name[48];
+            double tolerance = Transmitter_GoldenTolerance(tx);
+            double rate_tolerance = tolerance / (GOLDEN_BANK_WINDOW * SCAN_TICK_MS / 1000.0);
+            double signals[1 + WINDOW_STAT_COUNT] = {tx->state.current_value, b.stats.mean[p], b.stats.stddev[p],
+                                                     b.stats.min[p], b.stats.max[p], b.stats.rate[p]};
+            for (int k = 0; k <= WINDOW_STAT_COUNT; k++) {
+                snprintf(name, sizeof(name), "Tag_%u.%s", b.scheduler.index[p],
+                         k == 0 ? "CurrentValue" : window_stat_names[k - 1]);
+                SimGolden_Signal(golden, tick, name, signals[k],
+                                 k == WINDOW_STAT_COUNT ? rate_tolerance : tolerance, 0.0);
+            }
+        }
+    }
+    SimGolden_End(golden);
+    TransmitterBank_Free(&b);
+}
+
+static void Transmitter_GoldenScenarios(SimGolden *golden) {
+    Transmitter tx;
+
+    Transmitter_Init(&tx);
+    tx.config.simulation_active = true;
+    Transmitter_GoldenRun(golden, "transmitter_sawtooth", &tx);
+
+    Transmitter_Init(&tx);
+    tx.config.simulation_active = true;
+    tx.config.sawtooth_wave = false;
+    tx.config.sine_wave = true;
+    Transmitter_GoldenRun(golden, "transmitter_sine", &tx);
+
+    // Triangle ramp bouncing between the range limits
+    Transmitter_Init(&tx);
+    tx.config.simulation_active = true;
+    tx.config.sawtooth_wave = false;
+    tx.config.step_size = 3.0;
+    Transmitter_GoldenRun(golden, "transmitter_ramp", &tx);
+
+    // Ramp over a range wider than the scale: Fault outside the scale
+    Transmitter_Init(&tx);
+    tx.config.simulation_active = true;
+    tx.config.sawtooth_wave = false;
+    tx.config.step_size = 2.5;
+    tx.config.min_range = -20.0;
+    tx.config.max_range = 120.0;
+    Transmitter_GoldenRun(golden, "transmitter_fault_limits", &tx);
+
+    Transmitter_Init(&tx);
+    tx.config.simulation_active = true;
+    tx.config.overflow = true;
+    Transmitter_GoldenRun(golden, "transmitter_overflow", &tx);
+
+    Transmitter_Init(&tx);
+    tx.config.simulation_active = true;
+    tx.config.underflow = true;
+    Transmitter_GoldenRun(golden, "transmitter_underflow", &tx);
+
+    Transmitter_Init(&tx);
+    Transmitter_GoldenRun(golden, "transmitter_inactive", &tx);
+
+    Transmitter_GoldenBank(golden);
+}
+
+int main(int argc, char **argv) {
     signal(SIGINT, stopHandler);
     signal(SIGTERM, stopHandler);
 
+    // Optional bank mode
+    size_t bank_size = 0;
+    double scan_mix[SCAN_CLASS_COUNT] = {1.0, 9.0, 40.0, 50.0};
+    uint32_t stats_window = 0;
+    if (argc > 1 && strcmp(argv[1], "--golden") == 0)
+        return SimGolden_Main(argc - 1, argv + 1, Transmitter_GoldenScenarios);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bank") == 0 && i + 1 < argc) {
+            bank_size = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--stats-window") == 0 && i + 1 < argc) {
+            stats_window = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--scan-mix") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &scan_mix[0], &scan_mix[1],
+                       &scan_mix[2], &scan_mix[3]) != SCAN_CLASS_COUNT) {
+                fprintf(stderr, "--scan-mix expects four percentages: 10ms,100ms,1s,10s\n");
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--bank N] [--scan-mix p10ms,p100ms,p1s,p10s] [--stats-window samples]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (bank_size > 0)
+        return runTransmitterBank(bank_size, scan_mix, stats_window);
+
     Transmitter_Init(&transmitter);
 
+    // Optional per-cycle state hashes (SIM_HASH_LOG)
+    if (!SimHashLog_OpenFromEnv(&hash_log, NULL, 1))
+        return EXIT_FAILURE;
+    SimHashLog_SetSegment(&hash_log, "Transmitter.config", &transmitter.config, sizeof(transmitter.config), 1, 0);
+    SimHashLog_SetSegment(&hash_log, "Transmitter.state", &transmitter.state, sizeof(transmitter.state), 1, 0);
+    uint64_t cycle_count = 0;
+
     server = UA_Server_new();
-    UA_ServerConfig_setDefault(UA_Server_getConfig(server));
+    if (SimSecurity_ConfigureFromEnv(UA_Server_getConfig(server), 4840) != UA_STATUSCODE_GOOD) {
+        UA_Server_delete(server);
+        return EXIT_FAILURE;
+    }
 
     addTransmitterObject(server);
 
     printf("OPC UA Transmitter Server running at opc.tcp://localhost:4840\n");
 
+    SimMetrics_StartFromEnv(server);
+    int metrics_model = SimMetrics_RegisterModel("Transmitter");
+
     UA_StatusCode status = UA_Server_run_startup(server);
     if (status != UA_STATUSCODE_GOOD) {
         UA_Server_delete(server);
         return EXIT_FAILURE;
     }
 
+    if (!SimLoop_Open(&loop, server, DEFAULT_CYCLE_TIME_MS))
+        running = false;
+
     while (running) {
-        UA_Server_run_iterate(server, true);
+        if (SimLoop_WaitTick(&loop) == 0)
+            continue;
+        uint64_t cycle_start = SimMetrics_Now();
         Transmitter_Update(&transmitter, DEFAULT_CYCLE_TIME_MS);
+        SimMetrics_RecordModelStep(metrics_model, SimMetrics_Now() - cycle_start);
+        SimHashLog_Record(&hash_log, ++cycle_count);
 
         UA_Variant value;
         UA_Variant_init(&value);
@@ -299,14 +1102,14 @@ int main(void) {
         UA_Variant_setScalar(&value, &transmitter.state.fault, &UA_TYPES[UA_TYPES_BOOLEAN]);
         UA_Server_writeValue(server, UA_NODEID_STRING(1, "Fault"), value);
 
-#ifdef _WIN32
-        Sleep(DEFAULT_CYCLE_TIME_MS);
-#else
-        usleep(DEFAULT_CYCLE_TIME_MS * 1000);
-#endif
+        SimMetrics_RecordServer(server);
+        SimMetrics_RecordCycle(SimMetrics_Now() - cycle_start, DEFAULT_CYCLE_TIME_MS);
     }
 
+    SimLoop_Close(&loop);
     UA_Server_run_shutdown(server);
+    SimMetrics_Stop();
     UA_Server_delete(server);
+    SimHashLog_Close(&hash_log);
     return EXIT_SUCCESS;
 }